@@ -28,6 +28,8 @@
 #include <keyvalues.h>
 #include "c_rope.h"
 #include "isaverestore.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -35,6 +37,7 @@
 
 static ConVar r_drawmrmmodels(  "r_drawmrmmodels", "1" );
 static ConVar r_drawvehicles( "r_drawvehicles", "1" );
+static ConVar cl_posecache( "cl_posecache", "1", 0, "Reuse an entity's decompressed sequence poses while its sequence, cycle and pose parameters don't change." );
 
 // Removed macro used by shared code stuff
 #if defined( CBaseAnimating )
@@ -101,6 +104,7 @@ C_BaseAnimating::C_BaseAnimating()
 
 	m_lastPhysicsBone = 0;
 	m_iMostRecentModelBoneCounter = 0xFFFFFFFF;
+	m_iThreadedBonePass = 0;
 	m_CachedBoneFlags = 0;
 
 	m_vecPreRagdollMins = vec3_origin;
@@ -114,6 +118,7 @@ C_BaseAnimating::C_BaseAnimating()
 	m_nEventSequence = -1;
 
 	m_pIk = NULL;
+	m_pPoseCache = NULL;
 
 	// Assume false.  Derived classes might fill in a receive table entry
 	// and in that case this would show up as true
@@ -132,6 +137,7 @@ C_BaseAnimating::~C_BaseAnimating()
 	delete m_pRagdollInfo;
 	Assert(!m_pRagdoll);
 	delete m_pIk;
+	delete m_pPoseCache;
 }
 
 
@@ -616,13 +622,30 @@ void C_BaseAnimating::MaintainSequenceTransitions( float flCycle, float flPosePa
 		flCycle = blend->flCycle + dt * blend->flPlaybackrate * GetSequenceCycleRate( blend->nSequence );
 		flCycle = ClampCycle( flCycle, IsSequenceLooping( blend->nSequence ) );
 
-		AccumulatePose( hdr, m_pIk, pos, q, blend->nSequence, flCycle, flPoseParameter, boneMask, blend->flWeight );
+		AccumulatePose( hdr, m_pIk, pos, q, blend->nSequence, flCycle, flPoseParameter, boneMask, blend->flWeight, GetPoseCache() );
 	}
 }
 
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: The entity's cache of recent single sequence poses, created the
+//			first time its bones are set up. NULL if cl_posecache is off.
+//-----------------------------------------------------------------------------
+CBonePoseCache *C_BaseAnimating::GetPoseCache( void )
+{
+	if ( !cl_posecache.GetBool() )
+		return NULL;
+
+	if ( !m_pPoseCache )
+	{
+		m_pPoseCache = new CBonePoseCache;
+	}
+	return m_pPoseCache;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Do the default sequence blending rules as done in HL1
 //-----------------------------------------------------------------------------
@@ -649,7 +672,7 @@ void C_BaseAnimating::StandardBlendingRules( Vector pos[], Quaternion q[], float
 	float fCycle = m_flCycle;
 
 	InitPose( hdr, pos, q );
-	AccumulatePose( hdr, m_pIk, pos, q, m_nSequence, fCycle, poseparam, boneMask );
+	AccumulatePose( hdr, m_pIk, pos, q, m_nSequence, fCycle, poseparam, boneMask, 1.0f, GetPoseCache() );
 
 	// debugoverlay->AddTextOverlay( GetAbsOrigin() + Vector( 0, 0, 64 ), 0, 0, "%30s %6.2f : %6.2f", hdr->pSeqdesc( m_nSequence )->pszLabel( ), fCycle, 1.0 );
 
@@ -969,32 +992,16 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 	{
 		MEASURE_TIMED_STAT( CS_BONE_SETUP_TIME );
 
-		// Setup our transform based on render angles and origin.
 		matrix3x4_t parentTransform;
-		AngleMatrix( GetRenderAngles(), GetRenderOrigin(), parentTransform );
-
-		
-		if (hdr->flags & STUDIOHDR_FLAGS_STATIC_PROP)
+		if ( SetupBones_Begin( hdr, currentTime, parentTransform ) )
 		{
-			MatrixCopy(	parentTransform, m_CachedBones[0] );
-		}
-		else
-		{
-			if (!m_pIk)
-				m_pIk = new CIKContext;
-
 			Vector		pos[MAXSTUDIOBONES];
 			Quaternion	q[MAXSTUDIOBONES];
 
-			m_pIk->Init( hdr, GetRenderAngles(), GetRenderOrigin(), currentTime );
-
 			int bonesMaskNeedRecalc = boneMask & ~m_CachedBoneFlags;
 			StandardBlendingRules( pos, q, currentTime, bonesMaskNeedRecalc );
 
-			CalculateIKLocks( currentTime );
-			m_pIk->SolveDependencies( pos, q );
-
-			BuildTransformations( pos, q, parentTransform );
+			SetupBones_Finish( pos, q, currentTime, parentTransform );
 		}
 		if( !( m_CachedBoneFlags & BONE_USED_BY_ATTACHMENT ) && ( boneMask & BONE_USED_BY_ATTACHMENT ) )
 		{
@@ -1028,6 +1035,220 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 }
 
 
+//-----------------------------------------------------------------------------
+// SetupBones is split around StandardBlendingRules so the blending can run on
+// a worker thread. Begin computes the parent transform and readies the IK
+// context, and returns false if there is nothing to blend. Finish solves the
+// IK and builds the bone matrices; it may trace, so it stays on this thread.
+//-----------------------------------------------------------------------------
+bool C_BaseAnimating::SetupBones_Begin( studiohdr_t *hdr, float currentTime, matrix3x4_t &parentTransform )
+{
+	// Setup our transform based on render angles and origin.
+	AngleMatrix( GetRenderAngles(), GetRenderOrigin(), parentTransform );
+
+	if (hdr->flags & STUDIOHDR_FLAGS_STATIC_PROP)
+	{
+		MatrixCopy(	parentTransform, m_CachedBones[0] );
+		return false;
+	}
+
+	if (!m_pIk)
+		m_pIk = new CIKContext;
+
+	m_pIk->Init( hdr, GetRenderAngles(), GetRenderOrigin(), currentTime );
+	return true;
+}
+
+void C_BaseAnimating::SetupBones_Finish( Vector pos[], Quaternion q[], float currentTime, const matrix3x4_t &parentTransform )
+{
+	CalculateIKLocks( currentTime );
+	m_pIk->SolveDependencies( pos, q );
+
+	BuildTransformations( pos, q, parentTransform );
+}
+
+
+//-----------------------------------------------------------------------------
+// Threaded bone setup. Before the draw loop the view hands over the animating
+// entities it is about to draw. Their parent transforms and IK contexts are
+// set up here, StandardBlendingRules runs for all of them on the thread pool,
+// then the IK solve and matrix build run back here in draw order and the
+// bones are marked cached, so the SetupBones calls from drawing just copy.
+//-----------------------------------------------------------------------------
+static ConVar cl_threaded_bonesetup( "cl_threaded_bonesetup", "1", 0, "Blend the bones of the models in view on the thread pool before drawing them." );
+
+struct BoneSetupJob_t
+{
+	C_BaseAnimating		*m_pEntity;
+	int					m_nBoneMask;
+	float				m_flCurrentTime;
+	matrix3x4_t			m_ParentTransform;
+	Vector				m_Pos[MAXSTUDIOBONES];
+	Quaternion			m_Q[MAXSTUDIOBONES];
+};
+
+static CUtlVector< BoneSetupJob_t >	s_BoneSetupJobs;
+
+// Marks the entities already queued this pass. An entity can be in more than
+// one render group, and two workers blending it at once would race on its IK
+// context and pose cache.
+static int s_iThreadedBonePass = 0;
+
+struct BoneSetupStats_t
+{
+	int		m_nFrames;
+	int		m_nEntities;
+	float	m_flBeginMS;
+	float	m_flBlendMS;
+	float	m_flFinishMS;
+	float	m_flMaxTotalMS;
+};
+
+static BoneSetupStats_t	s_BoneSetupLastFrame;
+static BoneSetupStats_t	s_BoneSetupTotals;
+
+void C_BaseAnimating::ThreadedBlendBones( void *pContext, int nJob )
+{
+	BoneSetupJob_t &job = s_BoneSetupJobs[nJob];
+	job.m_pEntity->StandardBlendingRules( job.m_Pos, job.m_Q, job.m_flCurrentTime, job.m_nBoneMask );
+}
+
+void C_BaseAnimating::ThreadedSetupBones( C_BaseAnimating **ppEntities, int nEntities, float currentTime )
+{
+	if ( !cl_threaded_bonesetup.GetBool() || nEntities <= 0 )
+		return;
+
+	VPROF_BUDGET( "C_BaseAnimating::ThreadedSetupBones", VPROF_BUDGETGROUP_OTHER_ANIMATION );
+
+	CFastTimer timer;
+	timer.Start();
+
+	s_BoneSetupJobs.EnsureCount( nEntities );
+	s_iThreadedBonePass++;
+
+	int nJobs = 0;
+	int i;
+	for ( i = 0; i < nEntities; i++ )
+	{
+		C_BaseAnimating *pEntity = ppEntities[i];
+		if ( pEntity->m_iThreadedBonePass == s_iThreadedBonePass )
+			continue;
+		pEntity->m_iThreadedBonePass = s_iThreadedBonePass;
+
+		// Ragdolls get their bones from physics, and view models may not be
+		// allowed to set up yet
+		if ( pEntity->IsRagdoll() || !pEntity->IsBoneAccessAllowed() )
+			continue;
+
+		studiohdr_t *hdr = pEntity->GetModelPtr();
+		if ( !hdr )
+			continue;
+
+		if ( pEntity->m_iMostRecentModelBoneCounter != g_iModelBoneCounter )
+		{
+			pEntity->m_CachedBoneFlags = 0;
+			pEntity->m_iMostRecentModelBoneCounter = g_iModelBoneCounter;
+		}
+
+		// Same HACK as SetupBones, everything is always set up
+		int boneMask = BONE_USED_BY_ANYTHING;
+		if ( ( pEntity->m_CachedBoneFlags & boneMask ) == boneMask )
+			continue;
+
+		BoneSetupJob_t &job = s_BoneSetupJobs[nJobs];
+		if ( !pEntity->SetupBones_Begin( hdr, currentTime, job.m_ParentTransform ) )
+			continue;
+
+		job.m_pEntity = pEntity;
+		job.m_nBoneMask = boneMask & ~pEntity->m_CachedBoneFlags;
+		job.m_flCurrentTime = currentTime;
+		nJobs++;
+	}
+
+	timer.End();
+	float flBeginMS = timer.GetDuration().GetMillisecondsF();
+	timer.Start();
+
+#ifdef _DEBUG
+	for ( i = 0; i < nJobs; i++ )
+	{
+		for ( int j = i + 1; j < nJobs; j++ )
+		{
+			Assert( s_BoneSetupJobs[i].m_pEntity != s_BoneSetupJobs[j].m_pEntity );
+		}
+	}
+#endif
+
+	ThreadPool()->ParallelProcess( ThreadedBlendBones, NULL, nJobs );
+
+	timer.End();
+	float flBlendMS = timer.GetDuration().GetMillisecondsF();
+	timer.Start();
+
+	for ( i = 0; i < nJobs; i++ )
+	{
+		BoneSetupJob_t &job = s_BoneSetupJobs[i];
+		C_BaseAnimating *pEntity = job.m_pEntity;
+
+		// A follower's BuildTransformations sets up its leader's bones, which
+		// may have come first
+		if ( pEntity->m_CachedBoneFlags & job.m_nBoneMask )
+			continue;
+
+		pEntity->SetupBones_Finish( job.m_Pos, job.m_Q, job.m_flCurrentTime, job.m_ParentTransform );
+		if( !( pEntity->m_CachedBoneFlags & BONE_USED_BY_ATTACHMENT ) && ( job.m_nBoneMask & BONE_USED_BY_ATTACHMENT ) )
+		{
+			pEntity->SetupBones_AttachmentHelper();
+		}
+
+		pEntity->m_CachedBoneFlags |= job.m_nBoneMask;
+	}
+
+	timer.End();
+	float flFinishMS = timer.GetDuration().GetMillisecondsF();
+
+	s_BoneSetupLastFrame.m_nFrames = 1;
+	s_BoneSetupLastFrame.m_nEntities = nJobs;
+	s_BoneSetupLastFrame.m_flBeginMS = flBeginMS;
+	s_BoneSetupLastFrame.m_flBlendMS = flBlendMS;
+	s_BoneSetupLastFrame.m_flFinishMS = flFinishMS;
+	s_BoneSetupLastFrame.m_flMaxTotalMS = flBeginMS + flBlendMS + flFinishMS;
+
+	s_BoneSetupTotals.m_nFrames++;
+	s_BoneSetupTotals.m_nEntities += nJobs;
+	s_BoneSetupTotals.m_flBeginMS += flBeginMS;
+	s_BoneSetupTotals.m_flBlendMS += flBlendMS;
+	s_BoneSetupTotals.m_flFinishMS += flFinishMS;
+	s_BoneSetupTotals.m_flMaxTotalMS = max( s_BoneSetupTotals.m_flMaxTotalMS, s_BoneSetupLastFrame.m_flMaxTotalMS );
+}
+
+CON_COMMAND( cl_bonesetup_stats, "Print the timings of the threaded bone setup pass for the last frame and on average since the last reset. 'cl_bonesetup_stats reset' clears them." )
+{
+	if ( engine->Cmd_Argc() > 1 && !Q_stricmp( engine->Cmd_Argv( 1 ), "reset" ) )
+	{
+		memset( &s_BoneSetupTotals, 0, sizeof( s_BoneSetupTotals ) );
+		Msg( "Bone setup stats reset.\n" );
+		return;
+	}
+
+	Msg( "Threaded bone setup: %s, %d threads\n", cl_threaded_bonesetup.GetBool() ? "on" : "off", ThreadPool()->NumThreads() );
+	Msg( "%-10s %7s %9s %9s %9s %9s\n", "", "models", "begin ms", "blend ms", "finish ms", "max ms" );
+
+	const BoneSetupStats_t &last = s_BoneSetupLastFrame;
+	Msg( "%-10s %7d %9.3f %9.3f %9.3f %9.3f\n", "last frame",
+		last.m_nEntities, last.m_flBeginMS, last.m_flBlendMS, last.m_flFinishMS, last.m_flMaxTotalMS );
+
+	const BoneSetupStats_t &totals = s_BoneSetupTotals;
+	if ( totals.m_nFrames )
+	{
+		float flFrames = totals.m_nFrames;
+		Msg( "%-10s %7.1f %9.3f %9.3f %9.3f %9.3f  (%d frames)\n", "average",
+			totals.m_nEntities / flFrames, totals.m_flBeginMS / flFrames, totals.m_flBlendMS / flFrames,
+			totals.m_flFinishMS / flFrames, totals.m_flMaxTotalMS, totals.m_nFrames );
+	}
+}
+
+
 C_BaseAnimating* C_BaseAnimating::FindFollowedEntity()
 {
 
@@ -35,6 +35,7 @@ class C_BaseClientShader
 
 class IRagdoll;
 class CIKContext;
+class CBonePoseCache;
 class CIKState;
 class ConVar;
 class C_RopeKeyframe;
@@ -132,6 +133,7 @@ public:
 	virtual	void StandardBlendingRules( Vector pos[], Quaternion q[], float currentTime, int boneMask );
 
 	void MaintainSequenceTransitions( float flCycle, float flPoseParameter[], Vector pos[], Quaternion q[], int boneMask );
+	CBonePoseCache *GetPoseCache( void );
 
 	// Attachments
 	int LookupAttachment( const char *pAttachmentName );
@@ -250,6 +252,10 @@ public:
 	// Invalidate bone caches so all SetupBones() calls force bone transforms to be regenerated.
 	static void						InvalidateBoneCaches();
 
+	// Sets up the bones of entities about to be drawn, blending them on the
+	// thread pool. Later SetupBones calls this frame reuse the results.
+	static void						ThreadedSetupBones( C_BaseAnimating **ppEntities, int nEntities, float currentTime );
+
 	// Purpose: My physics object has been updated, react or extract data
 	virtual void					VPhysicsUpdate( IPhysicsObject *pPhysics );
 
@@ -318,6 +324,7 @@ public:
 	CUtlVector< AnimationLayer_t >	m_animationQueue;
 
 	CIKContext						*m_pIk;
+	CBonePoseCache					*m_pPoseCache;
 
 	// Clientside animation
 	bool							m_bClientSideAnimation;
@@ -349,6 +356,8 @@ protected:
 	CUtlVector< matrix3x4_t >		m_CachedBones;
 	int								m_CachedBoneFlags; // This contains BONE_USED_BY_* from studio.h
 	unsigned long					m_iMostRecentModelBoneCounter;
+	// ThreadedSetupBones pass this entity was last queued in
+	int								m_iThreadedBonePass;
 
 
 private:	
@@ -358,6 +367,9 @@ private:
 
 	float							m_flOldCycle;
 	void							SetupBones_AttachmentHelper();
+	bool							SetupBones_Begin( studiohdr_t *hdr, float currentTime, matrix3x4_t &parentTransform );
+	void							SetupBones_Finish( Vector pos[], Quaternion q[], float currentTime, const matrix3x4_t &parentTransform );
+	static void						ThreadedBlendBones( void *pContext, int nJob );
 
 // For prediction
 public:
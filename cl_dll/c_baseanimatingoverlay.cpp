@@ -131,7 +131,7 @@ void C_BaseAnimatingOverlay::StandardBlendingRules( Vector pos[], Quaternion q[]
 	float fCycle = m_flCycle;
 
 	InitPose( hdr, pos, q );
-	AccumulatePose( hdr, m_pIk, pos, q, GetSequence(), fCycle, poseparam, boneMask );
+	AccumulatePose( hdr, m_pIk, pos, q, GetSequence(), fCycle, poseparam, boneMask, 1.0f, GetPoseCache() );
 
 	// debugoverlay->AddTextOverlay( GetAbsOrigin() + Vector( 0, 0, 64 ), 0, 0, "%30s %6.2f : %6.2f", hdr->pSeqdesc( m_nSequence )->pszLabel( ), fCycle, 1.0 );
 
@@ -204,7 +204,7 @@ void C_BaseAnimatingOverlay::StandardBlendingRules( Vector pos[], Quaternion q[]
 				if (fWeight > 1)
 					fWeight = 1;
 
-				AccumulatePose( hdr, m_pIk, pos, q, m_Layer[i].nSequence, fCycle, poseparam, boneMask, fWeight );
+				AccumulatePose( hdr, m_pIk, pos, q, m_Layer[i].nSequence, fCycle, poseparam, boneMask, fWeight, GetPoseCache() );
 				// Msg( "%30s %6.2f : %6.2f : %1d\n", hdr->pSeqdesc( m_Layer[i].nSequence )->pszLabel(), fCycle, fWeight, i );
 
 //#define DEBUG_TF2_OVERLAYS
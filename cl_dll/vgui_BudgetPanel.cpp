@@ -82,7 +82,7 @@ static ConVar budget_old( "budget_old", "0" );
 void CBudgetPanel::CalculateBudgetGroupTimes_Recursive( CVProfNode *pNode )
 {
 	int groupID = pNode->GetBudgetGroupID();
-	Assert( groupID >= 0 && groupID < m_CachedNumBudgetGroups );
+	Assert( groupID >= 0 );
 
 	double nodeTime;
 
@@ -95,7 +95,11 @@ void CBudgetPanel::CalculateBudgetGroupTimes_Recursive( CVProfNode *pNode )
 		nodeTime = pNode->GetPrevTimeLessChildren();
 	}
 //	Assert( nodeTime >= 0.0 );
-	m_BudgetGroupTimes[groupID].m_Time[m_BudgetHistoryOffset] += nodeTime;
+	// Groups first seen on another thread this frame aren't cached yet
+	if( groupID < m_CachedNumBudgetGroups )
+	{
+		m_BudgetGroupTimes[groupID].m_Time[m_BudgetHistoryOffset] += nodeTime;
+	}
 	if( pNode->GetSibling() )
 	{
 		CalculateBudgetGroupTimes_Recursive( pNode->GetSibling() );
@@ -115,6 +119,17 @@ void CBudgetPanel::SnapshotVProfHistory( void )
 	{
 		CalculateBudgetGroupTimes_Recursive( pNode->GetChild() );
 	}
+
+	// Time spent on other threads counts against the same budgets
+	int i;
+	for( i = 0; i < g_VProfCurrentProfile.GetNumThreads(); i++ )
+	{
+		pNode = g_VProfCurrentProfile.GetThreadRoot( i );
+		if( pNode && pNode->GetChild() )
+		{
+			CalculateBudgetGroupTimes_Recursive( pNode->GetChild() );
+		}
+	}
 }
 
 static void NumBudgetGroupsChangedCallBack( void )
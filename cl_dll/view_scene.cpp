@@ -35,6 +35,7 @@
 #include "view_scene.h"
 #include "particles_ez.h"
 #include "engine/IStaticPropMgr.h"
+#include "c_baseanimating.h"
 
 // GR
 #include "rendertexture.h"
@@ -416,6 +417,39 @@ void CViewRender::SetupRenderList( const CViewSetup *pView, WorldListInfo_t& inf
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Sets up the bones of the animating entities in the render list in one go,
+// so their blending can be spread over the thread pool
+//-----------------------------------------------------------------------------
+static void SetupBonesForRenderList( CRenderList &renderList )
+{
+	static C_BaseAnimating *s_pEntities[CRenderList::MAX_GROUP_ENTITIES * 2];
+	int nEntities = 0;
+
+	static const int s_Groups[] = { RENDER_GROUP_OPAQUE_ENTITY, RENDER_GROUP_TRANSLUCENT_ENTITY };
+	for ( int g = 0; g < ARRAYSIZE( s_Groups ); g++ )
+	{
+		int group = s_Groups[g];
+		for ( int i = 0; i < renderList.m_RenderGroupCounts[group]; i++ )
+		{
+			IClientRenderable *pRenderable = renderList.m_RenderGroups[group][i].m_pRenderable;
+			const model_t *pModel = pRenderable->GetModel();
+			if ( !pModel || modelinfo->GetModelType( pModel ) != mod_studio )
+				continue;
+
+			IClientUnknown *pUnknown = pRenderable->GetIClientUnknown();
+			C_BaseEntity *pEntity = pUnknown ? pUnknown->GetBaseEntity() : NULL;
+			C_BaseAnimating *pAnimating = pEntity ? dynamic_cast< C_BaseAnimating * >( pEntity ) : NULL;
+			if ( pAnimating )
+			{
+				s_pEntities[nEntities++] = pAnimating;
+			}
+		}
+	}
+
+	C_BaseAnimating::ThreadedSetupBones( s_pEntities, nEntities, gpGlobals->curtime );
+}
+
 static ConVar mat_wateroverlaysize( "mat_wateroverlaysize", "128" );
 static void OverlayWaterTexture( void )
 {
@@ -590,9 +624,6 @@ void CViewRender::BuildWorldRenderLists(
 		render->BuildWorldLists( &info, updateLightmaps, iForceViewLeaf );
 	}
 
-	// Now that we have the list of all leaves, regenerate shadows cast
-	g_pClientShadowMgr->ComputeShadowTextures( pView, info.m_LeafCount, info.m_pLeafList );
-
 	// Compute the prop opacity based on the view position
 	staticpropmgr->ComputePropOpacity( CurrentViewOrigin() );
 
@@ -612,6 +643,17 @@ void CViewRender::BuildWorldRenderLists(
 		SetupRenderList( pView, info, renderList );
 	}
 
+	// Set up the bones of everything we're about to draw before anything asks
+	// for them one at a time
+	if( ShouldDrawEntities() )
+	{
+		SetupBonesForRenderList( renderList );
+	}
+
+	// Now that we have the list of all leaves, regenerate shadows cast. This
+	// comes after the bone setup so the shadows reuse the bones.
+	g_pClientShadowMgr->ComputeShadowTextures( pView, info.m_LeafCount, info.m_pLeafList );
+
 	// Iterate through any bmodels that aren't rotated/translated ( they use the identity matrix )
 	//  and therefore are rendered with the world as an optimization
 	{
@@ -238,6 +238,7 @@ extern	qboolean	com_eof;
 extern void COM_FileBase (const char *in, char *out);
 extern void COM_WriteFile (char *filename, void *data, int len);
 extern int COM_OpenFile( const char *filename, FileHandle_t* file );
+extern FileHandle_t COM_FindFileHandle( const char *filename );
 extern void COM_CloseFile( FileHandle_t hFile );
 extern void COM_CreatePath (char *path);
 extern int COM_FileSize (const char *filename);
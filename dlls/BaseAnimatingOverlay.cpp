@@ -386,7 +386,7 @@ void CBaseAnimatingOverlay::GetSkeleton( Vector pos[], Quaternion q[], int boneM
 		return;
 	}
 
-	CalcPose( pStudioHdr, m_pIk, pos, q, GetSequence(), m_flCycle, GetPoseParameterArray(), boneMask );
+	CalcPose( pStudioHdr, m_pIk, pos, q, GetSequence(), m_flCycle, GetPoseParameterArray(), boneMask, 1.0f, GetPoseCache() );
 
 	// layers
 	{
@@ -395,7 +395,7 @@ void CBaseAnimatingOverlay::GetSkeleton( Vector pos[], Quaternion q[], int boneM
 			if (m_AnimOverlay[i].m_flWeight > 0)
 			{
 				// UNDONE: Is it correct to use overlay weight for IK too?
-				AccumulatePose( pStudioHdr, m_pIk, pos, q, m_AnimOverlay[i].m_nSequence, m_AnimOverlay[i].m_flCycle, GetPoseParameterArray(), boneMask, m_AnimOverlay[i].m_flWeight );
+				AccumulatePose( pStudioHdr, m_pIk, pos, q, m_AnimOverlay[i].m_nSequence, m_AnimOverlay[i].m_flCycle, GetPoseParameterArray(), boneMask, m_AnimOverlay[i].m_flWeight, GetPoseCache() );
 			}
 		}
 	}
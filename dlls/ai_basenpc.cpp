@@ -60,6 +60,8 @@
 #include "saverestore_bitstring.h"
 #include "checksum_crc.h"
 #include "iservervehicle.h"
+#include "vstdlib/jobthread.h"
+#include "igamesystem.h"
 #ifdef HL2_DLL
 #include "npc_bullseye.h"
 #include "hl2_player.h"
@@ -121,11 +123,16 @@ CFastTimer g_AIMaintainScheduleTimer;
 
 CAI_Manager g_AI_Manager;
 
+ConVar ai_parallel_think( "ai_parallel_think", "0", 0, "Gather the NPCs' sight candidates on the thread pool before the entities think" );
+ConVar ai_parallel_think_margin( "ai_parallel_think_margin", "64", 0, "How far NPCs and players can move between the parallel gather and the look" );
+
 //-------------------------------------
 
 CAI_Manager::CAI_Manager()
 {
 	m_AIs.EnsureCapacity( MAX_AIS );
+	m_nChanges = 0;
+	memset( &m_GatherStats, 0, sizeof(m_GatherStats) );
 }
 
 //-------------------------------------
@@ -149,6 +156,7 @@ int CAI_Manager::NumAIs()
 void CAI_Manager::AddAI( CAI_BaseNPC *pAI )
 {
 	m_AIs.AddToTail( pAI );
+	m_nChanges++;
 }
 
 //-------------------------------------
@@ -161,8 +169,110 @@ void CAI_Manager::RemoveAI( CAI_BaseNPC *pAI )
 
 	if ( i != -1 )
 		m_AIs.FastRemove( i );
+	m_nChanges++;
+}
+
+//-------------------------------------
+
+struct AIGatherContext_t
+{
+	AISenseSnapshot_t	snapshot;
+	CAI_BaseNPC			**ppAIs;
+};
+
+static void GatherSensesItem( void *pContext, int nItem )
+{
+	AIGatherContext_t *pGather = (AIGatherContext_t *)pContext;
+	CAI_BaseNPC *pAI = pGather->ppAIs[nItem];
+
+	CFastTimer timer;
+	timer.Start();
+	pAI->GetSenses()->GatherCandidates( pGather->snapshot );
+	timer.End();
+
+	// Only this item touches this NPC
+	pAI->AccessThinkCost().m_flGather += timer.GetDuration().GetMillisecondsF();
+}
+
+//-------------------------------------
+// Everything the gather reads is copied out here on the main thread, since
+// even GetAbsOrigin can write. The gather itself only reads the copies, so
+// it can't see an NPC half way through its think.
+
+void CAI_Manager::GatherSenses()
+{
+	if ( !ai_parallel_think.GetBool() || !m_AIs.Count() )
+		return;
+
+	CFastTimer timer;
+	timer.Start();
+
+	int nAIs = m_AIs.Count();
+	int nPlayers = min( gpGlobals->maxClients, MAX_PLAYERS );
+	m_GatherAIOrigins.SetCount( nAIs );
+	m_GatherAIs.RemoveAll();
+
+	int i;
+	for ( i = 0; i < nAIs; i++ )
+	{
+		CAI_BaseNPC *pAI = m_AIs[i];
+		m_GatherAIOrigins[i] = pAI->GetAbsOrigin();
+		if ( pAI->GetSenses() && pAI->GetSenses()->PrepareGather( nAIs, nPlayers ) )
+		{
+			m_GatherAIs.AddToTail( pAI );
+		}
+	}
+
+	Vector playerOrigins[MAX_PLAYERS];
+	bool bPlayerValid[MAX_PLAYERS];
+	for ( i = 0; i < nPlayers; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i + 1 );
+		bPlayerValid[i] = ( pPlayer != NULL );
+		if ( pPlayer )
+		{
+			playerOrigins[i] = pPlayer->GetAbsOrigin();
+		}
+	}
+
+	timer.End();
+	m_GatherStats.m_flSnapshotMs += timer.GetDuration().GetMillisecondsF();
+
+	if ( !m_GatherAIs.Count() )
+		return;
+
+	AIGatherContext_t context;
+	context.snapshot.m_pAIOrigins = m_GatherAIOrigins.Base();
+	context.snapshot.m_nAIs = nAIs;
+	context.snapshot.m_pPlayerOrigins = playerOrigins;
+	context.snapshot.m_pPlayerValid = bPlayerValid;
+	context.snapshot.m_nPlayers = nPlayers;
+	context.snapshot.m_iAIChanges = m_nChanges;
+	context.snapshot.m_flMargin = ai_parallel_think_margin.GetFloat();
+	context.ppAIs = m_GatherAIs.Base();
+
+	timer.Start();
+	ThreadPool()->ParallelProcess( GatherSensesItem, &context, m_GatherAIs.Count() );
+	timer.End();
+
+	m_GatherStats.m_nFrames++;
+	m_GatherStats.m_nGathers += m_GatherAIs.Count();
+	m_GatherStats.m_flGatherMs += timer.GetDuration().GetMillisecondsF();
 }
 
+//-------------------------------------
+
+class CAI_GatherSensesSystem : public CAutoGameSystem
+{
+public:
+	virtual void FrameUpdatePreEntityThink()
+	{
+		g_AI_Manager.GatherSenses();
+	}
+};
+
+static CAI_GatherSensesSystem g_AIGatherSensesSystem;
+
 
 //-----------------------------------------------------------------------------
 
@@ -2401,11 +2511,29 @@ void CAI_BaseNPC::NPCThink( void )
 		if ( !PreThink() )
 			return;
 
+		// Per-NPC costs for ai_report; RunAI splits its own time up
+		CFastTimer thinkTimer;
+		CFastTimer partTimer;
+		thinkTimer.Start();
+
 		RunAI();
 
+		partTimer.Start();
 		PostRun();
+		partTimer.End();
+		m_ThinkCost.m_flPostRun += partTimer.GetDuration().GetMillisecondsF();
 
+		partTimer.Start();
 		PerformMovement();
+		partTimer.End();
+		m_ThinkCost.m_flMove += partTimer.GetDuration().GetMillisecondsF();
+
+		thinkTimer.End();
+		float flThink = thinkTimer.GetDuration().GetMillisecondsF();
+		m_ThinkCost.m_nThinks++;
+		m_ThinkCost.m_flTotal += flThink;
+		if ( flThink > m_ThinkCost.m_flMax )
+			m_ThinkCost.m_flMax = flThink;
 
 		SetSimulationTime( gpGlobals->curtime );
 	}
@@ -2737,7 +2865,13 @@ void CAI_BaseNPC::SetState ( NPC_STATE State )
 //-----------------------------------------------------------------------------
 void CAI_BaseNPC::PerformSensing( void )
 {
+	CFastTimer timer;
+	timer.Start();
+
 	GetSenses()->PerformSensing();
+
+	timer.End();
+	m_ThinkCost.m_flSense += timer.GetDuration().GetMillisecondsF();
 }
 
 
@@ -2837,9 +2971,13 @@ void CAI_BaseNPC::RunAI( void )
 
 	{
 	AI_PROFILE_SCOPE(CAI_BaseNPC_RunAI_GatherConditions);
+	CFastTimer conditionsTimer;
+	conditionsTimer.Start();
 	GatherConditions();
 	if ( !m_bConditionsGathered )
 		m_bConditionsGathered = true; // derived class didn't call to base
+	conditionsTimer.End();
+	m_ThinkCost.m_flConditions += conditionsTimer.GetDuration().GetMillisecondsF();
 	}
 
 	TryRestoreHull();
@@ -2854,7 +2992,9 @@ void CAI_BaseNPC::RunAI( void )
 	g_AIPrescheduleThinkTimer.End();
 	}
 
+	// MaintainSchedule times itself into g_AIMaintainScheduleTimer
 	MaintainSchedule();
+	m_ThinkCost.m_flSchedule += g_AIMaintainScheduleTimer.GetDuration().GetMillisecondsF();
 
 	// if the npc didn't use these conditions during the above call to MaintainSchedule()
 	// we throw them out cause we don't want them sitting around through the lifespan of a schedule
@@ -5782,6 +5922,70 @@ void CAI_BaseNPC::ReportAIState( void )
 ConVar ai_report_task_timings_on_limit( "ai_report_task_timings_on_limit", "0", FCVAR_ARCHIVE );
 ConVar ai_think_limit_label( "ai_think_limit_label", "0", FCVAR_ARCHIVE );
 
+static int __cdecl AIThinkCostCompare( const void *pLeft, const void *pRight )
+{
+	float flLeft = (*(CAI_BaseNPC **)pLeft)->AccessThinkCost().m_flTotal;
+	float flRight = (*(CAI_BaseNPC **)pRight)->AccessThinkCost().m_flTotal;
+	if ( flLeft > flRight )
+		return -1;
+	return ( flLeft < flRight ) ? 1 : 0;
+}
+
+CON_COMMAND( ai_report, "Per-NPC think costs, most expensive first. Usage: ai_report [count], 'ai_report reset' clears them" )
+{
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	int nAIs = g_AI_Manager.NumAIs();
+	AIGatherStats_t &gather = g_AI_Manager.GatherStats();
+	int i;
+
+	if ( engine->Cmd_Argc() > 1 && !Q_stricmp( engine->Cmd_Argv( 1 ), "reset" ) )
+	{
+		for ( i = 0; i < nAIs; i++ )
+		{
+			memset( &ppAIs[i]->AccessThinkCost(), 0, sizeof(CAI_BaseNPC::ThinkCost_t) );
+		}
+		memset( &gather, 0, sizeof(gather) );
+		Msg( "AI report reset.\n" );
+		return;
+	}
+
+	int nShow = ( engine->Cmd_Argc() > 1 ) ? atoi( engine->Cmd_Argv( 1 ) ) : 20;
+
+	Msg( "Parallel think %s, %d threads\n", ai_parallel_think.GetBool() ? "on" : "off", ThreadPool()->NumThreads() );
+	if ( gather.m_nFrames )
+	{
+		Msg( "Gather: %d frames, %.1f NPCs/frame, snapshot %.3f ms/frame, parallel %.3f ms/frame\n",
+			gather.m_nFrames, (float)gather.m_nGathers / gather.m_nFrames,
+			gather.m_flSnapshotMs / gather.m_nFrames, gather.m_flGatherMs / gather.m_nFrames );
+	}
+	Msg( "NPC looks: %d from gathered candidates, %d serial\n", gather.m_nLooksGathered, gather.m_nLooksSerial );
+
+	CUtlVector<CAI_BaseNPC *> sorted;
+	sorted.CopyArray( ppAIs, nAIs );
+	if ( nAIs )
+	{
+		qsort( sorted.Base(), nAIs, sizeof(CAI_BaseNPC *), AIThinkCostCompare );
+	}
+
+	float flTotal = 0;
+	for ( i = 0; i < nAIs; i++ )
+	{
+		flTotal += sorted[i]->AccessThinkCost().m_flTotal;
+	}
+	Msg( "%d NPCs, %.2f ms of think\n", nAIs, flTotal );
+	Msg( "%-32s %6s %9s %7s %7s %7s %7s %7s %7s %7s\n", "npc", "thinks", "total", "avg", "max", "sense", "cond", "sched", "move", "gather" );
+
+	nShow = min( nShow, nAIs );
+	for ( i = 0; i < nShow; i++ )
+	{
+		const CAI_BaseNPC::ThinkCost_t &cost = sorted[i]->AccessThinkCost();
+		Msg( "%-32.32s %6d %9.2f %7.3f %7.3f %7.2f %7.2f %7.2f %7.2f %7.2f\n",
+			sorted[i]->GetDebugName(), cost.m_nThinks, cost.m_flTotal,
+			cost.m_nThinks ? cost.m_flTotal / cost.m_nThinks : 0.0f, cost.m_flMax,
+			cost.m_flSense, cost.m_flConditions, cost.m_flSchedule, cost.m_flMove, cost.m_flGather );
+	}
+}
+
 void CAI_BaseNPC::ReportOverThinkLimit( float time )
 {
 	Msg( "%s thinking for %.02fms!!! (%s); r%.2f (c%.2f, pst%.2f, ms%.2f), p-r%.2f, m%.2f\n",
@@ -7059,6 +7263,8 @@ CAI_BaseNPC::CAI_BaseNPC(void)
 	m_pPathfinder = NULL;
 	m_pLocalNavigator = NULL;
 
+	memset( &m_ThinkCost, 0, sizeof(m_ThinkCost) );
+
 #ifdef _DEBUG
 	// necessary since in debug, we initialize vectors to NAN for debugging
 	m_vecLastPosition.Init();
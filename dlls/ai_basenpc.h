@@ -214,6 +214,16 @@ float ChangeDistance( float flInterval, float flGoalDistance, float flGoalVeloci
 //
 //=============================================================================
 
+struct AIGatherStats_t
+{
+	int		m_nFrames;
+	int		m_nGathers;					// NPCs gathered for
+	float	m_flSnapshotMs;				// main thread
+	float	m_flGatherMs;				// wall clock of the parallel part
+	int		m_nLooksGathered;			// looks that used the gathered candidates
+	int		m_nLooksSerial;
+};
+
 class CAI_Manager
 {
 public:
@@ -224,6 +234,15 @@ public:
 	
 	void AddAI( CAI_BaseNPC *pAI );
 	void RemoveAI( CAI_BaseNPC *pAI );
+
+	// Bumped whenever an AI is added or removed, so indices into the list
+	// taken earlier can be checked
+	int				ChangeCount() const		{ return m_nChanges; }
+
+	// ai_parallel_think: the read-only part of the NPCs' senses, run on the
+	// thread pool before the entities think
+	void			GatherSenses();
+	AIGatherStats_t &GatherStats()			{ return m_GatherStats; }
 	
 private:
 	enum
@@ -234,7 +253,11 @@ private:
 	typedef CUtlVector<CAI_BaseNPC *> CAIArray;
 	
 	CAIArray m_AIs;
+	int		 m_nChanges;
 
+	CUtlVector<Vector>	m_GatherAIOrigins;
+	CUtlVector<CAI_BaseNPC *> m_GatherAIs;
+	AIGatherStats_t		m_GatherStats;
 };
 
 //-------------------------------------
@@ -517,6 +540,21 @@ public:
 	void				ClearCustomInterruptConditions( void );
 
 	bool				ConditionsGathered() const		{ return m_bConditionsGathered; }
+
+	// Think costs since the last 'ai_report reset', in milliseconds
+	struct ThinkCost_t
+	{
+		int		m_nThinks;
+		float	m_flTotal;
+		float	m_flMax;
+		float	m_flSense;
+		float	m_flConditions;				// includes m_flSense
+		float	m_flSchedule;
+		float	m_flPostRun;
+		float	m_flMove;
+		float	m_flGather;					// parallel pre-think, off the main thread
+	};
+	ThinkCost_t &		AccessThinkCost()				{ return m_ThinkCost; }
 	const CAI_ScheduleBits &AccessConditionBits() const { return m_Conditions; }
 	CAI_ScheduleBits &	AccessConditionBits()			{ return m_Conditions; }
 
@@ -528,6 +566,8 @@ private:
 
 	bool				m_bConditionsGathered;
 
+	ThinkCost_t			m_ThinkCost;
+
 public:
 	//-----------------------------------------------------
 	//
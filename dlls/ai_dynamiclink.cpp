@@ -331,6 +331,9 @@ void CAI_DynamicLink::SetLinkState(void)
 			{
 				pLink->m_LinkInfo &= ~bits_LINK_OFF;
 			}
+
+			// Cached paths may run through here, or a shorter one may now exist
+			g_pBigAINet->InvalidatePaths();
 			bLinkFormed = true;
 			break;
 		}
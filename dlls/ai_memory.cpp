@@ -18,7 +18,7 @@
 //
 //-----------------------------------------------------------------------------
 
-DEFINE_FIXEDSIZE_ALLOCATOR( AI_EnemyInfo_t, EMEMORY_POOL_SIZE, CMemoryPool::GROW_FAST );
+DEFINE_FIXEDSIZE_ALLOCATOR_MT( AI_EnemyInfo_t, EMEMORY_POOL_SIZE, CMemoryPool::GROW_FAST );
 
 //-----------------------------------------------------------------------------
 
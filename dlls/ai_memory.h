@@ -33,7 +33,7 @@ struct AI_EnemyInfo_t
 	bool			bEludedMe;			// True if enemy not at last known location 
 
 	DECLARE_SIMPLE_DATADESC();
-	DECLARE_FIXEDSIZE_ALLOCATOR(AI_EnemyInfo_t);
+	DECLARE_FIXEDSIZE_ALLOCATOR_MT(AI_EnemyInfo_t);
 };
 
 //-----------------------------------------------------------------------------
@@ -99,6 +99,10 @@ public:
 // PERFORMANCE: Tune this number
 #define MAX_NEAR_NODES	10			// Trace to 10 nodes at most
 
+// Clusters are grown out from a seed node until they hit either limit
+#define AI_CLUSTER_MAX_NODES	24
+#define AI_CLUSTER_RADIUS		768.0f
+
 //-----------------------------------------------------------------------------
 
 CAI_Network::CAI_Network()
@@ -106,6 +110,10 @@ CAI_Network::CAI_Network()
 	m_iNumNodes				= 0;		// Number of nodes in this network
 	m_pAInode				= NULL;		// Array of all nodes in this network
 
+	m_nClusteredNodes		= 0;
+	m_nPortalNodes			= 0;
+	m_iPathGeneration		= 0;
+
 	m_nNearestCacheIndex	= 0;
 	// Force empty node caches to be rebuild
 	for (int node=0;node<NEARNODE_CACHE_SIZE;node++)
@@ -540,4 +548,211 @@ bool CAI_Network::IsConnected(int srcID, int destID)
 	return ( srcZone == destZone );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Groups the nodes into clusters and finds the links between the
+//			clusters. A cluster link accepts a move type for a hull if any of
+//			the node links it stands for does, so a route that exists in the
+//			node graph always exists in the cluster graph.
+//-----------------------------------------------------------------------------
+
+void CAI_Network::InitClusters()
+{
+	m_Clusters.RemoveAll();
+	m_ClusterNodes.RemoveAll();
+	m_ClusterLinks.RemoveAll();
+	m_nClusteredNodes = 0;
+	m_nPortalNodes = 0;
+	InvalidatePaths();
+
+	if ( !m_iNumNodes )
+		return;
+
+	int i;
+	for ( i = 0; i < m_iNumNodes; i++ )
+	{
+		m_pAInode[i]->SetCluster( -1 );
+	}
+
+	// Grow the clusters breadth first, so the members of each one end up
+	// next to each other in m_ClusterNodes
+	m_ClusterNodes.EnsureCapacity( m_iNumNodes );
+	for ( i = 0; i < m_iNumNodes; i++ )
+	{
+		if ( m_pAInode[i]->GetCluster() != -1 )
+			continue;
+
+		int iCluster = m_Clusters.AddToTail();
+		Cluster_t &cluster = m_Clusters[iCluster];
+		cluster.iFirstNode = m_ClusterNodes.Count();
+		cluster.nNodes = 0;
+		cluster.iFirstLink = 0;
+		cluster.nLinks = 0;
+		cluster.vecCenter.Init();
+
+		const Vector &vecSeed = m_pAInode[i]->GetOrigin();
+		m_pAInode[i]->SetCluster( iCluster );
+		m_ClusterNodes.AddToTail( i );
+
+		for ( int iNext = cluster.iFirstNode; iNext < m_ClusterNodes.Count(); iNext++ )
+		{
+			CAI_Node *pNode = m_pAInode[m_ClusterNodes[iNext]];
+			cluster.vecCenter += pNode->GetOrigin();
+			cluster.nNodes++;
+
+			for ( int link = 0; link < pNode->NumLinks(); link++ )
+			{
+				if ( m_ClusterNodes.Count() - cluster.iFirstNode >= AI_CLUSTER_MAX_NODES )
+					break;
+
+				CAI_Node *pLinked = m_pAInode[pNode->GetLinkByIndex( link )->DestNodeID( pNode->GetId() )];
+				if ( pLinked->GetCluster() != -1 )
+					continue;
+
+				if ( ( pLinked->GetOrigin() - vecSeed ).LengthSqr() > AI_CLUSTER_RADIUS * AI_CLUSTER_RADIUS )
+					continue;
+
+				pLinked->SetCluster( iCluster );
+				m_ClusterNodes.AddToTail( pLinked->GetId() );
+			}
+		}
+
+		cluster.vecCenter /= cluster.nNodes;
+	}
+
+	// Now the links between them
+	for ( int iCluster = 0; iCluster < m_Clusters.Count(); iCluster++ )
+	{
+		Cluster_t &cluster = m_Clusters[iCluster];
+		cluster.iFirstLink = m_ClusterLinks.Count();
+
+		for ( i = 0; i < cluster.nNodes; i++ )
+		{
+			CAI_Node *pNode = m_pAInode[m_ClusterNodes[cluster.iFirstNode + i]];
+			bool bPortal = false;
+
+			for ( int link = 0; link < pNode->NumLinks(); link++ )
+			{
+				CAI_Link *pLink = pNode->GetLinkByIndex( link );
+				int iOther = m_pAInode[pLink->DestNodeID( pNode->GetId() )]->GetCluster();
+				if ( iOther == iCluster )
+					continue;
+
+				bPortal = true;
+
+				int iClusterLink;
+				for ( iClusterLink = cluster.iFirstLink; iClusterLink < m_ClusterLinks.Count(); iClusterLink++ )
+				{
+					if ( m_ClusterLinks[iClusterLink].iCluster == iOther )
+						break;
+				}
+
+				if ( iClusterLink == m_ClusterLinks.Count() )
+				{
+					m_ClusterLinks.AddToTail();
+					m_ClusterLinks[iClusterLink].iCluster = iOther;
+					memset( m_ClusterLinks[iClusterLink].acceptedMoveTypes, 0, sizeof( m_ClusterLinks[iClusterLink].acceptedMoveTypes ) );
+				}
+
+				for ( int hull = 0; hull < NUM_HULLS; hull++ )
+				{
+					m_ClusterLinks[iClusterLink].acceptedMoveTypes[hull] |= pLink->m_iAcceptedMoveTypes[hull];
+				}
+			}
+
+			if ( bPortal )
+			{
+				m_nPortalNodes++;
+			}
+		}
+
+		cluster.nLinks = m_ClusterLinks.Count() - cluster.iFirstLink;
+	}
+
+	m_nClusteredNodes = m_iNumNodes;
+
+	DevMsg( 2, "AI network: %d nodes in %d clusters, %d portal nodes\n", m_iNumNodes, m_Clusters.Count(), m_nPortalNodes );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs A* over the cluster graph from the start node's cluster to the
+//			end node's, and marks the clusters along the way plus the ones
+//			bordering them in pCorridor, which must be NumClusters() bits long.
+//			Returns false if no cluster route exists for the hull and move
+//			capabilities, in which case no node route exists either.
+//-----------------------------------------------------------------------------
+
+bool CAI_Network::BuildClusterCorridor( int startID, int endID, Hull_t hull, int capabilities, CBitString *pCorridor )
+{
+	Assert( HasClusters() );
+	Assert( pCorridor->Size() == m_Clusters.Count() );
+
+	int nClusters = m_Clusters.Count();
+	int startCluster = m_pAInode[startID]->GetCluster();
+	int endCluster = m_pAInode[endID]->GetCluster();
+
+	CBitString	openBS( nClusters );
+	CBitString	closeBS( nClusters );
+
+	float* clusterG = (float *)stackalloc( nClusters * sizeof(float) );
+	float* clusterF = (float *)stackalloc( nClusters * sizeof(float) );
+	int*   clusterP = (int *)stackalloc( nClusters * sizeof(int) );
+
+	for ( int i = 0; i < nClusters; i++ )
+	{
+		clusterG[i] = FLT_MAX;
+		clusterP[i] = -1;
+	}
+
+	const Vector &vecGoal = m_Clusters[endCluster].vecCenter;
+
+	clusterG[startCluster] = 0;
+	clusterF[startCluster] = ( m_Clusters[startCluster].vecCenter - vecGoal ).Length();
+	openBS.SetBit( startCluster );
+
+	while ( !openBS.IsAllClear() )
+	{
+		int current = FindBSSmallest( &openBS, clusterF, nClusters );
+		openBS.ClearBit( current );
+		closeBS.SetBit( current );
+
+		if ( current == endCluster )
+		{
+			pCorridor->ClearAllBits();
+			for ( int iCluster = endCluster; iCluster != -1; iCluster = clusterP[iCluster] )
+			{
+				const Cluster_t &cluster = m_Clusters[iCluster];
+				pCorridor->SetBit( iCluster );
+				for ( int link = 0; link < cluster.nLinks; link++ )
+				{
+					pCorridor->SetBit( m_ClusterLinks[cluster.iFirstLink + link].iCluster );
+				}
+			}
+			return true;
+		}
+
+		const Cluster_t &cluster = m_Clusters[current];
+		for ( int link = 0; link < cluster.nLinks; link++ )
+		{
+			const ClusterLink_t &clusterLink = m_ClusterLinks[cluster.iFirstLink + link];
+			if ( !( clusterLink.acceptedMoveTypes[hull] & capabilities ) )
+				continue;
+
+			int next = clusterLink.iCluster;
+			if ( closeBS.GetBit( next ) )
+				continue;
+
+			float new_g = clusterG[current] + ( m_Clusters[next].vecCenter - cluster.vecCenter ).Length();
+			if ( new_g < clusterG[next] )
+			{
+				clusterP[next] = current;
+				clusterG[next] = new_g;
+				clusterF[next] = new_g + ( m_Clusters[next].vecCenter - vecGoal ).Length();
+				openBS.SetBit( next );
+			}
+		}
+	}
+
+	return false;
+}
+
 //=============================================================================
@@ -13,6 +13,7 @@
 #endif
 
 #include "utlpriorityqueue.h"
+#include "utlvector.h"
 
 // ------------------------------------
 
@@ -83,6 +84,18 @@ public:
 
 	bool			IsConnected(int srcID, int destID);	// Use during run time
 	void			TestIsConnected(int startID, int endID);	// Use only for initialization!
+
+	// Coarse graph of clusters of nearby nodes, joined where a link crosses
+	// between two clusters. Built whenever the graph is loaded or built.
+	void			InitClusters();
+	bool			HasClusters() const		{ return ( m_nClusteredNodes == m_iNumNodes && m_Clusters.Count() > 0 ); }
+	int				NumClusters() const		{ return m_Clusters.Count(); }
+	int				NumPortalNodes() const	{ return m_nPortalNodes; }
+	bool			BuildClusterCorridor( int startID, int endID, Hull_t hull, int capabilities, CBitString *pCorridor );
+
+	// Bumped whenever routes through the graph may have changed
+	int				GetPathGeneration() const	{ return m_iPathGeneration; }
+	void			InvalidatePaths()			{ m_iPathGeneration++; }
 	
 	Vector			GetNodePosition( CBaseCombatCharacter *pNPC, int nodeID );
 	Vector			GetNodePosition( Hull_t hull, int nodeID );
@@ -129,6 +142,28 @@ private:
 	int					m_iNumNodes;				// Number of nodes in this network
 	CAI_Node**			m_pAInode;					// Array of all nodes in this network
 
+	struct Cluster_t
+	{
+		Vector	vecCenter;					// Average of the node origins
+		int		iFirstNode;					// Into m_ClusterNodes
+		int		nNodes;
+		int		iFirstLink;					// Into m_ClusterLinks
+		int		nLinks;
+	};
+
+	struct ClusterLink_t
+	{
+		int		iCluster;					// The cluster on the other side
+		int		acceptedMoveTypes[NUM_HULLS];	// Union over all the node links crossing over
+	};
+
+	CUtlVector<Cluster_t>		m_Clusters;
+	CUtlVector<short>			m_ClusterNodes;		// Node IDs grouped by cluster
+	CUtlVector<ClusterLink_t>	m_ClusterLinks;
+	int					m_nClusteredNodes;			// Node count when the clusters were built
+	int					m_nPortalNodes;				// Nodes with a link into another cluster
+	int					m_iPathGeneration;
+
 	NearNodeCache_T		m_pNearestCache[NEARNODE_CACHE_SIZE];	// Cache of nearest nodes
 	int					m_nNearestCacheIndex;					// Oldest record in the cache
 };
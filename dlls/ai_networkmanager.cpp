@@ -19,12 +19,15 @@
 #include "ai_dynamiclink.h"
 #include "ai_initutils.h"
 #include "ai_moveprobe.h"
+#include "bspfile.h"
+#include "checksum_crc.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 // Increment this to force rebuilding of all networks
-#define	 AINET_VERSION_NUMBER	26
+#define	 AINET_VERSION_NUMBER	27
 
 //-----------------------------------------------------------------------------
 
@@ -218,6 +221,7 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 	// Save the version number
 	// ---------------------------
 	buf.Printf("Version	%d\n",AINET_VERSION_NUMBER);
+	buf.Printf("Geometry	%u\n",ComputeGeometryCRC( STRING( gpGlobals->mapname ) ));
 
 	// -------------------------------
 	// Dump all the nodes to the file
@@ -421,18 +425,85 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 		return;
 	}
 
-	// -----------------------------
-	// Make sure directories have been made
-	// -----------------------------
-	char	szNrpFilename [MAX_PATH];// text node report filename
-	Q_strncpy( szNrpFilename, "maps" ,sizeof(szNrpFilename));
-	filesystem->CreateDirHierarchy( szNrpFilename, "GAME"  );
-	strcat( szNrpFilename, "/graphs" );
-	filesystem->CreateDirHierarchy( szNrpFilename, "GAME"  );
+	AI_SavedGraph_t graph;
+	if ( !ReadNetworkGraph( &graph ) )
+	{
+		return;
+	}
 
-	strcat( szNrpFilename, "/" );
-	strcat( szNrpFilename, STRING( gpGlobals->mapname ) );
-	strcat( szNrpFilename, ".ain" );
+	// ----------------------------------------
+	// Get the network size and allocate space
+	// ----------------------------------------
+	int numNodes = graph.nodes.Count();
+	m_pNetwork->m_pAInode = new CAI_Node*[max( numNodes, 1 )];
+
+	// -------------------------------
+	// Create the nodes
+	// -------------------------------
+	int node;
+	for ( node = 0; node < numNodes; node++)
+	{
+		const AI_SavedNode_t &savedNode = graph.nodes[node];
+
+		CAI_Node *new_node = m_pNetwork->AddNode( savedNode.origin, savedNode.yaw );
+
+		for (int hull =0;hull<NUM_HULLS;hull++)
+		{
+			new_node->m_flVOffset[hull] = savedNode.vOffset[hull];
+		}
+
+		new_node->m_eNodeType = (NodeType_e)savedNode.type;
+		new_node->m_eNodeInfo = savedNode.info;
+
+		new_node->m_zone = savedNode.zone;
+		Assert( new_node->GetZone() != AI_NODE_ZONE_UNKNOWN );
+	}
+
+	// -------------------------------
+	// Create the links
+	// -------------------------------
+	for (int link = 0; link < graph.links.Count(); link++)
+	{
+		const AI_SavedLink_t &savedLink = graph.links[link];
+		CAI_Link *new_link = new CAI_Link;
+
+		new_link->m_iSrcID = savedLink.srcID;
+		new_link->m_iDestID = savedLink.destID;
+
+		for (int hull =0;hull<NUM_HULLS;hull++)
+		{
+			new_link->m_iAcceptedMoveTypes[hull] = savedLink.acceptedMoveTypes[hull];
+		}
+		// Now add link to source and destination nodes
+		m_pNetwork->GetNode(new_link->m_iSrcID)->AddLink(new_link);
+		m_pNetwork->GetNode(new_link->m_iDestID)->AddLink(new_link);
+	}
+
+	// -------------------------------
+	// WC lookup table
+	// -------------------------------
+	delete [] GetEditOps()->m_pNodeIndexTable;
+	GetEditOps()->m_pNodeIndexTable	= new int[max( m_pNetwork->m_iNumNodes, 1 )];
+
+	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
+	{
+		GetEditOps()->m_pNodeIndexTable[node] = graph.wcIDs[node];
+	}
+
+	m_pNetwork->InitClusters();
+
+	gm_fNetworksLoaded = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:  Reads this map's .ain file, whether or not it is up to date
+// Output :  false if there is no file, or it is from another version
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkManager::ReadNetworkGraph( AI_SavedGraph_t *pGraph )
+{
+	char	szNrpFilename [MAX_PATH];
+	Q_snprintf( szNrpFilename, sizeof( szNrpFilename ), "maps/graphs/%s.ain", STRING( gpGlobals->mapname ) );
 
 	FileHandle_t fh = filesystem->Open ( szNrpFilename, "r" );
 
@@ -441,8 +512,8 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	// -----------------------------
 	if ( !fh )
 	{
-		DevWarning( 2, "Couldn't create %s!\n", szNrpFilename );
-		return;
+		DevWarning( 2, "Couldn't open %s!\n", szNrpFilename );
+		return false;
 	}
  
 	// Create a text buffer for unserialization
@@ -462,102 +533,186 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	buf.Scanf("%i\n",&version);
 	if (version!=AINET_VERSION_NUMBER)
 	{
-		return;
+		return false;
 	}
 
-	// ----------------------------------------
-	// Get the network size and allocate space
-	// ----------------------------------------
+	buf.Scanf("%s",&temps);
+	buf.Scanf("%u\n",&pGraph->geometryCRC);
+
+	// ---------------------------
+	// Get the network size
+	// ---------------------------
 	int numNodes;
 	buf.Scanf("%s",&temps);
 	buf.Scanf("%d\n", &numNodes);
-
-	// ------------------------------------------------------------------------
-	// If in wc_edit mode allocate extra space for nodes that might be created
-	// ------------------------------------------------------------------------
-	if ( engine->IsInEditMode() )
+	if ( numNodes < 0 || numNodes > MAX_NODES )
 	{
-		numNodes = max( numNodes, 1024 );
+		return false;
 	}
 
-	m_pNetwork->m_pAInode = new CAI_Node*[numNodes];
-
 	// -------------------------------
-	// Load all the nodes to the file
+	// Read the nodes
 	// -------------------------------
+	pGraph->nodes.SetCount( numNodes );
+
 	int node;
 	for ( node = 0; node < numNodes; node++)
 	{
-		Vector origin;
-		float yaw;
-		buf.Scanf("%f,%f,%f", &origin.x, &origin.y, &origin.z );
-		buf.Scanf("%f", &yaw );
+		AI_SavedNode_t &savedNode = pGraph->nodes[node];
 
-		CAI_Node *new_node = m_pNetwork->AddNode( origin, yaw );
+		buf.Scanf("%f,%f,%f", &savedNode.origin.x, &savedNode.origin.y, &savedNode.origin.z );
+		buf.Scanf("%f", &savedNode.yaw );
 
 		for (int hull =0;hull<NUM_HULLS;hull++)
 		{
-			buf.Scanf("%f", &new_node->m_flVOffset[hull]);
+			buf.Scanf("%f", &savedNode.vOffset[hull]);
 		}
 
-		buf.Scanf("%d",&new_node->m_eNodeType);
-		buf.Scanf("%d",&new_node->m_eNodeInfo);
-
-		buf.Scanf("%d",&new_node->m_zone);
-		Assert( new_node->GetZone() != AI_NODE_ZONE_UNKNOWN );
+		buf.Scanf("%d",&savedNode.type);
+		buf.Scanf("%d",&savedNode.info);
+		buf.Scanf("%d",&savedNode.zone);
 
+		// Links are listed again below
 		int numLinks;
 		buf.Scanf("%d",&numLinks);
-
-		// ------------------------------------------------------------------------
-		// If in wc_edit mode allocate extra space for nodes that might be created
-		// ------------------------------------------------------------------------
-		if ( engine->IsInEditMode() )
-		{
-			numLinks = AI_MAX_NODE_LINKS;
-		}
-
-		//Assert ( numLinks >= 1 );
-		// NOTE:  Don't need to manually allocate these since m_Link is CUtlVector autogrowable now
-		//new_node->AllocateLinkSpace( max( numLinks, 1 ) );
 	}
 
 	// -------------------------------
-	// Load all the links to the fild
+	// Read the links
 	// -------------------------------
 	int totalNumLinks;
 	buf.Scanf("%s",&temps);
 	buf.Scanf("%d",&totalNumLinks);
+	if ( totalNumLinks < 0 )
+	{
+		return false;
+	}
+
+	pGraph->links.SetCount( totalNumLinks );
 
 	for (int link = 0; link < totalNumLinks; link++)
 	{
-		CAI_Link *new_link = new CAI_Link;
-
-		buf.Scanf("%d", &new_link->m_iSrcID);
+		AI_SavedLink_t &savedLink = pGraph->links[link];
 
-		buf.Scanf("%d", &new_link->m_iDestID);
+		buf.Scanf("%d", &savedLink.srcID);
+		buf.Scanf("%d", &savedLink.destID);
 
 		for (int hull =0;hull<NUM_HULLS;hull++)
 		{
-			buf.Scanf("%d", &new_link->m_iAcceptedMoveTypes[hull]);
+			buf.Scanf("%d", &savedLink.acceptedMoveTypes[hull]);
+		}
+
+		if ( savedLink.srcID < 0 || savedLink.srcID >= numNodes || savedLink.destID < 0 || savedLink.destID >= numNodes )
+		{
+			return false;
 		}
-		// Now add link to source and destination nodes
-		m_pNetwork->GetNode(new_link->m_iSrcID)->AddLink(new_link);
-		m_pNetwork->GetNode(new_link->m_iDestID)->AddLink(new_link);
 	}
 
 	// -------------------------------
-	// Load WC lookup table
+	// Read WC lookup table
 	// -------------------------------
-	delete [] GetEditOps()->m_pNodeIndexTable;
-	GetEditOps()->m_pNodeIndexTable	= new int[max( m_pNetwork->m_iNumNodes, 1 )];
+	pGraph->wcIDs.SetCount( numNodes );
 
-	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
+	for (node = 0; node < numNodes; node++)
 	{
-		buf.Scanf("%d",&GetEditOps()->m_pNodeIndexTable[node]);
+		buf.Scanf("%d",&pGraph->wcIDs[node]);
 	}
 
-	gm_fNetworksLoaded = true;
+	return buf.IsValid();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:  CRC of the parts of the .bsp that node links can depend on: every
+//			 lump except the pak file and the entities, and every entity 
+//			 except the nodes and hints. If it matches the one in an out of date .ain, only
+//			 the nodes have changed since that graph was built.
+// Output :  0 if the .bsp couldn't be read
+//-----------------------------------------------------------------------------
+
+unsigned int CAI_NetworkManager::ComputeGeometryCRC( const char *szMapName )
+{
+	char	szBspFilename[MAX_PATH];
+	Q_snprintf( szBspFilename, sizeof( szBspFilename ), "maps/%s.bsp", szMapName );
+
+	FileHandle_t fh = filesystem->Open( szBspFilename, "rb" );
+	if ( !fh )
+	{
+		return 0;
+	}
+
+	dheader_t header;
+	if ( filesystem->Read( &header, sizeof(header), fh ) != sizeof(header) || header.ident != IDBSPHEADER )
+	{
+		filesystem->Close( fh );
+		return 0;
+	}
+
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, &header.version, sizeof(header.version) );
+
+	CUtlBuffer lump;
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		int len = header.lumps[i].filelen;
+		if ( len <= 0 || i == LUMP_PAKFILE )
+			continue;
+
+		lump.EnsureCapacity( len + 1 );
+		filesystem->Seek( fh, header.lumps[i].fileofs, FILESYSTEM_SEEK_HEAD );
+		if ( filesystem->Read( lump.Base(), len, fh ) != len )
+		{
+			filesystem->Close( fh );
+			return 0;
+		}
+
+		if ( i != LUMP_ENTITIES )
+		{
+			CRC32_ProcessBuffer( &crc, lump.Base(), len );
+			continue;
+		}
+
+		// Skip the { } block of every node entity
+		char *pEntities = (char *)lump.Base();
+		pEntities[len] = 0;
+
+		char *pBlock = pEntities;
+		while ( *pBlock )
+		{
+			char *pEnd = strchr( pBlock, '}' );
+			pEnd = pEnd ? pEnd + 1 : pBlock + strlen( pBlock );
+
+			char *pClassname = Q_strstr( pBlock, "\"classname\"" );
+			bool bNode = false;
+			if ( pClassname && pClassname < pEnd )
+			{
+				pClassname = strchr( pClassname + 11, '"' );
+				if ( pClassname && ( !Q_strncmp( pClassname, "\"info_node", 10 ) || !Q_strncmp( pClassname, "\"info_hint\"", 11 ) ) )
+				{
+					bNode = true;
+				}
+			}
+
+			// Hammer bumps the map version on every save
+			for ( char *pLine = pBlock; !bNode && pLine < pEnd; )
+			{
+				char *pNextLine = strchr( pLine, '\n' );
+				pNextLine = ( pNextLine && pNextLine < pEnd ) ? pNextLine + 1 : pEnd;
+				if ( Q_strncmp( pLine, "\"mapversion\"", 12 ) )
+				{
+					CRC32_ProcessBuffer( &crc, pLine, pNextLine - pLine );
+				}
+				pLine = pNextLine;
+			}
+			pBlock = pEnd;
+		}
+	}
+
+	filesystem->Close( fh );
+	CRC32_Final( &crc );
+
+	// 0 means unknown
+	return crc ? crc : 1;
 }
 
 /* Keep this around for debugging
@@ -748,7 +903,24 @@ void CAI_NetworkManager::DeleteAllAINetworks(void)
 
 void CAI_NetworkManager::BuildNetworkGraph( void )
 {
-	g_AINetworkBuilder.Build( m_pNetwork );
+	// If the old graph was built against the same geometry, only the 
+	// parts of it around nodes that changed have to be rebuilt
+	AI_SavedGraph_t savedGraph;
+	const AI_SavedGraph_t *pSavedGraph = NULL;
+	if ( !engine->IsInEditMode() && ReadNetworkGraph( &savedGraph ) )
+	{
+		unsigned int geometryCRC = ComputeGeometryCRC( STRING( gpGlobals->mapname ) );
+		if ( geometryCRC && geometryCRC == savedGraph.geometryCRC )
+		{
+			pSavedGraph = &savedGraph;
+		}
+		else
+		{
+			DevMsg( 2, "Map geometry changed since the AI node graph was built\n" );
+		}
+	}
+
+	g_AINetworkBuilder.Build( m_pNetwork, pSavedGraph );
 
 	// If I'm loading for the first time save.  Otherwise I'm 
 	// doing a wc edit and I don't want to save
@@ -1909,14 +2081,9 @@ void CAI_NetworkBuilder::Rebuild( CAI_Network *pNetwork )
 	{
 		m_NeighborsTable[i].Resize( nNodes );
 	}
-	for (i = 0; i < nNodes; i++)
-	{
-		// If near point of change recalculate
-		if (ppNodes[i]->NeedsRebuild())
-		{
-			InitNeighbors( pNetwork, ppNodes[i] );
-		}
-	}
+
+	// If near point of change recalculate
+	InitNeighbors( pNetwork, true );
 
 	// ---------------------------
 	// Force node neighbors for dynamic links
@@ -1941,6 +2108,9 @@ void CAI_NetworkBuilder::Rebuild( CAI_Network *pNetwork )
 		}
 	}
 
+	// Links changed, so regroup
+	pNetwork->InitClusters();
+
 	EndBuild();
 }
 
@@ -1957,6 +2127,8 @@ void CAI_NetworkBuilder::EndBuild()
 {
 	m_NeighborsTable.SetSize(0);
 	m_DidSetNeighborsTable.Resize(0);
+	m_FitTable.RemoveAll();
+	m_StandTable.RemoveAll();
 	CAI_TestHull::ReturnTestHull();
 }
 
@@ -1966,7 +2138,7 @@ void CAI_NetworkBuilder::EndBuild()
 //-----------------------------------------------------------------------------
 
 
-void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
+void CAI_NetworkBuilder::Build( CAI_Network *pNetwork, const AI_SavedGraph_t *pSavedGraph )
 {
 	int nNodes = pNetwork->NumNodes();
 	CAI_Node **ppNodes = pNetwork->AccessNodes();
@@ -1997,6 +2169,19 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	timer.End();
 	Msg( "...done initializing node positions. %f seconds\n", timer.GetDuration().GetSeconds() );
 
+	// ---------------------------
+	// Keep what still holds of the old graph
+	// ---------------------------
+	bool bIncremental = ( pSavedGraph != NULL );
+	if ( bIncremental )
+	{
+		Msg( "Matching nodes against the saved graph...\n" );
+		timer.Start();
+		int nRebuild = ReuseSavedGraph( pNetwork, *pSavedGraph );
+		timer.End();
+		Msg( "...done matching nodes, %d of %d need rebuilding. %f seconds\n", nRebuild, nNodes, timer.GetDuration().GetSeconds() );
+	}
+
 	// ---------------------------
 	// Initialize node neighbors
 	// ---------------------------
@@ -2010,10 +2195,7 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 		m_NeighborsTable[i].Resize( nNodes );
 		m_NeighborsTable[i].ClearAllBits();
 	}
-	for (i = 0; i < nNodes; i++)
-	{	
-		InitNeighbors( pNetwork, ppNodes[i] );
-	}
+	InitNeighbors( pNetwork, bIncremental );
 	timer.End();
 	Msg( "...done initializing node neighbors. %f seconds\n", timer.GetDuration().GetSeconds() );
 
@@ -2031,14 +2213,20 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	// ---------------------------
 	Msg( "Determining links...\n" );
 	timer.Start();
-	for (i = 0; i < nNodes; i++)
-	{	
-		// Make sure all the links are clear
-		ppNodes[i]->m_iNumLinks = 0;
+	if ( !bIncremental )
+	{
+		for (i = 0; i < nNodes; i++)
+		{	
+			// Make sure all the links are clear
+			ppNodes[i]->m_iNumLinks = 0;
+		}
 	}
 	for (i = 0; i < nNodes; i++)
 	{	
-		InitLinks( pNetwork, ppNodes[i] );
+		if ( !bIncremental || ppNodes[i]->NeedsRebuild() )
+		{
+			InitLinks( pNetwork, ppNodes[i] );
+		}
 	}
 	timer.End();
 	Msg( "...done determining links. %f seconds\n", timer.GetDuration().GetSeconds() );
@@ -2050,10 +2238,25 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	timer.Start();
 	InitZones( pNetwork);
 	timer.End();
-	masterTimer.End();
 	Msg( "...done determining zones. %f seconds\n", timer.GetDuration().GetSeconds() );
+
+	// ------------------------------
+	// Group the nodes for pathfinding
+	// ------------------------------
+	Msg( "Determining clusters...\n" );
+	timer.Start();
+	pNetwork->InitClusters();
+	timer.End();
+	masterTimer.End();
+	Msg( "...done determining clusters. %d clusters, %f seconds\n", pNetwork->NumClusters(), timer.GetDuration().GetSeconds() );
 	Msg( "...done building AI node graph, %f seconds\n", masterTimer.GetDuration().GetSeconds() );
 
+	// The flags get saved with the nodes
+	for (i = 0; i < nNodes; i++)
+	{
+		ppNodes[i]->ClearNeedsRebuild();
+	}
+
 	EndBuild();
 }
 
@@ -2513,101 +2716,319 @@ void CAI_NetworkBuilder::InitVisibility(CAI_Network *pNetwork, CAI_Node *pNode)
 
 
 //-----------------------------------------------------------------------------
-// Purpose: Initializes the neighbors list
-// Input  :
-// Output :
+// Purpose: Initializes the neighbors lists of all the nodes, or of only those
+//			that need rebuilding. The visibility traces all run first, here.
+//			Pruning a list only reads the network and writes that list, so the
+//			lists are then pruned on the thread pool.
 //-----------------------------------------------------------------------------
 
-void CAI_NetworkBuilder::InitNeighbors(CAI_Network *pNetwork, CAI_Node *pNode)
+struct PruneNeighborsContext_t
 {
-	m_NeighborsTable[pNode->m_iID].ClearAllBits();
-	
-	// Begin by establishing viewability to limit the number of nodes tested
-	InitVisibility( pNetwork, pNode );
+	CAI_NetworkBuilder	*pBuilder;
+	CAI_Network			*pNetwork;
+	CUtlVector<int>		nodes;
+};
 
+void CAI_NetworkBuilder::InitNeighbors(CAI_Network *pNetwork, bool bRebuildOnly)
+{
+	PruneNeighborsContext_t context;
+	context.pBuilder = this;
+	context.pNetwork = pNetwork;
+
+	for (int i = 0; i < pNetwork->NumNodes(); i++)
 	{
+		CAI_Node *pNode = pNetwork->GetNode( i );
+		if ( bRebuildOnly && !pNode->NeedsRebuild() )
+			continue;
+
+		m_NeighborsTable[i].ClearAllBits();
+	
+		// Begin by establishing viewability to limit the number of nodes tested
+		InitVisibility( pNetwork, pNode );
+
+		// Nodes after this one use its visibility instead of tracing again
+		m_DidSetNeighborsTable.SetBit( i );
+		context.nodes.AddToTail( i );
+	}
+
 	AI_PROFILE_SCOPE( CAI_Node_InitNeighbors );
+	ThreadPool()->ParallelProcess( PruneNeighborsItem, &context, context.nodes.Count() );
+}
 
-	// Now check each neighbor against all other neighbors to see if one of
-	// them is a redundant connection
-	for (int checknode = 0; checknode < pNetwork->NumNodes(); checknode++ )
-	{
-		if ( DebuggingConnect( pNode->m_iID, checknode ) )
-		{
-			Msg( "" ); // break here..
-		}
+void CAI_NetworkBuilder::PruneNeighborsItem( void *pContext, int nItem )
+{
+	PruneNeighborsContext_t *pPrune = (PruneNeighborsContext_t *)pContext;
+	pPrune->pBuilder->PruneNeighbors( pPrune->pNetwork, pPrune->pNetwork->GetNode( pPrune->nodes[nItem] ) );
+}
 
-		// I'm not a neighbor of myself
-		if ( pNode->m_iID == checknode )
-		{
-			m_NeighborsTable[pNode->m_iID].ClearBit(checknode);
+//-----------------------------------------------------------------------------
+// Purpose: Checks each neighbor against all the other neighbors to see if one 
+//			of them is a redundant connection. Runs on any thread.
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuilder::PruneNeighbors(CAI_Network *pNetwork, CAI_Node *pNode)
+{
+	CBitString &neighbors = m_NeighborsTable[pNode->m_iID];
+
+	// I'm not a neighbor of myself
+	neighbors.ClearBit( pNode->m_iID );
+
+	// Gather the neighbors and their directions once. Bits only get cleared
+	// below, so walking this list in order and checking the bits as we go
+	// tests the same pairs as walking every node in the network.
+	int nNodes = pNetwork->NumNodes();
+	int *pNeighbors = (int *)stackalloc( nNodes * sizeof(int) );
+	Vector *pDirs = (Vector *)stackalloc( nNodes * sizeof(Vector) );
+	float *pDists = (float *)stackalloc( nNodes * sizeof(float) );
+	int nNeighbors = 0;
+
+	int i;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		if ( !neighbors.GetBit( i ) )
 			continue;
-		}
 
-		// Only check if already on the neightbor list
-		if (!m_NeighborsTable[pNode->m_iID].GetBit(checknode)) 
-		{
+		pNeighbors[nNeighbors] = i;
+		pDirs[nNeighbors] = pNetwork->GetNode( i )->GetOrigin() - pNode->m_vOrigin;
+		pDists[nNeighbors] = VectorNormalize( pDirs[nNeighbors] );
+		nNeighbors++;
+	}
+
+	for ( i = 0; i < nNeighbors; i++ )
+	{
+		int checknode = pNeighbors[i];
+
+		// Only check if still on the neighbor list
+		if ( !neighbors.GetBit( checknode ) )
 			continue;
-		}
 
-		CAI_Node *pCheckNode = pNetwork->GetNode(checknode);
+		// ----------------------------------------------------------
+		// If climb node, don't consider redundancy
+		// ----------------------------------------------------------
+		CAI_Node *pCheckNode = pNetwork->GetNode( checknode );
+		if ( pCheckNode->GetType() == NODE_CLIMB )
+			continue;
 
-		for (int testnode = 0; testnode < pNetwork->NumNodes(); testnode++ )
+		for ( int j = 0; j < nNeighbors; j++ )
 		{
-			// don't check against itself
-			if (( testnode == checknode ) || (testnode == pNode->m_iID))
-			{
-				continue;
-			}
+			int testnode = pNeighbors[j];
 
-			// Only check if already on the neightbor list
-			if (!m_NeighborsTable[pNode->m_iID].GetBit(testnode)) 
-			{
+			// don't check against itself, only check if still on the neighbor list
+			if ( testnode == checknode || !neighbors.GetBit( testnode ) )
 				continue;
-			}
 
 			// ----------------------------------------------------------
 			//  Don't check air nodes against nodes of a different types
 			// ----------------------------------------------------------
-			if ((pNetwork->GetNode(checknode)->GetType() == NODE_AIR && pNetwork->GetNode(testnode)->GetType() != NODE_AIR)||
-				(pNetwork->GetNode(checknode)->GetType() != NODE_AIR && pNetwork->GetNode(testnode)->GetType() == NODE_AIR))
-			{
+			CAI_Node *pTestNode = pNetwork->GetNode( testnode );
+			if ( ( pCheckNode->GetType() == NODE_AIR ) != ( pTestNode->GetType() == NODE_AIR ) )
 				continue;
-			}
 
-			// ----------------------------------------------------------
-			// If climb node, don't consider redundancy
-			// ----------------------------------------------------------
-			if (pNetwork->GetNode(checknode)->GetType() == NODE_CLIMB) 
+			if ( DotProduct( pDirs[i], pDirs[j] ) >= 0.92388 ) // 45 degrees
 			{
-				continue;
+				if ( pDists[j] < pDists[i] )
+				{
+					neighbors.ClearBit( checknode );
+				}
+				else
+				{
+					neighbors.ClearBit( testnode );
+				}
 			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Matches the spawned nodes against the nodes of a graph built with 
+//			the same geometry, and carries over the links between nodes that
+//			are outside the reach of any node that was added, moved or 
+//			removed. Those nodes are left flagged as needing a rebuild.
+// Output : The number of nodes to rebuild
+//-----------------------------------------------------------------------------
+
+static bool NodeMatchesSaved( CAI_Node *pNode, const AI_SavedNode_t &savedNode )
+{
+	// Duplicate nodes are deleted when the neighbors are found
+	if ( pNode->GetType() != savedNode.type && savedNode.type != NODE_DELETED )
+		return false;
+
+	if ( pNode->m_eNodeInfo != savedNode.info )
+		return false;
+
+	// The .ain only keeps two decimals
+	if ( !VectorsAreEqual( pNode->GetOrigin(), savedNode.origin, 0.01 ) || fabs( pNode->GetYaw() - savedNode.yaw ) > 0.001 )
+		return false;
+
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		if ( fabs( pNode->m_flVOffset[hull] - savedNode.vOffset[hull] ) > 0.01 )
+			return false;
+	}
+
+	return true;
+}
+
+static bool SavedGraphHasLink( const AI_SavedGraph_t &savedGraph, int srcID, int destID )
+{
+	for ( int i = 0; i < savedGraph.links.Count(); i++ )
+	{
+		const AI_SavedLink_t &savedLink = savedGraph.links[i];
+		if ( ( savedLink.srcID == srcID && savedLink.destID == destID ) || 
+			 ( savedLink.srcID == destID && savedLink.destID == srcID ) )
+			return true;
+	}
+	return false;
+}
 
-			CAI_Node *pTestNode = pNetwork->GetNode(testnode);
+int CAI_NetworkBuilder::ReuseSavedGraph( CAI_Network *pNetwork, const AI_SavedGraph_t &savedGraph )
+{
+	int nNodes = pNetwork->NumNodes();
+	int nSaved = savedGraph.nodes.Count();
+	CAI_Node **ppNodes = pNetwork->AccessNodes();
 
-			Vector	 vec2DirToCheckNode = pCheckNode->GetOrigin() - pNode->m_vOrigin; 
-			float	 flDistToCheckNode  = VectorNormalize( vec2DirToCheckNode );
+	CUtlVector<int> nodeToSaved;
+	CUtlVector<int> savedToNode;
+	nodeToSaved.SetCount( nNodes );
+	savedToNode.SetCount( nSaved );
 
-			Vector	 vec2DirToTestNode = ( pTestNode->GetOrigin() - pNode->m_vOrigin ); 
-			float	 flDistToTestNode  = VectorNormalize( vec2DirToTestNode );
+	int i;
+	for ( i = 0; i < nSaved; i++ )
+	{
+		savedToNode[i] = NO_NODE;
+	}
 
-			if ( DotProduct ( vec2DirToCheckNode, vec2DirToTestNode ) >= 0.92388 ) // 45 degrees
+	// ---------------------------
+	// Pair up identical nodes. Usually they have the same ID, or all the IDs
+	// after an added or removed node are off by the same amount.
+	// ---------------------------
+	int iNextGuess = 0;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		nodeToSaved[i] = NO_NODE;
+
+		int guesses[2] = { i, iNextGuess };
+		int j;
+		for ( j = 0; j < 2; j++ )
+		{
+			int iSaved = guesses[j];
+			if ( iSaved < nSaved && savedToNode[iSaved] == NO_NODE && NodeMatchesSaved( ppNodes[i], savedGraph.nodes[iSaved] ) )
 			{
-				if ( flDistToTestNode < flDistToCheckNode )
-				{
-					m_NeighborsTable[pNode->m_iID].ClearBit(checknode);
-				}
-				else
+				nodeToSaved[i] = iSaved;
+				break;
+			}
+		}
+
+		if ( nodeToSaved[i] == NO_NODE )
+		{
+			for ( j = 0; j < nSaved; j++ )
+			{
+				if ( savedToNode[j] == NO_NODE && NodeMatchesSaved( ppNodes[i], savedGraph.nodes[j] ) )
 				{
-					m_NeighborsTable[pNode->m_iID].ClearBit(testnode);
+					nodeToSaved[i] = j;
+					break;
 				}
 			}
 		}
+
+		if ( nodeToSaved[i] != NO_NODE )
+		{
+			savedToNode[nodeToSaved[i]] = i;
+			iNextGuess = nodeToSaved[i] + 1;
+
+			if ( savedGraph.nodes[nodeToSaved[i]].type == NODE_DELETED )
+			{
+				ppNodes[i]->SetType( NODE_DELETED );
+			}
+		}
 	}
-	
-	} // profile scope
 
-	m_DidSetNeighborsTable.SetBit(pNode->m_iID);
+	// ---------------------------
+	// Everything within link distance of an added, moved or removed node
+	// may link differently now
+	// ---------------------------
+	CUtlVector<Vector> changed;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		if ( nodeToSaved[i] == NO_NODE )
+		{
+			changed.AddToTail( ppNodes[i]->GetOrigin() );
+		}
+	}
+	for ( i = 0; i < nSaved; i++ )
+	{
+		if ( savedToNode[i] == NO_NODE )
+		{
+			changed.AddToTail( savedGraph.nodes[i].origin );
+		}
+	}
+
+	// As do the ends of dynamic links that weren't linked before
+	for ( CAI_DynamicLink *pDynamicLink = CAI_DynamicLink::m_pAllDynamicLinks; pDynamicLink; pDynamicLink = pDynamicLink->m_pNextDynamicLink )
+	{
+		int nSrcID = g_pAINetworkManager->GetEditOps()->GetNodeIdFromWCId( pDynamicLink->m_nSrcID );
+		int nDestID = g_pAINetworkManager->GetEditOps()->GetNodeIdFromWCId( pDynamicLink->m_nDestID );
+		if ( nSrcID < 0 || nSrcID >= nNodes || nDestID < 0 || nDestID >= nNodes )
+			continue;
+
+		if ( nodeToSaved[nSrcID] == NO_NODE || nodeToSaved[nDestID] == NO_NODE )
+			continue;
+
+		if ( !SavedGraphHasLink( savedGraph, nodeToSaved[nSrcID], nodeToSaved[nDestID] ) )
+		{
+			changed.AddToTail( ppNodes[nSrcID]->GetOrigin() );
+			changed.AddToTail( ppNodes[nDestID]->GetOrigin() );
+		}
+	}
+
+	int nRebuild = 0;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		CAI_Node *pNode = ppNodes[i];
+		float flMaxDistSqr = ( pNode->GetType() == NODE_AIR ) ? MAX_AIR_NODE_LINK_DIST_SQ : MAX_NODE_LINK_DIST_SQ;
+
+		bool bRebuild = ( nodeToSaved[i] == NO_NODE );
+		for ( int j = 0; !bRebuild && j < changed.Count(); j++ )
+		{
+			if ( ( pNode->GetOrigin() - changed[j] ).LengthSqr() < flMaxDistSqr )
+			{
+				bRebuild = true;
+			}
+		}
+
+		if ( bRebuild )
+		{
+			pNode->SetNeedsRebuild();
+			nRebuild++;
+		}
+	}
+
+	// ---------------------------
+	// Carry over the links unless both ends are being rebuilt
+	// ---------------------------
+	for ( i = 0; i < savedGraph.links.Count(); i++ )
+	{
+		const AI_SavedLink_t &savedLink = savedGraph.links[i];
+		int srcID = savedToNode[savedLink.srcID];
+		int destID = savedToNode[savedLink.destID];
+		if ( srcID == NO_NODE || destID == NO_NODE )
+			continue;
+
+		if ( ppNodes[srcID]->NeedsRebuild() && ppNodes[destID]->NeedsRebuild() )
+			continue;
+
+		CAI_Link *pLink = new CAI_Link;
+		pLink->m_iSrcID = srcID;
+		pLink->m_iDestID = destID;
+		for ( int hull = 0; hull < NUM_HULLS; hull++ )
+		{
+			pLink->m_iAcceptedMoveTypes[hull] = savedLink.acceptedMoveTypes[hull];
+		}
+		ppNodes[srcID]->AddLink( pLink );
+		ppNodes[destID]->AddLink( pLink );
+	}
+
+	return nRebuild;
 }
 
 //-----------------------------------------------------------------------------
@@ -2676,14 +3097,13 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 	// ==============================================================
 	// FIRST CHECK IF HULL CAN EVEN FIT AT THESE NODES
 	// ==============================================================
-	// @Note (toml 02-10-03): this should be optimized, caching the results of CanFitAtNode() 
-	if ( !m_pTestHull->GetNavigator()->CanFitAtNode(srcId,MASK_NPCWORLDSTATIC) )
+	if ( !CanFitAtNode( srcId, hull ) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", srcId );
 		return 0;
 	}
 	
-	if ( !m_pTestHull->GetNavigator()->CanFitAtNode(destId,MASK_NPCWORLDSTATIC) )
+	if ( !CanFitAtNode( destId, hull ) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", destId );
 		return 0;
@@ -2769,13 +3189,13 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 		Vector srcPos	 = pSrcNode->GetPosition(hull);
 		Vector destPos	 = pDestNode->GetPosition(hull);
 
-		if (!m_pTestHull->GetMoveProbe()->CheckStandPosition( srcPos, MASK_NPCWORLDSTATIC))
+		if (!CanStandAtNode( pSrcNode, hull ))
 		{
 			DebugConnectMsg( srcId, destId, "      Failed to stand at %d\n", srcId );
 			fStandFailed = true;
 		}
 
-		if (!m_pTestHull->GetMoveProbe()->CheckStandPosition( destPos, MASK_NPCWORLDSTATIC))
+		if (!CanStandAtNode( pDestNode, hull ))
 		{
 			DebugConnectMsg( srcId, destId, "      Failed to stand at %d\n", destId );
 			fStandFailed = true;
@@ -2848,6 +3268,41 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 
 
 
+//-------------------------------------
+// Every pair a node is in tests whether each hull fits and can stand at
+// the node, so only test once. Call with the test hull set to hull.
+//-------------------------------------
+
+bool CAI_NetworkBuilder::CanFitAtNode( int nodeID, Hull_t hull )
+{
+	int index = nodeID * NUM_HULLS + hull;
+	while ( m_FitTable.Count() <= index )
+	{
+		m_FitTable.AddToTail( -1 );
+	}
+
+	if ( m_FitTable[index] == -1 )
+	{
+		m_FitTable[index] = m_pTestHull->GetNavigator()->CanFitAtNode( nodeID, MASK_NPCWORLDSTATIC ) ? 1 : 0;
+	}
+	return ( m_FitTable[index] != 0 );
+}
+
+bool CAI_NetworkBuilder::CanStandAtNode( CAI_Node *pNode, Hull_t hull )
+{
+	int index = pNode->m_iID * NUM_HULLS + hull;
+	while ( m_StandTable.Count() <= index )
+	{
+		m_StandTable.AddToTail( -1 );
+	}
+
+	if ( m_StandTable[index] == -1 )
+	{
+		m_StandTable[index] = m_pTestHull->GetMoveProbe()->CheckStandPosition( pNode->GetPosition( hull ), MASK_NPCWORLDSTATIC ) ? 1 : 0;
+	}
+	return ( m_StandTable[index] != 0 );
+}
+
 //-------------------------------------
 
 void CAI_NetworkBuilder::InitLinks(CAI_Network *pNetwork, CAI_Node *pNode)
@@ -20,6 +20,37 @@ class CAI_Node;
 class CAI_Link;
 class CAI_TestHull;
 
+//-----------------------------------------------------------------------------
+// The contents of a .ain file. Used to load the network, and when the file is
+// out of date but the map's geometry isn't, to rebuild only the parts of the 
+// network around nodes that were added, moved or removed.
+//-----------------------------------------------------------------------------
+
+struct AI_SavedNode_t
+{
+	Vector	origin;
+	float	yaw;
+	float	vOffset[NUM_HULLS];
+	int		type;
+	int		info;
+	int		zone;
+};
+
+struct AI_SavedLink_t
+{
+	int		srcID;
+	int		destID;
+	int		acceptedMoveTypes[NUM_HULLS];
+};
+
+struct AI_SavedGraph_t
+{
+	unsigned int				geometryCRC;	// Of everything in the .bsp but the node entities
+	CUtlVector<AI_SavedNode_t>	nodes;
+	CUtlVector<AI_SavedLink_t>	links;
+	CUtlVector<int>				wcIDs;			// Hammer ID of each node
+};
+
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
 //
@@ -64,6 +95,8 @@ private:
 	void			RebuildThink();
 	void			SaveNetworkGraph( void) ;	
 	static bool		IsAIFileCurrent( const char *szMapName );		
+	static bool		ReadNetworkGraph( AI_SavedGraph_t *pGraph );
+	static unsigned int ComputeGeometryCRC( const char *szMapName );
 	
 	static bool				gm_fNetworksLoaded;							// Have AINetworks been loaded
 	
@@ -80,7 +113,7 @@ private:
 class CAI_NetworkBuilder
 {
 public:
-	void			Build( CAI_Network *pNetwork );
+	void			Build( CAI_Network *pNetwork, const AI_SavedGraph_t *pSavedGraph = NULL );
 	void			Rebuild( CAI_Network *pNetwork );
 
 	void			InitNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
@@ -88,7 +121,10 @@ public:
 private:
 	void			InitZones( CAI_Network *pNetwork );
 	void			InitVisibility( CAI_Network *pNetwork, CAI_Node *pNode );
-	void			InitNeighbors( CAI_Network *pNetwork, CAI_Node *pNode );
+	void			InitNeighbors( CAI_Network *pNetwork, bool bRebuildOnly );
+	void			PruneNeighbors( CAI_Network *pNetwork, CAI_Node *pNode );
+	static void		PruneNeighborsItem( void *pContext, int nItem );
+	int				ReuseSavedGraph( CAI_Network *pNetwork, const AI_SavedGraph_t &savedGraph );
 	void			InitClimbNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
 	void			InitGroundNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
 	void			InitLinks( CAI_Network *pNetwork, CAI_Node *pNode );
@@ -97,6 +133,8 @@ private:
 	void			FloodFillZone( CAI_Node **ppNodes, CAI_Node *pNode, int zone );
 
 	int				ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull );
+	bool			CanFitAtNode( int nodeID, Hull_t hull );
+	bool			CanStandAtNode( CAI_Node *pNode, Hull_t hull );
 	
 	void 			BeginBuild();
 	void			EndBuild();
@@ -104,6 +142,11 @@ private:
 	CUtlVector<CBitString>	m_NeighborsTable;
 	CBitString				m_DidSetNeighborsTable;
 	CAI_TestHull *			m_pTestHull;
+
+	// Per node and hull results of the tests ComputeConnection makes for 
+	// both ends of every pair, -1 until tested
+	CUtlVector<char>		m_FitTable;
+	CUtlVector<char>		m_StandTable;
 };
 
 extern CAI_NetworkBuilder g_AINetworkBuilder;
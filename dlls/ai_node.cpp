@@ -256,5 +256,6 @@ CAI_Node::CAI_Node( int id, const Vector &origin, float yaw  )
 	m_flNextUseTime			= 0;
 
 	m_zone = AI_NODE_ZONE_UNKNOWN;
+	m_iCluster = -1;
 };
 
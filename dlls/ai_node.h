@@ -107,6 +107,9 @@ public:
 
 	int 			GetZone() const			{ return m_zone; }
 	void 			SetZone( int zone )		{ m_zone = zone; }
+
+	int				GetCluster() const		{ return m_iCluster; }
+	void			SetCluster( int cluster ) { m_iCluster = cluster; }
 	
 	Vector			GetPosition(int hull);		// Hull specific position for a node
 	CAI_Link*		HasLink(int nNodeID);				// Return link to nNodeID or NULL
@@ -143,6 +146,7 @@ public:
 	CUtlVector<CAI_Link *> m_Links;		// growable array of links to this node
 
 	int				m_zone;
+	int				m_iCluster;				// Cluster in the network's hierarchical graph, -1 if not built yet
 
 public:
 	
@@ -20,6 +20,7 @@
 #include "ai_moveprobe.h"
 #include "ai_dynamiclink.h"
 #include "bitstring.h"
+#include "tier0/fasttimer.h"
 
 //@todo: bad dependency!
 #include "ai_navigator.h"
@@ -28,6 +29,83 @@
 
 const float MAX_LOCAL_NAV = 50 * 12;
 
+ConVar ai_path_hierarchical( "ai_path_hierarchical", "1", 0, "Only search the nodes in clusters along a route through the network's cluster graph" );
+ConVar ai_path_cache( "ai_path_cache", "1", 0, "Share node paths between NPCs of the same class, hull and move capabilities" );
+ConVar ai_path_cache_time( "ai_path_cache_time", "3", 0, "Seconds a shared node path can be reused for" );
+
+//-----------------------------------------------------------------------------
+// Node paths found by FindBestPath, shared by all NPCs of a class with the
+// same hull and move capabilities, so a squad closing in on one target pays
+// for one search. Entries die when the network's path generation moves on
+// (dynamic links switching, graph rebuilds) or when they get old, and every
+// NPC re-checks the nodes and links along a path before taking it.
+//-----------------------------------------------------------------------------
+
+#define AI_PATH_CACHE_SIZE	64		// Per hull, power of two
+
+struct AI_CachedPath_t
+{
+	string_t			iszClass;
+	int					capabilities;
+	int					startID;
+	int					endID;
+	int					generation;
+	float				flTime;
+	CUtlVector<short>	nodes;			// Start to end, empty if the entry is unused
+};
+
+static AI_CachedPath_t g_AIPathCache[NUM_HULLS][AI_PATH_CACHE_SIZE];
+
+struct AIPathStats_t
+{
+	int		m_nSearches;
+	int		m_nCacheHits;
+	int		m_nCacheExpired;
+	int		m_nCacheRejected;		// Found but not usable by the asking NPC
+	int		m_nCorridorSearches;
+	int		m_nCorridorMisses;		// Fell back to searching the whole network
+	int		m_nNoClusterRoute;
+	int		m_nNodesExpanded;
+	float	m_flSearchMs;
+};
+
+static AIPathStats_t g_AIPathStats;
+
+static AI_CachedPath_t &PathCacheEntry( Hull_t hull, string_t iszClass, int capabilities, int startID, int endID )
+{
+	unsigned int hash = ( (unsigned int)startID * 2654435761u ) ^ ( (unsigned int)endID * 40503u ) ^ (unsigned int)capabilities;
+	hash ^= (unsigned int)( (size_t)STRING( iszClass ) >> 4 );
+	hash ^= hash >> 16;
+	return g_AIPathCache[hull][hash & ( AI_PATH_CACHE_SIZE - 1 )];
+}
+
+CON_COMMAND( ai_path_stats, "Node pathfinding and shared path cache stats. 'ai_path_stats reset' clears them" )
+{
+	if ( engine->Cmd_Argc() > 1 && !Q_stricmp( engine->Cmd_Argv( 1 ), "reset" ) )
+	{
+		memset( &g_AIPathStats, 0, sizeof(g_AIPathStats) );
+		Msg( "AI path stats reset.\n" );
+		return;
+	}
+
+	if ( g_pBigAINet )
+	{
+		Msg( "Network: %d nodes, %d clusters, %d portal nodes%s\n", g_pBigAINet->NumNodes(),
+			g_pBigAINet->NumClusters(), g_pBigAINet->NumPortalNodes(), g_pBigAINet->HasClusters() ? "" : " (out of date)" );
+	}
+
+	const AIPathStats_t &stats = g_AIPathStats;
+	int nSearched = stats.m_nSearches - stats.m_nCacheHits;
+	Msg( "Paths: %d asked for, %d from the cache (%.1f%%), %d cached paths expired, %d not usable by the asking NPC\n",
+		stats.m_nSearches, stats.m_nCacheHits, stats.m_nSearches ? 100.0f * stats.m_nCacheHits / stats.m_nSearches : 0.0f,
+		stats.m_nCacheExpired, stats.m_nCacheRejected );
+	Msg( "Searches: %d through cluster corridors, %d corridor misses, %d with no cluster route\n",
+		stats.m_nCorridorSearches, stats.m_nCorridorMisses, stats.m_nNoClusterRoute );
+	Msg( "Nodes expanded: %d (%.1f per search), %.2f ms total, %.3f ms per path\n",
+		stats.m_nNodesExpanded, nSearched > 0 ? (float)stats.m_nNodesExpanded / nSearched : 0.0f,
+		stats.m_flSearchMs, stats.m_nSearches ? stats.m_flSearchMs / stats.m_nSearches : 0.0f );
+}
+
 //-----------------------------------------------------------------------------
 // CAI_Pathfinder
 //
@@ -223,6 +301,99 @@ bool CAI_Pathfinder::IsLinkStillStale(int moveType, CAI_Link *nodeLink)
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Looks for a path another NPC like this one found recently, and
+//			builds a route from it if this NPC can use every node and link
+//			along it
+//-----------------------------------------------------------------------------
+
+AI_Waypoint_t *CAI_Pathfinder::FindCachedPath(int startID, int endID)
+{
+	if ( !ai_path_cache.GetBool() )
+		return NULL;
+
+	string_t iszClass = GetOuter()->m_iClassname;
+	int capabilities = CapabilitiesGet();
+	AI_CachedPath_t &entry = PathCacheEntry( GetHullType(), iszClass, capabilities, startID, endID );
+
+	if ( !entry.nodes.Count() || entry.startID != startID || entry.endID != endID || 
+		 entry.capabilities != capabilities || entry.iszClass != iszClass )
+		return NULL;
+
+	if ( entry.generation != GetNetwork()->GetPathGeneration() || 
+		 gpGlobals->curtime - entry.flTime > ai_path_cache_time.GetFloat() )
+	{
+		entry.nodes.RemoveAll();
+		g_AIPathStats.m_nCacheExpired++;
+		return NULL;
+	}
+
+	CAI_Node **pAInode = GetNetwork()->AccessNodes();
+	int *nodeP = (int *)stackalloc( GetNetwork()->NumNodes() * sizeof(int) );
+
+	int prevID = NO_NODE;
+	for ( int i = 0; i < entry.nodes.Count(); i++ )
+	{
+		int nodeID = entry.nodes[i];
+
+		if ( GetOuter()->IsUnusableNode( nodeID, pAInode[nodeID]->GetHint() ) )
+		{
+			g_AIPathStats.m_nCacheRejected++;
+			return NULL;
+		}
+
+		if ( prevID != NO_NODE )
+		{
+			CAI_Link *pLink = pAInode[prevID]->HasLink( nodeID );
+			if ( !pLink || !IsLinkUsable( pLink, prevID ) )
+			{
+				g_AIPathStats.m_nCacheRejected++;
+				return NULL;
+			}
+		}
+
+		nodeP[nodeID] = prevID;
+		prevID = nodeID;
+	}
+
+	g_AIPathStats.m_nCacheHits++;
+	return MakeRouteFromParents( nodeP, endID );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Stores the path SearchNodes found for other NPCs like this one
+//-----------------------------------------------------------------------------
+
+void CAI_Pathfinder::CachePath(int startID, int endID, const int *parentArray)
+{
+	if ( !ai_path_cache.GetBool() )
+		return;
+
+	string_t iszClass = GetOuter()->m_iClassname;
+	int capabilities = CapabilitiesGet();
+	AI_CachedPath_t &entry = PathCacheEntry( GetHullType(), iszClass, capabilities, startID, endID );
+
+	int nPathNodes = 0;
+	int nodeID;
+	for ( nodeID = endID; nodeID != NO_NODE; nodeID = parentArray[nodeID] )
+	{
+		nPathNodes++;
+	}
+
+	entry.iszClass = iszClass;
+	entry.capabilities = capabilities;
+	entry.startID = startID;
+	entry.endID = endID;
+	entry.generation = GetNetwork()->GetPathGeneration();
+	entry.flTime = gpGlobals->curtime;
+	entry.nodes.SetCount( nPathNodes );
+
+	for ( nodeID = endID; nodeID != NO_NODE; nodeID = parentArray[nodeID] )
+	{
+		entry.nodes[--nPathNodes] = nodeID;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Build a path between two nodes
 //-----------------------------------------------------------------------------
@@ -236,6 +407,68 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 	m_nPerfStatPB++;
 #endif
 
+	CFastTimer timer;
+	timer.Start();
+	g_AIPathStats.m_nSearches++;
+
+	AI_Waypoint_t *pRoute = FindCachedPath( startID, endID );
+	if ( !pRoute )
+	{
+		int *nodeP = (int *)stackalloc( GetNetwork()->NumNodes() * sizeof(int) );
+		bool bFound = false;
+		bool bNoRoute = false;
+
+		// Search the clusters a route through the cluster graph passes, and 
+		// their neighbors, first. Only if that fails search everything.
+		if ( ai_path_hierarchical.GetBool() && GetNetwork()->HasClusters() &&
+			 GetNetwork()->GetNode( startID )->GetCluster() != GetNetwork()->GetNode( endID )->GetCluster() )
+		{
+			CBitString corridor( GetNetwork()->NumClusters() );
+			if ( GetNetwork()->BuildClusterCorridor( startID, endID, GetHullType(), CapabilitiesGet(), &corridor ) )
+			{
+				g_AIPathStats.m_nCorridorSearches++;
+				bFound = SearchNodes( startID, endID, &corridor, nodeP );
+				if ( !bFound )
+				{
+					g_AIPathStats.m_nCorridorMisses++;
+				}
+			}
+			else
+			{
+				g_AIPathStats.m_nNoClusterRoute++;
+				bNoRoute = true;
+			}
+		}
+
+		if ( !bFound && !bNoRoute )
+		{
+			bFound = SearchNodes( startID, endID, NULL, nodeP );
+		}
+
+		if ( bFound )
+		{
+			pRoute = MakeRouteFromParents( nodeP, endID );
+			if ( pRoute )
+			{
+				CachePath( startID, endID, nodeP );
+			}
+		}
+	}
+
+	timer.End();
+	g_AIPathStats.m_flSearchMs += timer.GetDuration().GetMillisecondsF();
+
+	return pRoute;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A* over the nodes, skipping any outside the clusters marked in 
+//			pCorridor if one is given. On success parentArray holds the path 
+//			back from endID.
+//-----------------------------------------------------------------------------
+
+bool CAI_Pathfinder::SearchNodes(int startID, int endID, const CBitString *pCorridor, int *parentArray) 
+{
 	int nNodes = GetNetwork()->NumNodes();
 	CAI_Node **pAInode = GetNetwork()->AccessNodes();
 
@@ -246,7 +479,7 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 	float* nodeG = (float *)stackalloc( nNodes * sizeof(float) );
 	float* nodeH = (float *)stackalloc( nNodes * sizeof(float) );
 	float* nodeF = (float *)stackalloc( nNodes * sizeof(float) );
-	int*   nodeP = (int *)stackalloc( nNodes * sizeof(int) );		// Node parent 
+	int*   nodeP = parentArray;		// Node parent 
 
 	for (int node=0;node<nNodes;node++)
 	{
@@ -268,6 +501,7 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 		int smallestID = CAI_Network::FindBSSmallest(&openBS,nodeF,nNodes);
 	
 		openBS.ClearBit(smallestID);
+		g_AIPathStats.m_nNodesExpanded++;
 
 		CAI_Node *pSmallestNode = pAInode[smallestID];
 		
@@ -275,10 +509,7 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 			continue;
 
 		if (smallestID == endID) 
-		{
-			AI_Waypoint_t* route = MakeRouteFromParents(&nodeP[0], endID);
-			return route;
-		}
+			return true;
 
 		// Check this if the node is immediately in the path after the startNode 
 		// that it isn't blocked
@@ -293,6 +524,9 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 			int moveType = nodeLink->m_iAcceptedMoveTypes[GetHullType()] & CapabilitiesGet();
 			int testID	 = nodeLink->DestNodeID(smallestID);
 
+			if ( pCorridor && !pCorridor->GetBit( pAInode[testID]->GetCluster() ) )
+				continue;
+
 			Vector r1 = pSmallestNode->GetPosition(GetHullType());
 			Vector r2 = pAInode[testID]->GetPosition(GetHullType());
 			float dist   = GetOuter()->GetNavigator()->MovementCost( moveType, r1, r2 ); // MovementCost takes ref parameters!!
@@ -315,7 +549,7 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 		}
 	}
 
-	return NULL;   
+	return false;   
 }
 
 //-----------------------------------------------------------------------------
@@ -21,6 +21,7 @@ struct AI_Waypoint_t;
 class CAI_Link;
 class CAI_Network;
 class CAI_Node;
+class CBitString;
 
 
 //-----------------------------------------------------------------------------
@@ -94,6 +95,10 @@ private:
 
 	//---------------------------------
 	
+	bool			SearchNodes(int startID, int endID, const CBitString *pCorridor, int *parentArray);
+	AI_Waypoint_t*	FindCachedPath(int startID, int endID);
+	void			CachePath(int startID, int endID, const int *parentArray);
+
 	AI_Waypoint_t*	MakeRouteFromParents(int *parentArray, int endID);
 	AI_Waypoint_t*	CreateNodeWaypoint( Hull_t hullType, int nodeID, int nodeFlags = 0 );
 
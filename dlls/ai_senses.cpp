@@ -347,9 +347,12 @@ int CAI_Senses::LookForHighPriorityEntities( int iDistance )
 		float distSq = ( iDistance * iDistance );
 		const Vector &origin = GetLocalOrigin();
 		
-		// Players
-		for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+		// Players, only the ones that were close enough if the gather ran
+		bool bGathered = HasGatheredCandidates( iDistance );
+		int nPlayers = ( bGathered ) ? m_nGatheredPlayers : gpGlobals->maxClients;
+		for ( int j = 0; j < nPlayers; j++ )
 		{
+			int i = ( bGathered ) ? m_GatheredPlayers[j] + 1 : j + 1;
 			CBaseEntity *pPlayer = UTIL_PlayerByIndex( i );
 
 			if ( pPlayer )
@@ -408,9 +411,19 @@ int CAI_Senses::LookForNPCs( int iDistance )
 		float distSq = ( iDistance * iDistance );
 		const Vector &origin = GetLocalOrigin();
 		CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+
+		// The gathered candidates are in list order, so the seen list comes
+		// out the same either way
+		bool bGathered = HasGatheredCandidates( iDistance );
+		int nAIs = ( bGathered ) ? m_nGatheredAIs : g_AI_Manager.NumAIs();
+		if ( bGathered )
+			g_AI_Manager.GatherStats().m_nLooksGathered++;
+		else
+			g_AI_Manager.GatherStats().m_nLooksSerial++;
 		
-		for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+		for ( int j = 0; j < nAIs; j++ )
 		{
+			int i = ( bGathered ) ? m_GatheredAIs[j] : j;
 #if OTHER_IMPORTANT_ENTITIES_NOT_BAKED
 			if ( ppAIs[i] != GetOuter()->GetTarget() && ppAIs[i] != GetOuter()->GetEnemy() )
 #endif
@@ -492,6 +505,64 @@ int CAI_Senses::LookForObjects( int iDistance )
 	return nSeen;
 }
 
+//-----------------------------------------------------------------------------
+// The gather only narrows down who to look at. The looks still test the
+// live distances, so the result only differs from a serial look if something
+// moved further than the margin between the gather and the think.
+//-----------------------------------------------------------------------------
+
+bool CAI_Senses::PrepareGather( int nAIs, int nPlayers )
+{
+	m_iGatherTick = -1;
+	if ( !m_HighPriorityTimer.Expired() && !m_NPCsTimer.Expired() )
+		return false;
+
+	m_GatheredAIs.SetCount( nAIs );
+	m_GatheredPlayers.SetCount( nPlayers );
+	m_nGatheredAIs = 0;
+	m_nGatheredPlayers = 0;
+	m_vecGatherOrigin = GetLocalOrigin();
+	m_iGatherLookDist = (int)m_LookDist;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_Senses::GatherCandidates( const AISenseSnapshot_t &snapshot )
+{
+	float flRange = m_iGatherLookDist + snapshot.m_flMargin;
+	float flRangeSq = flRange * flRange;
+	int i;
+
+	for ( i = 0; i < snapshot.m_nAIs; i++ )
+	{
+		if ( m_vecGatherOrigin.DistToSqr( snapshot.m_pAIOrigins[i] ) < flRangeSq )
+		{
+			m_GatheredAIs[m_nGatheredAIs++] = i;
+		}
+	}
+
+	for ( i = 0; i < snapshot.m_nPlayers; i++ )
+	{
+		if ( snapshot.m_pPlayerValid[i] && m_vecGatherOrigin.DistToSqr( snapshot.m_pPlayerOrigins[i] ) < flRangeSq )
+		{
+			m_GatheredPlayers[m_nGatheredPlayers++] = i;
+		}
+	}
+
+	m_iGatherAIChanges = snapshot.m_iAIChanges;
+	m_iGatherTick = gpGlobals->tickcount;
+}
+
+//-----------------------------------------------------------------------------
+
+bool CAI_Senses::HasGatheredCandidates( int iDistance ) const
+{
+	return ( m_iGatherTick == gpGlobals->tickcount && 
+			 m_iGatherLookDist == iDistance && 
+			 m_iGatherAIChanges == g_AI_Manager.ChangeCount() );
+}
+
 //-----------------------------------------------------------------------------
 
 CSound* CAI_Senses::GetFirstHeardSound( AISoundIter_t *pIter )
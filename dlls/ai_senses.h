@@ -24,6 +24,20 @@ class CSound;
 DECLARE_POINTER_HANDLE( AISightIter_t );
 DECLARE_POINTER_HANDLE( AISoundIter_t );
 
+//-------------------------------------
+// Positions taken on the main thread for the parallel gather
+
+struct AISenseSnapshot_t
+{
+	const Vector *	m_pAIOrigins;			// in g_AI_Manager order
+	int				m_nAIs;
+	const Vector *	m_pPlayerOrigins;		// by player index - 1
+	const bool *	m_pPlayerValid;
+	int				m_nPlayers;
+	int				m_iAIChanges;			// g_AI_Manager.ChangeCount() when taken
+	float			m_flMargin;				// how far things may move before the look
+};
+
 //-----------------------------------------------------------------------------
 // class CAI_ScriptConditions
 //
@@ -40,7 +54,12 @@ public:
 		m_iAudibleList(0),
 		m_HighPriorityTimer(0.15),	// every other thinks (5Hz)
 		m_NPCsTimer(0.25),			// every third think (~3Hz)
-		m_MiscTimer(0.45)			// every fifth think (2Hz)
+		m_MiscTimer(0.45),			// every fifth think (2Hz)
+		m_nGatheredAIs(0),
+		m_nGatheredPlayers(0),
+		m_iGatherTick(-1),
+		m_iGatherAIChanges(-1),
+		m_iGatherLookDist(-1)
 	{
 		m_SeenArrays[0] = &m_SeenHighPriority;
 		m_SeenArrays[1] = &m_SeenNPCs;
@@ -67,6 +86,14 @@ public:
 	CSound *		GetNextHeardSound( AISoundIter_t *pIter );
 	CSound *		GetClosestSound( bool fScent = false );
 
+	//---------------------------------
+	// ai_parallel_think. PrepareGather runs on the main thread and returns
+	// false if the next look won't need candidates. GatherCandidates only
+	// reads the snapshot and writes this object, so it can run on any thread.
+
+	bool			PrepareGather( int nAIs, int nPlayers );
+	void			GatherCandidates( const AISenseSnapshot_t &snapshot );
+
 	//---------------------------------
 
 	DECLARE_SIMPLE_DATADESC();
@@ -87,6 +114,8 @@ private:
 	int 			LookForObjects( int iDistance );
 	
 	bool			SeeEntity( CBaseEntity *pEntity );
+
+	bool			HasGatheredCandidates( int iDistance ) const;
 	
 	float			m_LookDist;				// distance npc sees (Default 2048)
 	float			m_LastLookDist;
@@ -103,6 +132,16 @@ private:
 	CSimTimer		m_HighPriorityTimer;
 	CSimTimer		m_NPCsTimer;
 	CSimTimer		m_MiscTimer;
+
+	// NPCs and players that were within look distance plus the margin when gathered
+	CUtlVector<short> m_GatheredAIs;
+	CUtlVector<short> m_GatheredPlayers;
+	int				m_nGatheredAIs;
+	int				m_nGatheredPlayers;
+	int				m_iGatherTick;
+	int				m_iGatherAIChanges;
+	int				m_iGatherLookDist;
+	Vector			m_vecGatherOrigin;
 };
 
 //-----------------------------------------------------------------------------
@@ -20,7 +20,7 @@
 // Init static variables
 //-----------------------------------------------------------------------------
 
-DEFINE_FIXEDSIZE_ALLOCATOR( AI_Waypoint_t, WAYPOINT_POOL_SIZE, CMemoryPool::GROW_FAST );
+DEFINE_FIXEDSIZE_ALLOCATOR_MT( AI_Waypoint_t, WAYPOINT_POOL_SIZE, CMemoryPool::GROW_FAST );
 
 //-------------------------------------
 
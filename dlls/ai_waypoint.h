@@ -144,7 +144,7 @@ private:
 	// it's not maintained when the waypoint list is modified.
 	AI_Waypoint_t *pPrev;
 
-	DECLARE_FIXEDSIZE_ALLOCATOR(AI_Waypoint_t);
+	DECLARE_FIXEDSIZE_ALLOCATOR_MT(AI_Waypoint_t);
 
 };
 
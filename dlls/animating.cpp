@@ -43,6 +43,8 @@ class CIKSaveRestoreOps : public CClassPtrSaveRestoreOps
 
 static CIKSaveRestoreOps s_IKSaveRestoreOp;
 
+ConVar sv_posecache( "sv_posecache", "1", 0, "Reuse an entity's decompressed sequence poses while its sequence, cycle and pose parameters don't change." );
+
 
 BEGIN_DATADESC( CBaseAnimating )
 
@@ -115,11 +117,13 @@ CBaseAnimating::CBaseAnimating()
 
 	m_bClientSideAnimation = false;
 	m_pIk = NULL;
+	m_pPoseCache = NULL;
 }
 
 CBaseAnimating::~CBaseAnimating()
 {
 	delete m_pIk;
+	delete m_pPoseCache;
 }
 
 void CBaseAnimating::UseClientSideAnimation()
@@ -1650,6 +1654,22 @@ void CBaseAnimating::GetVelocity(Vector *vVelocity, QAngle *vAngVelocity)
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: The entity's cache of recent single sequence poses, created the
+//			first time its bones are set up. NULL if sv_posecache is off.
+//-----------------------------------------------------------------------------
+CBonePoseCache *CBaseAnimating::GetPoseCache( void )
+{
+	if ( !sv_posecache.GetBool() )
+		return NULL;
+
+	if ( !m_pPoseCache )
+	{
+		m_pPoseCache = new CBonePoseCache;
+	}
+	return m_pPoseCache;
+}
+
 //=========================================================
 //=========================================================
 
@@ -1662,7 +1682,7 @@ void CBaseAnimating::GetSkeleton( Vector pos[], Quaternion q[], int boneMask )
 		return;
 	}
 
-	CalcPose( pStudioHdr, m_pIk, pos, q, m_nSequence, m_flCycle, GetPoseParameterArray(), boneMask );
+	CalcPose( pStudioHdr, m_pIk, pos, q, m_nSequence, m_flCycle, GetPoseParameterArray(), boneMask, 1.0f, GetPoseCache() );
 
 	if ( m_pIk )
 	{
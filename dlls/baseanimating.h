@@ -25,6 +25,7 @@ struct animevent_t;
 struct studiocache_t;
 struct matrix3x4_t;
 class CIKContext;
+class CBonePoseCache;
 
 class CBaseAnimating : public CBaseEntity
 {
@@ -107,6 +108,7 @@ public:
 	bool    CanBecomeRagdoll( void ); //Check if this entity will ragdoll when dead.
 
 	virtual	void GetSkeleton( Vector pos[], Quaternion q[], int boneMask );
+	CBonePoseCache *GetPoseCache( void );
 
 	virtual void GetBoneTransform( int iBone, matrix3x4_t &pBoneToWorld );
 	virtual void SetupBones( matrix3x4_t *pBoneToWorld, int boneMask );
@@ -271,6 +273,7 @@ public:
 
 protected:
 	CIKContext			*m_pIk;
+	CBonePoseCache		*m_pPoseCache;
 
 private:
 
@@ -34,6 +34,8 @@
 #include "tier0/vprof.h"
 #include "engine/IStaticPropMgr.h"
 #include "physics_prop_ragdoll.h"
+#include "vstdlib/random.h"
+#include "tier0/fasttimer.h"
 
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -41,6 +43,11 @@
 
 ConVar phys_timescale( "phys_timescale", "1" );
 ConVar phys_speeds( "phys_speeds", "0" );
+ConVar phys_sleep_speed( "phys_sleep_speed", "0", 0, "Objects slower than this (in/s, rotation included) for a moment go to sleep, 0 = off" );
+ConVar phys_sleep_island_speed( "phys_sleep_island_speed", "0", 0, "Touching objects whose mass weighted speed is below this (in/s) go to sleep together, 0 = off" );
+ConVar phys_sleep_wake_ramp_time( "phys_sleep_wake_ramp_time", "1", 0, "Seconds after waking during which objects go back to sleep at a higher speed" );
+ConVar phys_sleep_wake_ramp_scale( "phys_sleep_wake_ramp_scale", "4", 0, "Sleep speed multiplier right after waking" );
+ConVar phys_broadphase( "phys_broadphase", "0", 0, "Broadphase of the physics environment, takes effect on level load. 0 = octree, 1 = bounding box tree" );
 extern ConVar phys_rolling_drag;
 
 // defined in phys_constraint
@@ -277,7 +284,7 @@ const char *PhysCheck( IPhysicsObject *pPhys )
 
 void CPhysicsHook::LevelInitPreEntity() 
 {
-	physenv = physics->CreateEnvironment();
+	physenv = physics->CreateEnvironmentEx( phys_broadphase.GetInt() == 1 ? PHYSICS_BROADPHASE_BVH : PHYSICS_BROADPHASE_OVTREE );
 	physenv->EnableDeleteQueue( true );
 
 	physenv->SetCollisionSolver( &g_Collisions );
@@ -778,6 +785,138 @@ CON_COMMAND(physics_report_active, "Lists all active physics objects")
 	IterateActivePhysicsEntities( CallbackReport );
 }
 
+CON_COMMAND( phys_sleepstats, "Print how many physics objects are awake and how long they spent awake and asleep since the last reset. 'phys_sleepstats reset' clears the counters." )
+{
+	if ( !physenv )
+		return;
+
+	physsleepstats_t stats;
+	bool bReset = ( engine->Cmd_Argc() > 1 && !Q_stricmp( engine->Cmd_Argv( 1 ), "reset" ) );
+	physenv->GetSleepStats( stats, bReset );
+	if ( bReset )
+	{
+		Msg( "Physics sleep stats reset.\n" );
+		return;
+	}
+
+	Msg( "Objects: %d moveable, %d awake (%d moving, %d settling), %d asleep\n",
+		stats.objects, stats.awake, stats.awake - stats.settling, stats.settling, stats.objects - stats.awake );
+
+	float flTotal = stats.awakeSeconds + stats.asleepSeconds;
+	if ( flTotal > 0 )
+	{
+		Msg( "Object time: %.1f%% moving, %.1f%% settling, %.1f%% asleep or static\n",
+			100.0f * ( stats.awakeSeconds - stats.settlingSeconds ) / flTotal, 100.0f * stats.settlingSeconds / flTotal, 100.0f * stats.asleepSeconds / flTotal );
+	}
+	if ( stats.awakeSeconds > 0 )
+	{
+		Msg( "Simulate: %.1f ms total, %.3f ms per awake object second\n", stats.simulateMS, stats.simulateMS / stats.awakeSeconds );
+	}
+	Msg( "%d sleeps, %d wakes, %d islands slept (%d by island speed), %d objects slept by speed\n",
+		stats.sleeps, stats.wakes, stats.islandsSlept, stats.islandsSleptByEnergy, stats.objectsCalmByEnergy );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Stress test for the broadphases. Fills a scratch environment with
+//			spheres flying around a box (no gravity, no drag, walls reflect
+//			them) and times the same scene with each broadphase.
+//-----------------------------------------------------------------------------
+static void BenchBroadphase( physbroadphase_t broadphase, const char *pName, int nObjects, int nSteps )
+{
+	const float flBoxSize = 40.0f * sqrt( (float)nObjects );
+	const float flRadius = 8.0f;
+	const float flSpeed = 200.0f;
+
+	IPhysicsEnvironment *pEnv = physics->CreateEnvironmentEx( broadphase );
+	pEnv->SetGravity( vec3_origin );
+	pEnv->SetSimulationTimestep( 0.015 );
+
+	objectparams_t params = g_PhysDefaultObjectParams;
+	params.damping = 0;
+	params.rotdamping = 0;
+	params.dragCoefficient = 0;
+
+	// the same scene for every broadphase
+	CUniformRandomStream randomStream;
+	randomStream.SetSeed( 1 );
+
+	int materialIndex = physprops->GetSurfaceIndex( "default" );
+	CUtlVector<IPhysicsObject *> objects;
+	objects.EnsureCapacity( nObjects );
+	for ( int i = 0; i < nObjects; i++ )
+	{
+		Vector pos( randomStream.RandomFloat( 0, flBoxSize ), randomStream.RandomFloat( 0, flBoxSize ), randomStream.RandomFloat( 0, flBoxSize ) );
+		Vector vel( randomStream.RandomFloat( -1, 1 ), randomStream.RandomFloat( -1, 1 ), randomStream.RandomFloat( -1, 1 ) );
+		vel *= flSpeed;
+
+		IPhysicsObject *pObject = pEnv->CreateSphereObject( flRadius, materialIndex, pos, vec3_angle, &params, false );
+		pObject->EnableDrag( false );
+		pObject->SetVelocity( &vel, NULL );
+		pObject->Wake();
+		objects.AddToTail( pObject );
+	}
+
+	physbroadphasestats_t start, end;
+	pEnv->GetBroadphaseStats( start );
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int step = 0; step < nSteps; step++ )
+	{
+		pEnv->Simulate( 0.015 );
+
+		for ( int i = 0; i < nObjects; i++ )
+		{
+			Vector pos, vel;
+			objects[i]->GetPosition( &pos, NULL );
+			objects[i]->GetVelocity( &vel, NULL );
+			bool bReflect = false;
+			for ( int k = 0; k < 3; k++ )
+			{
+				if ( ( pos[k] < 0 && vel[k] < 0 ) || ( pos[k] > flBoxSize && vel[k] > 0 ) )
+				{
+					vel[k] = -vel[k];
+					bReflect = true;
+				}
+			}
+			if ( bReflect )
+			{
+				objects[i]->SetVelocity( &vel, NULL );
+			}
+		}
+	}
+	timer.End();
+	pEnv->GetBroadphaseStats( end );
+
+	for ( int i = 0; i < nObjects; i++ )
+	{
+		pEnv->DestroyObject( objects[i] );
+	}
+	physics->DestroyEnvironment( pEnv );
+
+	float flSeconds = timer.GetDuration().GetSeconds();
+	if ( flSeconds <= 0 )
+	{
+		flSeconds = 1e-6f;
+	}
+	int nUpdates = end.updates - start.updates;
+	int nPairs = end.pairs - start.pairs;
+	Msg( "%-8s %8.3f ms/step %10.0f updates/sec %10.0f pairs/sec (%d updates, %d pairs)\n",
+		pName, flSeconds * 1000.0f / nSteps, nUpdates / flSeconds, nPairs / flSeconds, nUpdates, nPairs );
+}
+
+CON_COMMAND( bench_physbroadphase, "Time the physics broadphases on a scene of moving spheres. Usage: bench_physbroadphase [objects] [steps]" )
+{
+	int nObjects = ( engine->Cmd_Argc() > 1 ) ? atoi( engine->Cmd_Argv( 1 ) ) : 1000;
+	int nSteps = ( engine->Cmd_Argc() > 2 ) ? atoi( engine->Cmd_Argv( 2 ) ) : 200;
+	nObjects = clamp( nObjects, 1, 20000 );
+	nSteps = max( nSteps, 1 );
+
+	Msg( "%d spheres, %d steps\n", nObjects, nSteps );
+	BenchBroadphase( PHYSICS_BROADPHASE_OVTREE, "octree", nObjects, nSteps );
+	BenchBroadphase( PHYSICS_BROADPHASE_BVH, "bvh", nObjects, nSteps );
+}
+
 // Advance physics by time (in seconds)
 void PhysFrame( float deltaTime )
 {
@@ -812,6 +951,14 @@ void PhysFrame( float deltaTime )
 		simRealTime = engine->Time();
 	}
 	g_Collisions.BufferTouchEvents( true );
+
+	physsleepparams_t sleepParams;
+	sleepParams.sleepSpeed = phys_sleep_speed.GetFloat();
+	sleepParams.islandSleepSpeed = phys_sleep_island_speed.GetFloat();
+	sleepParams.wakeRampTime = phys_sleep_wake_ramp_time.GetFloat();
+	sleepParams.wakeRampScale = phys_sleep_wake_ramp_scale.GetFloat();
+	physenv->SetSleepParams( sleepParams );
+
 	physenv->Simulate( deltaTime );
 
 	int activeCount = physenv->GetActiveObjectCount();
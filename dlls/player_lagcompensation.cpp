@@ -9,11 +9,14 @@
 #include "usercmd.h"
 #include "igamesystem.h"
 #include "ilagcompensationmanager.h"
+#include "bitvec.h"
+#include "tier0/fasttimer.h"
 
 static ConVar sv_unlag("sv_unlag", "1", FCVAR_SERVER );
 static ConVar sv_maxunlag("sv_maxunlag"	, "0.5", FCVAR_NONE );
 static ConVar sv_unlagpush("sv_unlagpush"	, "0.0", FCVAR_NONE );
 static ConVar sv_unlagsamples("sv_unlagsamples", "1", FCVAR_NONE );
+static ConVar sv_unlag_cone("sv_unlag_cone", "45", FCVAR_NONE, "Only move back players within this many degrees of where the shooter is aiming, 0 moves everyone" );
 
 #define LC_NONE				0
 #define LC_ALIVE			(1<<0)
@@ -28,16 +31,20 @@ static ConVar sv_unlagsamples("sv_unlagsamples", "1", FCVAR_NONE );
 #define LAG_COMPENSATION_ERROR_EPS_SQR ( 4.0f * 4.0f )
 // Only keep 1 second of data
 #define LAG_COMPENSATION_DATA_TIME	1.0f
+// Records kept per player, a power of two. Past 256 fps the history covers less than a second.
+#define LAG_COMPENSATION_MAX_RECORDS	256
+#define LAG_COMPENSATION_RECORD_MASK	( LAG_COMPENSATION_MAX_RECORDS - 1 )
+// Players this close to the shooter get moved whatever the direction
+#define LAG_COMPENSATION_NEAR_DIST	128.0f
 
 //-----------------------------------------------------------------------------
-// Purpose: 
+// Purpose: What was changed on a player, and what to put back
 //-----------------------------------------------------------------------------
 struct LagRecord
 {
 public:
 	LagRecord()
 	{
-		m_nPlayerIndex = 0;
 		m_fFlags = 0;
 		m_vecOrigin.Init();
 		m_vecAngles.Init();
@@ -47,7 +54,6 @@ public:
 	}
 	LagRecord( const LagRecord& src )
 	{
-		m_nPlayerIndex = src.m_nPlayerIndex;
 		m_fFlags = src.m_fFlags;
 		m_vecOrigin = src.m_vecOrigin;
 		m_vecAngles = src.m_vecAngles;
@@ -57,9 +63,7 @@ public:
 	}
 
 	bool					m_bActive;
-	// Which player this belongs to
-	int						m_nPlayerIndex;
-	// Did player die this frame
+	// What got changed
 	int						m_fFlags;
 
 	// Player position, orientation and bbox
@@ -67,38 +71,63 @@ public:
 	QAngle					m_vecAngles;
 	Vector					m_vecMins;
 	Vector					m_vecMaxs;
-
-	// Fixme, do we care about animation frame?
-	// float				m_flFrame;
-	// int					m_nSequence;
 };
 
 //-----------------------------------------------------------------------------
-// Purpose: 
+// Purpose: One player's recent history in a ring, newest record at m_iHead.
+//			Each field has its own array so searching by time only touches 
+//			the times.
 //-----------------------------------------------------------------------------
-class LagCompensationContext
+class CLagHistory
 {
 public:
-	LagCompensationContext()
-	{ 
-		m_flRecordTime = 0.0f;
-		memset( m_Records, 0, sizeof( m_Records ) );
+	CLagHistory()
+	{
+		Reset();
 	}
-	LagCompensationContext( const LagCompensationContext& src )
+
+	void Reset()
 	{
-		m_flRecordTime = src.m_flRecordTime;
-		int i;
-		for ( i = 0; i < MAX_CLIENTS; i++ )
-		{
-			m_Records[ i ] = src.m_Records[ i ];
-		}
+		m_iHead = 0;
+		m_nCount = 0;
+		m_nValid = 0;
 	}
-	// Timestamp record was created (at end of frame?)
-	float			m_flRecordTime;
-	LagRecord		m_Records[ MAX_CLIENTS ];	
+
+	// Slot of the record n frames back from the newest
+	int				Slot( int n ) const		{ return ( m_iHead - n ) & LAG_COMPENSATION_RECORD_MASK; }
+
+	void			AddRecord( float flTime, CBasePlayer *pPlayer );
+	void			DecayRecords( float flDeadTime );
+	bool			FindSpanningRecords( float flTargetTime, int *newer, int *older ) const;
+
+	int				m_iHead;
+	int				m_nCount;
+	// Records back from the newest with no death, respawn or teleport between them
+	int				m_nValid;
+
+	float			m_flTime[ LAG_COMPENSATION_MAX_RECORDS ];
+	int				m_fFlags[ LAG_COMPENSATION_MAX_RECORDS ];
+	Vector			m_vecOrigin[ LAG_COMPENSATION_MAX_RECORDS ];
+	QAngle			m_vecAngles[ LAG_COMPENSATION_MAX_RECORDS ];
+	Vector			m_vecMins[ LAG_COMPENSATION_MAX_RECORDS ];
+	Vector			m_vecMaxs[ LAG_COMPENSATION_MAX_RECORDS ];
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Totals reported by sv_unlag_stats
+//-----------------------------------------------------------------------------
+struct LagCompensationStats_t
+{
+	int		m_nCommands;		// commands that wanted lag compensation
+	int		m_nConsidered;		// other players looked at for them
+	int		m_nLostTrack;		// with no unbroken history back to the target time
+	int		m_nCulled;			// outside the shot cone
+	int		m_nMoved;			// actually moved back
+	int		m_nMaxMoved;		// most moved back for one command
+	float	m_flStartMs;
+};
 
+static LagCompensationStats_t g_LagCompensationStats;
 
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -107,14 +136,12 @@ class CLagCompensationManager : public CAutoGameSystem, public ILagCompensationM
 {
 public:
 	// IServerSystem stuff
-	virtual void Shutdown()
-	{
-		m_Data.Purge();
-	}
-
 	virtual void LevelShutdownPostEntity()
 	{
-		m_Data.RemoveAll();
+		for ( int i = 0; i < MAX_CLIENTS; i++ )
+		{
+			m_History[ i ].Reset();
+		}
 	}
 
 	// called after entities think
@@ -128,14 +155,11 @@ public:
 
 private:
 	float			GetLatency( CBasePlayer *player );
-	void			DecayStaleContextData( void );
-
-	bool			FindSpanningContexts( float targettime, int *context1, int *context2 );
 
-	CUtlVector< LagCompensationContext >	m_Data;
+	CLagHistory		m_History[ MAX_CLIENTS ];
 
 	// Scratchpad for determining what needs to be restored
-	unsigned int	restorebits;
+	CBitVec<MAX_CLIENTS>	restorebits;
 	bool			m_bNeedToRestore;
 	enum
 	{
@@ -168,90 +192,115 @@ float CLagCompensationManager::GetLatency ( CBasePlayer *player )
 	return ping;
 }
 
-void CLagCompensationManager::DecayStaleContextData( void )
+//-----------------------------------------------------------------------------
+// Purpose: Pushes the player's current state
+//-----------------------------------------------------------------------------
+void CLagHistory::AddRecord( float flTime, CBasePlayer *pPlayer )
 {
-	float deadtime = gpGlobals->realtime - LAG_COMPENSATION_DATA_TIME;
+	int fFlags = pPlayer->IsAlive() ? LC_ALIVE : 0;
+	const Vector &vecOrigin = pPlayer->GetLocalOrigin();
 
-	int c = m_Data.Size();
-	int i;
-	for ( i = c - 1; i >= 0; i-- )
+	// Dying, respawning or teleporting breaks the chain, there's nothing to interpolate across them
+	bool bContinuous = false;
+	if ( m_nCount > 0 )
 	{
-		LagCompensationContext *context = &m_Data[ i ];
-		if ( context->m_flRecordTime >= deadtime )
-			continue;
+		bool bSameState = !( ( m_fFlags[ m_iHead ] ^ fFlags ) & LC_ALIVE );
+		Vector delta = vecOrigin - m_vecOrigin[ m_iHead ];
+		bContinuous = bSameState && delta.LengthSqr() <= LAG_COMPENSATION_TELEPORTED_DISTANCE_SQR;
+	}
+
+	m_iHead = ( m_iHead + 1 ) & LAG_COMPENSATION_RECORD_MASK;
+	m_nCount = min( m_nCount + 1, LAG_COMPENSATION_MAX_RECORDS );
+	m_nValid = bContinuous ? min( m_nValid + 1, m_nCount ) : 1;
+
+	m_flTime[ m_iHead ]		= flTime;
+	m_fFlags[ m_iHead ]		= fFlags;
+	m_vecOrigin[ m_iHead ]	= vecOrigin;
+	m_vecAngles[ m_iHead ]	= pPlayer->GetLocalAngles();
+	m_vecMins[ m_iHead ]	= pPlayer->WorldAlignMins();
+	m_vecMaxs[ m_iHead ]	= pPlayer->WorldAlignMaxs();
+}
 
-		m_Data.Remove( i );
+void CLagHistory::DecayRecords( float flDeadTime )
+{
+	while ( m_nCount > 0 && m_flTime[ Slot( m_nCount - 1 ) ] < flDeadTime )
+	{
+		m_nCount--;
 	}
+	m_nValid = min( m_nValid, m_nCount );
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Called once per frame after all entities have had a chance to think
+// Purpose: Finds the slots of the records either side of the target time. 
+//			Fails if there's a break in the history before the target time.
 //-----------------------------------------------------------------------------
-void CLagCompensationManager::FrameUpdatePostEntityThink()
+bool CLagHistory::FindSpanningRecords( float flTargetTime, int *newer, int *older ) const
 {
-	DecayStaleContextData();
+	Assert( older && newer );
 
-	LagCompensationContext context;
-	context.m_flRecordTime = gpGlobals->realtime;
+	if ( m_nValid < 2 )
+		return false;
 
-	// Iterate all active players
-	int i;
-	for ( i = 1; i <= gpGlobals->maxClients; i++ )
+	// Times fall going back, so binary search for the newest record at or before the target
+	int lo = 0;
+	int hi = m_nValid;
+	while ( lo < hi )
 	{
-		CBasePlayer *pPlayer = ToBasePlayer( UTIL_PlayerByIndex( i ) );
-		if ( !pPlayer )
-			continue;
-
-		LagRecord *record = &context.m_Records[ i - 1 ];
-		record->m_bActive = true;
-		record->m_nPlayerIndex = pPlayer->entindex();
-		record->m_fFlags = 0;
-		if ( pPlayer->IsAlive() )
+		int mid = ( lo + hi ) / 2;
+		if ( m_flTime[ Slot( mid ) ] <= flTargetTime )
+		{
+			hi = mid;
+		}
+		else
 		{
-			record->m_fFlags |= LC_ALIVE;
+			lo = mid + 1;
 		}
-		record->m_vecAngles			= pPlayer->GetLocalAngles();
-		record->m_vecOrigin			= pPlayer->GetLocalOrigin();
-		record->m_vecMaxs			= pPlayer->WorldAlignMaxs();
-		record->m_vecMins			= pPlayer->WorldAlignMins();
 	}
 
-	m_Data.AddToHead( context );
+	if ( lo == m_nValid )
+	{
+		// Further back than the chain goes. If it was broken the player can't be put back there.
+		if ( m_nValid < m_nCount )
+			return false;
+
+		// Otherwise we just ran out of history, use the oldest
+		lo = m_nValid - 1;
+	}
+	else if ( lo == 0 )
+	{
+		// Newer than anything recorded, use the newest
+		lo = 1;
+	}
+
+	*newer = Slot( lo - 1 );
+	*older = Slot( lo );
+	return true;
 }
 
-bool CLagCompensationManager::FindSpanningContexts( float targettime, int *newer, int *older )
+//-----------------------------------------------------------------------------
+// Purpose: Called once per frame after all entities have had a chance to think
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::FrameUpdatePostEntityThink()
 {
-	Assert( older && newer );
-	*newer = -1;
-	*older = -1;
-
-	int count = m_Data.Size();
-	if ( count < 2 )
-		return false;
+	float deadtime = gpGlobals->realtime - LAG_COMPENSATION_DATA_TIME;
 
+	// Iterate all active players
 	int i;
-	int j;
-	for ( i = 0; i < count - 1; i++ )
+	for ( i = 1; i <= gpGlobals->maxClients; i++ )
 	{
-		j = i + 1;
-
-		// New items are pushed onto front of stack
-		LagCompensationContext *c1, *c2;
-		c1 = &m_Data[ i ]; // newer
-		c2 = &m_Data[ j ]; // older
+		CLagHistory *history = &m_History[ i - 1 ];
 
-		if ( targettime >= c2->m_flRecordTime && 
-			 targettime <= c1->m_flRecordTime )
+		CBasePlayer *pPlayer = ToBasePlayer( UTIL_PlayerByIndex( i ) );
+		if ( !pPlayer )
 		{
-			*newer = i;
-			*older = j;
-			return true;
+			// Nothing before a gap can be used
+			history->Reset();
+			continue;
 		}
-	}
 
-	*newer = count - 2;
-	*older = count - 1;
-	return true;
+		history->DecayRecords( deadtime );
+		history->AddRecord( gpGlobals->realtime, pPlayer );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -281,18 +330,60 @@ static void InterpolateAngles( float frac, const QAngle& src, const QAngle& dest
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Could a shot from the eye within flConeAngle of forward hit a box
+//			at this spot? Tests the sphere around the box, so it errs on yes.
+//-----------------------------------------------------------------------------
+static bool BoxInShotCone( const Vector& eye, const Vector& forward, float flConeAngle, 
+						   const Vector& org, const Vector& mins, const Vector& maxs )
+{
+	Vector center = org + ( mins + maxs ) * 0.5f;
+	float radius = ( maxs - mins ).Length() * 0.5f;
+
+	Vector dir = center - eye;
+	float dist = VectorNormalize( dir );
+
+	// The shooter's own movement this command could bring close players into the cone
+	if ( dist <= radius + LAG_COMPENSATION_NEAR_DIST )
+		return true;
+
+	// Angle off the aim to the center, less the angle the sphere covers
+	float angle = acos( clamp( DotProduct( dir, forward ), -1.0f, 1.0f ) );
+	return ( angle - asin( radius / dist ) <= flConeAngle );
+}
+
+CON_COMMAND( sv_unlag_stats, "Players moved back by lag compensation per command. 'sv_unlag_stats reset' clears them" )
+{
+	if ( engine->Cmd_Argc() > 1 && !Q_stricmp( engine->Cmd_Argv( 1 ), "reset" ) )
+	{
+		memset( &g_LagCompensationStats, 0, sizeof(g_LagCompensationStats) );
+		Msg( "Lag compensation stats reset.\n" );
+		return;
+	}
+
+	const LagCompensationStats_t &stats = g_LagCompensationStats;
+	float flCommands = max( stats.m_nCommands, 1 );
+	Msg( "Commands: %d compensated, %.2f ms total, %.4f ms per command\n",
+		stats.m_nCommands, stats.m_flStartMs, stats.m_flStartMs / flCommands );
+	Msg( "Players per command: %.2f looked at, %.2f without history, %.2f outside the shot cone, %.2f moved (%d at most)\n",
+		stats.m_nConsidered / flCommands, stats.m_nLostTrack / flCommands, stats.m_nCulled / flCommands,
+		stats.m_nMoved / flCommands, stats.m_nMaxMoved );
+}
+
 // Called during player movement to set up/restore after lag compensation
 void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCmd *cmd )
 {
 	// Assume no players need to be restored
-	restorebits = 0UL;
+	restorebits.ClearAll();
 	m_bNeedToRestore = false;
-	memset( restoreData, 0, sizeof( restoreData ) );
 
 	// Player not wanting lag compensation
 	if ( !cmd->lag_compensation )
 		return;
 
+	CFastTimer timer;
+	timer.Start();
+
 	// Get true latency
 	float latency = GetLatency( player ) / 1000.0f;
 
@@ -339,19 +430,14 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 	// Cap target to present time, of course
 	targettime = min( realtime, targettime );
 
-	int newer = -1;
-	int older = -1;
+	// Where this command's shots can go. Only players that could be in the way get moved.
+	float flConeAngle = DEG2RAD( sv_unlag_cone.GetFloat() );
+	bool bCull = ( sv_unlag_cone.GetFloat() > 0.0f && sv_unlag_cone.GetFloat() < 180.0f );
+	Vector eye = player->EyePosition();
+	Vector forward;
+	AngleVectors( cmd->viewangles, &forward );
 
-	if ( !FindSpanningContexts( targettime, &newer, &older ) )
-	{
-		return;
-	}
-
-	// Couldn't find suitable span!!!
-	if ( newer == -1 || older == -1 )
-	{
-		return;
-	}
+	int nMoved = 0;
 
 	// Iterate all active players
 	int i;
@@ -370,70 +456,24 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		}
 
 		int index = pPlayer->entindex() - 1;
+		const CLagHistory *history = &m_History[ index ];
+		g_LagCompensationStats.m_nConsidered++;
 
-		// Walk context looking for any invalidating event
-		Vector prevOrigin;
-		prevOrigin.Init();
-		bool wasAlive = true;
-
-		bool lost_track = false;
+		int newer;
+		int older;
 
-		for ( int j = 0; j <= older; j++ )
+		// Player didn't exist all the way through history to spanning records!!!
+		if ( !history->FindSpanningRecords( targettime, &newer, &older ) )
 		{
-			LagCompensationContext *context = &m_Data[ j ];
-			Assert( context );
-
-			LagRecord *record = &context->m_Records[ index ];
-
-			if ( !record->m_bActive )
-			{
-				lost_track = true;
-				break;
-			}
-
-			if ( j != 0 )
-			{
-				// Check for state change
-				bool alive = ( record->m_fFlags & LC_ALIVE ) ? true : false;
-				if ( alive ^ wasAlive )
-				{
-					// Respawned or died, stop chain here
-					lost_track = true;
-					break;
-				}
-
-				Vector delta = record->m_vecOrigin - prevOrigin;
-				if ( delta.LengthSqr() > LAG_COMPENSATION_TELEPORTED_DISTANCE_SQR )
-				{
-					lost_track = true;
-					break;
-				}
-			}
-
-			wasAlive = ( record->m_fFlags & LC_ALIVE ) ? true : false;
-			prevOrigin = record->m_vecOrigin;
-		}
-
-		// Player didn't exist all the way through history to spanning contexts!!!
-		if ( lost_track )
+			g_LagCompensationStats.m_nLostTrack++;
 			continue;
+		}
 
 		// Okay, interpolate data
-		LagCompensationContext *newcontext, *oldcontext;
-		
-		newcontext = &m_Data[ newer ];
-		oldcontext = &m_Data[ older ];
-
-		LagRecord *newrecord, *oldrecord;
-
-		newrecord = &newcontext->m_Records[ index ];
-		oldrecord = &oldcontext->m_Records[ index ];
-		Assert( oldrecord && newrecord );
-
 		float frac = 1.0f;
-		if ( oldcontext->m_flRecordTime != newcontext->m_flRecordTime )
+		if ( history->m_flTime[ older ] != history->m_flTime[ newer ] )
 		{
-			frac = ( targettime - oldcontext->m_flRecordTime ) / ( newcontext->m_flRecordTime - oldcontext->m_flRecordTime );
+			frac = ( targettime - history->m_flTime[ older ] ) / ( history->m_flTime[ newer ] - history->m_flTime[ older ] );
 			frac = clamp( frac, 0.0f, 1.0f );
 		}
 
@@ -443,10 +483,20 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		Vector mins;
 		Vector maxs;
 
-		InterpolateVector( frac, oldrecord->m_vecOrigin, newrecord->m_vecOrigin, org );
-		InterpolateAngles( frac, oldrecord->m_vecAngles, newrecord->m_vecAngles, ang );
-		InterpolateVector( frac, oldrecord->m_vecMins, newrecord->m_vecMins, mins );
-		InterpolateVector( frac, oldrecord->m_vecMaxs, newrecord->m_vecMaxs, maxs );
+		InterpolateVector( frac, history->m_vecOrigin[ older ], history->m_vecOrigin[ newer ], org );
+		InterpolateAngles( frac, history->m_vecAngles[ older ], history->m_vecAngles[ newer ], ang );
+		InterpolateVector( frac, history->m_vecMins[ older ], history->m_vecMins[ newer ], mins );
+		InterpolateVector( frac, history->m_vecMaxs[ older ], history->m_vecMaxs[ newer ], maxs );
+
+		// Hits are judged against wherever the player ends up, so only skip them 
+		// if neither where they are now nor where they'd be moved to is in the way
+		if ( bCull && 
+			 !BoxInShotCone( eye, forward, flConeAngle, org, mins, maxs ) &&
+			 !BoxInShotCone( eye, forward, flConeAngle, pPlayer->GetLocalOrigin(), pPlayer->WorldAlignMins(), pPlayer->WorldAlignMaxs() ) )
+		{
+			g_LagCompensationStats.m_nCulled++;
+			continue;
+		}
 
 		// See if this represents a change for the player
 		int flags = 0;
@@ -492,8 +542,9 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 			continue;
 		}
 
-		restorebits |= (1<<index);
+		restorebits.Set( index );
 		m_bNeedToRestore = true;
+		nMoved++;
 		restore->m_bActive = true;
 		restore->m_fFlags = flags;
 
@@ -536,6 +587,12 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		}
 		*/
 	}
+
+	timer.End();
+	g_LagCompensationStats.m_nCommands++;
+	g_LagCompensationStats.m_nMoved += nMoved;
+	g_LagCompensationStats.m_nMaxMoved = max( g_LagCompensationStats.m_nMaxMoved, nMoved );
+	g_LagCompensationStats.m_flStartMs += timer.GetDuration().GetMillisecondsF();
 }
 
 void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
@@ -543,8 +600,6 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 	if ( !m_bNeedToRestore )
 		return;
 
-	if ( restorebits == 0UL )
-		return;
 
 	// Iterate all active players
 	int i;
@@ -557,9 +612,8 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 		}
 
 		int index = pPlayer->entindex() - 1;
-		int bitmask = (1<<index);
 
-		if ( !( bitmask & restorebits ) )
+		if ( !restorebits.Get( index ) )
 		{
 			continue;
 		}
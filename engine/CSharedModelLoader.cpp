@@ -6,7 +6,11 @@
 
 #define TYPICAL_SHAREDANIMGROUP_FILESIZE 14 * 1024 * 1024 // Just about 1384588 bytes
 
-EXPOSE_SINGLE_INTERFACE( CSharedModelLoader, ISharedModelLoader, ISHAREDMODELLOADER_INTERFACE_VERSION );
+static CSharedModelLoader s_SharedModelLoader;
+EXPOSE_SINGLE_INTERFACE_GLOBALVAR( CSharedModelLoader, ISharedModelLoader, ISHAREDMODELLOADER_INTERFACE_VERSION, s_SharedModelLoader );
+
+// bone_setup.cpp is built into the engine too, for bench_bonesetup
+ISharedModelLoader *sharedmodelloader = &s_SharedModelLoader;
 
 // Always compile the shared model loader - studioanimgrouphdr_t is available for all STUDIO_VERSION values
 // This allows loading v37 animation groups regardless of compile-time STUDIO_VERSION
@@ -32,6 +32,9 @@ class CUtlBuffer;
 class IOcclusionSystem
 {
 public:
+	// Called when a new map has been loaded
+	virtual void LevelInit() = 0;
+
 	// Activate/deactivate an occluder brush model
 	virtual void ActivateOccluder( int nOccluderIndex, bool bActive ) = 0;
 
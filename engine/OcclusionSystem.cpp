@@ -21,7 +21,10 @@
 #include "gl_matsysiface.h"
 #include "glquake.h"
 #include "materialsystem/imesh.h"
+#include "materialsystem/imaterial.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
+#include <xmmintrin.h>
 
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -40,6 +43,8 @@ static ConVar r_occludermincount( "r_occludermincount", "6", 0, "At least this m
 static ConVar r_occlusionspew( "r_occlusionspew", "0", 0, "Activate/deactivates spew about what the occlusion system is doing." );
 static ConVar r_occluderminarea( "r_occluderminarea", "5", 0, "Prevents this occluder from being used if it takes up less than X% of the screen." );
 static ConVar r_occludeemaxarea( "r_occludeemaxarea", "5", 0, "Prevents occlusion testing for entities that take up more than X% of the screen." );
+static ConVar r_occlusion_depthbuffer( "r_occlusion_depthbuffer", "1", 0, "Activate/deactivate testing props + entities against a software depth buffer of the largest world faces and the occluders." );
+static ConVar r_occlusion_depthfaces( "r_occlusion_depthfaces", "128", 0, "Max number of world faces drawn into the occlusion depth buffer per view." );
 
 
 #ifdef DEBUG_OCCLUSION_SYSTEM
@@ -1892,6 +1897,300 @@ void CEdgeList::Visualize( unsigned char *pColor )
 
 
 
+//-----------------------------------------------------------------------------
+//
+// Low resolution software depth buffer. Occluder triangles are scan converted
+// four pixels at a time, keeping the nearest depth in each pixel. Afterwards
+// the farthest depth in each tile is gathered so that most box tests can be
+// answered a whole tile at a time without looking at the pixels.
+//
+// Everything is in projection space: x + y in [-1,1], z in [0,1] going away
+// from the camera.
+//
+//-----------------------------------------------------------------------------
+#define DEPTH_BUFFER_WIDTH		256
+#define DEPTH_BUFFER_HEIGHT		128
+#define DEPTH_TILE_SIZE			8
+#define DEPTH_TILES_X			( DEPTH_BUFFER_WIDTH / DEPTH_TILE_SIZE )
+#define DEPTH_TILES_Y			( DEPTH_BUFFER_HEIGHT / DEPTH_TILE_SIZE )
+#define DEPTH_MAX_POLYGON_EDGES	128
+
+class CDepthBuffer
+{
+public:
+	CDepthBuffer();
+
+	void Clear();
+
+	// Adds a convex polygon in projection space
+	void RasterizePolygon( const Vector *pVerts, int nCount );
+
+	// Computes the tile depths; call after all the triangles are in
+	void BuildTiles();
+
+	// Is every pixel the rectangle touches covered by something closer than flMinZ?
+	bool IsRectOccluded( float flMinX, float flMinY, float flMaxX, float flMaxY, float flMinZ ) const;
+
+	int PolygonCount() const;
+
+private:
+	inline float ToPixelX( float x ) const;
+	inline float ToPixelY( float y ) const;
+
+	float m_flDepth[DEPTH_BUFFER_HEIGHT][DEPTH_BUFFER_WIDTH];
+	float m_flTileMaxZ[DEPTH_TILES_Y][DEPTH_TILES_X];
+	int m_nPolygons;
+};
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+CDepthBuffer::CDepthBuffer()
+{
+	Clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Nothing drawn = nothing occluded
+//-----------------------------------------------------------------------------
+void CDepthBuffer::Clear()
+{
+	__m128 vFar = _mm_set1_ps( FLT_MAX );
+	for ( int y = 0; y < DEPTH_BUFFER_HEIGHT; ++y )
+	{
+		for ( int x = 0; x < DEPTH_BUFFER_WIDTH; x += 4 )
+		{
+			_mm_storeu_ps( &m_flDepth[y][x], vFar );
+		}
+	}
+
+	for ( int ty = 0; ty < DEPTH_TILES_Y; ++ty )
+	{
+		for ( int tx = 0; tx < DEPTH_TILES_X; ++tx )
+		{
+			m_flTileMaxZ[ty][tx] = FLT_MAX;
+		}
+	}
+
+	m_nPolygons = 0;
+}
+
+inline int CDepthBuffer::PolygonCount() const
+{
+	return m_nPolygons;
+}
+
+inline float CDepthBuffer::ToPixelX( float x ) const
+{
+	return ( x + 1.0f ) * ( 0.5f * DEPTH_BUFFER_WIDTH );
+}
+
+inline float CDepthBuffer::ToPixelY( float y ) const
+{
+	return ( y + 1.0f ) * ( 0.5f * DEPTH_BUFFER_HEIGHT );
+}
+
+
+//-----------------------------------------------------------------------------
+// Scan converts a convex polygon. Coverage is conservative: a pixel is only
+// covered if all of it is inside, at the farthest depth the polygon has over
+// the pixel, so anything seen through a gap narrower than a buffer pixel is
+// never culled. Whole polygons go in rather than triangles so there are no
+// uncovered seams along the fan diagonals. The edge functions and the depth
+// are stepped four pixels at a time.
+//-----------------------------------------------------------------------------
+void CDepthBuffer::RasterizePolygon( const Vector *pVerts, int nCount )
+{
+	Assert( nCount <= DEPTH_MAX_POLYGON_EDGES );
+	if ( ( nCount < 3 ) || ( nCount > DEPTH_MAX_POLYGON_EDGES ) )
+		return;
+
+	float px[DEPTH_MAX_POLYGON_EDGES];
+	float py[DEPTH_MAX_POLYGON_EDGES];
+	float flMinX = FLT_MAX, flMinY = FLT_MAX, flMaxX = -FLT_MAX, flMaxY = -FLT_MAX;
+	int i;
+	for ( i = 0; i < nCount; ++i )
+	{
+		px[i] = ToPixelX( pVerts[i].x );
+		py[i] = ToPixelY( pVerts[i].y );
+		flMinX = min( flMinX, px[i] );
+		flMinY = min( flMinY, py[i] );
+		flMaxX = max( flMaxX, px[i] );
+		flMaxY = max( flMaxY, py[i] );
+	}
+
+	// Either winding is fine, make it counterclockwise. z comes from the plane
+	// of the biggest triangle in the fan, the thin ones can be degenerate.
+	float flArea = 0.0f;
+	float flBestArea = 0.0f;
+	int nBest = 1;
+	for ( i = 1; i < nCount - 1; ++i )
+	{
+		float flTriArea = ( px[i] - px[0] ) * ( py[i+1] - py[0] ) - ( px[i+1] - px[0] ) * ( py[i] - py[0] );
+		flArea += flTriArea;
+		if ( fabs( flTriArea ) > fabs( flBestArea ) )
+		{
+			flBestArea = flTriArea;
+			nBest = i;
+		}
+	}
+	if ( fabs( flBestArea ) < 1e-4f )
+		return;
+
+	float flWinding = ( flArea < 0.0f ) ? -1.0f : 1.0f;
+
+	int nMinX = max( (int)floor( flMinX ), 0 );
+	int nMinY = max( (int)floor( flMinY ), 0 );
+	int nMaxX = min( (int)ceil( flMaxX ), DEPTH_BUFFER_WIDTH - 1 );
+	int nMaxY = min( (int)ceil( flMaxY ), DEPTH_BUFFER_HEIGHT - 1 );
+	if ( ( nMinX > nMaxX ) || ( nMinY > nMaxY ) )
+		return;
+
+	++m_nPolygons;
+
+	// z is linear in screen space after the projection
+	float x0 = px[0], y0 = py[0], z0 = pVerts[0].z;
+	float x1 = px[nBest], y1 = py[nBest], z1 = pVerts[nBest].z;
+	float x2 = px[nBest+1], y2 = py[nBest+1], z2 = pVerts[nBest+1].z;
+	float ooArea = 1.0f / flBestArea;
+	float dzdx = ( ( z1 - z0 ) * ( y2 - y0 ) - ( z2 - z0 ) * ( y1 - y0 ) ) * ooArea;
+	float dzdy = ( ( z2 - z0 ) * ( x1 - x0 ) - ( z1 - z0 ) * ( x2 - x0 ) ) * ooArea;
+
+	// Farthest over the pixel rather than at its center
+	float cz = z0 - dzdx * x0 - dzdy * y0 + 0.5f * ( fabs( dzdx ) + fabs( dzdy ) );
+
+	// Start on a multiple of 4 so the rows can be read + written four at a time
+	nMinX &= ~3;
+
+	__m128 vPixelX = _mm_add_ps( _mm_set1_ps( (float)nMinX ), _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f ) );
+
+	// Edge i runs from vertex i to i+1: E(x,y) = A*x + B*y + C, >= 0 inside.
+	// Pulling C in by half the pixel's extent along the edge normal tests
+	// the pixel's worst corner instead of its center.
+	__m128 vERow[DEPTH_MAX_POLYGON_EDGES];
+	__m128 vEStep[DEPTH_MAX_POLYGON_EDGES];
+	float flB[DEPTH_MAX_POLYGON_EDGES];
+	for ( i = 0; i < nCount; ++i )
+	{
+		int j = ( i + 1 < nCount ) ? i + 1 : 0;
+		float a = ( py[i] - py[j] ) * flWinding;
+		float b = ( px[j] - px[i] ) * flWinding;
+		float c = -( a * px[i] + b * py[i] ) - 0.5f * ( fabs( a ) + fabs( b ) );
+		vERow[i] = _mm_add_ps( _mm_mul_ps( vPixelX, _mm_set1_ps( a ) ), _mm_set1_ps( c ) );
+		vEStep[i] = _mm_set1_ps( 4.0f * a );
+		flB[i] = b;
+	}
+
+	__m128 vZRow = _mm_add_ps( _mm_mul_ps( vPixelX, _mm_set1_ps( dzdx ) ), _mm_set1_ps( cz ) );
+	__m128 vZStep = _mm_set1_ps( 4.0f * dzdx );
+	__m128 vZero = _mm_setzero_ps();
+
+	__m128 vE[DEPTH_MAX_POLYGON_EDGES];
+	for ( int y = nMinY; y <= nMaxY; ++y )
+	{
+		float flPixelY = y + 0.5f;
+		for ( i = 0; i < nCount; ++i )
+		{
+			vE[i] = _mm_add_ps( vERow[i], _mm_set1_ps( flB[i] * flPixelY ) );
+		}
+		__m128 vZ = _mm_add_ps( vZRow, _mm_set1_ps( dzdy * flPixelY ) );
+
+		float *pDepth = &m_flDepth[y][nMinX];
+		for ( int x = nMinX; x <= nMaxX; x += 4, pDepth += 4 )
+		{
+			__m128 vInside = _mm_cmpge_ps( vE[0], vZero );
+			vE[0] = _mm_add_ps( vE[0], vEStep[0] );
+			for ( i = 1; i < nCount; ++i )
+			{
+				vInside = _mm_and_ps( vInside, _mm_cmpge_ps( vE[i], vZero ) );
+				vE[i] = _mm_add_ps( vE[i], vEStep[i] );
+			}
+
+			if ( _mm_movemask_ps( vInside ) )
+			{
+				__m128 vOld = _mm_loadu_ps( pDepth );
+				__m128 vNew = _mm_min_ps( vOld, vZ );
+				_mm_storeu_ps( pDepth, _mm_or_ps( _mm_and_ps( vInside, vNew ), _mm_andnot_ps( vInside, vOld ) ) );
+			}
+
+			vZ = _mm_add_ps( vZ, vZStep );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Gathers the farthest depth in each tile
+//-----------------------------------------------------------------------------
+void CDepthBuffer::BuildTiles()
+{
+	for ( int ty = 0; ty < DEPTH_TILES_Y; ++ty )
+	{
+		for ( int tx = 0; tx < DEPTH_TILES_X; ++tx )
+		{
+			__m128 vMax = _mm_set1_ps( -FLT_MAX );
+			for ( int y = 0; y < DEPTH_TILE_SIZE; ++y )
+			{
+				const float *pDepth = &m_flDepth[ty * DEPTH_TILE_SIZE + y][tx * DEPTH_TILE_SIZE];
+				for ( int x = 0; x < DEPTH_TILE_SIZE; x += 4 )
+				{
+					vMax = _mm_max_ps( vMax, _mm_loadu_ps( pDepth + x ) );
+				}
+			}
+
+			vMax = _mm_max_ps( vMax, _mm_shuffle_ps( vMax, vMax, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+			vMax = _mm_max_ps( vMax, _mm_shuffle_ps( vMax, vMax, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+			_mm_store_ss( &m_flTileMaxZ[ty][tx], vMax );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Tiles whose farthest pixel is still in front of the rectangle are occluded
+// outright; the rest are checked pixel by pixel.
+//-----------------------------------------------------------------------------
+bool CDepthBuffer::IsRectOccluded( float flMinX, float flMinY, float flMaxX, float flMaxY, float flMinZ ) const
+{
+	if ( m_nPolygons == 0 )
+		return false;
+
+	// Any pixel the rectangle touches at all counts
+	int nMinX = max( (int)floor( ToPixelX( flMinX ) ), 0 );
+	int nMinY = max( (int)floor( ToPixelY( flMinY ) ), 0 );
+	int nMaxX = min( (int)floor( ToPixelX( flMaxX ) ), DEPTH_BUFFER_WIDTH - 1 );
+	int nMaxY = min( (int)floor( ToPixelY( flMaxY ) ), DEPTH_BUFFER_HEIGHT - 1 );
+	if ( ( nMinX > nMaxX ) || ( nMinY > nMaxY ) )
+		return false;
+
+	for ( int ty = nMinY / DEPTH_TILE_SIZE; ty <= nMaxY / DEPTH_TILE_SIZE; ++ty )
+	{
+		for ( int tx = nMinX / DEPTH_TILE_SIZE; tx <= nMaxX / DEPTH_TILE_SIZE; ++tx )
+		{
+			if ( m_flTileMaxZ[ty][tx] < flMinZ )
+				continue;
+
+			int nStartY = max( nMinY, ty * DEPTH_TILE_SIZE );
+			int nEndY = min( nMaxY, ty * DEPTH_TILE_SIZE + DEPTH_TILE_SIZE - 1 );
+			int nStartX = max( nMinX, tx * DEPTH_TILE_SIZE );
+			int nEndX = min( nMaxX, tx * DEPTH_TILE_SIZE + DEPTH_TILE_SIZE - 1 );
+			for ( int y = nStartY; y <= nEndY; ++y )
+			{
+				for ( int x = nStartX; x <= nEndX; ++x )
+				{
+					if ( m_flDepth[y][x] >= flMinZ )
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+
 //-----------------------------------------------------------------------------
 // Implementation of IOcclusionSystem
 //-----------------------------------------------------------------------------
@@ -1902,10 +2201,14 @@ public:
 	~COcclusionSystem();
 
 	// Inherited from IOcclusionSystem
+	virtual void LevelInit();
 	virtual void ActivateOccluder( int nOccluderIndex, bool bActive );
 	virtual void SetView( const Vector &vecCameraPos, float flFOV, const VMatrix &worldToCamera, const VMatrix &cameraToProjection, const VPlane &nearClipPlane );
 	virtual bool IsOccluded( const Vector &vecAbsMins, const Vector &vecAbsMaxs );
 
+	// Prints what the depth buffer did for the last view
+	void SpewDepthBufferStats();
+
 private:
 	struct AxisAlignedPlane_t
 	{
@@ -1942,6 +2245,18 @@ private:
 	// Stitches up clipped vertices
 	void StitchClippedVertices( Vector *pVertices, int nCount );
 
+	// Finds the world faces that are big enough to be worth drawing into the depth buffer
+	void BuildDepthBufferFaceList();
+
+	// Draws the occluders + largest world faces into the depth buffer
+	void RecomputeDepthBuffer();
+
+	// Clips, projects + draws a world-space polygon into the depth buffer
+	bool AddPolygonToDepthBuffer( Vector **ppPolygon, int nCount );
+
+	// Tests a box against the depth buffer
+	bool IsOccludedByDepthBuffer( const Vector &vecAbsMins, const Vector &vecAbsMaxs );
+
 private:
 	// Per-frame information
 	bool m_bEdgeListDirty;
@@ -1959,9 +2274,25 @@ private:
 	CWingedEdgeList m_WingedEdgeList;
 	CUtlVector< Vector > m_ClippedVerts;
 
+	// Software depth buffer, sorted largest first
+	bool m_bDepthBufferDirty;
+	bool m_bDepthBufferEnabled;
+	CDepthBuffer m_DepthBuffer;
+	CUtlVector< int > m_DepthBufferFaces;
+
 	// Stats
 	int m_nTests;
 	int m_nOccluded;
+
+	int m_nDepthTests;
+	int m_nDepthOccluded;
+	int m_nDepthFaces;
+	float m_flDepthBufferTime;
+	int m_nLastDepthTests;
+	int m_nLastDepthOccluded;
+	int m_nLastDepthFaces;
+	int m_nLastDepthPolygons;
+	float m_flLastDepthBufferTime;
 };
 
 static COcclusionSystem g_OcclusionSystem;
@@ -1980,11 +2311,22 @@ IOcclusionSystem *OcclusionSystem()
 //-----------------------------------------------------------------------------
 // Constructor, destructor
 //-----------------------------------------------------------------------------
-COcclusionSystem::COcclusionSystem() : m_ClippedVerts( 0, 64 )
+COcclusionSystem::COcclusionSystem() : m_ClippedVerts( 0, 64 ), m_DepthBufferFaces( 0, 256 )
 {
 	m_bEdgeListDirty = false;
+	m_bDepthBufferDirty = false;
+	m_bDepthBufferEnabled = true;
 	m_nTests = 0;
 	m_nOccluded = 0;
+	m_nDepthTests = 0;
+	m_nDepthOccluded = 0;
+	m_nDepthFaces = 0;
+	m_flDepthBufferTime = 0.0f;
+	m_nLastDepthTests = 0;
+	m_nLastDepthOccluded = 0;
+	m_nLastDepthFaces = 0;
+	m_nLastDepthPolygons = 0;
+	m_flLastDepthBufferTime = 0.0f;
 }
 
 COcclusionSystem::~COcclusionSystem()
@@ -2348,6 +2690,215 @@ void COcclusionSystem::RecomputeOccluderEdgeList()
 }
 
 
+//-----------------------------------------------------------------------------
+// Finds the world faces worth drawing into the depth buffer, largest first
+//-----------------------------------------------------------------------------
+#define MAX_DEPTH_BUFFER_FACES		2048
+#define MAX_DEPTH_POLYGON_VERTS		64
+#define MIN_DEPTH_BUFFER_FACE_AREA	( 64.0f * 64.0f )
+
+struct DepthBufferFace_t
+{
+	int m_nSurfID;
+	float m_flArea;
+};
+
+static int DepthBufferFaceCompare( const void *elem1, const void *elem2 )
+{
+	const DepthBufferFace_t *pFace1 = (const DepthBufferFace_t *)elem1;
+	const DepthBufferFace_t *pFace2 = (const DepthBufferFace_t *)elem2;
+	if ( pFace1->m_flArea > pFace2->m_flArea )
+		return -1;
+	if ( pFace1->m_flArea < pFace2->m_flArea )
+		return 1;
+	return 0;
+}
+
+void COcclusionSystem::BuildDepthBufferFaceList()
+{
+	m_DepthBufferFaces.RemoveAll();
+	m_bDepthBufferDirty = true;
+
+	model_t *pWorld = host_state.worldmodel;
+	if ( !pWorld )
+		return;
+
+	CUtlVector< DepthBufferFace_t > faces( 0, 256 );
+	int nSurfID = pWorld->brush.firstmodelsurface;
+	for ( int i = 0; i < pWorld->brush.nummodelsurfaces; ++i, ++nSurfID )
+	{
+		// Only faces that are drawn solid hide anything
+		if ( MSurf_Flags( nSurfID ) & ( SURFDRAW_NODRAW | SURFDRAW_SKY | SURFDRAW_TRANS | SURFDRAW_WATERSURFACE | SURFDRAW_HAS_DISP ) )
+			continue;
+
+		IMaterial *pMaterial = MSurf_TexInfo( nSurfID )->material;
+		if ( !pMaterial || pMaterial->IsTranslucent() || pMaterial->IsAlphaTested() )
+			continue;
+
+		int nFirstVertIndex = MSurf_FirstVertIndex( nSurfID );
+		int nVertexCount = MSurf_VertCount( nSurfID );
+		if ( ( nVertexCount < 3 ) || ( nVertexCount > MAX_DEPTH_POLYGON_VERTS ) )
+			continue;
+
+		const Vector &vecFirst = pWorld->brush.vertexes[ pWorld->brush.vertindices[nFirstVertIndex] ].position;
+		Vector vecArea( 0.0f, 0.0f, 0.0f );
+		for ( int k = 1; k < nVertexCount - 1; ++k )
+		{
+			Vector vecEdge1, vecEdge2;
+			VectorSubtract( pWorld->brush.vertexes[ pWorld->brush.vertindices[nFirstVertIndex + k] ].position, vecFirst, vecEdge1 );
+			VectorSubtract( pWorld->brush.vertexes[ pWorld->brush.vertindices[nFirstVertIndex + k + 1] ].position, vecFirst, vecEdge2 );
+			vecArea += CrossProduct( vecEdge1, vecEdge2 );
+		}
+
+		float flArea = 0.5f * vecArea.Length();
+		if ( flArea < MIN_DEPTH_BUFFER_FACE_AREA )
+			continue;
+
+		int j = faces.AddToTail();
+		faces[j].m_nSurfID = nSurfID;
+		faces[j].m_flArea = flArea;
+	}
+
+	if ( faces.Count() == 0 )
+		return;
+
+	qsort( faces.Base(), faces.Count(), sizeof( DepthBufferFace_t ), DepthBufferFaceCompare );
+
+	int nFaceCount = min( faces.Count(), MAX_DEPTH_BUFFER_FACES );
+	for ( int i = 0; i < nFaceCount; ++i )
+	{
+		m_DepthBufferFaces.AddToTail( faces[i].m_nSurfID );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Clips, projects + draws a world-space polygon into the depth buffer.
+// Returns false if none of it was on screen.
+//-----------------------------------------------------------------------------
+bool COcclusionSystem::AddPolygonToDepthBuffer( Vector **ppPolygon, int nCount )
+{
+	Assert( nCount <= MAX_DEPTH_POLYGON_VERTS );
+
+	Vector *ppClipVerts[ MAX_DEPTH_POLYGON_VERTS * 2 ];
+	bool bClipped;
+	int nClipCount = ClipPolygonToNearPlane( ppPolygon, nCount, ppClipVerts, &bClipped );
+	if ( nClipCount < 3 )
+		return false;
+
+	Vector pProjectedVertex[ MAX_DEPTH_POLYGON_VERTS * 2 ];
+	Vector2D vecMins( FLT_MAX, FLT_MAX );
+	Vector2D vecMaxs( -FLT_MAX, -FLT_MAX );
+	int k;
+	for ( k = 0; k < nClipCount; ++k )
+	{
+		Vector3DMultiplyPositionProjective( m_WorldToProjection, *ppClipVerts[k], pProjectedVertex[k] );
+		Vector2DMin( pProjectedVertex[k].AsVector2D(), vecMins, vecMins );
+		Vector2DMax( pProjectedVertex[k].AsVector2D(), vecMaxs, vecMaxs );
+	}
+
+	if ( ( vecMaxs.x < -1.0f ) || ( vecMins.x > 1.0f ) || ( vecMaxs.y < -1.0f ) || ( vecMins.y > 1.0f ) )
+		return false;
+
+	m_DepthBuffer.RasterizePolygon( pProjectedVertex, nClipCount );
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Draws the occluders, then as many of the largest world faces as are
+// facing us + on screen, into the depth buffer
+//-----------------------------------------------------------------------------
+void COcclusionSystem::RecomputeDepthBuffer()
+{
+	if ( !m_bDepthBufferDirty )
+		return;
+
+	m_bDepthBufferDirty = false;
+
+	CFastTimer timer;
+	timer.Start();
+
+	m_DepthBuffer.Clear();
+	m_nDepthFaces = 0;
+
+	model_t *pWorld = host_state.worldmodel;
+	Vector *ppSurfVerts[ MAX_DEPTH_POLYGON_VERTS ];
+	int i, j, k;
+
+	// Mapper-placed occluders always go in
+	mvertex_t *pVertices = pWorld->brush.vertexes;
+	int *pIndices = pWorld->brush.occludervertindices;
+	doccluderdata_t *pOccluders = pWorld->brush.occluders;
+	for ( i = pWorld->brush.numoccluders; --i >= 0; )
+	{
+		if ( pOccluders[i].flags & OCCLUDER_FLAGS_INACTIVE )
+			continue;
+
+		int nSurfID = pOccluders[i].firstpoly;
+		int nSurfCount = pOccluders[i].polycount;
+		for ( j = 0; j < nSurfCount; ++j, ++nSurfID )
+		{
+			doccluderpolydata_t *pSurf = &pWorld->brush.occluderpolys[nSurfID];
+
+			const cplane_t &surfPlane = pWorld->brush.planes[ pSurf->planenum ];
+			if ( DotProduct( surfPlane.normal, m_vecCameraPosition ) <= surfPlane.dist )
+				continue;
+
+			int nVertexCount = min( pSurf->vertexcount, MAX_DEPTH_POLYGON_VERTS );
+			for ( k = 0; k < nVertexCount; ++k )
+			{
+				ppSurfVerts[k] = &( pVertices[ pIndices[pSurf->firstvertexindex + k] ].position );
+			}
+
+			AddPolygonToDepthBuffer( ppSurfVerts, nVertexCount );
+		}
+	}
+
+	// Then the biggest world faces
+	int nMaxFaces = r_occlusion_depthfaces.GetInt();
+	for ( i = 0; ( i < m_DepthBufferFaces.Count() ) && ( m_nDepthFaces < nMaxFaces ); ++i )
+	{
+		int nSurfID = m_DepthBufferFaces[i];
+
+		// Backface cull
+		const cplane_t &surfPlane = MSurf_Plane( nSurfID );
+		float flDist = DotProduct( surfPlane.normal, m_vecCameraPosition ) - surfPlane.dist;
+		bool bPlaneBack = ( MSurf_Flags( nSurfID ) & SURFDRAW_PLANEBACK ) != 0;
+		if ( ( flDist == 0.0f ) || ( ( flDist > 0.0f ) == bPlaneBack ) )
+			continue;
+
+		int nFirstVertIndex = MSurf_FirstVertIndex( nSurfID );
+		int nVertexCount = MSurf_VertCount( nSurfID );
+		for ( k = 0; k < nVertexCount; ++k )
+		{
+			ppSurfVerts[k] = &( pVertices[ pWorld->brush.vertindices[nFirstVertIndex + k] ].position );
+		}
+
+		if ( AddPolygonToDepthBuffer( ppSurfVerts, nVertexCount ) )
+		{
+			++m_nDepthFaces;
+		}
+	}
+
+	m_DepthBuffer.BuildTiles();
+
+	timer.End();
+	m_flDepthBufferTime += timer.GetDuration().GetMillisecondsF();
+}
+
+
+//-----------------------------------------------------------------------------
+// Level init
+//-----------------------------------------------------------------------------
+void COcclusionSystem::LevelInit()
+{
+	m_bEdgeListDirty = true;
+	BuildDepthBufferFaceList();
+}
+
+
 //-----------------------------------------------------------------------------
 // Occluder list management
 //-----------------------------------------------------------------------------
@@ -2366,6 +2917,7 @@ void COcclusionSystem::ActivateOccluder( int nOccluderIndex, bool bActive )
 	}
 
 	m_bEdgeListDirty = true;
+	m_bDepthBufferDirty = true;
 }
 
 
@@ -2385,6 +2937,23 @@ void COcclusionSystem::SetView( const Vector &vecCameraPos, float flFOV, const V
 	m_NearClipPlane.dist = nearClipPlane.m_Dist;
 	m_NearClipPlane.type = 3;
 	m_bEdgeListDirty = true;
+
+	// Roll the depth buffer stats over to the new view
+	m_nLastDepthTests = m_nDepthTests;
+	m_nLastDepthOccluded = m_nDepthOccluded;
+	m_nLastDepthFaces = m_bDepthBufferDirty ? 0 : m_nDepthFaces;
+	m_nLastDepthPolygons = m_bDepthBufferDirty ? 0 : m_DepthBuffer.PolygonCount();
+	m_flLastDepthBufferTime = m_flDepthBufferTime;
+	m_nDepthTests = 0;
+	m_nDepthOccluded = 0;
+	m_flDepthBufferTime = 0.0f;
+	m_bDepthBufferDirty = true;
+
+	// Views drawn into a texture include the water reflection + refraction,
+	// which are mirrored and height clipped on the card. The depth buffer
+	// would still have the clipped-away world in it, so leave them alone.
+	m_bDepthBufferEnabled = ( materialSystemInterface->GetRenderTarget() == NULL );
+
 	m_flNearPlaneDist = -( DotProduct( vecCameraPos, m_NearClipPlane.normal ) - m_NearClipPlane.dist );
 	Assert( m_flNearPlaneDist > 0.0f );
 	m_flFOVFactor = m_flNearPlaneDist * tan( flFOV * 0.5f * M_PI / 180.0f );
@@ -2400,10 +2969,31 @@ void COcclusionSystem::SetView( const Vector &vecCameraPos, float flFOV, const V
 			m_nTests = 0;
 			m_nOccluded = 0;
 		}
+
+		if ( m_nLastDepthTests )
+		{
+			SpewDepthBufferStats();
+		}
 	}
 }
 
 
+//-----------------------------------------------------------------------------
+// Prints what the depth buffer did for the last view
+//-----------------------------------------------------------------------------
+void COcclusionSystem::SpewDepthBufferStats()
+{
+	float flPercent = m_nLastDepthTests ? 100.0f * ((float)m_nLastDepthOccluded / (float)m_nLastDepthTests) : 0.0f;
+	Msg( "Depth occl %.2f (%d/%d), %d faces, %d polys, %.2f ms\n", flPercent, m_nLastDepthOccluded, m_nLastDepthTests,
+		m_nLastDepthFaces, m_nLastDepthPolygons, m_flLastDepthBufferTime );
+}
+
+CON_COMMAND( r_occlusion_stats, "Prints how many props + entities the occlusion depth buffer culled in the last view." )
+{
+	g_OcclusionSystem.SpewDepthBufferStats();
+}
+
+
 //-----------------------------------------------------------------------------
 // Used to build the quads to test for occlusion
 //-----------------------------------------------------------------------------
@@ -2506,6 +3096,49 @@ static bool WingedEdgeLessFunc( const int& src1, const int& src2, void *pCtx )
 	return dEdge1.x * dEdge2.y <= dEdge1.y * dEdge2.x;
 }
 
+//-----------------------------------------------------------------------------
+// Tests the screen rectangle of the box against the depth buffer
+//-----------------------------------------------------------------------------
+bool COcclusionSystem::IsOccludedByDepthBuffer( const Vector &vecAbsMins, const Vector &vecAbsMaxs )
+{
+	RecomputeDepthBuffer();
+
+	++m_nDepthTests;
+
+	float flMinX = FLT_MAX, flMinY = FLT_MAX, flMinZ = FLT_MAX;
+	float flMaxX = -FLT_MAX, flMaxY = -FLT_MAX;
+	for ( int i = 0; i < 8; ++i )
+	{
+		Vector4D vecCorner, vecProj;
+		vecCorner.Init( ( i & 0x1 ) ? vecAbsMaxs.x : vecAbsMins.x, ( i & 0x2 ) ? vecAbsMaxs.y : vecAbsMins.y,
+			( i & 0x4 ) ? vecAbsMaxs.z : vecAbsMins.z, 1.0f );
+		Vector4DMultiply( m_WorldToProjection, vecCorner, vecProj );
+
+		// Boxes crossing the near plane are never occluded
+		if ( vecProj.w <= 0.0f )
+			return false;
+
+		float flOOW = 1.0f / vecProj.w;
+		float z = vecProj.z * flOOW;
+		if ( z <= 0.0f )
+			return false;
+
+		float x = vecProj.x * flOOW;
+		float y = vecProj.y * flOOW;
+		flMinX = min( flMinX, x );
+		flMaxX = max( flMaxX, x );
+		flMinY = min( flMinY, y );
+		flMaxY = max( flMaxY, y );
+		flMinZ = min( flMinZ, z );
+	}
+
+	bool bOccluded = m_DepthBuffer.IsRectOccluded( flMinX, flMinY, flMaxX, flMaxY, flMinZ );
+	if ( bOccluded )
+		++m_nDepthOccluded;
+
+	return bOccluded;
+}
+
 bool COcclusionSystem::IsOccluded( const Vector &vecAbsMins, const Vector &vecAbsMaxs )
 {
 	if ( r_occlusion.GetInt() == 0 )
@@ -2513,6 +3146,9 @@ bool COcclusionSystem::IsOccluded( const Vector &vecAbsMins, const Vector &vecAb
 
 	VPROF_BUDGET( "COcclusionSystem::IsOccluded", "Occlusion" );
 
+	if ( r_occlusion_depthbuffer.GetInt() && m_bDepthBufferEnabled && IsOccludedByDepthBuffer( vecAbsMins, vecAbsMaxs ) )
+		return true;
+
 	RecomputeOccluderEdgeList();
 
 	// No occluders? Then the edge list isn't occluded
@@ -15,5 +15,6 @@
 #include "convar.h"
 
 extern	ConVar hisound;
+extern	ConVar snd_async_fill;
 
 #endif // SND_CONVARS_H
@@ -154,6 +154,7 @@ ConVar snd_show( "snd_show", "0");
 	);
 */
 ConVar snd_mixahead( "snd_mixahead", "0.1", FCVAR_ARCHIVE );
+ConVar snd_async_fill( "snd_async_fill", "0", 0, "Reload sounds the data cache threw out on its worker thread" );
 
 // vaudio DLL
 IVAudio *vaudio = NULL;
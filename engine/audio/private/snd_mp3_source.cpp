@@ -4,6 +4,7 @@
 
 #include "soundservice.h"
 #include "snd_io.h"
+#include "snd_convars.h"
 #include "../../cache.h"
 #include "vstdlib/strtools.h"
 #include "tier0/dbg.h"
@@ -14,6 +15,7 @@ CAudioSourceMP3::CAudioSourceMP3( const char *pFileName )
 {
 	m_sampleRate = 44100;
 	m_pName = pFileName;
+	m_fileSize = 0;
 }
 
 // mixer's references
@@ -55,6 +57,8 @@ protected:
 
 private:
 	CAudioSourceMP3Cache( const CAudioSourceMP3Cache & );
+
+	static bool				FillData( void *pDest, int nSize, void *pContext );
 };
 
 
@@ -96,18 +100,40 @@ void CAudioSourceMP3Cache::CacheTouch( void )
 }
 
 
+// Reads the file back in on the data cache worker thread
+bool CAudioSourceMP3Cache::FillData( void *pDest, int nSize, void *pContext )
+{
+	CAudioSourceMP3Cache *pSource = (CAudioSourceMP3Cache *)pContext;
+
+	int file = g_pSndIO->open( pSource->m_pName );
+	if ( !file )
+		return false;
+
+	bool bRead = ( g_pSndIO->read( pDest, nSize, file ) == nSize );
+	g_pSndIO->close( file );
+	return bRead;
+}
+
+
 void CAudioSourceMP3Cache::CacheLoad( void )
 {
-	if ( IsCached() )
+	if ( IsCached() || DataCache_IsPending( &m_cache ) )
 		return;
 
+	// The size is known after the first load
+	if ( m_fileSize && snd_async_fill.GetBool() )
+	{
+		DataCache_AllocAsync( DC_SECTION_SOUND, &m_cache, m_fileSize, m_pName, FillData, this );
+		return;
+	}
+
 	int file = g_pSndIO->open( m_pName );
 	if ( !file )
 		return;
 
 	m_fileSize = g_pSndIO->size( file );
 	// create a buffer for the samples
-	char *pData = (char *)Cache_Alloc( &m_cache, m_fileSize, m_pName );
+	char *pData = (char *)Cache_Alloc( &m_cache, m_fileSize, m_pName, DC_SECTION_SOUND );
 	// load them into memory
 	g_pSndIO->read( pData, m_fileSize, file );
 
@@ -116,6 +142,9 @@ void CAudioSourceMP3Cache::CacheLoad( void )
 
 void CAudioSourceMP3Cache::CacheUnload( void )
 {
+	// a queued reload would write into us after we're gone
+	DataCache_CancelAsync( &m_cache );
+
 	if ( !m_cache.data )
 		return;
 
@@ -126,7 +155,15 @@ char *CAudioSourceMP3Cache::GetDataPointer( void )
 {
 	char *pData = (char *)Cache_Check( &m_cache );
 	if ( !pData )
+	{
 		CacheLoad();
+
+		// the mixer needs the data now, not after the next DataCache_Update
+		if ( DataCache_IsPending( &m_cache ) )
+		{
+			DataCache_FinishPendingFills();
+		}
+	}
 	return (char *)Cache_Check( &m_cache );
 }
 
@@ -19,6 +19,7 @@
 
 #include "soundservice.h"
 #include "snd_io.h"
+#include "snd_convars.h"
 #include "../../cache.h"
 #include "vstdlib/strtools.h"
 #include "snd_mp3_source.h"
@@ -764,6 +765,11 @@ protected:
 
 private:
 	CAudioSourceMemWaveCache( const CAudioSourceMemWaveCache & );
+
+	static bool				FillData( void *pDest, int nSize, void *pContext );
+
+	int				m_dataOffset;	// file position of the samples
+	int				m_dataSize;
 };
 
 
@@ -774,6 +780,8 @@ CAudioSourceMemWaveCache::CAudioSourceMemWaveCache( const char *pName ) :
 	CAudioSourceMemWave( pName )
 {
 	memset( &m_cache, 0, sizeof(m_cache) );
+	m_dataOffset = 0;
+	m_dataSize = 0;
 }
 
 
@@ -813,9 +821,13 @@ void CAudioSourceMemWaveCache::ParseChunk( IterateRIFF &walk, int chunkName )
 void CAudioSourceMemWaveCache::ParseDataChunk( IterateRIFF &walk )
 {
 	int size = walk.ChunkSize();
+
+	// remember where the samples are, so a reload can read them directly
+	m_dataOffset = walk.ChunkFilePosition() + 8;
+	m_dataSize = size;
 	
 	// create a buffer for the samples
-	char *pData = (char *)Cache_Alloc( &m_cache, size, m_pName );
+	char *pData = (char *)Cache_Alloc( &m_cache, size, m_pName, DC_SECTION_SOUND );
 
 	// load them into memory
 	walk.ChunkRead( pData );
@@ -860,10 +872,45 @@ void CAudioSourceMemWaveCache::CacheTouch( void )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Reads the samples back in on the data cache worker thread
+// Input  : *pDest - cache entry
+//			nSize - bytes of sample data
+//			*pContext - the wave source
+//-----------------------------------------------------------------------------
+bool CAudioSourceMemWaveCache::FillData( void *pDest, int nSize, void *pContext )
+{
+	CAudioSourceMemWaveCache *pSource = (CAudioSourceMemWaveCache *)pContext;
+
+	int file = g_pSndIO->open( pSource->m_pName );
+	if ( !file )
+		return false;
+
+	g_pSndIO->seek( file, pSource->m_dataOffset );
+	bool bRead = ( g_pSndIO->read( pDest, nSize, file ) == nSize );
+	g_pSndIO->close( file );
+	if ( !bRead )
+		return false;
+
+	if ( pSource->m_format == WAVE_FORMAT_PCM )
+	{
+		pSource->ConvertSamples( (char *)pDest, nSize / pSource->m_sampleSize );
+	}
+	return true;
+}
+
+
 void CAudioSourceMemWaveCache::CacheLoad( void )
 {
-	if ( IsCached() )
+	if ( IsCached() || DataCache_IsPending( &m_cache ) )
+		return;
+
+	// Once the data chunk has been found, a reload is a single read
+	if ( m_dataSize && snd_async_fill.GetBool() )
+	{
+		DataCache_AllocAsync( DC_SECTION_SOUND, &m_cache, m_dataSize, m_pName, FillData, this );
 		return;
+	}
 
 	InFileRIFF riff( m_pName, *g_pSndIO );
 
@@ -889,6 +936,9 @@ void CAudioSourceMemWaveCache::CacheLoad( void )
 
 void CAudioSourceMemWaveCache::CacheUnload( void )
 {
+	// a queued reload would write into us after we're gone
+	DataCache_CancelAsync( &m_cache );
+
 	if ( !m_cache.data )
 		return;
 
@@ -899,7 +949,15 @@ char *CAudioSourceMemWaveCache::GetDataPointer( void )
 {
 	char *pData = (char *)Cache_Check( &m_cache );
 	if ( !pData )
+	{
 		CacheLoad();
+
+		// the mixer needs the samples now, not after the next DataCache_Update
+		if ( DataCache_IsPending( &m_cache ) )
+		{
+			DataCache_FinishPendingFills();
+		}
+	}
 	return (char *)Cache_Check( &m_cache );
 }
 
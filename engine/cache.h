@@ -3,6 +3,7 @@
 #pragma once
 
 #include "cache_user.h"
+#include "datacache.h"
 
 void Cache_Flush (void);
 
@@ -12,9 +13,10 @@ void *Cache_Check (cache_user_t *c);
 
 void Cache_Free (cache_user_t *c);
 
-void *Cache_Alloc (cache_user_t *c, int size, const char *name);
-// Returns NULL if all purgable data was tossed and there still
-// wasn't enough room.
+void *Cache_Alloc (cache_user_t *c, int size, const char *name, DataCacheSection_t section = DC_SECTION_OTHER);
+// Evicts least recently used data from the section until the new entry fits
+// its budget. Never returns NULL; if everything is locked the section goes
+// over budget.
 
 void Cache_Report (void);
 
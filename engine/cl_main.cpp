@@ -59,6 +59,7 @@
 #include "vstdlib/icommandline.h"
 #include "enginebugreporter.h"
 #include "vgui_intwrap2.h"
+#include "lightcache.h"
 
 void R_UnloadSkys( void );
 void CL_ResetEntityBits( void );
@@ -1457,6 +1458,7 @@ void CL_SignonReply (void)
 			// that raycasts against the world is supported (owing to the fact
 			// that the world entity has been created by this point)
 			StaticPropMgr()->LevelInitClient();
+			R_StudioPrewarmLightingCache();
  			g_ClientDLL->LevelInitPostEntity();
 
 			SpatialPartition()->SuppressLists( PARTITION_ALL_CLIENT_EDICTS, true );
@@ -23,6 +23,7 @@
 #include "vphysics_interface.h"
 #include "icliententity.h"
 #include "engine/icollideable.h"
+#include "enginetrace.h"
 
 
 CCollisionBSPData g_BSPData;								// the global collision bsp
@@ -78,6 +79,7 @@ typedef CUtlVector<cnode_t> CSubBSPTree;
 static CSubBSPTree s_BSPSubTree;
 
 static ConVar map_noareas( "map_noareas", "0", 0 );
+ConVar cm_flattree( "cm_flattree", "1", 0, "Sweep traces through the packed copy of the collision tree built at map load" );
 
 void	CM_InitBoxHull (CCollisionBSPData *pBSPData);
 void	FloodAreaConnections (CCollisionBSPData *pBSPData);
@@ -243,6 +245,9 @@ void CM_FreeMap(void)
 	// get the current collision bsp -- there is only one!
 	CCollisionBSPData *pBSPData = GetCollisionBSPData();
 
+	CM_FreeFlatTree();
+	InvalidateWorldTraceCache();
+
 	// free the collision bsp data
 	CollisionBSPData_Destroy( pBSPData );
 }
@@ -306,6 +311,8 @@ cmodel_t *CM_LoadMap( const char *name, qboolean clientload, unsigned *checksum
 
 	CM_InitBoxHull( pBSPData );
 
+	CM_BuildFlatTree( pBSPData );
+
     // Push the displacement bounding boxes down the tree and set leaf data.
     CM_DispTreeLeafnum( pBSPData );
 
@@ -1022,6 +1029,47 @@ void CM_TestBoxInBrush( CCollisionBSPData *pBSPData, const Vector& mins, const V
 }
 
 
+/*
+================
+CM_TraceToLeafDisplacements
+================
+*/
+void FASTCALL CM_TraceToLeafDisplacements( cleaf_t *pLeaf, float startFrac, float endFrac )
+{
+	int nCurrentCheckCount = CurrentCheckCount();
+	int nDepth = CurrentCheckCountDepth();
+
+	//
+	// trace ray/swept box against all displacement surfaces in this leaf
+	//
+	for( CDispIterator it( pLeaf->m_pDisplacements, CDispLeafLink::LIST_LEAF ); it.IsValid(); )
+	{
+		CDispCollTree *pDispTree = static_cast<CDispCollTree*>( it.Inc()->m_pDispInfo );
+		
+		// make sure we only check this brush once per trace/stab
+		if( pDispTree->GetCheckCount(nDepth) == nCurrentCheckCount )
+			continue;
+		
+		// mark the brush as checked
+		if( !trace_ispoint )
+		{
+			pDispTree->SetCheckCount( nDepth, nCurrentCheckCount );
+		}
+		
+		// only collide with objects you are interested in
+		if( !( pDispTree->GetContents() & trace_contents ) )
+			continue;
+
+		CM_TraceToDispTree( pDispTree, trace_start, trace_end, trace_mins, trace_maxs, 
+			                startFrac, endFrac, &trace_trace, ( trace_ispoint == 1 ) );
+		if( !trace_trace.fraction )
+			break;
+	}
+	
+	CM_PostTraceToDispTree();
+}
+
+
 /*
 ================
 CM_TraceToLeaf
@@ -1072,34 +1120,7 @@ void FASTCALL CM_TraceToLeaf( CCollisionBSPData *pBSPData, int ndxLeaf, float st
 	// Collide (test) against displacement surfaces in this leaf.
 	if( pLeaf->m_pDisplacements )
 	{		
-		//
-		// trace ray/swept box against all displacement surfaces in this leaf
-		//
-		for( CDispIterator it( pLeaf->m_pDisplacements, CDispLeafLink::LIST_LEAF ); it.IsValid(); )
-		{
-			CDispCollTree *pDispTree = static_cast<CDispCollTree*>( it.Inc()->m_pDispInfo );
-			
-			// make sure we only check this brush once per trace/stab
-			if( pDispTree->GetCheckCount(nDepth) == nCurrentCheckCount )
-				continue;
-			
-			// mark the brush as checked
-			if( !trace_ispoint )
-			{
-				pDispTree->SetCheckCount( nDepth, nCurrentCheckCount );
-			}
-			
-			// only collide with objects you are interested in
-			if( !( pDispTree->GetContents() & trace_contents ) )
-				continue;
-
-			CM_TraceToDispTree( pDispTree, trace_start, trace_end, trace_mins, trace_maxs, 
-				                startFrac, endFrac, &trace_trace, ( trace_ispoint == 1 ) );
-			if( !trace_trace.fraction )
-				break;
-		}
-		
-		CM_PostTraceToDispTree();
+		CM_TraceToLeafDisplacements( pLeaf, startFrac, endFrac );
 	}
 
 	Assert( nDepth == CurrentCheckCountDepth() );
@@ -1444,6 +1465,11 @@ void CM_BoxTrace( const Ray_t& ray, int headnode, int brushmask, bool computeEnd
 		// check for position test special case
 		CM_UnsweptBoxTrace( pBSPData, ray, headnode, brushmask );
 	}
+	else if ( cm_flattree.GetBool() && CM_FlatTreeHasHeadnode( pBSPData, headnode ) )
+	{
+		// general sweeping through world, using the packed copy of the tree
+		CM_FlatHullCheck( headnode, trace_start, trace_end );
+	}
 	else
 	{
 		// general sweeping through world
@@ -12,6 +12,7 @@
 #include "builddisp.h"
 #include "collisionutils.h"
 #include "enginestats.h"
+#include "enginetrace.h"
 
 Vector trace_StabDir;		// the direction to stab in
 int trace_bDispHit;			// hit displacement surface last
@@ -397,4 +398,6 @@ void CM_ApplyTerrainMod( ITerrainMod *pMod )
 			ReAddDispSurfToCModelLeafs( pDispTree );
 		}
 	}
+
+	InvalidateWorldTraceCache();
 }
@@ -0,0 +1,505 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Flattened copy of the collision BSP for swept traces. The nodes
+//			are packed depth first with their planes inline, so the near child
+//			of a node is usually the next one in memory, and the brush sides
+//			are packed per brush with the bevels already split off for rays.
+//			CM_FlatHullCheck walks it with an explicit stack and gives the
+//			same results as CM_RecursiveHullCheck.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "cmodel_engine.h"
+#include "convar.h"
+#include "utlvector.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+// Deeper trees than this are left to CM_RecursiveHullCheck
+#define MAX_FLAT_TREE_DEPTH		256
+
+struct cflatnode_t
+{
+	Vector		normal;
+	float		dist;
+	int			type;
+	int			children[2];		// flat node indices, negative numbers are leafs
+	int			pad;
+};
+
+struct cflatbrushside_t
+{
+	Vector			normal;
+	float			dist;
+	Vector			absnormal;		// pushes the plane out for the trace extents
+	cbrushside_t	*side;			// plane and surface to report on a hit
+};
+
+// Sides [firstside, firstside + numsides) are all the sides in map order, the
+// numraysides after them are the same minus the bevels, for point traces
+struct cflatbrush_t
+{
+	int				contents;
+	int				firstside;
+	unsigned short	numsides;
+	unsigned short	numraysides;
+	int				checkcount[2];
+};
+
+struct flattracestack_t
+{
+	int			node;
+	float		p1f;
+	float		p2f;
+	Vector		p1;
+	Vector		p2;
+};
+
+static CUtlVector<cflatnode_t>		s_FlatNodes;
+static CUtlVector<cflatbrushside_t>	s_FlatBrushSides;
+static CUtlVector<cflatbrush_t>		s_FlatBrushes;
+static CUtlVector<int>				s_FlatNodeForMapNode;		// -1 for nodes not in the flat tree
+static cleaf_t						*s_pFlatLeafs;
+static unsigned short				*s_pFlatLeafBrushes;
+static bool							s_bFlatTreeValid;
+
+
+//-----------------------------------------------------------------------------
+// Copies the subtree below nodenum, near child first, and returns its index
+//-----------------------------------------------------------------------------
+static int CM_BuildFlatNode_r( CCollisionBSPData *pBSPData, int nodenum, int nDepth, int *pMaxDepth )
+{
+	if ( nodenum < 0 )
+		return nodenum;
+
+	if ( s_FlatNodeForMapNode[nodenum] >= 0 )
+		return s_FlatNodeForMapNode[nodenum];
+
+	if ( nDepth > *pMaxDepth )
+	{
+		*pMaxDepth = nDepth;
+	}
+
+	cnode_t *pNode = &pBSPData->map_nodes[nodenum];
+	int nFlat = s_FlatNodes.AddToTail();
+	s_FlatNodeForMapNode[nodenum] = nFlat;
+
+	cflatnode_t &flat = s_FlatNodes[nFlat];
+	VectorCopy( pNode->plane->normal, flat.normal );
+	flat.dist = pNode->plane->dist;
+	flat.type = pNode->plane->type;
+	flat.pad = 0;
+
+	// The vector can grow under us, so don't hold the reference across the recursion
+	int nChild0 = CM_BuildFlatNode_r( pBSPData, pNode->children[0], nDepth + 1, pMaxDepth );
+	s_FlatNodes[nFlat].children[0] = nChild0;
+	int nChild1 = CM_BuildFlatNode_r( pBSPData, pNode->children[1], nDepth + 1, pMaxDepth );
+	s_FlatNodes[nFlat].children[1] = nChild1;
+
+	return nFlat;
+}
+
+
+//-----------------------------------------------------------------------------
+// Builds the flat tree for the world and the brush models. The box hull is
+// left out, its planes are rewritten for every trace against it.
+//-----------------------------------------------------------------------------
+void CM_BuildFlatTree( CCollisionBSPData *pBSPData )
+{
+	CM_FreeFlatTree();
+
+	if ( !pBSPData->numnodes )
+		return;
+
+	int i;
+	s_FlatNodeForMapNode.SetCount( pBSPData->numnodes );
+	for ( i = 0; i < pBSPData->numnodes; i++ )
+	{
+		s_FlatNodeForMapNode[i] = -1;
+	}
+
+	s_FlatNodes.EnsureCapacity( pBSPData->numnodes );
+	int nMaxDepth = 0;
+	for ( i = 0; i < pBSPData->numcmodels; i++ )
+	{
+		int headnode = pBSPData->map_cmodels[i].headnode;
+		if ( headnode >= 0 && headnode < pBSPData->numnodes )
+		{
+			CM_BuildFlatNode_r( pBSPData, headnode, 1, &nMaxDepth );
+		}
+	}
+
+	if ( nMaxDepth >= MAX_FLAT_TREE_DEPTH )
+	{
+		Con_DPrintf( "CM_BuildFlatTree: tree is %d nodes deep, using the recursive trace\n", nMaxDepth );
+		CM_FreeFlatTree();
+		return;
+	}
+
+	// Brushes keep their map indices so the leaf brush lists can be shared
+	s_FlatBrushes.SetCount( pBSPData->numbrushes );
+	s_FlatBrushSides.EnsureCapacity( pBSPData->numbrushsides * 2 );
+	for ( i = 0; i < pBSPData->numbrushes; i++ )
+	{
+		cbrush_t *pBrush = &pBSPData->map_brushes[i];
+		cflatbrush_t &flat = s_FlatBrushes[i];
+		flat.contents = pBrush->contents;
+		flat.firstside = s_FlatBrushSides.Count();
+		flat.numsides = pBrush->numsides;
+		flat.numraysides = 0;
+		flat.checkcount[0] = flat.checkcount[1] = 0;
+
+		for ( int nPass = 0; nPass < 2; nPass++ )
+		{
+			for ( int j = 0; j < pBrush->numsides; j++ )
+			{
+				cbrushside_t *pSide = &pBSPData->map_brushsides[pBrush->firstbrushside + j];
+				if ( nPass == 1 )
+				{
+					if ( pSide->bBevel )
+						continue;
+					flat.numraysides++;
+				}
+
+				cflatbrushside_t &side = s_FlatBrushSides[s_FlatBrushSides.AddToTail()];
+				VectorCopy( pSide->plane->normal, side.normal );
+				side.dist = pSide->plane->dist;
+				side.absnormal.Init( fabs( side.normal.x ), fabs( side.normal.y ), fabs( side.normal.z ) );
+				side.side = pSide;
+			}
+		}
+	}
+
+	s_pFlatLeafs = pBSPData->map_leafs.Base();
+	s_pFlatLeafBrushes = pBSPData->map_leafbrushes.Base();
+	s_bFlatTreeValid = true;
+
+	Con_DPrintf( "Flat collision tree: %d nodes, %d brushes, %d brush sides, %d deep\n",
+		s_FlatNodes.Count(), s_FlatBrushes.Count(), s_FlatBrushSides.Count(), nMaxDepth );
+}
+
+void CM_FreeFlatTree( void )
+{
+	s_bFlatTreeValid = false;
+	s_pFlatLeafs = NULL;
+	s_pFlatLeafBrushes = NULL;
+	s_FlatNodes.Purge();
+	s_FlatBrushSides.Purge();
+	s_FlatBrushes.Purge();
+	s_FlatNodeForMapNode.Purge();
+}
+
+
+//-----------------------------------------------------------------------------
+// The flat tree can't be used for the box hull or while a subtree is hooked in
+//-----------------------------------------------------------------------------
+bool CM_FlatTreeHasHeadnode( CCollisionBSPData *pBSPData, int headnode )
+{
+	if ( !s_bFlatTreeValid || pBSPData->map_rootnode != pBSPData->map_nodes.Base() )
+		return false;
+
+	if ( headnode < 0 || headnode >= s_FlatNodeForMapNode.Count() )
+		return false;
+
+	return s_FlatNodeForMapNode[headnode] >= 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// CM_ClipBoxToBrush against the packed sides. The box is always centered on
+// the trace, so pushing a plane out is a dot with the absolute normal.
+//-----------------------------------------------------------------------------
+static void CM_FlatClipBoxToBrush( cflatbrush_t *pBrush, trace_t *trace )
+{
+	if (!pBrush->numsides)
+		return;
+
+	g_CollisionCounts.m_BrushTraces++;
+
+	float enterfrac = NEVER_UPDATED;
+	float leavefrac = 1.f;
+	cflatbrushside_t *leadside = NULL;
+
+	bool getout = false;
+	bool startout = false;
+
+	cflatbrushside_t *side;
+	int numsides;
+	if ( trace_ispoint )
+	{
+		side = s_FlatBrushSides.Base() + pBrush->firstside + pBrush->numsides;
+		numsides = pBrush->numraysides;
+	}
+	else
+	{
+		side = s_FlatBrushSides.Base() + pBrush->firstside;
+		numsides = pBrush->numsides;
+	}
+
+	for (int i=0 ; i<numsides ; i++, side++)
+	{
+		float dist = side->dist;
+		if (!trace_ispoint)
+		{
+			dist += DotProduct( side->absnormal, trace_extents );
+		}
+
+		float d1 = DotProduct (trace_start, side->normal) - dist;
+		float d2 = DotProduct (trace_end, side->normal) - dist;
+
+		// if completely in front of face, no intersection
+		if( d1 > 0.f )
+		{
+			startout = true;
+
+			// d1 > 0.f && d2 > 0.f
+			if( d2 > 0.f )
+				return;
+		}
+		else
+		{
+			// d1 <= 0.f && d2 <= 0.f
+			if( d2 <= 0.f )
+				continue;
+
+			// d2 > 0.f
+			getout = true;
+		}
+
+		// crosses face
+		if (d1 > d2)
+		{	// enter
+			float f = (d1-DIST_EPSILON);
+			if ( f < 0.f )
+				f = 0.f;
+			f = f / (d1-d2);
+			if (f > enterfrac)
+			{
+				enterfrac = f;
+				leadside = side;
+			}
+		}
+		else
+		{	// leave
+			float f = (d1+DIST_EPSILON) / (d1-d2);
+			if (f < leavefrac)
+				leavefrac = f;
+		}
+	}
+
+	// see CM_ClipBoxToBrush
+	if (trace_ispoint && startout)
+	{
+		if ((trace->fractionleftsolid - enterfrac) > 0.0f )
+			startout = false;
+	}
+
+	if (!startout)
+	{	// original point was inside brush
+		trace->startsolid = true;
+		trace->contents = pBrush->contents;
+
+		if (!getout)
+		{
+			trace->allsolid = true;
+			trace->fraction = 0.0f;
+			trace->fractionleftsolid = 1.0f;
+		}
+		else
+		{
+			if ((leavefrac != 1) && (leavefrac > trace->fractionleftsolid))
+			{
+				trace->fractionleftsolid = leavefrac;
+
+				if (trace->fraction <= leavefrac)
+				{
+					trace->fraction = 1.0f;
+					trace->surface = nullsurface;
+				}
+			}
+		}
+		return;
+	}
+
+	// We haven't hit anything at all until we've left...
+	if (enterfrac < leavefrac)
+	{
+		if (enterfrac > NEVER_UPDATED && enterfrac < trace->fraction)
+		{
+			if (enterfrac < 0)
+				enterfrac = 0;
+			trace->fraction = enterfrac;
+			trace_bDispHit = false;
+			trace->plane = *leadside->side->plane;
+			trace->surface = *leadside->side->surface;
+			trace->contents = pBrush->contents;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// CM_TraceToLeaf against the packed brushes
+//-----------------------------------------------------------------------------
+static void CM_FlatTraceToLeaf( int ndxLeaf, float startFrac, float endFrac )
+{
+	int nCurrentCheckCount = CurrentCheckCount();
+	int nDepth = CurrentCheckCountDepth();
+
+	cleaf_t *pLeaf = &s_pFlatLeafs[ndxLeaf];
+	unsigned short *pLeafBrushes = &s_pFlatLeafBrushes[pLeaf->firstleafbrush];
+	for( int ndxLeafBrush = 0; ndxLeafBrush < pLeaf->numleafbrushes; ndxLeafBrush++ )
+	{
+		cflatbrush_t *pBrush = &s_FlatBrushes[pLeafBrushes[ndxLeafBrush]];
+
+		// make sure we only check this brush once per trace/stab
+		if( pBrush->checkcount[nDepth] == nCurrentCheckCount )
+			continue;
+		pBrush->checkcount[nDepth] = nCurrentCheckCount;
+
+		if( !( pBrush->contents & trace_contents ) )
+			continue;
+
+		CM_FlatClipBoxToBrush( pBrush, &trace_trace );
+		if( !trace_trace.fraction )
+			return;
+	}
+
+	if( trace_trace.startsolid )
+		return;
+
+	if( pLeaf->m_pDisplacements )
+	{
+		CM_TraceToLeafDisplacements( pLeaf, startFrac, endFrac );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// CM_RecursiveHullCheck from headnode over the whole trace, with the far side
+// of each split pushed on a stack instead of recursed into
+//-----------------------------------------------------------------------------
+void CM_FlatHullCheck( int headnode, const Vector& p1, const Vector& p2 )
+{
+	flattracestack_t stack[MAX_FLAT_TREE_DEPTH];
+	int nStack = 0;
+
+	int num = s_FlatNodeForMapNode[headnode];
+	float p1f = 0.0f;
+	float p2f = 1.0f;
+	Vector start = p1;
+	Vector end = p2;
+
+	for ( ;; )
+	{
+		if ( trace_trace.fraction > p1f )
+		{
+			cflatnode_t	*node = NULL;
+			float		t1 = 0, t2 = 0, offset = 0;
+
+			while( num >= 0 )
+			{
+				node = &s_FlatNodes[num];
+
+				if (node->type < 3)
+				{
+					t1 = start[node->type] - node->dist;
+					t2 = end[node->type] - node->dist;
+					offset = trace_extents[node->type];
+				}
+				else
+				{
+					t1 = DotProduct (node->normal, start) - node->dist;
+					t2 = DotProduct (node->normal, end) - node->dist;
+					if ( trace_ispoint )
+					{
+						offset = 0;
+					}
+					else
+					{
+						offset = fabs(trace_extents[0]*node->normal[0]) +
+								 fabs(trace_extents[1]*node->normal[1]) +
+								 fabs(trace_extents[2]*node->normal[2]);
+					}
+				}
+
+				// see which sides we need to consider
+				if (t1 > offset && t2 > offset )
+				{
+					num = node->children[0];
+					continue;
+				}
+				if (t1 < -offset && t2 < -offset)
+				{
+					num = node->children[1];
+					continue;
+				}
+				break;
+			}
+
+			if (num >= 0)
+			{
+				float	frac, frac2, idist, midf;
+				int		side;
+
+				// put the crosspoint DIST_EPSILON pixels on the near side
+				if (t1 < t2)
+				{
+					idist = 1.0/(t1-t2);
+					side = 1;
+					frac2 = (t1 + offset + DIST_EPSILON)*idist;
+					frac = (t1 - offset - DIST_EPSILON)*idist;
+				}
+				else if (t1 > t2)
+				{
+					idist = 1.0/(t1-t2);
+					side = 0;
+					frac2 = (t1 - offset - DIST_EPSILON)*idist;
+					frac = (t1 + offset + DIST_EPSILON)*idist;
+				}
+				else
+				{
+					side = 0;
+					frac = 1;
+					frac2 = 0;
+				}
+
+				// the far side waits on the stack
+				Assert( nStack < MAX_FLAT_TREE_DEPTH );
+				flattracestack_t &pastNode = stack[nStack++];
+				frac2 = clamp( frac2, 0, 1 );
+				pastNode.node = node->children[side^1];
+				pastNode.p1f = p1f + (p2f - p1f)*frac2;
+				pastNode.p2f = p2f;
+				VectorLerp( start, end, frac2, pastNode.p1 );
+				pastNode.p2 = end;
+
+				// move up to the node
+				frac = clamp( frac, 0, 1 );
+				midf = p1f + (p2f - p1f)*frac;
+				Vector mid;
+				VectorLerp( start, end, frac, mid );
+
+				num = node->children[side];
+				p2f = midf;
+				end = mid;
+				continue;
+			}
+
+			CM_FlatTraceToLeaf( -1-num, p1f, p2f );
+		}
+
+		if ( !nStack )
+			break;
+
+		flattracestack_t &next = stack[--nStack];
+		num = next.node;
+		p1f = next.p1f;
+		p2f = next.p2f;
+		start = next.p1;
+		end = next.p2;
+	}
+}
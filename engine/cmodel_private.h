@@ -319,6 +319,23 @@ void FASTCALL CM_ClipBoxToBrush ( CCollisionBSPData *pBSPData, const Vector& min
 void CM_TestBoxInBrush ( CCollisionBSPData *pBSPData, const Vector& mins, const Vector& maxs, const Vector& p1,
 					  trace_t *trace, cbrush_t *brush, BOOL bDispSurf );
 void FASTCALL CM_RecursiveHullCheck ( CCollisionBSPData *pBSPData, int num, float p1f, float p2f, const Vector& p1, const Vector& p2);
+void FASTCALL CM_TraceToLeafDisplacements( cleaf_t *pLeaf, float startFrac, float endFrac );
+
+//=============================================================================
+//
+// Flattened collision tree (cmodel_flat.cpp)
+//
+// A copy of the world and brush model nodes packed depth first with the planes
+// inline, and of the brush sides packed per brush with the bevels split off.
+// Swept traces walk it without recursion; the results match CM_RecursiveHullCheck.
+//
+class ConVar;
+extern ConVar cm_flattree;
+
+void CM_BuildFlatTree( CCollisionBSPData *pBSPData );
+void CM_FreeFlatTree( void );
+bool CM_FlatTreeHasHeadnode( CCollisionBSPData *pBSPData, int headnode );
+void CM_FlatHullCheck( int headnode, const Vector& p1, const Vector& p2 );
 
 //=============================================================================
 //
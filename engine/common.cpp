@@ -1027,30 +1027,18 @@ char    com_gamedir[MAX_OSPATH];
 char	com_defaultgamedir[MAX_OSPATH];
 
 //-----------------------------------------------------------------------------
-// Purpose: Finds the file in the search path.
-//  Sets com_filesize and file handle
+// Purpose: Opens the file from the search path without touching com_filesize,
+//  so it's safe to call from any thread
 // Input  : *filename - 
-//			*file - 
-// Output : int
+// Output : FileHandle_t - NULL if it wasn't found
 //-----------------------------------------------------------------------------
-int COM_FindFile( const char *filename, FileHandle_t *file )
+FileHandle_t COM_FindFileHandle( const char *filename )
 {
-	assert( file );
-
 	// Check if filename has embedded path ID (starts with //)
 	// If so, let the filesystem handle it directly without specifying a pathID
 	if ( filename[0] == '/' && filename[1] == '/' )
 	{
-		*file = g_pFileSystem->Open( filename, "rb", NULL );
-		if ( *file )
-		{
-			com_filesize = g_pFileSystem->Size( *file );
-		}
-		else
-		{
-			com_filesize = -1;
-		}
-		return com_filesize;
+		return g_pFileSystem->Open( filename, "rb", NULL );
 	}
 
 	// Search order for models, sounds, and other game files:
@@ -1058,16 +1046,30 @@ int COM_FindFile( const char *filename, FileHandle_t *file )
 	// 2) BSP pak files (GAME pathID)
 	// 3) hl2 directory (HL2 pathID)
 
-	*file = g_pFileSystem->Open( filename, "rb", "MOD" );
-	if ( !*file )
+	FileHandle_t file = g_pFileSystem->Open( filename, "rb", "MOD" );
+	if ( !file )
 	{
-		*file = g_pFileSystem->Open( filename, "rb", "GAME" );
+		file = g_pFileSystem->Open( filename, "rb", "GAME" );
 	}
-	if ( !*file )
+	if ( !file )
 	{
-		*file = g_pFileSystem->Open( filename, "rb", "HL2" );
+		file = g_pFileSystem->Open( filename, "rb", "HL2" );
 	}
+	return file;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the file in the search path.
+//  Sets com_filesize and file handle
+// Input  : *filename - 
+//			*file - 
+// Output : int
+//-----------------------------------------------------------------------------
+int COM_FindFile( const char *filename, FileHandle_t *file )
+{
+	assert( file );
 
+	*file = COM_FindFileHandle( filename );
 	if ( *file )
 	{
 		com_filesize = g_pFileSystem->Size( *file );
@@ -127,6 +127,8 @@ public:
 
 	// Methods of ISpatialPartitionInternal
 	void	Init( const Vector& worldmin, const Vector& worldmax );
+	void	EnumerateElementsAlongRays( SpatialPartitionListMask_t listMask,
+		const Ray_t *pRays, int nRays, IPartitionRayPacketEnumerator *pIterator );
 
 	// Returns the number of leaves
 	int		LeafCount() const;
@@ -1197,4 +1199,107 @@ void CSpatialPartition::EnumerateElementsAlongRay( SpatialPartitionListMask_t li
 }
 
 
+//-----------------------------------------------------------------------------
+// Gets all entities along a packet of rays: walks the leaves in the rays'
+// bounding box once and tests each element against every ray the way
+// CEnumRay (or CEnumBox for unswept rays) would
+//-----------------------------------------------------------------------------
+class CEnumRayPacket : public CEnumBase
+{
+public:
+	CEnumRayPacket( SpatialPartitionListMask_t listMask, IPartitionRayPacketEnumerator* pIterator, 
+				const Ray_t *pRays, int nRays ) :
+		CEnumBase( listMask, false, NULL )
+	{
+		m_pPacketIterator = pIterator;
+		m_pRays = pRays;
+		m_nRays = nRays;
+		m_nRayMask = 0;
+	}
+
+	bool Intersect( HandleInfo_t& handleInfo )
+	{
+		m_nRayMask = 0;
+		for ( int i = 0; i < m_nRays; ++i )
+		{
+			const Ray_t &ray = m_pRays[i];
+			bool bHit;
+			if ( !ray.m_IsSwept )
+			{
+				Vector rmin, rmax;
+				VectorSubtract( ray.m_Start, ray.m_Extents, rmin );
+				VectorAdd( ray.m_Start, ray.m_Extents, rmax );
+				bHit = IsBoxIntersectingBox( handleInfo.m_Min, handleInfo.m_Max, rmin, rmax );
+			}
+			else if ( ray.m_IsRay )
+			{
+				bHit = IsBoxIntersectingRay( handleInfo.m_Min, handleInfo.m_Max, ray.m_Start, ray.m_Delta );
+			}
+			else
+			{
+				Vector bmin, bmax;
+				VectorAdd( handleInfo.m_Max, ray.m_Extents, bmax );
+				VectorSubtract( handleInfo.m_Min, ray.m_Extents, bmin );
+				bHit = IsBoxIntersectingRay( bmin, bmax, ray.m_Start, ray.m_Delta );
+			}
+
+			if ( bHit )
+			{
+				m_nRayMask |= ( 1U << i );
+			}
+		}
+		return ( m_nRayMask != 0 );
+	}
+
+	bool FASTCALL EnumerateElement( int partitionHandle, int enumId )
+	{
+		HandleInfo_t& handleInfo = g_SpatialPartition.HandleInfo( partitionHandle );
+
+		if ( !ShouldVisit( partitionHandle, handleInfo, enumId ) )
+			return true;
+
+		if ( !Intersect( handleInfo ) )
+			return true;
+
+		IterationRetval_t retVal = m_pPacketIterator->EnumElement( handleInfo.m_pHandleEntity, m_nRayMask );
+		return (retVal != ITERATION_STOP);
+	}
+
+private:
+	IPartitionRayPacketEnumerator *m_pPacketIterator;
+	const Ray_t *m_pRays;
+	int m_nRays;
+	unsigned int m_nRayMask;
+};
+
+void CSpatialPartition::EnumerateElementsAlongRays( SpatialPartitionListMask_t listMask, 
+	const Ray_t *pRays, int nRays, IPartitionRayPacketEnumerator *pIterator )
+{
+	Assert( (listMask & m_nSuppressedListMask) == 0);
+	Assert( nRays <= MAX_PARTITION_RAY_PACKET );
+	
+	if ( listMask == 0 || nRays <= 0 )
+		return;
+
+	Vector mins, maxs;
+	ClearBounds( mins, maxs );
+	for ( int i = 0; i < nRays; ++i )
+	{
+		const Ray_t &ray = pRays[i];
+		Vector vecEnd, rayMins, rayMaxs;
+		VectorAdd( ray.m_Start, ray.m_Delta, vecEnd );
+		VectorMin( ray.m_Start, vecEnd, rayMins );
+		VectorMax( ray.m_Start, vecEnd, rayMaxs );
+		VectorSubtract( rayMins, ray.m_Extents, rayMins );
+		VectorAdd( rayMaxs, ray.m_Extents, rayMaxs );
+		AddPointToBounds( rayMins, mins, maxs );
+		AddPointToBounds( rayMaxs, mins, maxs );
+	}
+
+	CEnumRayPacket enumPacket( listMask, pIterator, pRays, nRays );
+	++m_EnumId;
+	m_pTreeData->EnumerateLeavesInBox( mins, maxs, &enumPacket, m_EnumId );
+}
+
+
 
@@ -0,0 +1,818 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Engine data cache. Each section keeps its entries on intrusive
+//			lists (LRU, frame locked, explicitly locked) so touching, locking
+//			and evicting an entry are all constant time. Entry headers sit
+//			right in front of the data, so a cache_user_t is all that's
+//			needed to find one.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "quakedef.h"
+#include "datacache.h"
+#include "convar.h"
+#include "cmd.h"
+#include "utlvector.h"
+#include "tier0/threadtools.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+static ConVar datacache_budget_model( "datacache_budget_model", "64", 0, "Memory budget for cached model data, in megabytes." );
+static ConVar datacache_budget_sound( "datacache_budget_sound", "32", 0, "Memory budget for cached sounds, in megabytes." );
+static ConVar datacache_budget_other( "datacache_budget_other", "16", 0, "Memory budget for other cached data, in megabytes." );
+
+#define DATACACHE_NAME_LEN	64
+
+struct DataCacheLink_t
+{
+	DataCacheLink_t	*m_pPrev;
+	DataCacheLink_t	*m_pNext;
+};
+
+enum
+{
+	DCL_NONE = 0,			// pending async fill, not on any list
+	DCL_LRU,
+	DCL_FRAMELOCKED,
+	DCL_LOCKED,
+};
+
+enum
+{
+	DCE_FILLED		= 0x01,
+	DCE_FILL_FAILED	= 0x02,
+	DCE_CANCELLED	= 0x04,
+};
+
+struct DataCacheEntry_t
+{
+	DataCacheLink_t		m_Link;			// must be first
+	void				*m_pAlloc;		// unaligned block we got from the heap
+	cache_user_t		*m_pUser;
+	int					m_nSize;		// user bytes
+	unsigned short		m_nLockCount;
+	unsigned char		m_nSection;
+	unsigned char		m_nList;
+	unsigned char		m_nFlags;
+	DataCacheFillFunc_t	m_pfnFill;
+	void				*m_pFillContext;
+	char				m_Name[DATACACHE_NAME_LEN];
+};
+
+// Keeps the user data 16 byte aligned, like the hunk did
+#define DATACACHE_HEADER_SIZE	( ( sizeof( DataCacheEntry_t ) + 15 ) & ~15 )
+
+inline void *EntryData( DataCacheEntry_t *pEntry )
+{
+	return (byte *)pEntry + DATACACHE_HEADER_SIZE;
+}
+
+inline DataCacheEntry_t *EntryFromData( void *pData )
+{
+	return (DataCacheEntry_t *)( (byte *)pData - DATACACHE_HEADER_SIZE );
+}
+
+// Lists are circular with a sentinel; m_pNext is the most recently used end
+inline void ListInit( DataCacheLink_t *pHead )
+{
+	pHead->m_pPrev = pHead->m_pNext = pHead;
+}
+
+inline bool ListIsEmpty( const DataCacheLink_t *pHead )
+{
+	return pHead->m_pNext == pHead;
+}
+
+inline void ListUnlink( DataCacheLink_t *pLink )
+{
+	pLink->m_pPrev->m_pNext = pLink->m_pNext;
+	pLink->m_pNext->m_pPrev = pLink->m_pPrev;
+	pLink->m_pPrev = pLink->m_pNext = NULL;
+}
+
+inline void ListLinkHead( DataCacheLink_t *pHead, DataCacheLink_t *pLink )
+{
+	pLink->m_pPrev = pHead;
+	pLink->m_pNext = pHead->m_pNext;
+	pHead->m_pNext->m_pPrev = pLink;
+	pHead->m_pNext = pLink;
+}
+
+
+//-----------------------------------------------------------------------------
+// A budgeted section of the cache
+//-----------------------------------------------------------------------------
+class CDataCacheSection
+{
+public:
+	void				Init( const char *pName, ConVar *pBudget );
+	void				Shutdown();
+
+	DataCacheEntry_t	*Alloc( cache_user_t *c, int size, const char *name, bool bPending );
+	void				Free( DataCacheEntry_t *pEntry );
+	void				Touch( DataCacheEntry_t *pEntry, bool bHit );
+	void				Lock( DataCacheEntry_t *pEntry );
+	void				Unlock( DataCacheEntry_t *pEntry );
+	void				FinishFill( DataCacheEntry_t *pEntry );
+	void				EndLock();
+	void				Flush();
+
+	int					Budget() const;
+	void				GetStats( DataCacheStats_t *pStats );
+	void				ResetStats();
+	void				Enumerate( DataCacheEntryFunc_t pfnEntry, void *pContext );
+
+	int					m_nUsed;
+
+private:
+	void				Link( DataCacheEntry_t *pEntry, int nList );
+	void				Unlink( DataCacheEntry_t *pEntry );
+	void				EvictToFit( int nSize );
+	void				FreeEntry( DataCacheEntry_t *pEntry );
+
+	const char			*m_pName;
+	ConVar				*m_pBudget;
+	CThreadFastMutex	m_Lock;
+
+	DataCacheLink_t		m_LRU;
+	DataCacheLink_t		m_FrameLocked;
+	DataCacheLink_t		m_Locked;
+
+	int					m_nPeakUsed;
+	int					m_nLockedBytes;
+	int					m_nEntries;
+	int					m_nHits;
+	int					m_nFills;
+	int					m_nEvictions;
+	int					m_nEvictedBytes;
+	int					m_nOverBudget;
+	int					m_nAsyncFills;
+};
+
+static CDataCacheSection	s_Sections[DC_NUM_SECTIONS];
+static bool					s_bInLockFrame;
+
+void CDataCacheSection::Init( const char *pName, ConVar *pBudget )
+{
+	m_pName = pName;
+	m_pBudget = pBudget;
+	ListInit( &m_LRU );
+	ListInit( &m_FrameLocked );
+	ListInit( &m_Locked );
+	m_nUsed = 0;
+	m_nPeakUsed = 0;
+	m_nLockedBytes = 0;
+	m_nEntries = 0;
+	ResetStats();
+}
+
+void CDataCacheSection::Shutdown()
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	// Owners may already be gone by now, so don't touch their cache_user_t
+	DataCacheLink_t *pLists[3] = { &m_LRU, &m_FrameLocked, &m_Locked };
+	for ( int i = 0; i < 3; i++ )
+	{
+		while ( !ListIsEmpty( pLists[i] ) )
+		{
+			DataCacheEntry_t *pEntry = (DataCacheEntry_t *)pLists[i]->m_pNext;
+			pEntry->m_nLockCount = 0;
+			FreeEntry( pEntry );
+		}
+	}
+}
+
+int CDataCacheSection::Budget() const
+{
+	return (int)( m_pBudget->GetFloat() * 1024.0f * 1024.0f );
+}
+
+void CDataCacheSection::Link( DataCacheEntry_t *pEntry, int nList )
+{
+	Assert( pEntry->m_nList == DCL_NONE );
+	switch ( nList )
+	{
+	case DCL_LRU:
+		ListLinkHead( &m_LRU, &pEntry->m_Link );
+		break;
+
+	case DCL_FRAMELOCKED:
+		ListLinkHead( &m_FrameLocked, &pEntry->m_Link );
+		m_nLockedBytes += pEntry->m_nSize;
+		break;
+
+	case DCL_LOCKED:
+		ListLinkHead( &m_Locked, &pEntry->m_Link );
+		m_nLockedBytes += pEntry->m_nSize;
+		break;
+	}
+	pEntry->m_nList = nList;
+}
+
+void CDataCacheSection::Unlink( DataCacheEntry_t *pEntry )
+{
+	if ( pEntry->m_nList == DCL_NONE )
+		return;
+
+	ListUnlink( &pEntry->m_Link );
+	if ( pEntry->m_nList != DCL_LRU )
+	{
+		m_nLockedBytes -= pEntry->m_nSize;
+	}
+	pEntry->m_nList = DCL_NONE;
+}
+
+void CDataCacheSection::FreeEntry( DataCacheEntry_t *pEntry )
+{
+	Assert( pEntry->m_nLockCount == 0 );
+	Unlink( pEntry );
+	m_nUsed -= pEntry->m_nSize;
+	m_nEntries--;
+	free( pEntry->m_pAlloc );
+}
+
+//-----------------------------------------------------------------------------
+// Throws out least recently used entries until nSize more bytes fit in the
+// budget. Locked entries aren't on the LRU list, so they're never touched.
+//-----------------------------------------------------------------------------
+void CDataCacheSection::EvictToFit( int nSize )
+{
+	int nBudget = Budget();
+	while ( m_nUsed + nSize > nBudget )
+	{
+		if ( ListIsEmpty( &m_LRU ) )
+		{
+			m_nOverBudget++;
+			return;
+		}
+
+		DataCacheEntry_t *pEntry = (DataCacheEntry_t *)m_LRU.m_pPrev;
+		m_nEvictions++;
+		m_nEvictedBytes += pEntry->m_nSize;
+		pEntry->m_pUser->data = NULL;
+		FreeEntry( pEntry );
+	}
+}
+
+DataCacheEntry_t *CDataCacheSection::Alloc( cache_user_t *c, int size, const char *name, bool bPending )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	EvictToFit( size );
+
+	void *pAlloc = malloc( size + DATACACHE_HEADER_SIZE + 15 );
+	if ( !pAlloc )
+	{
+		Sys_Error( "DataCache_Alloc: out of memory allocating %d bytes for %s", size, name );
+	}
+
+	DataCacheEntry_t *pEntry = (DataCacheEntry_t *)( ( (uintp)pAlloc + 15 ) & ~15 );
+	memset( pEntry, 0, sizeof( *pEntry ) );
+	pEntry->m_pAlloc = pAlloc;
+	pEntry->m_pUser = c;
+	pEntry->m_nSize = size;
+	pEntry->m_nSection = this - s_Sections;
+	Q_strncpy( pEntry->m_Name, name ? name : "", sizeof( pEntry->m_Name ) );
+
+	m_nUsed += size;
+	m_nEntries++;
+	m_nFills++;
+	if ( m_nUsed > m_nPeakUsed )
+	{
+		m_nPeakUsed = m_nUsed;
+	}
+
+	// Pending entries stay off the lists until the fill comes back
+	if ( !bPending )
+	{
+		Link( pEntry, s_bInLockFrame ? DCL_FRAMELOCKED : DCL_LRU );
+	}
+	return pEntry;
+}
+
+void CDataCacheSection::Free( DataCacheEntry_t *pEntry )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	// Freeing a locked entry is a bug in the caller, but don't leak it
+	Assert( pEntry->m_nLockCount == 0 );
+	pEntry->m_nLockCount = 0;
+	FreeEntry( pEntry );
+}
+
+void CDataCacheSection::Touch( DataCacheEntry_t *pEntry, bool bHit )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	if ( bHit )
+	{
+		m_nHits++;
+	}
+
+	if ( pEntry->m_nList == DCL_LOCKED || pEntry->m_nList == DCL_NONE )
+		return;
+
+	Unlink( pEntry );
+	Link( pEntry, s_bInLockFrame ? DCL_FRAMELOCKED : DCL_LRU );
+}
+
+void CDataCacheSection::Lock( DataCacheEntry_t *pEntry )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	if ( pEntry->m_nLockCount++ == 0 )
+	{
+		Unlink( pEntry );
+		Link( pEntry, DCL_LOCKED );
+	}
+}
+
+void CDataCacheSection::Unlock( DataCacheEntry_t *pEntry )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	Assert( pEntry->m_nLockCount > 0 );
+	if ( pEntry->m_nLockCount == 0 || --pEntry->m_nLockCount != 0 )
+		return;
+
+	Unlink( pEntry );
+	Link( pEntry, s_bInLockFrame ? DCL_FRAMELOCKED : DCL_LRU );
+}
+
+void CDataCacheSection::FinishFill( DataCacheEntry_t *pEntry )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	m_nAsyncFills++;
+	Link( pEntry, s_bInLockFrame ? DCL_FRAMELOCKED : DCL_LRU );
+}
+
+//-----------------------------------------------------------------------------
+// Everything touched during the lock frame was used more recently than the
+// rest of the LRU, so the frame list goes on the front in the same order.
+//-----------------------------------------------------------------------------
+void CDataCacheSection::EndLock()
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	while ( !ListIsEmpty( &m_FrameLocked ) )
+	{
+		DataCacheEntry_t *pEntry = (DataCacheEntry_t *)m_FrameLocked.m_pPrev;
+		Unlink( pEntry );
+		Link( pEntry, DCL_LRU );
+	}
+}
+
+void CDataCacheSection::Flush()
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	EndLock();
+	while ( !ListIsEmpty( &m_LRU ) )
+	{
+		DataCacheEntry_t *pEntry = (DataCacheEntry_t *)m_LRU.m_pNext;
+		pEntry->m_pUser->data = NULL;
+		FreeEntry( pEntry );
+	}
+}
+
+void CDataCacheSection::GetStats( DataCacheStats_t *pStats )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	pStats->m_pName = m_pName;
+	pStats->m_nBudget = Budget();
+	pStats->m_nUsed = m_nUsed;
+	pStats->m_nPeakUsed = m_nPeakUsed;
+	pStats->m_nLocked = m_nLockedBytes;
+	pStats->m_nEntries = m_nEntries;
+	pStats->m_nHits = m_nHits;
+	pStats->m_nFills = m_nFills;
+	pStats->m_nEvictions = m_nEvictions;
+	pStats->m_nEvictedBytes = m_nEvictedBytes;
+	pStats->m_nOverBudget = m_nOverBudget;
+	pStats->m_nAsyncFills = m_nAsyncFills;
+}
+
+void CDataCacheSection::ResetStats()
+{
+	m_nPeakUsed = m_nUsed;
+	m_nHits = 0;
+	m_nFills = 0;
+	m_nEvictions = 0;
+	m_nEvictedBytes = 0;
+	m_nOverBudget = 0;
+	m_nAsyncFills = 0;
+}
+
+void CDataCacheSection::Enumerate( DataCacheEntryFunc_t pfnEntry, void *pContext )
+{
+	AUTO_LOCK_FM( m_Lock );
+
+	DataCacheLink_t *pLists[3] = { &m_Locked, &m_FrameLocked, &m_LRU };
+	for ( int i = 0; i < 3; i++ )
+	{
+		for ( DataCacheLink_t *pLink = pLists[i]->m_pNext; pLink != pLists[i]; pLink = pLink->m_pNext )
+		{
+			DataCacheEntry_t *pEntry = (DataCacheEntry_t *)pLink;
+			pfnEntry( pEntry->m_Name, pEntry->m_nSize, EntryData( pEntry ), pContext );
+		}
+	}
+}
+
+inline CDataCacheSection &EntrySection( DataCacheEntry_t *pEntry )
+{
+	return s_Sections[pEntry->m_nSection];
+}
+
+
+//-----------------------------------------------------------------------------
+// Async fills. A single worker runs the fill callbacks in order; finished
+// entries wait on a list until DataCache_Update publishes them on the main
+// thread, so owners never see c->data change underneath them.
+//-----------------------------------------------------------------------------
+static CThreadMutex					s_AsyncMutex;
+static CThreadEvent					s_AsyncWork;
+static CUtlVector<DataCacheEntry_t *> s_AsyncQueue;
+static CUtlVector<DataCacheEntry_t *> s_AsyncDone;
+static DataCacheEntry_t * volatile	s_pAsyncFilling;
+static ThreadHandle_t				s_hAsyncThread;
+static volatile bool				s_bAsyncExit;
+
+static unsigned DataCache_AsyncThread( void *pParam )
+{
+	g_VProfCurrentProfile.SetThreadName( "DataCache" );
+
+	for ( ;; )
+	{
+		s_AsyncWork.Wait();
+
+		for ( ;; )
+		{
+			s_AsyncMutex.Lock();
+			if ( s_bAsyncExit || !s_AsyncQueue.Count() )
+			{
+				bool bExit = s_bAsyncExit;
+				s_AsyncMutex.Unlock();
+				if ( bExit )
+					return 0;
+				break;
+			}
+
+			DataCacheEntry_t *pEntry = s_AsyncQueue[0];
+			s_AsyncQueue.Remove( 0 );
+			s_pAsyncFilling = pEntry;
+			s_AsyncMutex.Unlock();
+
+			bool bFilled;
+			{
+				VPROF_BUDGET( "DataCache_AsyncFill", VPROF_BUDGETGROUP_OTHER_FILESYSTEM );
+				bFilled = pEntry->m_pfnFill( EntryData( pEntry ), pEntry->m_nSize, pEntry->m_pFillContext );
+			}
+
+			s_AsyncMutex.Lock();
+			pEntry->m_nFlags |= bFilled ? DCE_FILLED : DCE_FILL_FAILED;
+			s_AsyncDone.AddToTail( pEntry );
+			s_pAsyncFilling = NULL;
+			s_AsyncMutex.Unlock();
+		}
+	}
+}
+
+void DataCache_AllocAsync( DataCacheSection_t section, cache_user_t *c, int size, const char *name, DataCacheFillFunc_t pfnFill, void *pContext )
+{
+	if ( c->data || DataCache_IsPending( c ) )
+	{
+		Sys_Error( "DataCache_AllocAsync: already allocated" );
+	}
+
+	if ( size <= 0 )
+	{
+		Sys_Error( "DataCache_AllocAsync: size %i", size );
+	}
+
+	DataCacheEntry_t *pEntry = s_Sections[section].Alloc( c, size, name, true );
+	pEntry->m_pfnFill = pfnFill;
+	pEntry->m_pFillContext = pContext;
+
+	AUTO_LOCK( s_AsyncMutex );
+	if ( !s_hAsyncThread )
+	{
+		s_bAsyncExit = false;
+		s_hAsyncThread = CreateSimpleThread( DataCache_AsyncThread, NULL );
+	}
+
+	if ( !s_hAsyncThread )
+	{
+		// No worker; fill it right here
+		pEntry->m_nFlags |= pfnFill( EntryData( pEntry ), size, pContext ) ? DCE_FILLED : DCE_FILL_FAILED;
+		s_AsyncDone.AddToTail( pEntry );
+		return;
+	}
+
+	s_AsyncQueue.AddToTail( pEntry );
+	s_AsyncWork.Set();
+}
+
+static int FindEntryForUser( const CUtlVector<DataCacheEntry_t *> &list, cache_user_t *c )
+{
+	for ( int i = 0; i < list.Count(); i++ )
+	{
+		if ( list[i]->m_pUser == c )
+			return i;
+	}
+	return -1;
+}
+
+bool DataCache_IsPending( cache_user_t *c )
+{
+	AUTO_LOCK( s_AsyncMutex );
+	if ( s_pAsyncFilling && s_pAsyncFilling->m_pUser == c )
+		return true;
+
+	return ( FindEntryForUser( s_AsyncQueue, c ) >= 0 || FindEntryForUser( s_AsyncDone, c ) >= 0 );
+}
+
+void DataCache_CancelAsync( cache_user_t *c )
+{
+	for ( ;; )
+	{
+		s_AsyncMutex.Lock();
+
+		DataCacheEntry_t *pEntry = NULL;
+		int i = FindEntryForUser( s_AsyncQueue, c );
+		if ( i >= 0 )
+		{
+			pEntry = s_AsyncQueue[i];
+			s_AsyncQueue.Remove( i );
+		}
+		else if ( ( i = FindEntryForUser( s_AsyncDone, c ) ) >= 0 )
+		{
+			pEntry = s_AsyncDone[i];
+			s_AsyncDone.Remove( i );
+		}
+
+		bool bInFlight = ( s_pAsyncFilling && s_pAsyncFilling->m_pUser == c );
+		s_AsyncMutex.Unlock();
+
+		if ( pEntry )
+		{
+			EntrySection( pEntry ).Free( pEntry );
+			return;
+		}
+
+		// The fill callback may be using the owner's memory, so wait it out
+		if ( !bInFlight )
+			return;
+
+		ThreadSleep( 1 );
+	}
+}
+
+void DataCache_Update( void )
+{
+	if ( !s_AsyncDone.Count() )
+		return;
+
+	CUtlVector<DataCacheEntry_t *> done;
+	s_AsyncMutex.Lock();
+	done.AddVectorToTail( s_AsyncDone );
+	s_AsyncDone.RemoveAll();
+	s_AsyncMutex.Unlock();
+
+	for ( int i = 0; i < done.Count(); i++ )
+	{
+		DataCacheEntry_t *pEntry = done[i];
+		if ( pEntry->m_nFlags & DCE_FILLED )
+		{
+			pEntry->m_pUser->data = EntryData( pEntry );
+			EntrySection( pEntry ).FinishFill( pEntry );
+		}
+		else
+		{
+			DevWarning( "DataCache: async fill of %s failed\n", pEntry->m_Name );
+			EntrySection( pEntry ).Free( pEntry );
+		}
+	}
+}
+
+void DataCache_FinishPendingFills( void )
+{
+	for ( ;; )
+	{
+		s_AsyncMutex.Lock();
+		bool bBusy = ( s_AsyncQueue.Count() || s_pAsyncFilling );
+		s_AsyncMutex.Unlock();
+
+		if ( !bBusy )
+			break;
+
+		ThreadSleep( 1 );
+	}
+
+	DataCache_Update();
+}
+
+
+//-----------------------------------------------------------------------------
+// Synchronous interface
+//-----------------------------------------------------------------------------
+void DataCache_Init( void )
+{
+	s_Sections[DC_SECTION_MODEL].Init( "model", &datacache_budget_model );
+	s_Sections[DC_SECTION_SOUND].Init( "sound", &datacache_budget_sound );
+	s_Sections[DC_SECTION_OTHER].Init( "other", &datacache_budget_other );
+	s_bInLockFrame = false;
+}
+
+void DataCache_Shutdown( void )
+{
+	if ( s_hAsyncThread )
+	{
+		s_AsyncMutex.Lock();
+		s_bAsyncExit = true;
+		s_AsyncMutex.Unlock();
+		s_AsyncWork.Set();
+
+		ThreadJoin( s_hAsyncThread );
+		ReleaseThreadHandle( s_hAsyncThread );
+		s_hAsyncThread = NULL;
+	}
+
+	// Whatever never got published just goes away
+	s_AsyncDone.AddVectorToTail( s_AsyncQueue );
+	s_AsyncQueue.Purge();
+	for ( int i = 0; i < s_AsyncDone.Count(); i++ )
+	{
+		EntrySection( s_AsyncDone[i] ).Free( s_AsyncDone[i] );
+	}
+	s_AsyncDone.Purge();
+
+	for ( int i = 0; i < DC_NUM_SECTIONS; i++ )
+	{
+		s_Sections[i].Shutdown();
+	}
+}
+
+void *DataCache_Alloc( DataCacheSection_t section, cache_user_t *c, int size, const char *name )
+{
+	if ( c->data )
+	{
+		Sys_Error( "DataCache_Alloc: already allocated" );
+	}
+
+	if ( size <= 0 )
+	{
+		Sys_Error( "DataCache_Alloc: size %i", size );
+	}
+
+	// Whoever fills it right now wins over a queued fill
+	DataCache_CancelAsync( c );
+
+	DataCacheEntry_t *pEntry = s_Sections[section].Alloc( c, size, name, false );
+	c->data = EntryData( pEntry );
+	return c->data;
+}
+
+void *DataCache_Check( cache_user_t *c )
+{
+	if ( !c->data )
+		return NULL;
+
+	DataCacheEntry_t *pEntry = EntryFromData( c->data );
+	EntrySection( pEntry ).Touch( pEntry, true );
+	return c->data;
+}
+
+void DataCache_Free( cache_user_t *c )
+{
+	if ( !c->data )
+		return;
+
+	DataCacheEntry_t *pEntry = EntryFromData( c->data );
+	c->data = NULL;
+	EntrySection( pEntry ).Free( pEntry );
+}
+
+void *DataCache_Lock( cache_user_t *c )
+{
+	if ( !c->data )
+		return NULL;
+
+	DataCacheEntry_t *pEntry = EntryFromData( c->data );
+	EntrySection( pEntry ).Lock( pEntry );
+	return c->data;
+}
+
+void DataCache_Unlock( cache_user_t *c )
+{
+	if ( !c->data )
+		return;
+
+	DataCacheEntry_t *pEntry = EntryFromData( c->data );
+	EntrySection( pEntry ).Unlock( pEntry );
+}
+
+void DataCache_BeginLock( void )
+{
+	s_bInLockFrame = true;
+}
+
+void DataCache_EndLock( void )
+{
+	s_bInLockFrame = false;
+	for ( int i = 0; i < DC_NUM_SECTIONS; i++ )
+	{
+		s_Sections[i].EndLock();
+	}
+}
+
+void DataCache_Flush( void )
+{
+	for ( int i = 0; i < DC_NUM_SECTIONS; i++ )
+	{
+		s_Sections[i].Flush();
+	}
+}
+
+void DataCache_FlushSection( DataCacheSection_t section )
+{
+	s_Sections[section].Flush();
+}
+
+int DataCache_TotalUsed( void )
+{
+	int nTotal = 0;
+	for ( int i = 0; i < DC_NUM_SECTIONS; i++ )
+	{
+		nTotal += s_Sections[i].m_nUsed;
+	}
+	return nTotal;
+}
+
+void DataCache_GetStats( DataCacheSection_t section, DataCacheStats_t *pStats )
+{
+	s_Sections[section].GetStats( pStats );
+}
+
+void DataCache_ResetStats( void )
+{
+	for ( int i = 0; i < DC_NUM_SECTIONS; i++ )
+	{
+		s_Sections[i].ResetStats();
+	}
+}
+
+void DataCache_EnumerateSection( DataCacheSection_t section, DataCacheEntryFunc_t pfnEntry, void *pContext )
+{
+	s_Sections[section].Enumerate( pfnEntry, pContext );
+}
+
+
+//-----------------------------------------------------------------------------
+// Reports usage, hit rate and evictions for each section
+//-----------------------------------------------------------------------------
+CON_COMMAND( datacache_stats, "Print data cache usage, hit rates and evictions per section. 'datacache_stats reset' clears the counters." )
+{
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) )
+	{
+		DataCache_ResetStats();
+		Con_Printf( "Data cache stats reset.\n" );
+		return;
+	}
+
+	Con_Printf( "%-8s %10s %10s %10s %10s %7s %7s %8s %8s %10s %6s\n",
+		"section", "budget", "used", "peak", "locked", "entries", "hit %", "fills", "evicted", "evict mem", "over" );
+
+	for ( int i = 0; i < DC_NUM_SECTIONS; i++ )
+	{
+		DataCacheStats_t stats;
+		DataCache_GetStats( (DataCacheSection_t)i, &stats );
+
+		int nLookups = stats.m_nHits + stats.m_nFills;
+		float flHitRate = nLookups ? 100.0f * stats.m_nHits / nLookups : 0.0f;
+
+		Con_Printf( "%-8s %10s %10s %10s %10s %7d %6.1f%% %8d %8d %10s %6d\n",
+			stats.m_pName,
+			Q_pretifymem( stats.m_nBudget ),
+			Q_pretifymem( stats.m_nUsed ),
+			Q_pretifymem( stats.m_nPeakUsed ),
+			Q_pretifymem( stats.m_nLocked ),
+			stats.m_nEntries,
+			flHitRate,
+			stats.m_nFills,
+			stats.m_nEvictions,
+			Q_pretifymem( stats.m_nEvictedBytes ),
+			stats.m_nOverBudget );
+
+		if ( stats.m_nAsyncFills )
+		{
+			Con_Printf( "         %d async fills\n", stats.m_nAsyncFills );
+		}
+	}
+}
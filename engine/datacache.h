@@ -0,0 +1,101 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Engine data cache. Cached data lives in per resource type
+//			sections, each with its own memory budget and LRU list. Entries
+//			are tracked through a cache_user_t so the old Cache_ interface
+//			in cache.h sits directly on top of this.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef DATACACHE_H
+#define DATACACHE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cache_user.h"
+
+
+//-----------------------------------------------------------------------------
+// Cache sections. Each section has its own budget, so a level full of sounds
+// can't push the models out and vice versa.
+//-----------------------------------------------------------------------------
+enum DataCacheSection_t
+{
+	DC_SECTION_MODEL = 0,
+	DC_SECTION_SOUND,
+	DC_SECTION_OTHER,
+
+	DC_NUM_SECTIONS
+};
+
+struct DataCacheStats_t
+{
+	const char	*m_pName;
+	int			m_nBudget;			// bytes
+	int			m_nUsed;			// bytes, including locked and pending entries
+	int			m_nPeakUsed;
+	int			m_nLocked;			// bytes that can't be evicted right now
+	int			m_nEntries;
+	int			m_nHits;			// checks that found their data
+	int			m_nFills;			// allocations, ie. misses that had to be reloaded
+	int			m_nEvictions;
+	int			m_nEvictedBytes;
+	int			m_nOverBudget;		// allocations that couldn't evict enough to fit
+	int			m_nAsyncFills;
+};
+
+// Fills in an entry from the cache's worker thread. Must only touch the
+// buffer and thread safe services. Return false to discard the entry.
+typedef bool (*DataCacheFillFunc_t)( void *pDest, int nSize, void *pContext );
+
+void	DataCache_Init( void );
+void	DataCache_Shutdown( void );
+
+// Call once a frame; hands finished async fills to their owners
+void	DataCache_Update( void );
+
+// Allocates an entry, evicting least recently used data from the section
+// if it's over budget. Never fails; if everything is locked the section
+// just goes over budget. Drops a pending async fill for the same owner.
+void	*DataCache_Alloc( DataCacheSection_t section, cache_user_t *c, int size, const char *name );
+
+// Returns the data and makes it the most recently used, or NULL if it was evicted
+void	*DataCache_Check( cache_user_t *c );
+
+void	DataCache_Free( cache_user_t *c );
+
+// Locked entries are never evicted. Locks nest; returns NULL if the data
+// was already evicted.
+void	*DataCache_Lock( cache_user_t *c );
+void	DataCache_Unlock( cache_user_t *c );
+
+// All entries allocated or checked between these are treated as locked
+// until EndLock.
+void	DataCache_BeginLock( void );
+void	DataCache_EndLock( void );
+
+// Queues an allocation to be filled on the worker thread. c->data stays
+// NULL until DataCache_Update sees the fill finish.
+void	DataCache_AllocAsync( DataCacheSection_t section, cache_user_t *c, int size, const char *name, DataCacheFillFunc_t pfnFill, void *pContext );
+bool	DataCache_IsPending( cache_user_t *c );
+
+// Drops a pending fill. Blocks if the worker is in the middle of it.
+void	DataCache_CancelAsync( cache_user_t *c );
+void	DataCache_FinishPendingFills( void );
+
+// Throws out every unlocked entry
+void	DataCache_Flush( void );
+void	DataCache_FlushSection( DataCacheSection_t section );
+
+int		DataCache_TotalUsed( void );
+void	DataCache_GetStats( DataCacheSection_t section, DataCacheStats_t *pStats );
+void	DataCache_ResetStats( void );
+
+// Walks the entries of a section, locked ones included
+typedef void (*DataCacheEntryFunc_t)( const char *pName, int nSize, void *pData, void *pContext );
+void	DataCache_EnumerateSection( DataCacheSection_t section, DataCacheEntryFunc_t pfnEntry, void *pContext );
+
+#endif // DATACACHE_H
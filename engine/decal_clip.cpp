@@ -6,6 +6,7 @@
 //=============================================================================
 
 #include "decal_clip.h"
+#include "tier0/mem.h"
 
 
 // --------------------------------------------------------------------------- //
@@ -41,13 +42,8 @@ public:
 
 
 
-// --------------------------------------------------------------------------- //
-// Globals.
-// --------------------------------------------------------------------------- //
-static CDecalVert g_DecalClipVerts[MAX_DECALCLIPVERT];
-static CDecalVert g_DecalClipVerts2[MAX_DECALCLIPVERT];
-
-
+// Clipping a convex polygon to each of the four decal planes adds at most one vertex
+#define DECAL_CLIP_MAX_OUT_VERTS( _nStartVerts )	( (_nStartVerts) + 4 )
 
 
 template< class Clipper >
@@ -116,8 +112,15 @@ CDecalVert* R_DoDecalSHClip(
 	int nStartVerts, 
 	int *pVertCount )
 {
+	int nMaxVerts = DECAL_CLIP_MAX_OUT_VERTS( nStartVerts );
+
+	// The result lives in frame memory unless the caller supplied a buffer
 	if ( pOutVerts == NULL )
-		pOutVerts = &g_DecalClipVerts[0];
+		pOutVerts = MemAllocFrameArray<CDecalVert>( nMaxVerts );
+
+	CMemFrameMark clipVertsMark;
+	CDecalVert *pClipVerts = MemAllocFrameArray<CDecalVert>( nMaxVerts );
+	CDecalVert *pClipVerts2 = MemAllocFrameArray<CDecalVert>( nMaxVerts );
 
 	CPlane_Top top;
 	CPlane_Left left;
@@ -125,10 +128,10 @@ CDecalVert* R_DoDecalSHClip(
 	CPlane_Bottom bottom;
 
 	// Clip the polygon to the decal texture space
-	int outCount = SHClip( pInVerts, nStartVerts, &g_DecalClipVerts2[0], top );
-	outCount = SHClip( &g_DecalClipVerts2[0], outCount, &g_DecalClipVerts[0], left );
-	outCount = SHClip( &g_DecalClipVerts[0], outCount, &g_DecalClipVerts2[0], right );
-	outCount = SHClip( &g_DecalClipVerts2[0], outCount, pOutVerts, bottom );
+	int outCount = SHClip( pInVerts, nStartVerts, pClipVerts2, top );
+	outCount = SHClip( pClipVerts2, outCount, pClipVerts, left );
+	outCount = SHClip( pClipVerts, outCount, pClipVerts2, right );
+	outCount = SHClip( pClipVerts2, outCount, pOutVerts, bottom );
 
 	if ( outCount ) 
 	{
@@ -166,7 +169,7 @@ CDecalVert* R_DoDecalSHClip(
 	return pOutVerts;
 }
 
-// Build the initial list of vertices from the surface verts into the global array, 'verts'.
+// Build the initial list of vertices from the surface verts into pVerts.
 void R_SetupDecalVertsForMSurface( 
 	decal_t *pDecal, 
 	int surfID, 
@@ -296,9 +299,6 @@ void R_SetupDecalClip(
 	Vector textureSpaceBasis[3],
 	float decalWorldScale[2] )
 {
-//	if ( pOutVerts == NULL )
-//		pOutVerts = &g_DecalClipVerts[0];
-
 	R_SetupDecalTextureSpaceBasis( pDecal, vSurfNormal, pMaterial, textureSpaceBasis, decalWorldScale );
 
 	// Generate texture coordinates for each vertex in decal s,t space
@@ -330,8 +330,15 @@ CDecalVert* R_DecalVertsClip(
 		pMaterial,
 		textureSpaceBasis, decalWorldScale );
 
+	// The result has to outlive the surface verts, so allocate it first
+	int nVertCount = MSurf_VertCount( surfID );
+	if ( pOutVerts == NULL )
+		pOutVerts = MemAllocFrameArray<CDecalVert>( DECAL_CLIP_MAX_OUT_VERTS( nVertCount ) );
+
 	// Build the initial list of vertices from the surface verts.
-	R_SetupDecalVertsForMSurface( pDecal, surfID, textureSpaceBasis, g_DecalClipVerts );
+	CMemFrameMark surfVertsMark;
+	CDecalVert *pSurfVerts = MemAllocFrameArray<CDecalVert>( nVertCount );
+	R_SetupDecalVertsForMSurface( pDecal, surfID, textureSpaceBasis, pSurfVerts );
 
-	return R_DoDecalSHClip( g_DecalClipVerts, pOutVerts, pDecal, MSurf_VertCount( surfID ), pVertCount );
+	return R_DoDecalSHClip( pSurfVerts, pOutVerts, pDecal, nVertCount, pVertCount );
 }
@@ -20,9 +20,6 @@
 #include "gl_model_private.h"
 
 
-#define MAX_DECALCLIPVERT		32
-
-
 class CDecalVert
 {
 public:
@@ -31,6 +31,7 @@
 #include "cmodel_private.h"
 #include "collisionutils.h"
 #include "tier0/dbg.h"
+#include "tier0/mem.h"
 #include "gl_rmain.h"
 #include "lightcache.h"
 #include "r_local.h"
@@ -178,7 +179,8 @@ void CDispInfo::TestAddDecalTri( unsigned short *tempIndices, unsigned short dec
 		Vector2DCopy( tmp.AsVector2D(), pOutVert->m_tCoords );
 	}
 
-	// Clip them.
+	// Clip them. The clipped verts are copied into the fragment right away.
+	CMemFrameMark clipMark;
 	int outCount;
 	CDecalVert *pClipped;
 
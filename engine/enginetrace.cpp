@@ -26,6 +26,11 @@
 #include "client_class.h"
 #include "enginestats.h"
 #include "server_class.h"
+#include "tier0/mem.h"
+#include "enginetrace.h"
+#include "convar.h"
+#include "cmd.h"
+#include <typeinfo>
 
 
 //-----------------------------------------------------------------------------
@@ -50,6 +55,13 @@ public:
 	// Same thing, but enumerate entitys within a box
 	virtual void	EnumerateEntities( const Vector &vecAbsMins, const Vector &vecAbsMaxs, IEntityEnumerator *pEnumerator );
 
+	// Batched traces
+	virtual ITraceBatch *CreateTraceBatch();
+	virtual void	DestroyTraceBatch( ITraceBatch *pBatch );
+
+	// Traces each ray like TraceRay, sharing the entity lookups of nearby rays
+	void TraceRays( int nRays, const Ray_t *pRays, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTraces );
+
 	// FIXME: Different versions for client + server. Eventually we need to make these go away
 	virtual void HandleEntityToCollideable( IHandleEntity *pHandleEntity, ICollideable **ppCollide, const char **ppDebugName ) = 0;
 	virtual ICollideable *GetWorldCollideable() = 0;
@@ -88,6 +100,16 @@ private:
 	// Clips a trace to another trace
 	bool ClipTraceToTrace( trace_t &clipTrace, trace_t *pFinalTrace );
 
+	// The parts of TraceRay: the world trace (returns false when the trace is done),
+	// the entity filter and the fixup back to the unclipped ray
+	bool TraceRayAgainstWorld( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace, Ray_t *pEntityRay, float *pWorldFraction );
+	ICollideable *GetEntityToClip( IHandleEntity *pHandleEntity, unsigned int fMask, ITraceFilter *pTraceFilter );
+	void ClipRayToEntities( const Ray_t &entityRay, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace );
+	void FinishTraceRay( const Ray_t &ray, float flWorldFraction, trace_t *pTrace );
+
+	// Traces up to MAX_PARTITION_RAY_PACKET rays with one entity enumeration
+	void TraceRayPacket( int nRays, const Ray_t **ppRays, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t **ppTraces );
+	void ClipRayPacketToEntities( int nRays, const Ray_t *pRays, trace_t **ppTraces, unsigned int fMask, ITraceFilter *pTraceFilter );
 };
 
 class CEngineTraceServer : public CEngineTrace
@@ -661,23 +683,39 @@ void CEngineTrace::ClipRayToEntity( const Ray_t &ray, unsigned int fMask, IHandl
 //-----------------------------------------------------------------------------
 // Grabs all entities along a ray
 //-----------------------------------------------------------------------------
+// The list lives in frame memory, so callers must hold a CMemFrameMark
+// around the enumeration and their use of the results.
 class CEntitiesAlongRay : public IPartitionEnumerator
 {
 public:
-	CEntitiesAlongRay( ) : m_EntityHandles(0, 32) {}
+	CEntitiesAlongRay( ) : m_pEntityHandles(NULL), m_nCount(0), m_nMaxCount(0) {}
 
 	void Reset()
 	{
-		m_EntityHandles.RemoveAll();
+		m_nCount = 0;
 	}
 
 	IterationRetval_t EnumElement( IHandleEntity *pHandleEntity )
 	{
-		m_EntityHandles.AddToTail( pHandleEntity );
+		if ( m_nCount == m_nMaxCount )
+		{
+			// Frame memory can't grow in place; the old list goes away with the mark
+			m_nMaxCount = m_nMaxCount ? m_nMaxCount * 2 : 32;
+			IHandleEntity **pNewHandles = MemAllocFrameArray<IHandleEntity*>( m_nMaxCount );
+			if ( m_nCount )
+			{
+				memcpy( pNewHandles, m_pEntityHandles, m_nCount * sizeof(IHandleEntity*) );
+			}
+			m_pEntityHandles = pNewHandles;
+		}
+
+		m_pEntityHandles[m_nCount++] = pHandleEntity;
 		return ITERATION_CONTINUE;
 	}
 
-	CUtlVector< IHandleEntity * >	m_EntityHandles;
+	IHandleEntity	**m_pEntityHandles;
+	int				m_nCount;
+	int				m_nMaxCount;
 };
 
 
@@ -800,20 +838,231 @@ ICollideable *CEngineTraceServer::GetWorldCollideable()
 
 
 //-----------------------------------------------------------------------------
-// A version that simply accepts a ray (can work as a traceline or tracehull)
+// World trace cache. Servers trace the same static world rays over and over
+// (NPCs checking sight between nodes they stand on, idle props checking the
+// ground), so the world part of TraceRay is remembered by ray and mask. The
+// buckets hash the ray snapped to a grid; a hit needs the exact same ray.
+// Only the world BSP is cached. Brush entities are clipped as entities on
+// every trace, so their moving can't make an entry stale; the world itself
+// only changes on a map load or a terrain mod, which flush the cache.
 //-----------------------------------------------------------------------------
-void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace )
+static ConVar trace_worldcache( "trace_worldcache", "0", 0, "Cache world traces by ray and mask" );
+static ConVar trace_worldcache_callers( "trace_worldcache_callers", "0", 0, "Count world trace cache hits per trace filter class and mask for trace_worldcache_stats" );
+
+#define WORLD_TRACE_CACHE_BITS		12
+#define WORLD_TRACE_CACHE_SIZE		( 1 << WORLD_TRACE_CACHE_BITS )
+#define WORLD_TRACE_CACHE_GRID		0.125f
+#define MAX_WORLD_TRACE_CALLERS		64
+
+struct WorldTraceCacheEntry_t
 {
-	CTraceFilterHitAll traceFilter;
-	if ( !pTraceFilter )
+	Vector			m_Start;
+	Vector			m_Delta;
+	Vector			m_StartOffset;
+	Vector			m_Extents;
+	unsigned int	m_fMask;
+	int				m_nGeneration;			// the entry is empty unless this matches the cache's
+	trace_t			m_Trace;
+};
+
+// Callers are told apart by the class of their trace filter and their mask.
+// The class name lives in the game DLL, so it is copied for printing.
+struct WorldTraceCaller_t
+{
+	const void		*m_pFilterType;
+	char			m_szFilterName[64];
+	unsigned int	m_fMask;
+	int				m_nLookups;
+	int				m_nHits;
+};
+
+struct WorldTraceCacheStats_t
+{
+	int				m_nLookups;
+	int				m_nHits;
+	int				m_nEvictions;
+	int				m_nFlushes;
+	int				m_nCallers;
+	int				m_nUntrackedLookups;	// from callers past MAX_WORLD_TRACE_CALLERS
+	WorldTraceCaller_t m_Callers[MAX_WORLD_TRACE_CALLERS];
+};
+
+static WorldTraceCacheEntry_t	*s_pWorldTraceCache;
+static int						s_nWorldTraceCacheGeneration = 1;
+static WorldTraceCacheStats_t	s_WorldTraceCacheStats;
+
+void InvalidateWorldTraceCache()
+{
+	// Entries from older generations read as empty
+	++s_nWorldTraceCacheGeneration;
+	++s_WorldTraceCacheStats.m_nFlushes;
+}
+
+static inline int WorldTraceCacheSnap( float flValue )
+{
+	return (int)floor( flValue * ( 1.0f / WORLD_TRACE_CACHE_GRID ) );
+}
+
+static unsigned int WorldTraceCacheBucket( const Ray_t &ray, unsigned int fMask )
+{
+	unsigned int nHash = fMask * 0x9E3779B1;
+	for ( int i = 0; i < 3; ++i )
 	{
-		pTraceFilter = &traceFilter;
+		nHash = ( nHash ^ (unsigned int)WorldTraceCacheSnap( ray.m_Start[i] ) ) * 0x01000193;
+		nHash = ( nHash ^ (unsigned int)WorldTraceCacheSnap( ray.m_Start[i] + ray.m_Delta[i] ) ) * 0x01000193;
+		nHash = ( nHash ^ (unsigned int)WorldTraceCacheSnap( ray.m_Extents[i] ) ) * 0x01000193;
 	}
+	return ( nHash ^ ( nHash >> WORLD_TRACE_CACHE_BITS ) ) & ( WORLD_TRACE_CACHE_SIZE - 1 );
+}
 
-	// Gather statistics.
-	g_EngineStats.IncrementCountedStat( ENGINE_STATS_NUM_TRACE_LINES, 1 );
-	MEASURE_TIMED_STAT( ENGINE_STATS_TRACE_LINE_TIME );
-	
+static WorldTraceCaller_t *WorldTraceCacheCaller( ITraceFilter *pTraceFilter, unsigned int fMask )
+{
+	const std::type_info &filterType = typeid( *pTraceFilter );
+	WorldTraceCacheStats_t &stats = s_WorldTraceCacheStats;
+	for ( int i = 0; i < stats.m_nCallers; ++i )
+	{
+		if ( stats.m_Callers[i].m_pFilterType == &filterType && stats.m_Callers[i].m_fMask == fMask )
+			return &stats.m_Callers[i];
+	}
+
+	if ( stats.m_nCallers == MAX_WORLD_TRACE_CALLERS )
+		return NULL;
+
+	WorldTraceCaller_t *pCaller = &stats.m_Callers[stats.m_nCallers++];
+	pCaller->m_pFilterType = &filterType;
+	Q_strncpy( pCaller->m_szFilterName, filterType.name(), sizeof( pCaller->m_szFilterName ) );
+	pCaller->m_fMask = fMask;
+	pCaller->m_nLookups = 0;
+	pCaller->m_nHits = 0;
+	return pCaller;
+}
+
+//-----------------------------------------------------------------------------
+// CM_BoxTrace against the world, through the cache when it is on
+//-----------------------------------------------------------------------------
+static void TraceWorldCached( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace )
+{
+	// Bypassed while a BSP subtree is hooked in, the world is cut down then
+	CCollisionBSPData *pBSPData = GetCollisionBSPData();
+	if ( !trace_worldcache.GetBool() || pBSPData->map_rootnode != pBSPData->map_nodes.Base() )
+	{
+		CM_BoxTrace( ray, 0, fMask, true, *pTrace );
+		return;
+	}
+
+	if ( !s_pWorldTraceCache )
+	{
+		s_pWorldTraceCache = new WorldTraceCacheEntry_t[WORLD_TRACE_CACHE_SIZE];
+		memset( s_pWorldTraceCache, 0, WORLD_TRACE_CACHE_SIZE * sizeof(WorldTraceCacheEntry_t) );
+	}
+
+	// The per caller search is only paid for while someone is looking
+	WorldTraceCaller_t *pCaller = NULL;
+	++s_WorldTraceCacheStats.m_nLookups;
+	if ( trace_worldcache_callers.GetBool() )
+	{
+		pCaller = WorldTraceCacheCaller( pTraceFilter, fMask );
+		if ( pCaller )
+		{
+			++pCaller->m_nLookups;
+		}
+		else
+		{
+			++s_WorldTraceCacheStats.m_nUntrackedLookups;
+		}
+	}
+
+	WorldTraceCacheEntry_t &entry = s_pWorldTraceCache[WorldTraceCacheBucket( ray, fMask )];
+	bool bValid = ( entry.m_nGeneration == s_nWorldTraceCacheGeneration );
+	if ( bValid && entry.m_fMask == fMask && entry.m_Start == ray.m_Start && entry.m_Delta == ray.m_Delta &&
+		entry.m_Extents == ray.m_Extents && entry.m_StartOffset == ray.m_StartOffset )
+	{
+		++s_WorldTraceCacheStats.m_nHits;
+		if ( pCaller )
+		{
+			++pCaller->m_nHits;
+		}
+		*pTrace = entry.m_Trace;
+		return;
+	}
+
+	CM_BoxTrace( ray, 0, fMask, true, *pTrace );
+
+	if ( bValid )
+	{
+		++s_WorldTraceCacheStats.m_nEvictions;
+	}
+	entry.m_Start = ray.m_Start;
+	entry.m_Delta = ray.m_Delta;
+	entry.m_StartOffset = ray.m_StartOffset;
+	entry.m_Extents = ray.m_Extents;
+	entry.m_fMask = fMask;
+	entry.m_nGeneration = s_nWorldTraceCacheGeneration;
+	entry.m_Trace = *pTrace;
+}
+
+static int __cdecl WorldTraceCallerCompare( const void *a, const void *b )
+{
+	const WorldTraceCaller_t *pA = (const WorldTraceCaller_t *)a;
+	const WorldTraceCaller_t *pB = (const WorldTraceCaller_t *)b;
+	return pB->m_nHits - pA->m_nHits;
+}
+
+CON_COMMAND( trace_worldcache_stats, "Print world trace cache hit rates per caller. 'trace_worldcache_stats reset' clears the counters." )
+{
+	WorldTraceCacheStats_t &stats = s_WorldTraceCacheStats;
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) )
+	{
+		memset( &stats, 0, sizeof(stats) );
+		Con_Printf( "World trace cache stats reset.\n" );
+		return;
+	}
+
+	int nEntries = 0;
+	if ( s_pWorldTraceCache )
+	{
+		for ( int i = 0; i < WORLD_TRACE_CACHE_SIZE; ++i )
+		{
+			if ( s_pWorldTraceCache[i].m_nGeneration == s_nWorldTraceCacheGeneration )
+			{
+				++nEntries;
+			}
+		}
+	}
+
+	float flHitRate = stats.m_nLookups ? 100.0f * stats.m_nHits / stats.m_nLookups : 0.0f;
+	Con_Printf( "World trace cache %s: %d lookups, %.1f%% hits\n", trace_worldcache.GetBool() ? "on" : "off", stats.m_nLookups, flHitRate );
+	Con_Printf( "Entries: %d/%d in use, %d evicted, %d flushes\n", nEntries, WORLD_TRACE_CACHE_SIZE, stats.m_nEvictions, stats.m_nFlushes );
+
+	// Best callers first
+	WorldTraceCaller_t callers[MAX_WORLD_TRACE_CALLERS];
+	memcpy( callers, stats.m_Callers, stats.m_nCallers * sizeof(WorldTraceCaller_t) );
+	qsort( callers, stats.m_nCallers, sizeof(WorldTraceCaller_t), WorldTraceCallerCompare );
+
+	Con_Printf( "%-40s %10s %10s %10s %7s\n", "filter", "mask", "lookups", "hits", "rate" );
+	for ( int i = 0; i < stats.m_nCallers; ++i )
+	{
+		const WorldTraceCaller_t &caller = callers[i];
+		Con_Printf( "%-40s 0x%08x %10d %10d %6.1f%%\n", caller.m_szFilterName, caller.m_fMask, caller.m_nLookups, caller.m_nHits,
+			caller.m_nLookups ? 100.0f * caller.m_nHits / caller.m_nLookups : 0.0f );
+	}
+	if ( !trace_worldcache_callers.GetBool() )
+	{
+		Con_Printf( "Per caller counts are off, set trace_worldcache_callers 1 to collect them\n" );
+	}
+	if ( stats.m_nUntrackedLookups )
+	{
+		Con_Printf( "%d lookups from callers past the first %d\n", stats.m_nUntrackedLookups, MAX_WORLD_TRACE_CALLERS );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Traces the world for TraceRay and sets up the ray the entities are clipped
+// to, which ends where the world was hit. Returns false if the trace is done.
+//-----------------------------------------------------------------------------
+bool CEngineTrace::TraceRayAgainstWorld( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace, Ray_t *pEntityRay, float *pWorldFraction )
+{
 	CM_ClearTrace( pTrace );
 
 	// Collide with the world.
@@ -828,92 +1077,83 @@ void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter
 		Assert(!pCollide || pCollide->GetCollisionOrigin() == vec3_origin );
 		Assert(!pCollide || pCollide->GetCollisionAngles() == vec3_angle );
 
-		CM_BoxTrace( ray, 0, fMask, true, *pTrace );
+		TraceWorldCached( ray, fMask, pTraceFilter, pTrace );
 		SetTraceEntity( pCollide, pTrace );
 
 		// Blocked by the world.
 		if ( pTrace->fraction == 0 )
-			return;
+			return false;
 
 		// Early out if we only trace against the world
 		if ( pTraceFilter->GetTraceType() == TRACE_WORLD_ONLY )
-			return;
+			return false;
 	}
 
 	// Save the world collision fraction.
-	float flWorldFraction = pTrace->fraction;
+	*pWorldFraction = pTrace->fraction;
 
 	// Create a ray that extends only until we hit the world
 	// and adjust the trace accordingly
-	Ray_t entityRay = ray;
-	entityRay.m_Delta *= pTrace->fraction;
+	*pEntityRay = ray;
+	pEntityRay->m_Delta *= pTrace->fraction;
 
 	// We know this is safe because if pTrace->fraction == 0
 	// we would have exited above
 	pTrace->fractionleftsolid /= pTrace->fraction;
  	pTrace->fraction = 1.0;
+	return true;
+}
 
-	// Collide with entities along the ray
-	// FIXME: Hitbox code causes this to be re-entrant for the IK stuff.
-	// If we could eliminate that, this could be static and therefore
-	// not have to reallocate memory all the time
-	CEntitiesAlongRay enumerator;
-	enumerator.Reset();
-	SpatialPartition()->EnumerateElementsAlongRay( SpatialPartitionMask(), entityRay, false, &enumerator );
-
-	bool bNoStaticProps = pTraceFilter->GetTraceType() == TRACE_ENTITIES_ONLY;
-	bool bFilterStaticProps = pTraceFilter->GetTraceType() == TRACE_EVERYTHING_FILTER_PROPS;
 
-	trace_t tr;
+//-----------------------------------------------------------------------------
+// Returns the collideable of an entity found along the ray, or NULL if
+// the filter says to skip it
+//-----------------------------------------------------------------------------
+ICollideable *CEngineTrace::GetEntityToClip( IHandleEntity *pHandleEntity, unsigned int fMask, ITraceFilter *pTraceFilter )
+{
+	// Generate a collideable
 	ICollideable *pCollideable;
 	const char *pDebugName;
-	int nCount = enumerator.m_EntityHandles.Count();
-	for ( int i = 0; i < nCount; ++i )
+	HandleEntityToCollideable( pHandleEntity, &pCollideable, &pDebugName );
+
+	// Check for error condition
+	if ( !IsSolid( pCollideable->GetSolid(), pCollideable->GetSolidFlags() ) )
 	{
-		// Generate a collideable
-		IHandleEntity *pHandleEntity = enumerator.m_EntityHandles[i];
-		HandleEntityToCollideable( pHandleEntity, &pCollideable, &pDebugName );
+		char temp[1024];
+		Q_snprintf(temp, sizeof( temp ), "%s in solid list (not solid)\n", pDebugName );
+		Sys_Error (temp);
+	}
 
-		// Check for error condition
-		if ( !IsSolid( pCollideable->GetSolid(), pCollideable->GetSolidFlags() ) )
-		{
-			char temp[1024];
-			Q_snprintf(temp, sizeof( temp ), "%s in solid list (not solid)\n", pDebugName );
-			Sys_Error (temp);
-		}
+	if ( !StaticPropMgr()->IsStaticProp( pHandleEntity ) )
+	{
+		if ( !pTraceFilter->ShouldHitEntity( pHandleEntity, fMask ) )
+			return NULL;
+	}
+	else
+	{
+		// FIXME: Could remove this check here by
+		// using a different spatial partition mask. Look into it
+		// if we want more speedups here.
+		if ( pTraceFilter->GetTraceType() == TRACE_ENTITIES_ONLY )
+			return NULL;
 
-		if ( !StaticPropMgr()->IsStaticProp( pHandleEntity ) )
+		if ( pTraceFilter->GetTraceType() == TRACE_EVERYTHING_FILTER_PROPS )
 		{
 			if ( !pTraceFilter->ShouldHitEntity( pHandleEntity, fMask ) )
-				continue;
+				return NULL;
 		}
-		else
-		{
-			// FIXME: Could remove this check here by
-			// using a different spatial partition mask. Look into it
-			// if we want more speedups here.
-			if ( bNoStaticProps )
-				continue;
-
-			if ( bFilterStaticProps )
-			{
-				if ( !pTraceFilter->ShouldHitEntity( pHandleEntity, fMask ) )
-					continue;
-			}
-		}
-
-		ClipRayToCollideable( entityRay, fMask, pCollideable, &tr );
+	}
 
-		// Make sure the ray is always shorter than it currently is
-		ClipTraceToTrace( tr, pTrace );
+	return pCollideable;
+}
 
-		// Stop if we're in allsolid
-		if (pTrace->allsolid)
-			break;
-	}
 
-	// Fix up the fractions so they are appropriate given the original
-	// unclipped-to-world ray
+//-----------------------------------------------------------------------------
+// Fix up the fractions so they are appropriate given the original
+// unclipped-to-world ray
+//-----------------------------------------------------------------------------
+void CEngineTrace::FinishTraceRay( const Ray_t &ray, float flWorldFraction, trace_t *pTrace )
+{
 	pTrace->fraction *= flWorldFraction;
 	pTrace->fractionleftsolid *= flWorldFraction;
 
@@ -940,6 +1180,394 @@ void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter
 }
 
 
+//-----------------------------------------------------------------------------
+// A version that simply accepts a ray (can work as a traceline or tracehull)
+//-----------------------------------------------------------------------------
+void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace )
+{
+	CTraceFilterHitAll traceFilter;
+	if ( !pTraceFilter )
+	{
+		pTraceFilter = &traceFilter;
+	}
+
+	// Gather statistics.
+	g_EngineStats.IncrementCountedStat( ENGINE_STATS_NUM_TRACE_LINES, 1 );
+	MEASURE_TIMED_STAT( ENGINE_STATS_TRACE_LINE_TIME );
+	
+	Ray_t entityRay;
+	float flWorldFraction;
+	if ( !TraceRayAgainstWorld( ray, fMask, pTraceFilter, pTrace, &entityRay, &flWorldFraction ) )
+		return;
+
+	ClipRayToEntities( entityRay, fMask, pTraceFilter, pTrace );
+	FinishTraceRay( ray, flWorldFraction, pTrace );
+}
+
+
+//-----------------------------------------------------------------------------
+// Clips a ray that has been cut short at the world to the entities along it,
+// in the order the spatial partition hands them out
+//-----------------------------------------------------------------------------
+void CEngineTrace::ClipRayToEntities( const Ray_t &entityRay, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace )
+{
+	// Collide with entities along the ray
+	// NOTE: Hitbox code causes this to be re-entrant for the IK stuff,
+	// so the enumerator can't be static. Its list is frame memory, which
+	// nests fine and doesn't hit the heap.
+	CMemFrameMark enumMark;
+	CEntitiesAlongRay enumerator;
+	enumerator.Reset();
+	SpatialPartition()->EnumerateElementsAlongRay( SpatialPartitionMask(), entityRay, false, &enumerator );
+
+	trace_t tr;
+	int nCount = enumerator.m_nCount;
+	for ( int i = 0; i < nCount; ++i )
+	{
+		ICollideable *pCollideable = GetEntityToClip( enumerator.m_pEntityHandles[i], fMask, pTraceFilter );
+		if ( !pCollideable )
+			continue;
+
+		ClipRayToCollideable( entityRay, fMask, pCollideable, &tr );
+
+		// Make sure the ray is always shorter than it currently is
+		ClipTraceToTrace( tr, pTrace );
+
+		// Stop if we're in allsolid
+		if (pTrace->allsolid)
+			break;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Grabs the entities along a packet of rays, with the rays each one touches
+//-----------------------------------------------------------------------------
+class CEntitiesAlongRayPacket : public IPartitionRayPacketEnumerator
+{
+public:
+	CEntitiesAlongRayPacket( ) : m_pEntityHandles(NULL), m_pRayMasks(NULL), m_nCount(0), m_nMaxCount(0) {}
+
+	IterationRetval_t EnumElement( IHandleEntity *pHandleEntity, unsigned int nRayMask )
+	{
+		if ( m_nCount == m_nMaxCount )
+		{
+			m_nMaxCount = m_nMaxCount ? m_nMaxCount * 2 : 64;
+			IHandleEntity **pNewHandles = MemAllocFrameArray<IHandleEntity*>( m_nMaxCount );
+			unsigned int *pNewMasks = MemAllocFrameArray<unsigned int>( m_nMaxCount );
+			if ( m_nCount )
+			{
+				memcpy( pNewHandles, m_pEntityHandles, m_nCount * sizeof(IHandleEntity*) );
+				memcpy( pNewMasks, m_pRayMasks, m_nCount * sizeof(unsigned int) );
+			}
+			m_pEntityHandles = pNewHandles;
+			m_pRayMasks = pNewMasks;
+		}
+
+		m_pEntityHandles[m_nCount] = pHandleEntity;
+		m_pRayMasks[m_nCount] = nRayMask;
+		++m_nCount;
+		return ITERATION_CONTINUE;
+	}
+
+	IHandleEntity	**m_pEntityHandles;
+	unsigned int	*m_pRayMasks;
+	int				m_nCount;
+	int				m_nMaxCount;
+};
+
+
+//-----------------------------------------------------------------------------
+// Traces a packet of rays. Every ray gets the trace TraceRay would give it,
+// but the entities along all of them are found with one walk of the spatial
+// partition and each entity is filtered once.
+//-----------------------------------------------------------------------------
+void CEngineTrace::TraceRayPacket( int nRays, const Ray_t **ppRays, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t **ppTraces )
+{
+	Assert( nRays <= MAX_PARTITION_RAY_PACKET );
+
+	Ray_t entityRays[MAX_PARTITION_RAY_PACKET];
+	trace_t *pEntityTraces[MAX_PARTITION_RAY_PACKET];
+	float flWorldFraction[MAX_PARTITION_RAY_PACKET];
+	int nRayIndex[MAX_PARTITION_RAY_PACKET];
+	int nEntityRays = 0;
+
+	int i;
+	for ( i = 0; i < nRays; ++i )
+	{
+		if ( TraceRayAgainstWorld( *ppRays[i], fMask, pTraceFilter, ppTraces[i], &entityRays[nEntityRays], &flWorldFraction[nEntityRays] ) )
+		{
+			pEntityTraces[nEntityRays] = ppTraces[i];
+			nRayIndex[nEntityRays++] = i;
+		}
+	}
+
+	if ( !nEntityRays )
+		return;
+
+	ClipRayPacketToEntities( nEntityRays, entityRays, pEntityTraces, fMask, pTraceFilter );
+
+	for ( i = 0; i < nEntityRays; ++i )
+	{
+		FinishTraceRay( *ppRays[nRayIndex[i]], flWorldFraction[i], ppTraces[nRayIndex[i]] );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// The box a ray sweeps through, padded so flat and axial rays have a volume
+//-----------------------------------------------------------------------------
+#define TRACE_PACKET_MAX_SPREAD		8.0f
+
+static void GetRaySweptBounds( const Ray_t &ray, Vector &mins, Vector &maxs )
+{
+	Vector vecEnd;
+	VectorAdd( ray.m_Start, ray.m_Delta, vecEnd );
+	VectorMin( ray.m_Start, vecEnd, mins );
+	VectorMax( ray.m_Start, vecEnd, maxs );
+	VectorSubtract( mins, ray.m_Extents, mins );
+	VectorAdd( maxs, ray.m_Extents, maxs );
+}
+
+static float PaddedBoxVolume( const Vector &mins, const Vector &maxs )
+{
+	return ( maxs.x - mins.x + 2.0f ) * ( maxs.y - mins.y + 2.0f ) * ( maxs.z - mins.z + 2.0f );
+}
+
+
+//-----------------------------------------------------------------------------
+// Clips a packet of rays that have been cut short at the world to the
+// entities along them.
+//
+// ClipTraceToTrace keeps the nearest hit, except that a startsolid hit
+// replaces the result wherever it is, an allsolid hit stops the ray and
+// equal fractions go to whichever entity came first. So a ray only takes
+// its clips in packet order when none of those apply; otherwise it is
+// clipped again in the order TraceRay would use.
+//-----------------------------------------------------------------------------
+void CEngineTrace::ClipRayPacketToEntities( int nRays, const Ray_t *pRays, trace_t **ppTraces, unsigned int fMask, ITraceFilter *pTraceFilter )
+{
+	if ( nRays == 1 )
+	{
+		ClipRayToEntities( pRays[0], fMask, pTraceFilter, ppTraces[0] );
+		return;
+	}
+
+	// Rays that spread apart leave the union box mostly empty, and walking
+	// all of it costs more than walking the rays one at a time. The rays
+	// come sorted, so each half stays close together.
+	Vector mins, maxs, rayMins, rayMaxs;
+	ClearBounds( mins, maxs );
+	float flRayVolume = 0;
+	int i;
+	for ( i = 0; i < nRays; ++i )
+	{
+		GetRaySweptBounds( pRays[i], rayMins, rayMaxs );
+		flRayVolume += PaddedBoxVolume( rayMins, rayMaxs );
+		AddPointToBounds( rayMins, mins, maxs );
+		AddPointToBounds( rayMaxs, mins, maxs );
+	}
+
+	if ( PaddedBoxVolume( mins, maxs ) > TRACE_PACKET_MAX_SPREAD * flRayVolume )
+	{
+		int nHalf = nRays / 2;
+		ClipRayPacketToEntities( nHalf, pRays, ppTraces, fMask, pTraceFilter );
+		ClipRayPacketToEntities( nRays - nHalf, pRays + nHalf, ppTraces + nHalf, fMask, pTraceFilter );
+		return;
+	}
+
+	CMemFrameMark enumMark;
+	CEntitiesAlongRayPacket enumerator;
+	SpatialPartition()->EnumerateElementsAlongRays( SpatialPartitionMask(), pRays, nRays, &enumerator );
+
+	int nEntities = enumerator.m_nCount;
+	if ( !nEntities )
+		return;
+
+	ICollideable **ppCollideables = MemAllocFrameArray<ICollideable *>( nEntities );
+	for ( i = 0; i < nEntities; ++i )
+	{
+		ppCollideables[i] = GetEntityToClip( enumerator.m_pEntityHandles[i], fMask, pTraceFilter );
+	}
+
+	trace_t *pClips = MemAllocFrameArray<trace_t>( nEntities );
+	for ( int j = 0; j < nRays; ++j )
+	{
+		trace_t *pTrace = ppTraces[j];
+
+		// A ray that starts in the world keeps the deepest startpos it has
+		// seen, which also depends on the order
+		bool bOrdered = pTrace->startsolid;
+		bool bTied = false;
+		float flNearest = pTrace->fraction;
+		int nClips = 0;
+		for ( i = 0; i < nEntities && !bOrdered; ++i )
+		{
+			if ( !ppCollideables[i] || !( enumerator.m_pRayMasks[i] & ( 1U << j ) ) )
+				continue;
+
+			trace_t &tr = pClips[nClips++];
+			ClipRayToCollideable( pRays[j], fMask, ppCollideables[i], &tr );
+			if ( tr.startsolid || tr.allsolid )
+			{
+				bOrdered = true;
+			}
+			else if ( tr.fraction < flNearest )
+			{
+				flNearest = tr.fraction;
+				bTied = false;
+			}
+			else if ( tr.fraction == flNearest && flNearest < pTrace->fraction )
+			{
+				bTied = true;
+			}
+		}
+
+		if ( bOrdered || bTied )
+		{
+			ClipRayToEntities( pRays[j], fMask, pTraceFilter, pTrace );
+			continue;
+		}
+
+		for ( i = 0; i < nClips; ++i )
+		{
+			ClipTraceToTrace( pClips[i], pTrace );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Sorts rays into packets of rays that start close together and point the
+// same way, so the packets' bounding boxes stay small
+//-----------------------------------------------------------------------------
+struct TraceRaySortKey_t
+{
+	unsigned int	m_nKey;
+	int				m_nRay;
+};
+
+static int __cdecl TraceRaySortKeyCompare( const void *a, const void *b )
+{
+	const TraceRaySortKey_t *pA = (const TraceRaySortKey_t *)a;
+	const TraceRaySortKey_t *pB = (const TraceRaySortKey_t *)b;
+	if ( pA->m_nKey != pB->m_nKey )
+		return ( pA->m_nKey < pB->m_nKey ) ? -1 : 1;
+	return pA->m_nRay - pB->m_nRay;
+}
+
+static unsigned int TraceRaySortKey( const Ray_t &ray )
+{
+	unsigned int nKey = 0;
+	for ( int i = 0; i < 3; ++i )
+	{
+		// 512 unit cells over +/- 32k, then the direction's octant on top
+		int nCell = clamp( ( (int)ray.m_Start[i] >> 9 ) + 64, 0, 127 );
+		nKey = ( nKey << 7 ) | nCell;
+	}
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( ray.m_Delta[i] < 0 )
+		{
+			nKey |= ( 1U << ( 21 + i ) );
+		}
+	}
+	return nKey;
+}
+
+void CEngineTrace::TraceRays( int nRays, const Ray_t *pRays, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTraces )
+{
+	if ( nRays <= 0 )
+		return;
+
+	CTraceFilterHitAll traceFilter;
+	if ( !pTraceFilter )
+	{
+		pTraceFilter = &traceFilter;
+	}
+
+	// Gather statistics.
+	g_EngineStats.IncrementCountedStat( ENGINE_STATS_NUM_TRACE_LINES, nRays );
+	MEASURE_TIMED_STAT( ENGINE_STATS_TRACE_LINE_TIME );
+
+	CMemFrameMark sortMark;
+	TraceRaySortKey_t *pKeys = MemAllocFrameArray<TraceRaySortKey_t>( nRays );
+	int i;
+	for ( i = 0; i < nRays; ++i )
+	{
+		pKeys[i].m_nKey = TraceRaySortKey( pRays[i] );
+		pKeys[i].m_nRay = i;
+	}
+	qsort( pKeys, nRays, sizeof(TraceRaySortKey_t), TraceRaySortKeyCompare );
+
+	const Ray_t *pPacketRays[MAX_PARTITION_RAY_PACKET];
+	trace_t *pPacketTraces[MAX_PARTITION_RAY_PACKET];
+	for ( i = 0; i < nRays; i += MAX_PARTITION_RAY_PACKET )
+	{
+		int nPacket = min( nRays - i, MAX_PARTITION_RAY_PACKET );
+		for ( int j = 0; j < nPacket; ++j )
+		{
+			int nRay = pKeys[i + j].m_nRay;
+			pPacketRays[j] = &pRays[nRay];
+			pPacketTraces[j] = &pTraces[nRay];
+		}
+		TraceRayPacket( nPacket, pPacketRays, fMask, pTraceFilter, pPacketTraces );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Holds the rays and results of a batch between calls
+//-----------------------------------------------------------------------------
+class CTraceBatch : public ITraceBatch
+{
+public:
+	CTraceBatch( CEngineTrace *pEngineTrace ) : m_pEngineTrace( pEngineTrace ) {}
+
+	virtual int AddRay( const Ray_t &ray )
+	{
+		m_Traces.AddToTail();
+		return m_Rays.AddToTail( ray );
+	}
+
+	virtual int Count() const
+	{
+		return m_Rays.Count();
+	}
+
+	virtual void Clear()
+	{
+		m_Rays.RemoveAll();
+		m_Traces.RemoveAll();
+	}
+
+	virtual void Trace( unsigned int fMask, ITraceFilter *pTraceFilter )
+	{
+		m_pEngineTrace->TraceRays( m_Rays.Count(), m_Rays.Base(), fMask, pTraceFilter, m_Traces.Base() );
+	}
+
+	virtual const trace_t &GetTrace( int nRay ) const
+	{
+		return m_Traces[nRay];
+	}
+
+private:
+	CEngineTrace		*m_pEngineTrace;
+	CUtlVector<Ray_t>	m_Rays;
+	CUtlVector<trace_t>	m_Traces;
+};
+
+ITraceBatch *CEngineTrace::CreateTraceBatch()
+{
+	return new CTraceBatch( this );
+}
+
+void CEngineTrace::DestroyTraceBatch( ITraceBatch *pBatch )
+{
+	delete static_cast<CTraceBatch *>( pBatch );
+}
+
+
 //-----------------------------------------------------------------------------
 // Lets clients know about all edicts along a ray
 //-----------------------------------------------------------------------------
@@ -20,5 +20,8 @@
 extern IEngineTrace *g_pEngineTraceServer;
 extern IEngineTrace *g_pEngineTraceClient;
 
+// Forgets the cached world traces, for when the world collision changes
+void InvalidateWorldTraceCache();
+
 
 #endif // ENGINETRACE_H
\ No newline at end of file
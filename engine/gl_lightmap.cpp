@@ -29,16 +29,29 @@
 #include "tier0/dbg.h"
 #include "tier0/vprof.h"
 #include "lightcache.h"
+#include "vstdlib/jobthread.h"
+#include "utlvector.h"
+#include <emmintrin.h>
 
-Vector4D blocklights[NUM_BUMP_VECTS+1][ MAX_LIGHTMAP_DIM_INCLUDING_BORDER * MAX_LIGHTMAP_DIM_INCLUDING_BORDER ];
+#define MAX_LIGHTMAP_LUXELS		( MAX_LIGHTMAP_DIM_INCLUDING_BORDER * MAX_LIGHTMAP_DIM_INCLUDING_BORDER )
+
+// One luxel buffer per lightmap, the flat one followed by the bumped ones.
+// Surfaces built one at a time use s_BlockLights; batched surfaces each get
+// their own so they can be built on different threads.
+typedef Vector4D *BlockLights_t[NUM_BUMP_VECTS+1];
+
+static Vector4D s_BlockLights[NUM_BUMP_VECTS+1][ MAX_LIGHTMAP_LUXELS ];
+
+extern float power2_n[256];
 
 ConVar r_avglightmap("r_avglightmap", "0" );
+static ConVar r_threadedlightmaps( "r_threadedlightmaps", "1", 0, "Build the dynamic lightmaps of a frame on the thread pool." );
 
 
 //-----------------------------------------------------------------------------
 // Adds a single dynamic light
 //-----------------------------------------------------------------------------
-static void AddSingleDynamicLight( dlight_t& dl, int surfID, const Vector& entity_origin )
+static void AddSingleDynamicLight( dlight_t& dl, int surfID, const Vector& entity_origin, BlockLights_t blocklights )
 {
 	// NOTE: See version 66 in source control to see the old version
 
@@ -138,7 +151,7 @@ static void AddSingleDynamicLight( dlight_t& dl, int surfID, const Vector& entit
 // Adds a dynamic light to the bumped lighting
 //-----------------------------------------------------------------------------
 static void AddSingleDynamicLightToBumpLighting( dlight_t& dl, int surfID, 
-	const Vector& entity_origin, Vector* pBumpBasis, const Vector& luxelBasePosition )
+	const Vector& entity_origin, Vector* pBumpBasis, const Vector& luxelBasePosition, BlockLights_t blocklights )
 {
 	Vector		local, impact;
 
@@ -319,7 +332,7 @@ static void R_ComputeSurfaceBasis( int surfID, Vector *pBumpNormals, Vector &lux
 // Purpose: add dynamic lights to this surface's lightmap
 // Input  : *surf - 
 //-----------------------------------------------------------------------------
-void R_AddDynamicLights( int surfID, const Vector& entity_origin, bool needsBumpmap )
+void R_AddDynamicLights( int surfID, const Vector& entity_origin, bool needsBumpmap, BlockLights_t blocklights )
 {
 	ASSERT_SURF_VALID( surfID );
 	Vector bumpNormals[3];
@@ -354,7 +367,7 @@ void R_AddDynamicLights( int surfID, const Vector& entity_origin, bool needsBump
 
 		if (!needsBumpmap)
 		{
-			AddSingleDynamicLight( cl_dlights[lnum], surfID, entity_origin );
+			AddSingleDynamicLight( cl_dlights[lnum], surfID, entity_origin, blocklights );
 			continue;
 		}
 
@@ -367,7 +380,7 @@ void R_AddDynamicLights( int surfID, const Vector& entity_origin, bool needsBump
 		}
 
 		AddSingleDynamicLightToBumpLighting( cl_dlights[lnum], surfID, 
-			entity_origin, bumpNormals, luxelBasePosition );
+			entity_origin, bumpNormals, luxelBasePosition, blocklights );
 	}
 }
 
@@ -414,58 +427,62 @@ static int ComputeLightmapSize( int surfID )
 
 
 //-----------------------------------------------------------------------------
-// Compute the portion of the lightmap generated from lightstyles
+// Compute the portion of the lightmap generated from lightstyles. A luxel is
+// accumulated as one SSE vector: the r, g, b and exponent bytes are widened
+// to floats and scaled by (scalar * 2^exponent) in the rgb lanes and zero in
+// the last, so the alpha in w is left alone.
 //-----------------------------------------------------------------------------
-static void AccumulateLightstyles( colorRGBExp32* pLightmap, int lightmapSize, float scalar ) 
+static inline __m128 LightmapColorSSE( const colorRGBExp32 &color, __m128 scalarRGB )
+{
+	__m128i c = _mm_cvtsi32_si128( *(const int *)&color );
+	c = _mm_unpacklo_epi8( c, _mm_setzero_si128() );
+	c = _mm_unpacklo_epi16( c, _mm_setzero_si128() );
+
+	__m128 scale = _mm_mul_ps( scalarRGB, _mm_set1_ps( power2_n[color.exponent + 128] ) );
+	return _mm_mul_ps( _mm_cvtepi32_ps( c ), scale );
+}
+
+static inline void AccumulateLuxelSSE( Vector4D &luxel, __m128 color )
+{
+	_mm_storeu_ps( luxel.Base(), _mm_add_ps( _mm_loadu_ps( luxel.Base() ), color ) );
+}
+
+static void AccumulateLightstyles( colorRGBExp32* pLightmap, int lightmapSize, float scalar, BlockLights_t blocklights ) 
 {
 	Assert( pLightmap );
+	__m128 scalarRGB = _mm_setr_ps( scalar, scalar, scalar, 0.0f );
 	for (int i=0; i<lightmapSize ; ++i)
 	{
-		blocklights[0][i][0] += scalar * TexLightToLinear( pLightmap[i].r, pLightmap[i].exponent );
-		blocklights[0][i][1] += scalar * TexLightToLinear( pLightmap[i].g, pLightmap[i].exponent );
-		blocklights[0][i][2] += scalar * TexLightToLinear( pLightmap[i].b, pLightmap[i].exponent );
+		AccumulateLuxelSSE( blocklights[0][i], LightmapColorSSE( pLightmap[i], scalarRGB ) );
 	}
 }
 
-static void AccumulateLightstylesFlat( colorRGBExp32* pLightmap, int lightmapSize, float scalar ) 
+static void AccumulateLightstylesFlat( colorRGBExp32* pLightmap, int lightmapSize, float scalar, BlockLights_t blocklights ) 
 {
 	Assert( pLightmap );
+	__m128 color = LightmapColorSSE( *pLightmap, _mm_setr_ps( scalar, scalar, scalar, 0.0f ) );
 	for (int i=0; i<lightmapSize ; ++i)
 	{
-		blocklights[0][i][0] += scalar * TexLightToLinear( pLightmap->r, pLightmap->exponent );
-		blocklights[0][i][1] += scalar * TexLightToLinear( pLightmap->g, pLightmap->exponent );
-		blocklights[0][i][2] += scalar * TexLightToLinear( pLightmap->b, pLightmap->exponent );
+		AccumulateLuxelSSE( blocklights[0][i], color );
 	}
 }
 
-static void AccumulateBumpedLightstyles( colorRGBExp32* pLightmap, int lightmapSize, float scalar ) 
+// The flat lightmap and the three bumped ones are walked together, so each
+// luxel's four samples are done in one pass
+static void AccumulateBumpedLightstyles( colorRGBExp32* pLightmap, int lightmapSize, float scalar, BlockLights_t blocklights ) 
 {
 	colorRGBExp32 *pBumpedLightmaps[3];
 	pBumpedLightmaps[0] = pLightmap + lightmapSize;
 	pBumpedLightmaps[1] = pLightmap + 2 * lightmapSize;
 	pBumpedLightmaps[2] = pLightmap + 3 * lightmapSize;
 
-	// I chose to split up the loops this way because it was the best tradeoff
-	// based on profiles between cache miss + loop overhead
+	__m128 scalarRGB = _mm_setr_ps( scalar, scalar, scalar, 0.0f );
 	for (int i=0 ; i<lightmapSize ; ++i)
 	{
-		blocklights[0][i][0] += scalar * TexLightToLinear( pLightmap[i].r, pLightmap[i].exponent );
-		blocklights[0][i][1] += scalar * TexLightToLinear( pLightmap[i].g, pLightmap[i].exponent );
-		blocklights[0][i][2] += scalar * TexLightToLinear( pLightmap[i].b, pLightmap[i].exponent );
-
-		blocklights[1][i][0] += scalar * TexLightToLinear( pBumpedLightmaps[0][i].r, pBumpedLightmaps[0][i].exponent );
-		blocklights[1][i][1] += scalar * TexLightToLinear( pBumpedLightmaps[0][i].g, pBumpedLightmaps[0][i].exponent );
-		blocklights[1][i][2] += scalar * TexLightToLinear( pBumpedLightmaps[0][i].b, pBumpedLightmaps[0][i].exponent );
-	}
-	for ( int i=0 ; i<lightmapSize ; ++i)
-	{
-		blocklights[2][i][0] += scalar * TexLightToLinear( pBumpedLightmaps[1][i].r, pBumpedLightmaps[1][i].exponent );
-		blocklights[2][i][1] += scalar * TexLightToLinear( pBumpedLightmaps[1][i].g, pBumpedLightmaps[1][i].exponent );
-		blocklights[2][i][2] += scalar * TexLightToLinear( pBumpedLightmaps[1][i].b, pBumpedLightmaps[1][i].exponent );
-
-		blocklights[3][i][0] += scalar * TexLightToLinear( pBumpedLightmaps[2][i].r, pBumpedLightmaps[2][i].exponent );
-		blocklights[3][i][1] += scalar * TexLightToLinear( pBumpedLightmaps[2][i].g, pBumpedLightmaps[2][i].exponent );
-		blocklights[3][i][2] += scalar * TexLightToLinear( pBumpedLightmaps[2][i].b, pBumpedLightmaps[2][i].exponent );
+		AccumulateLuxelSSE( blocklights[0][i], LightmapColorSSE( pLightmap[i], scalarRGB ) );
+		AccumulateLuxelSSE( blocklights[1][i], LightmapColorSSE( pBumpedLightmaps[0][i], scalarRGB ) );
+		AccumulateLuxelSSE( blocklights[2][i], LightmapColorSSE( pBumpedLightmaps[1][i], scalarRGB ) );
+		AccumulateLuxelSSE( blocklights[3][i], LightmapColorSSE( pBumpedLightmaps[2][i], scalarRGB ) );
 	}
 }
 
@@ -474,7 +491,7 @@ static void AccumulateBumpedLightstyles( colorRGBExp32* pLightmap, int lightmapS
 // Compute the portion of the lightmap generated from lightstyles
 //-----------------------------------------------------------------------------
 static void ComputeLightmapFromLightstyle( msurfacelighting_t *pLighting, bool computeLightmap, 
-				bool computeBumpmap, int lightmapSize, bool hasBumpmapLightmapData )
+				bool computeBumpmap, int lightmapSize, bool hasBumpmapLightmapData, BlockLights_t blocklights )
 {
 	colorRGBExp32 *pLightmap = pLighting->m_pSamples;
 
@@ -506,7 +523,7 @@ static void ComputeLightmapFromLightstyle( msurfacelighting_t *pLighting, bool c
 		{
 			if( computeBumpmap )
 			{
-				AccumulateBumpedLightstyles( pLightmap, lightmapSize, scalar );
+				AccumulateBumpedLightstyles( pLightmap, lightmapSize, scalar, blocklights );
 			}
 			else if( computeLightmap )
 			{
@@ -514,15 +531,15 @@ static void ComputeLightmapFromLightstyle( msurfacelighting_t *pLighting, bool c
 				if (r_avglightmap.GetInt())
 				{
 					pLightmap = pLighting->AvgLightColor(maps);
-					AccumulateLightstylesFlat( pLightmap, lightmapSize, scalar );
+					AccumulateLightstylesFlat( pLightmap, lightmapSize, scalar, blocklights );
 				}
 				else
 				{
-					AccumulateLightstyles( pLightmap, lightmapSize, scalar );
+					AccumulateLightstyles( pLightmap, lightmapSize, scalar, blocklights );
 				}
 #else
 				pLightmap = pLighting->AvgLightColor(maps); 
-				AccumulateLightstylesFlat( pLightmap, lightmapSize, scalar );
+				AccumulateLightstylesFlat( pLightmap, lightmapSize, scalar, blocklights );
 #endif
 			}
 		}
@@ -536,7 +553,7 @@ static void ComputeLightmapFromLightstyle( msurfacelighting_t *pLighting, bool c
 // Update the lightmaps...
 //-----------------------------------------------------------------------------
 
-static void UpdateLightmapTextures( int surfID, bool needsBumpmap )
+static void UpdateLightmapTextures( int surfID, bool needsBumpmap, BlockLights_t blocklights )
 {
 	ASSERT_SURF_VALID( surfID );
 	// Displacement surfaces can change lightmap alpha for their shaders.
@@ -544,7 +561,7 @@ static void UpdateLightmapTextures( int surfID, bool needsBumpmap )
 	{
 		int w, h;
 		materialSystemInterface->GetLightmapPageSize( materialSortInfoArray[MSurf_MaterialSortID( surfID )].lightmapPageID, &w, &h );
-		MSurf_DispInfo( surfID )->UpdateLightmapAlpha( &blocklights[0][0], sizeof(blocklights[0])/sizeof(blocklights[0][0]) );
+		MSurf_DispInfo( surfID )->UpdateLightmapAlpha( &blocklights[0][0], MAX_LIGHTMAP_LUXELS );
 	}
 
 	if( materialSortInfoArray )
@@ -576,40 +593,41 @@ static void UpdateLightmapTextures( int surfID, bool needsBumpmap )
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Build the blocklights array for a given surface and copy to dest
-//			Combine and scale multiple lightmaps into the 8.8 format in blocklights
-// Input  : *psurf - surface to rebuild
-//			*dest - texture pointer to receive copy in lightmap texture format
-//			stride - stride of *dest memory
+// Returns the lightmap page a surface's lightmap should be built into, or -1
+// if it has none to build
 //-----------------------------------------------------------------------------
-void R_BuildLightMap( int surfID, const Vector& entity_origin )
+static int LightmapPageToBuild( int surfID )
 {
-	MEASURE_TIMED_STAT( ENGINE_STATS_DYNAMIC_LIGHTMAP_BUILD );
+	if( !SurfNeedsBumpedLightmaps( surfID ) && !SurfNeedsLightmap( surfID ) )
+		return -1;
+
+	if( !materialSortInfoArray )
+		return 0;
+
+	Assert( MSurf_MaterialSortID( surfID ) >= 0 && 
+		    MSurf_MaterialSortID( surfID )  < g_NumMaterialSortBins );
 
+	// hack - need to give -1 (white texture) a name
+	return materialSortInfoArray[MSurf_MaterialSortID( surfID )].lightmapPageID;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Build the blocklights array for a given surface
+//			Combine and scale multiple lightmaps into the 8.8 format in blocklights
+// Input  : surfID - surface to rebuild
+//			blocklights - buffers of at least size luxels to build into
+//-----------------------------------------------------------------------------
+static void R_ComputeLightMap( int surfID, const Vector& entity_origin, int size, BlockLights_t blocklights )
+{
 	int bumpID;
 
 	bool needsBumpmap = SurfNeedsBumpedLightmaps( surfID );
 	bool needsLightmap = SurfNeedsLightmap( surfID );
 
-	if( !needsBumpmap && !needsLightmap )
-	{
-		return;
-	}
-	
 	bool hasBumpmap = SurfHasBumpedLightmaps( surfID );
 	bool hasLightmap = SurfHasLightmap( surfID );
 
-	if( materialSortInfoArray )
-	{
-		Assert( MSurf_MaterialSortID( surfID ) >= 0 && 
-			    MSurf_MaterialSortID( surfID )  < g_NumMaterialSortBins );
-		// hack - need to give -1 (white texture) a name
-		if( materialSortInfoArray[MSurf_MaterialSortID( surfID )].lightmapPageID == -1 )
-		{
-			return;
-		}
-	}
-	
 	// Mark the surface with the particular cached light values...
 	msurfacelighting_t *pLighting = SurfaceLighting( surfID );
 
@@ -617,10 +635,6 @@ void R_BuildLightMap( int surfID, const Vector& entity_origin )
 	pLighting->m_fDLightBits &= r_dlightactive;
 	pLighting->m_nLastComputedFrame = r_framecount;
 
-	int size = ComputeLightmapSize( surfID );
-	if (size == 0)
-		return;
-
 	// clear to no light
 	if( needsLightmap )
 	{
@@ -642,13 +656,13 @@ void R_BuildLightMap( int surfID, const Vector& entity_origin )
 	if( ( hasLightmap && needsLightmap ) || ( hasBumpmap && needsBumpmap ) )
 	{
 		ComputeLightmapFromLightstyle( pLighting, ( hasLightmap && needsLightmap ),
-			( hasBumpmap && needsBumpmap ), size, hasBumpmap );
+			( hasBumpmap && needsBumpmap ), size, hasBumpmap, blocklights );
 	}
 	else if( !hasBumpmap && needsBumpmap && hasLightmap )
 	{
 		// make something up for the bumped lights if you need them but don't have the data
 		// if you have a lightmap, use that, otherwise fullbright
-		ComputeLightmapFromLightstyle( pLighting, true, false, size, hasBumpmap );
+		ComputeLightmapFromLightstyle( pLighting, true, false, size, hasBumpmap, blocklights );
 
 		for( bumpID = 0; bumpID < ( hasBumpmap ? ( NUM_BUMP_VECTS + 1 ) : 1 ); bumpID++ )
 		{
@@ -679,11 +693,160 @@ void R_BuildLightMap( int surfID, const Vector& entity_origin )
 	// add all the dynamic lights
 	if( ( needsLightmap || needsBumpmap ) && ( pLighting->m_nDLightFrame == r_framecount ) )
 	{
-		R_AddDynamicLights ( surfID, entity_origin, needsBumpmap );
+		R_AddDynamicLights ( surfID, entity_origin, needsBumpmap, blocklights );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Dynamic lightmap batches. While a batch is open R_BuildLightMap only queues
+// the surface. Ending the batch builds every queued surface into its own
+// slice of s_BatchLuxels on the thread pool, then uploads them sorted by
+// lightmap page so each page's updates go out together.
+//-----------------------------------------------------------------------------
+struct LightmapBuildJob_t
+{
+	int		m_nSurfID;
+	int		m_nPageID;
+	int		m_nSize;
+	int		m_nFirstLuxel;
+	bool	m_bBumped;
+	Vector	m_EntityOrigin;
+};
+
+static bool							s_bLightmapBatchOpen;
+static CUtlVector< LightmapBuildJob_t >	s_LightmapJobs;
+static CUtlVector< float >			s_BatchLuxels;	// 4 floats per luxel
+
+static void GetJobBlockLights( const LightmapBuildJob_t &job, BlockLights_t blocklights )
+{
+	Vector4D *pLuxels = (Vector4D *)&s_BatchLuxels[job.m_nFirstLuxel * 4];
+	for ( int i = 0; i < NUM_BUMP_VECTS + 1; i++ )
+	{
+		// Unbumped surfaces only have the first buffer
+		blocklights[i] = pLuxels + ( job.m_bBumped ? i * job.m_nSize : 0 );
+	}
+}
+
+static void BuildLightmapJob( void *pContext, int nJob )
+{
+	const LightmapBuildJob_t &job = s_LightmapJobs[nJob];
+
+	BlockLights_t blocklights;
+	GetJobBlockLights( job, blocklights );
+	R_ComputeLightMap( job.m_nSurfID, job.m_EntityOrigin, job.m_nSize, blocklights );
+}
+
+static int LightmapJobLessFunc( const void *p1, const void *p2 )
+{
+	const LightmapBuildJob_t *pJob1 = (const LightmapBuildJob_t *)p1;
+	const LightmapBuildJob_t *pJob2 = (const LightmapBuildJob_t *)p2;
+	if ( pJob1->m_nPageID != pJob2->m_nPageID )
+		return pJob1->m_nPageID - pJob2->m_nPageID;
+	return pJob1->m_nSurfID - pJob2->m_nSurfID;
+}
+
+void R_BeginDynamicLightmapBatch( void )
+{
+	Assert( !s_bLightmapBatchOpen );
+	s_bLightmapBatchOpen = true;
+}
+
+void R_EndDynamicLightmapBatch( void )
+{
+	Assert( s_bLightmapBatchOpen );
+	s_bLightmapBatchOpen = false;
+
+	int nJobs = s_LightmapJobs.Count();
+	if ( !nJobs )
+		return;
+
+	MEASURE_TIMED_STAT( ENGINE_STATS_DYNAMIC_LIGHTMAP_BUILD );
+
+	// A surface can be queued more than once in a frame, once is enough
+	qsort( s_LightmapJobs.Base(), nJobs, sizeof( LightmapBuildJob_t ), LightmapJobLessFunc );
+
+	int nUnique = 0;
+	int nLuxels = 0;
+	int i;
+	for ( i = 0; i < nJobs; i++ )
+	{
+		if ( nUnique && s_LightmapJobs[nUnique - 1].m_nSurfID == s_LightmapJobs[i].m_nSurfID )
+			continue;
+
+		LightmapBuildJob_t &job = s_LightmapJobs[nUnique++];
+		job = s_LightmapJobs[i];
+		job.m_nFirstLuxel = nLuxels;
+		nLuxels += job.m_bBumped ? job.m_nSize * ( NUM_BUMP_VECTS + 1 ) : job.m_nSize;
+	}
+
+	if ( s_BatchLuxels.Count() < nLuxels * 4 )
+	{
+		s_BatchLuxels.EnsureCount( nLuxels * 4 );
+	}
+
+	if ( r_threadedlightmaps.GetBool() )
+	{
+		ThreadPool()->ParallelProcess( BuildLightmapJob, NULL, nUnique );
+	}
+	else
+	{
+		for ( i = 0; i < nUnique; i++ )
+		{
+			BuildLightmapJob( NULL, i );
+		}
+	}
+
+	for ( i = 0; i < nUnique; i++ )
+	{
+		BlockLights_t blocklights;
+		GetJobBlockLights( s_LightmapJobs[i], blocklights );
+		UpdateLightmapTextures( s_LightmapJobs[i].m_nSurfID, s_LightmapJobs[i].m_bBumped, blocklights );
+	}
+
+	s_LightmapJobs.RemoveAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Build the lightmap for a given surface and upload it, or queue it
+//			if a batch is open
+// Input  : surfID - surface to rebuild
+//-----------------------------------------------------------------------------
+void R_BuildLightMap( int surfID, const Vector& entity_origin )
+{
+	int nPageID = LightmapPageToBuild( surfID );
+	if ( nPageID == -1 )
+		return;
+
+	int size = ComputeLightmapSize( surfID );
+	if (size == 0)
+		return;
+
+	if ( s_bLightmapBatchOpen )
+	{
+		LightmapBuildJob_t &job = s_LightmapJobs[ s_LightmapJobs.AddToTail() ];
+		job.m_nSurfID = surfID;
+		job.m_nPageID = nPageID;
+		job.m_nSize = size;
+		job.m_nFirstLuxel = 0;
+		job.m_bBumped = SurfNeedsBumpedLightmaps( surfID );
+		job.m_EntityOrigin = entity_origin;
+		return;
 	}
 
+	MEASURE_TIMED_STAT( ENGINE_STATS_DYNAMIC_LIGHTMAP_BUILD );
+
+	BlockLights_t blocklights;
+	for ( int i = 0; i < NUM_BUMP_VECTS + 1; i++ )
+	{
+		blocklights[i] = s_BlockLights[i];
+	}
+
+	R_ComputeLightMap( surfID, entity_origin, size, blocklights );
+
 	// Update the texture state
-	UpdateLightmapTextures( surfID, needsBumpmap );
+	UpdateLightmapTextures( surfID, SurfNeedsBumpedLightmaps( surfID ), blocklights );
 }
 
 
@@ -693,7 +856,7 @@ void R_RedownloadAllLightmaps( const Vector& entity_origin )
 	static bool initializedBlockLights = false;
 	if (!initializedBlockLights)
 	{
-		memset( &blocklights[0][0][0], 0, MAX_LIGHTMAP_DIM_INCLUDING_BORDER * MAX_LIGHTMAP_DIM_INCLUDING_BORDER * (NUM_BUMP_VECTS + 1) * sizeof( Vector ) );
+		memset( &s_BlockLights[0][0][0], 0, sizeof( s_BlockLights ) );
 		initializedBlockLights = true;
 	}
 #endif
@@ -702,11 +865,13 @@ void R_RedownloadAllLightmaps( const Vector& entity_origin )
 
 	double st = Sys_FloatTime();
 
+	R_BeginDynamicLightmapBatch();
 	for( surfID = 0; surfID < host_state.worldmodel->brush.numsurfaces; surfID++ )
 	{
 		ASSERT_SURF_VALID( surfID );
 		R_BuildLightMap( surfID, entity_origin );
 	}
+	R_EndDynamicLightmapBatch();
 
 	float elapsed = ( float )( Sys_FloatTime() - st ) * 1000.0;
 	if ( elapsed > 1000 )
@@ -31,6 +31,11 @@ extern int r_dlightactive;
 
 void R_AddDynamicLights( int surfID, const Vector& entity_origin );
 void R_BuildLightMap( int surfID, const Vector& entity_origin );
+
+// Lightmaps built between these are queued, then built together on the
+// thread pool and uploaded grouped by lightmap page when the batch ends
+void R_BeginDynamicLightmapBatch( void );
+void R_EndDynamicLightmapBatch( void );
 void R_RedownloadAllLightmaps( const Vector& entity_origin  );
 void GL_RebuildLightmaps( void );
 void FASTCALL R_RenderDynamicLightmaps (int surfID, const Vector& entity_origin );
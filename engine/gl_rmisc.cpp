@@ -45,6 +45,7 @@
 #include "vtf/vtf.h"
 #include "imageloader.h"
 #include "cmd.h"
+#include "IOcclusionSystem.h"
 
 #ifdef _WIN32
 #include "procinfo.h"
@@ -838,6 +839,7 @@ void R_NewMap (void)
 	R_DecalInit ();
 	R_LoadSkys();
 	R_InitStudio();
+	OcclusionSystem()->LevelInit();
 
 	// FIXME: Is this the best place to initialize the kd tree when we're client-only?
 	if ( !sv.active )
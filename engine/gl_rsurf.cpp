@@ -41,6 +41,7 @@
 #include "debugoverlay.h"
 #include "host.h"
 #include "materialsystem/imaterialsystemhardwareconfig.h"
+#include "tier0/mem.h"
 
 
 #ifndef SWDS
@@ -1149,6 +1150,8 @@ static void Shader_BuildDynamicLightmaps( void )
 
 	// FIXME: Does this correctly build lightmaps for displacements?
 
+	R_BeginDynamicLightmapBatch();
+
 	// Build all lightmaps for opaque surfaces
 	for ( nSortGroup = 0; nSortGroup < MAX_MAT_SORT_GROUPS; ++nSortGroup)
 	{
@@ -1173,7 +1176,8 @@ static void Shader_BuildDynamicLightmaps( void )
 	{
 		BuildDispChainLightmaps( s_DispChain[nSortGroup] );
 	}
-	
+
+	R_EndDynamicLightmapBatch();
 	materialSystemInterface->FlushLightmaps();
 }
 
@@ -2773,10 +2777,12 @@ static void R_DrawSortedBrushModel( IClientEntity *baseentity, model_t *model,
 
 	// Update the dynamic lightmaps for the brush model
 	int surfID;
+	R_BeginDynamicLightmapBatch();
 	for ( surfID = r_brushlist; surfID >= 0; surfID = MSurf_TextureChain( surfID ) )
 	{
 		R_RenderDynamicLightmaps( surfID, origin );
 	}
+	R_EndDynamicLightmapBatch();
 	materialSystemInterface->FlushLightmaps();
 
 	bool bCopiedFrameBuffer = false;
@@ -4635,6 +4641,7 @@ static void R_DecalCreate(
 	{
 		// Check to see if the decal actually intersects the surface
 		// if not, then remove the decal
+		CMemFrameMark clipMark;
 		R_DecalVertsClip( NULL, pdecal, surfID, 
 			decalinfo->m_pMaterial, &vertCount );
 		if ( !vertCount )
@@ -4709,6 +4716,9 @@ void DecalUpdateAndDrawSingle( int surfID, decal_t* pDecal )
 	}
 	else
 	{
+		// The clipped verts are frame memory; they're dead once they're drawn
+		CMemFrameMark decalVertsMark;
+
 		int outCount;
 		CDecalVert *v = R_DecalSetupVerts( pDecal, surfID, pDecal->material, outCount );
 
@@ -78,6 +78,8 @@
 #include "staticpropmgr.h"
 #include "gameeventmanager.h"
 #include "vgui_intwrap2.h"
+#include "tier0/mem.h"
+#include "datacache.h"
 
 
 int host_frameticks = 0;
@@ -1109,6 +1111,17 @@ void Host_DumpMemoryStats( void )
 	int hunk = MEM_Summary_Console();
 	Msg("\tAllocated outside hunk:  %s\n", Q_pretifymem( size - hunk ) );
 #endif
+
+	MemFrameStats_t frameStats;
+	MemGetFrameStats( &frameStats );
+	Msg("MEMORY:  Frame arena (main thread)\n------------------------------------\n");
+	Msg( "\tCapacity %s\n", Q_pretifymem( frameStats.m_nCapacity, 2 ) );
+	Msg( "\tLast frame peak %s (%s from heap)\n", Q_pretifymem( frameStats.m_nLastFramePeak, 2 ), Q_pretifymem( frameStats.m_nLastFrameOverflow, 2 ) );
+	Msg( "\tWorst frame peak %s\n", Q_pretifymem( frameStats.m_nMaxFramePeak, 2 ) );
+	Msg( "\t%d of %d frames overflowed to the heap\n", frameStats.m_nOverflowFrames, frameStats.m_nFrames );
+	Msg("------------------------------------\n");
+
+	MemDumpPoolStats();
 }
 
 //-----------------------------------------------------------------------------
@@ -1555,6 +1568,12 @@ void _Host_RunFrame (float time)
 
 	Host_CheckDumpMemoryStats();
 
+	// Everything allocated with MemAllocFrame this frame is dead now
+	MemFrameReset();
+
+	// Publish async cache fills that finished this frame
+	DataCache_Update();
+
 	GetTestScriptMgr()->CheckPoint( "frame_end" );
 	
 	} // Profile scope, protect from setjmp() problems
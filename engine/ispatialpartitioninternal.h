@@ -17,6 +17,19 @@
 #include "ispatialpartition.h"
 
 
+//-----------------------------------------------------------------------------
+// Gets the elements found for a packet of rays, nRayMask has a bit set for
+// each ray whose bounds touch the element
+//-----------------------------------------------------------------------------
+#define MAX_PARTITION_RAY_PACKET	32
+
+class IPartitionRayPacketEnumerator
+{
+public:
+	virtual IterationRetval_t EnumElement( IHandleEntity *pHandleEntity, unsigned int nRayMask ) = 0;
+};
+
+
 //-----------------------------------------------------------------------------
 // These methods of the spatial partition manager are only used in the engine
 //-----------------------------------------------------------------------------
@@ -26,6 +39,12 @@ public:
 	// Call this to clear out the spatial partition and to re-initialize
 	// it given a particular world size
 	virtual void Init( const Vector& worldmin, const Vector& worldmax ) = 0;
+
+	// Enumerates the elements along up to MAX_PARTITION_RAY_PACKET rays with one
+	// walk of the tree. Each element comes with the rays that EnumerateElementsAlongRay
+	// would have found it for, elements no ray touches are skipped.
+	virtual void EnumerateElementsAlongRays( SpatialPartitionListMask_t listMask,
+		const Ray_t *pRays, int nRays, IPartitionRayPacketEnumerator *pIterator ) = 0;
 };
 
 
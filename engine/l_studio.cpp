@@ -182,7 +182,7 @@ bool Mod_LoadStudioModel (model_t *mod, void *buffer, bool zerostructure )
 	}
 
 	// Allocate cache space for a working header, texture data and old (3*byte*256) palettes
-	Cache_Alloc( &mod->cache, phdr->length, mod->name );
+	Cache_Alloc( &mod->cache, phdr->length, mod->name, DC_SECTION_MODEL );
 	if (!mod->cache.data)
 		return false;
 
@@ -248,7 +248,7 @@ void Mod_ReleaseStudioModel(model_t *mod)
 	}
 }
  
-static void Mod_FreeVCollide( model_t *pModel )
+void Mod_FreeVCollide( model_t *pModel )
 {
 	if ( !pModel->studio.vcollisionLoaded )
 		return;
@@ -293,6 +293,16 @@ void Mod_UnloadStudioModel(model_t *mod)
 		mod->studio.studiomeshLoaded = false;
 	}
 	Mod_FreeVCollide( mod );
+	Mod_FlushStudioHdr( mod );
+}
+
+//-----------------------------------------------------------------------------
+// Throws the cached studiohdr out; it gets reloaded on the next access
+//-----------------------------------------------------------------------------
+void Mod_FlushStudioHdr( model_t *mod )
+{
+	// A refill queued by the MDL cache would otherwise land after the flush
+	DataCache_CancelAsync( &mod->cache );
 
 	// Destroy virtual model if present (only for v44+ models)
 	if( Cache_Check( &mod->cache ) )
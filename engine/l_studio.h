@@ -15,6 +15,8 @@ class IStudioRender;
 extern IStudioRender *g_pStudioRender;
 
 vcollide_t *Mod_VCollide( model_t *pModel );
+void Mod_FreeVCollide( model_t *pModel );
+void Mod_FlushStudioHdr( model_t *mod );
 void UpdateStudioRenderConfig( void );
 void InitStudioRender( void );
 void ShutdownStudioRender( void );
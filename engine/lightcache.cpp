@@ -29,9 +29,9 @@
 #include "enginetrace.h"
 
 
-// this should be prime to make the hash better
-#define MAX_CACHE_ENTRY		3709
-#define MAX_CACHE_BUCKETS	MAX_CACHE_ENTRY
+#define MAX_CACHE_ENTRY		8191
+// must be a power of two, the hash is masked down to a bucket
+#define MAX_CACHE_BUCKETS	16384
 #define FRAME_CACHE_COUNT	32
 
 float Engine_WorldLightDistanceFalloff( const dworldlight_t *wl, const Vector& delta, bool bNoRadiusCheck = false );
@@ -153,6 +153,8 @@ static ConVar  r_lightdebug	("r_lightdebug", "0");
 static ConVar  r_minnewsamples	("r_minnewsamples", "3");
 static ConVar  r_maxnewsamples	("r_maxnewsamples", "6");
 static ConVar  r_maxsampledist	("r_maxsampledist", "128");
+static ConVar  r_lightcache_prewarm	( "r_lightcache_prewarm", "2048", 0, "Max number of lightcache cells computed from the leaf centers when a map loads" );
+static ConVar  r_lightcache_refresh	( "r_lightcache_refresh", "4", 0, "Number of lightcache cells recomputed per frame after the cache is flushed mid-level" );
 
 static lightcache_t lightcache[MAX_CACHE_ENTRY];
 static lightcache_t	*lightbuckets[MAX_CACHE_BUCKETS];
@@ -169,6 +171,26 @@ static PropLightcache_t* s_pFirstProp = NULL;
 // head and tail sentinels of the LRU
 static lightcache_t	lightlru, lightlrutail;
 
+// Leaves whose centers get precomputed cache entries. The list is built when
+// the map finishes loading; if the cache is flushed afterwards the list is
+// walked again a few cells a frame.
+static CUtlVector<int>	s_PrewarmLeaves;
+static model_t			*s_pPrewarmWorld = NULL;
+static int				s_nNextPrewarmLeaf = 0;
+static int				s_nPrewarmFrame = -1;
+
+struct LightcacheStats_t
+{
+	int		m_nHits;
+	int		m_nMisses;
+	int		m_nFrameCacheHits;	// misses lit from a nearby sample computed this frame
+	int		m_nEvictions;
+	int		m_nPrewarmed;
+	int		m_nRefreshed;
+};
+
+static LightcacheStats_t s_LightcacheStats;
+
 // Used to convert RGB colors to greyscale intensity
 static Vector s_Grayscale( 0.299f, 0.587f, 0.114f ); 
 
@@ -211,6 +233,15 @@ void R_StudioInitLightingCache( void )
 	cached_r_avglight = r_avglight.GetInt();
 	cached_mat_fullbright = mat_fullbright.GetInt();
 
+	// Walk the prewarm list again if it belongs to this map; a new map builds
+	// its own once it has loaded
+	s_nNextPrewarmLeaf = 0;
+	if ( s_pPrewarmWorld != host_state.worldmodel )
+	{
+		s_PrewarmLeaves.Purge();
+		s_pPrewarmWorld = NULL;
+	}
+
 	// Recompute all static lighting
 	RecomputeStaticLighting();
 }
@@ -297,7 +328,11 @@ static lightcache_t *LightcacheGetLRU( void )
 	LightcacheMark( pcache );
 
 	// unlink from the bucket
-	LightcacheUnlink( pcache );
+	if ( pcache->bucket )
+	{
+		++s_LightcacheStats.m_nEvictions;
+		LightcacheUnlink( pcache );
+	}
 
 	pcache->leaf = -1;
 	return pcache;
@@ -310,13 +345,16 @@ static lightcache_t *LightcacheGetLRU( void )
 #define		HASH_GRID_SIZEZ		7
 
 //-----------------------------------------------------------------------------
-// Purpose: Quick & Dirty hashing function to bucket the cube in 4d parameter space
+// Purpose: Spatial hash of the cell in 4d parameter space. Each axis is scaled
+// by a large prime so that neighbouring cells don't pile up in neighbouring
+// buckets, then the high bits are folded down before masking.
 //-----------------------------------------------------------------------------
 static int LightcacheHashKey( int x, int y, int z, int leaf )
 {
-	unsigned int key = (((x<<20) + (y<<8) + z) ^ (leaf));
-	key =  key % MAX_CACHE_BUCKETS;
-	return (int)key;
+	unsigned int key = ( (unsigned int)x * 73856093u ) ^ ( (unsigned int)y * 19349663u ) ^
+		( (unsigned int)z * 83492791u ) ^ ( (unsigned int)leaf * 2654435761u );
+	key ^= key >> 16;
+	return (int)( key & ( MAX_CACHE_BUCKETS - 1 ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -1802,12 +1840,10 @@ ITexture *LightcacheGet( LightCacheHandle_t cache, LightingState_t& lightingStat
 
 
 //-----------------------------------------------------------------------------
-// Get or create the lighting information for this point
-// This is the version for dynamic objects.
+// Flushes the lighting cache if any of the convars it was built with changed
 //-----------------------------------------------------------------------------
-ITexture *LightcacheGet( const Vector& origin, LightingState_t& lightingState )
+static void CheckLightcacheConfig()
 {
-	// Initialize the lighting cache, if necessary
 	if (cached_r_worldlights != r_worldlights.GetInt() ||
 		cached_r_radiosity != r_radiosity.GetInt() ||
 		cached_r_avglight != r_avglight.GetInt() ||
@@ -1815,6 +1851,115 @@ ITexture *LightcacheGet( const Vector& origin, LightingState_t& lightingState )
 	{
 		R_StudioInitLightingCache();
 	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Computes the static lighting of the cell containing a point, unless that
+// cell is already cached. Returns true if a new entry was computed.
+//-----------------------------------------------------------------------------
+static bool PrewarmLightcacheCell( const Vector& origin )
+{
+	int leaf = CM_PointLeafnum( origin );
+	if ( ( CM_LeafCluster( leaf ) < 0 ) || ( CM_LeafContents( leaf ) & CONTENTS_SOLID ) )
+		return false;
+
+	int x = ((unsigned int)origin[0]) >> HASH_GRID_SIZEX;
+	int y = ((unsigned int)origin[1]) >> HASH_GRID_SIZEY;
+	int z = ((unsigned int)origin[2]) >> HASH_GRID_SIZEZ;
+
+	int bucket = LightcacheHashKey( x, y, z, leaf );
+	if ( FindInCache( bucket, x, y, z, leaf ) )
+		return false;
+
+	lightcache_t *pcache = NewLightcacheEntry( bucket );
+	pcache->x = x;
+	pcache->y = y;
+	pcache->z = z;
+	pcache->leaf = leaf;
+	pcache->m_pEnvCubemapTexture = FindEnvCubemapForPoint( origin );
+	ComputeStaticLightingForCacheEntry( pcache, origin, leaf );
+
+	// The first lookup adds in lightstyles + dlights
+	pcache->m_LastFrameUpdated = -1;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Computes cells from the prewarm list until nMaxCells new ones were made
+// or the list runs out
+//-----------------------------------------------------------------------------
+static int PrewarmLightcache( int nMaxCells )
+{
+	int nComputed = 0;
+	while ( ( nComputed < nMaxCells ) && ( s_nNextPrewarmLeaf < s_PrewarmLeaves.Count() ) )
+	{
+		int nLeaf = s_PrewarmLeaves[s_nNextPrewarmLeaf++];
+		if ( nLeaf >= host_state.worldmodel->brush.numleafs )
+			continue;
+
+		if ( PrewarmLightcacheCell( host_state.worldmodel->brush.leafs[nLeaf].m_vecCenter ) )
+		{
+			++nComputed;
+		}
+	}
+	return nComputed;
+}
+
+
+//-----------------------------------------------------------------------------
+// Precomputes the static lighting at the center of each empty leaf. This has
+// to happen once raycasts against the world work, i.e. at the end of signon.
+//-----------------------------------------------------------------------------
+void R_StudioPrewarmLightingCache( void )
+{
+	if ( !host_state.worldmodel )
+		return;
+
+	CheckLightcacheConfig();
+
+	model_t *pWorld = host_state.worldmodel;
+	s_PrewarmLeaves.RemoveAll();
+	s_pPrewarmWorld = pWorld;
+	s_nNextPrewarmLeaf = 0;
+
+	// Don't let the prewarmed cells push each other out of the LRU
+	int nMaxCells = min( r_lightcache_prewarm.GetInt(), MAX_CACHE_ENTRY / 2 );
+	if ( nMaxCells <= 0 )
+		return;
+
+	for ( int i = 0; i < pWorld->brush.numleafs; ++i )
+	{
+		mleaf_t *pLeaf = &pWorld->brush.leafs[i];
+		if ( ( pLeaf->cluster < 0 ) || ( pLeaf->contents & CONTENTS_SOLID ) )
+			continue;
+
+		s_PrewarmLeaves.AddToTail( i );
+		if ( s_PrewarmLeaves.Count() == nMaxCells )
+			break;
+	}
+
+	s_LightcacheStats.m_nPrewarmed += PrewarmLightcache( nMaxCells );
+}
+
+
+//-----------------------------------------------------------------------------
+// Get or create the lighting information for this point
+// This is the version for dynamic objects.
+//-----------------------------------------------------------------------------
+ITexture *LightcacheGet( const Vector& origin, LightingState_t& lightingState )
+{
+	// Initialize the lighting cache, if necessary
+	CheckLightcacheConfig();
+
+	// If the cache was flushed after the map loaded, rebuild the prewarmed
+	// cells a few at a time rather than all in one frame
+	if ( ( s_nPrewarmFrame != r_framecount ) && ( s_nNextPrewarmLeaf < s_PrewarmLeaves.Count() ) )
+	{
+		s_nPrewarmFrame = r_framecount;
+		s_LightcacheStats.m_nRefreshed += PrewarmLightcache( r_lightcache_refresh.GetInt() );
+	}
 
 	// generate the hashing vars
 	int leaf = CM_PointLeafnum(origin);
@@ -1837,6 +1982,7 @@ ITexture *LightcacheGet( const Vector& origin, LightingState_t& lightingState )
 	{
 		// move to tail of LRU
 		LightcacheMark( pcache );
+		++s_LightcacheStats.m_nHits;
 
 		// Given a cache entry, set the lighting state
 		// which we'll do by overriding the cached values (which include static
@@ -1852,6 +1998,7 @@ ITexture *LightcacheGet( const Vector& origin, LightingState_t& lightingState )
 	}
 
  	g_EngineStats.IncrementCountedStat( ENGINE_STATS_LIGHTCACHE_MISSES, 1 );
+	++s_LightcacheStats.m_nMisses;
 
 	if (!pcache)
 	{
@@ -1860,6 +2007,7 @@ ITexture *LightcacheGet( const Vector& origin, LightingState_t& lightingState )
 		pcache = CheckFrameCache( x, y, z, leaf );
 		if (pcache)
 		{
+			++s_LightcacheStats.m_nFrameCacheHits;
 			LightcacheMark( pcache );
 			AddDynamicLighting( pcache, lightingState, origin, pcache->leaf );
 			return pcache->m_pEnvCubemapTexture;
@@ -2051,35 +2199,47 @@ void ComputeLighting( const Vector& pt, const Vector* pNormal, bool bClamp, Vect
 }
 
 
-#if 0
-// This is used to measure the effectiveness of the bucketing/hashing function
-void LightcacheMetric_f( void )
+//-----------------------------------------------------------------------------
+// Reports the hit rate of the lightcache and how well the hash spreads it
+//-----------------------------------------------------------------------------
+CON_COMMAND( r_lightcache_stats, "Print lightcache hit rates and bucket usage. 'r_lightcache_stats reset' clears the counters." )
 {
-	int counts[MAX_CACHE_BUCKETS];
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) )
+	{
+		memset( &s_LightcacheStats, 0, sizeof(s_LightcacheStats) );
+		Con_Printf( "Lightcache stats reset.\n" );
+		return;
+	}
+
+	// This is used to measure the effectiveness of the bucketing/hashing function
 	int total = 0;
 	int totalEmpty = 0;
 	int maxBucket = 0;
-
 	for ( int i = 0; i < MAX_CACHE_BUCKETS; i++ )
 	{
-		lightcache_t *pcache = lightbuckets[i];
 		int count = 0;
-		while ( pcache )
+		for ( lightcache_t *pcache = lightbuckets[i]; pcache; pcache = pcache->next )
 		{
 			count++;
-			pcache = pcache->next;
 		}
 		total += count;
-		counts[i] = count;
 		if ( !count )
 			totalEmpty++;
 		if ( count > maxBucket )
 			maxBucket = count;
 	}
 
-	Con_Printf("Light; %d in cache, (%d/%d used) %d max\n", total, MAX_CACHE_BUCKETS-totalEmpty, MAX_CACHE_BUCKETS, maxBucket );
+	int nLookups = s_LightcacheStats.m_nHits + s_LightcacheStats.m_nMisses;
+	float flHitRate = nLookups ? 100.0f * s_LightcacheStats.m_nHits / nLookups : 0.0f;
+
+	Con_Printf( "Lookups: %d, %.1f%% hits, %d misses (%d lit from a nearby new sample)\n",
+		nLookups, flHitRate, s_LightcacheStats.m_nMisses, s_LightcacheStats.m_nFrameCacheHits );
+	Con_Printf( "Entries: %d/%d in use, %d evicted\n", total, MAX_CACHE_ENTRY, s_LightcacheStats.m_nEvictions );
+	Con_Printf( "Buckets: %d/%d used, %d max\n", MAX_CACHE_BUCKETS - totalEmpty, MAX_CACHE_BUCKETS, maxBucket );
+	Con_Printf( "Prewarm: %d cells at load, %d refreshed, %d of %d leaves left\n",
+		s_LightcacheStats.m_nPrewarmed, s_LightcacheStats.m_nRefreshed,
+		s_PrewarmLeaves.Count() - s_nNextPrewarmLeaf, s_PrewarmLeaves.Count() );
 }
-#endif
 
 static byte *s_pDLightVis = NULL;
 
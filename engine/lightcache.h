@@ -47,6 +47,9 @@ ITexture *LightcacheGet( const Vector& origin, LightingState_t& lightingState );
 // Reset the light cache.
 void R_StudioInitLightingCache( void );
 
+// Precompute the light cache at the leaf centers once the map has loaded
+void R_StudioPrewarmLightingCache( void );
+
 // Compute the comtribution of D- and E- lights at a point + normal
 void ComputeDynamicLighting( const Vector& pt, const Vector* pNormal, Vector& color );
 
@@ -0,0 +1,627 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: IMDLCache on top of the model loader. Studio headers live in the
+//			model section of the data cache; handles just name a model_t and
+//			carry the reference count and user data for it.
+//
+//			Model loading touches a lot of engine state, so unlike the data
+//			cache itself this is main thread only. The one exception is
+//			refilling an evicted studio header, which only reads the .mdl
+//			and can run on the data cache worker (SetAsyncLoad).
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "quakedef.h"
+#include "datacache/imdlcache.h"
+#include "datacache.h"
+#include "gl_model_private.h"
+#include "modelgen.h"
+#include "modelloader.h"
+#include "l_studio.h"
+#include "studio.h"
+#include "vcollide.h"
+#include "vphysics_interface.h"
+#include "cmodel_private.h"
+#include "utldict.h"
+#include "cache.h"
+#include "filesystem.h"
+#include "filesystem_engine.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+#ifdef SWDS
+#define MDLCACHE_REFERENCETYPE	IModelLoader::FMODELLOADER_SERVER
+#else
+#define MDLCACHE_REFERENCETYPE	IModelLoader::FMODELLOADER_CLIENTDLL
+#endif
+
+struct MDLEntry_t
+{
+	model_t		*m_pModel;
+	int			m_nRef;
+	int			m_nLockCount;
+	int			m_nStudioHdrSize;		// bytes, 0 until the header has been seen
+	bool		m_bStudioHdrPending;	// async refill queued or not announced yet
+	void		*m_pUserData;
+};
+
+class CMDLCache : public IMDLCache
+{
+public:
+	CMDLCache();
+
+	virtual void SetCacheNotify( IMDLCacheNotify *pNotify );
+	virtual MDLHandle_t FindMDL( const char *pMDLRelativePath );
+	virtual int AddRef( MDLHandle_t handle );
+	virtual int Release( MDLHandle_t handle );
+	virtual int GetRef( MDLHandle_t handle );
+	virtual studiohdr_t *GetStudioHdr( MDLHandle_t handle );
+	virtual studiohwdata_t *GetHardwareData( MDLHandle_t handle );
+	virtual vcollide_t *GetVCollide( MDLHandle_t handle );
+	virtual unsigned char *GetAnimBlock( MDLHandle_t handle, int nBlock );
+	virtual virtualmodel_t *GetVirtualModel( MDLHandle_t handle );
+	virtual int GetAutoplayList( MDLHandle_t handle, unsigned short **pOut );
+	virtual vertexFileHeader_t *GetVertexData( MDLHandle_t handle );
+	virtual void TouchAllData( MDLHandle_t handle );
+	virtual void SetUserData( MDLHandle_t handle, void* pData );
+	virtual void *GetUserData( MDLHandle_t handle );
+	virtual bool IsErrorModel( MDLHandle_t handle );
+	virtual void Flush( MDLCacheFlush_t nFlushFlags = MDLCACHE_FLUSH_ALL );
+	virtual void Flush( MDLHandle_t handle, int nFlushFlags = MDLCACHE_FLUSH_ALL );
+	virtual const char *GetModelName( MDLHandle_t handle );
+	virtual virtualmodel_t *GetVirtualModelFast( const studiohdr_t *pStudioHdr, MDLHandle_t handle );
+	virtual void BeginLock();
+	virtual void EndLock();
+	virtual int *GetFrameUnlockCounterPtrOLD();
+	virtual void FinishPendingLoads();
+	virtual vcollide_t *GetVCollideEx( MDLHandle_t handle, bool synchronousLoad = true );
+	virtual bool GetVCollideSize( MDLHandle_t handle, int *pVCollideSize );
+	virtual bool GetAsyncLoad( MDLCacheDataType_t type );
+	virtual bool SetAsyncLoad( MDLCacheDataType_t type, bool bAsync );
+	virtual void BeginMapLoad();
+	virtual void EndMapLoad();
+	virtual void MarkAsLoaded( MDLHandle_t handle );
+	virtual void InitPreloadData( bool rebuild );
+	virtual void ShutdownPreloadData();
+	virtual bool IsDataLoaded( MDLHandle_t handle, MDLCacheDataType_t type );
+	virtual int *GetFrameUnlockCounterPtr( MDLCacheDataType_t type );
+	virtual studiohdr_t *LockStudioHdr( MDLHandle_t handle );
+	virtual void UnlockStudioHdr( MDLHandle_t handle );
+	virtual bool PreloadModel( MDLHandle_t handle );
+	virtual bool GetAsyncLoading();
+	virtual void SetAsyncLoading( bool bAsync );
+	virtual void ReloadVCollide( MDLHandle_t handle );
+
+private:
+	model_t *GetModel( MDLHandle_t handle );
+
+	CUtlDict< MDLEntry_t, MDLHandle_t >	m_MDLDict;
+	IMDLCacheNotify		*m_pNotify;
+	int					m_nFrameUnlockCounter;
+	int					m_nLockDepth;
+	bool				m_bAsyncLoad[MDLCACHE_DECODEDANIMBLOCK + 1];
+	bool				m_bAsyncLoading;
+};
+
+static CMDLCache g_MDLCache;
+IMDLCache *mdlcache = &g_MDLCache;
+EXPOSE_SINGLE_INTERFACE_GLOBALVAR( CMDLCache, IMDLCache, MDLCACHE_INTERFACE_VERSION, g_MDLCache );
+
+CMDLCache::CMDLCache() : m_MDLDict( true, 0, 16 )
+{
+	m_pNotify = NULL;
+	m_nFrameUnlockCounter = 0;
+	m_nLockDepth = 0;
+	memset( m_bAsyncLoad, 0, sizeof( m_bAsyncLoad ) );
+	m_bAsyncLoading = false;
+}
+
+model_t *CMDLCache::GetModel( MDLHandle_t handle )
+{
+	if ( handle == MDLHANDLE_INVALID || !m_MDLDict.IsValidIndex( handle ) )
+		return NULL;
+
+	return m_MDLDict[handle].m_pModel;
+}
+
+void CMDLCache::SetCacheNotify( IMDLCacheNotify *pNotify )
+{
+	m_pNotify = pNotify;
+}
+
+
+//-----------------------------------------------------------------------------
+// Handles and reference counting
+//-----------------------------------------------------------------------------
+MDLHandle_t CMDLCache::FindMDL( const char *pMDLRelativePath )
+{
+	char pName[MAX_PATH];
+	Q_strncpy( pName, pMDLRelativePath, sizeof( pName ) );
+	for ( char *pSlash = pName; *pSlash; pSlash++ )
+	{
+		if ( *pSlash == '\\' )
+		{
+			*pSlash = '/';
+		}
+	}
+
+	MDLHandle_t handle = m_MDLDict.Find( pName );
+	if ( handle == m_MDLDict.InvalidIndex() )
+	{
+		model_t *pModel = modelloader->GetModelForName( pName, MDLCACHE_REFERENCETYPE );
+		if ( !pModel || pModel->type != mod_studio )
+			return MDLHANDLE_INVALID;
+
+		MDLEntry_t entry;
+		entry.m_pModel = pModel;
+		entry.m_nRef = 0;
+		entry.m_nLockCount = 0;
+		entry.m_nStudioHdrSize = 0;
+		entry.m_bStudioHdrPending = false;
+		entry.m_pUserData = NULL;
+		handle = m_MDLDict.Insert( pName, entry );
+	}
+
+	AddRef( handle );
+	return handle;
+}
+
+int CMDLCache::AddRef( MDLHandle_t handle )
+{
+	if ( !GetModel( handle ) )
+		return 0;
+
+	return ++m_MDLDict[handle].m_nRef;
+}
+
+int CMDLCache::Release( MDLHandle_t handle )
+{
+	if ( !GetModel( handle ) )
+		return 0;
+
+	MDLEntry_t &entry = m_MDLDict[handle];
+	Assert( entry.m_nRef > 0 );
+	if ( --entry.m_nRef > 0 )
+		return entry.m_nRef;
+
+	// Last reference; the model may still be in use by the engine, so just
+	// drop our locks and let the model loader unload it when it likes
+	while ( entry.m_nLockCount )
+	{
+		UnlockStudioHdr( handle );
+	}
+	modelloader->ReleaseModel( entry.m_pModel, MDLCACHE_REFERENCETYPE );
+	m_MDLDict.RemoveAt( handle );
+	return 0;
+}
+
+int CMDLCache::GetRef( MDLHandle_t handle )
+{
+	if ( !GetModel( handle ) )
+		return 0;
+
+	return m_MDLDict[handle].m_nRef;
+}
+
+
+//-----------------------------------------------------------------------------
+// Refills an evicted studio header on the data cache worker. The model loader
+// copies the .mdl into the cache as is, so reading the file and applying the
+// same fixups gives back the same header.
+//-----------------------------------------------------------------------------
+static bool FillStudioHdr( void *pDest, int nSize, void *pContext )
+{
+	model_t *pModel = (model_t *)pContext;
+
+	FileHandle_t hFile = COM_FindFileHandle( pModel->name );
+	if ( !hFile )
+		return false;
+
+	bool bRead = ( g_pFileSystem->Read( pDest, nSize, hFile ) == nSize );
+	g_pFileSystem->Close( hFile );
+
+	// The file changed underneath us; let the main thread load it properly
+	studiohdr_t *pStudioHdr = (studiohdr_t *)pDest;
+	if ( !bRead || LittleLong( pStudioHdr->id ) != IDSTUDIOHEADER || pStudioHdr->length != nSize )
+		return false;
+
+	if ( !Studio_ConvertStudioHdrToNewVersion( pStudioHdr ) )
+		return false;
+
+	if ( pStudioHdr->version >= STUDIO_VERSION_44 )
+	{
+		( (studiohdr_v44_t *)pStudioHdr )->virtualModel = NULL;
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Data access
+//-----------------------------------------------------------------------------
+studiohdr_t *CMDLCache::GetStudioHdr( MDLHandle_t handle )
+{
+	model_t *pModel = GetModel( handle );
+	if ( !pModel )
+		return NULL;
+
+	MDLEntry_t &entry = m_MDLDict[handle];
+	if ( entry.m_bStudioHdrPending )
+	{
+		// Nothing to hand out until DataCache_Update publishes the fill
+		if ( DataCache_IsPending( &pModel->cache ) )
+			return NULL;
+	}
+	else if ( !pModel->cache.data && entry.m_nStudioHdrSize && m_bAsyncLoad[MDLCACHE_STUDIOHDR] )
+	{
+		DataCache_AllocAsync( DC_SECTION_MODEL, &pModel->cache, entry.m_nStudioHdrSize, pModel->name, FillStudioHdr, pModel );
+		entry.m_bStudioHdrPending = true;
+		return NULL;
+	}
+
+	// GetExtraData reloads the header if the cache threw it out, or if the
+	// async fill failed. A header the fill brought in hasn't been announced yet.
+	bool bWasLoaded = ( pModel->cache.data != NULL ) && !entry.m_bStudioHdrPending;
+	entry.m_bStudioHdrPending = false;
+	studiohdr_t *pStudioHdr = (studiohdr_t *)modelloader->GetExtraData( pModel );
+	if ( pStudioHdr )
+	{
+		entry.m_nStudioHdrSize = pStudioHdr->length;
+	}
+
+	// The notify may add models, which moves the entries around
+	if ( !bWasLoaded && m_pNotify )
+	{
+		m_pNotify->OnDataLoaded( MDLCACHE_STUDIOHDR, handle );
+	}
+	return pStudioHdr;
+}
+
+studiohwdata_t *CMDLCache::GetHardwareData( MDLHandle_t handle )
+{
+	model_t *pModel = GetModel( handle );
+	if ( !pModel || !pModel->studio.studiomeshLoaded )
+		return NULL;
+
+	return &pModel->studio.hardwareData;
+}
+
+vcollide_t *CMDLCache::GetVCollide( MDLHandle_t handle )
+{
+	model_t *pModel = GetModel( handle );
+	if ( !pModel )
+		return NULL;
+
+	bool bWasLoaded = pModel->studio.vcollisionLoaded;
+	vcollide_t *pCollide = Mod_VCollide( pModel );
+	if ( !bWasLoaded && pCollide && m_pNotify )
+	{
+		m_pNotify->OnDataLoaded( MDLCACHE_VCOLLIDE, handle );
+	}
+	return pCollide;
+}
+
+vcollide_t *CMDLCache::GetVCollideEx( MDLHandle_t handle, bool synchronousLoad )
+{
+	return GetVCollide( handle );
+}
+
+bool CMDLCache::GetVCollideSize( MDLHandle_t handle, int *pVCollideSize )
+{
+	*pVCollideSize = 0;
+
+	vcollide_t *pCollide = GetVCollide( handle );
+	if ( !pCollide )
+		return false;
+
+	for ( int i = 0; i < pCollide->solidCount; i++ )
+	{
+		*pVCollideSize += physcollision->CollideSize( pCollide->solids[i] );
+	}
+	return true;
+}
+
+unsigned char *CMDLCache::GetAnimBlock( MDLHandle_t handle, int nBlock )
+{
+	// Animations are stored inline in the .mdl in this engine
+	return NULL;
+}
+
+virtualmodel_t *CMDLCache::GetVirtualModel( MDLHandle_t handle )
+{
+	return GetVirtualModelFast( GetStudioHdr( handle ), handle );
+}
+
+virtualmodel_t *CMDLCache::GetVirtualModelFast( const studiohdr_t *pStudioHdr, MDLHandle_t handle )
+{
+	if ( !pStudioHdr || pStudioHdr->version < STUDIO_VERSION_44 )
+		return NULL;
+
+	// The game builds these on demand; we only hand back what's there
+	return (virtualmodel_t *)( (const studiohdr_v44_t *)pStudioHdr )->virtualModel;
+}
+
+int CMDLCache::GetAutoplayList( MDLHandle_t handle, unsigned short **pOut )
+{
+	virtualmodel_t *pVirtualModel = GetVirtualModel( handle );
+	if ( !pVirtualModel || !pVirtualModel->m_autoplaySequences.Count() )
+	{
+		if ( pOut )
+		{
+			*pOut = NULL;
+		}
+		return 0;
+	}
+
+	if ( pOut )
+	{
+		*pOut = pVirtualModel->m_autoplaySequences.Base();
+	}
+	return pVirtualModel->m_autoplaySequences.Count();
+}
+
+vertexFileHeader_t *CMDLCache::GetVertexData( MDLHandle_t handle )
+{
+	// Vertex files only live in temporary buffers while the meshes are built
+	return NULL;
+}
+
+void CMDLCache::TouchAllData( MDLHandle_t handle )
+{
+	GetStudioHdr( handle );
+	GetVCollide( handle );
+}
+
+void CMDLCache::SetUserData( MDLHandle_t handle, void* pData )
+{
+	if ( GetModel( handle ) )
+	{
+		m_MDLDict[handle].m_pUserData = pData;
+	}
+}
+
+void *CMDLCache::GetUserData( MDLHandle_t handle )
+{
+	if ( !GetModel( handle ) )
+		return NULL;
+
+	return m_MDLDict[handle].m_pUserData;
+}
+
+bool CMDLCache::IsErrorModel( MDLHandle_t handle )
+{
+	model_t *pModel = GetModel( handle );
+	if ( !pModel )
+		return true;
+
+	// The loader renames models it couldn't load
+	return !Q_stricmp( pModel->name, "models/error.mdl" ) && Q_stricmp( m_MDLDict.GetElementName( handle ), "models/error.mdl" );
+}
+
+const char *CMDLCache::GetModelName( MDLHandle_t handle )
+{
+	if ( !GetModel( handle ) )
+		return "";
+
+	return m_MDLDict.GetElementName( handle );
+}
+
+bool CMDLCache::IsDataLoaded( MDLHandle_t handle, MDLCacheDataType_t type )
+{
+	model_t *pModel = GetModel( handle );
+	if ( !pModel )
+		return false;
+
+	switch ( type )
+	{
+	case MDLCACHE_STUDIOHDR:
+		return ( pModel->cache.data != NULL );
+
+	case MDLCACHE_STUDIOHWDATA:
+		return pModel->studio.studiomeshLoaded;
+
+	case MDLCACHE_VCOLLIDE:
+		return pModel->studio.vcollisionLoaded;
+
+	case MDLCACHE_VIRTUALMODEL:
+		return ( pModel->cache.data && GetVirtualModelFast( (studiohdr_t *)pModel->cache.data, handle ) );
+	}
+
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Flushing
+//-----------------------------------------------------------------------------
+void CMDLCache::Flush( MDLCacheFlush_t nFlushFlags )
+{
+	for ( MDLHandle_t i = m_MDLDict.First(); i != m_MDLDict.InvalidIndex(); i = m_MDLDict.Next( i ) )
+	{
+		Flush( i, nFlushFlags );
+	}
+}
+
+void CMDLCache::Flush( MDLHandle_t handle, int nFlushFlags )
+{
+	model_t *pModel = GetModel( handle );
+	if ( !pModel )
+		return;
+
+	MDLEntry_t &entry = m_MDLDict[handle];
+	bool bIgnoreLock = ( nFlushFlags & MDLCACHE_FLUSH_IGNORELOCK ) != 0;
+	if ( entry.m_nLockCount && !bIgnoreLock )
+		return;
+
+	if ( ( nFlushFlags & MDLCACHE_FLUSH_STUDIOHDR ) && entry.m_bStudioHdrPending )
+	{
+		DataCache_CancelAsync( &pModel->cache );
+		entry.m_bStudioHdrPending = false;
+	}
+
+	if ( ( nFlushFlags & MDLCACHE_FLUSH_VCOLLIDE ) && pModel->studio.vcollisionLoaded )
+	{
+		if ( m_pNotify )
+		{
+			m_pNotify->OnDataUnloaded( MDLCACHE_VCOLLIDE, handle );
+		}
+		Mod_FreeVCollide( pModel );
+	}
+
+	if ( ( nFlushFlags & MDLCACHE_FLUSH_STUDIOHWDATA ) && pModel->studio.studiomeshLoaded )
+	{
+		if ( m_pNotify )
+		{
+			m_pNotify->OnDataUnloaded( MDLCACHE_STUDIOHWDATA, handle );
+		}
+		Mod_ReleaseStudioModel( pModel );
+	}
+
+	if ( ( nFlushFlags & MDLCACHE_FLUSH_STUDIOHDR ) && pModel->cache.data )
+	{
+		if ( m_pNotify )
+		{
+			m_pNotify->OnDataUnloaded( MDLCACHE_STUDIOHDR, handle );
+		}
+
+		while ( entry.m_nLockCount )
+		{
+			UnlockStudioHdr( handle );
+		}
+		Mod_FlushStudioHdr( pModel );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Locking
+//-----------------------------------------------------------------------------
+void CMDLCache::BeginLock()
+{
+	if ( m_nLockDepth++ == 0 )
+	{
+		Cache_EnterCriticalSection();
+	}
+}
+
+void CMDLCache::EndLock()
+{
+	Assert( m_nLockDepth > 0 );
+	if ( m_nLockDepth > 0 && --m_nLockDepth == 0 )
+	{
+		Cache_ExitCriticalSection();
+		m_nFrameUnlockCounter++;
+	}
+}
+
+int *CMDLCache::GetFrameUnlockCounterPtrOLD()
+{
+	return &m_nFrameUnlockCounter;
+}
+
+int *CMDLCache::GetFrameUnlockCounterPtr( MDLCacheDataType_t type )
+{
+	return &m_nFrameUnlockCounter;
+}
+
+studiohdr_t *CMDLCache::LockStudioHdr( MDLHandle_t handle )
+{
+	studiohdr_t *pStudioHdr = GetStudioHdr( handle );
+	if ( !pStudioHdr )
+		return NULL;
+
+	DataCache_Lock( &GetModel( handle )->cache );
+	m_MDLDict[handle].m_nLockCount++;
+	return pStudioHdr;
+}
+
+void CMDLCache::UnlockStudioHdr( MDLHandle_t handle )
+{
+	model_t *pModel = GetModel( handle );
+	if ( !pModel || !m_MDLDict[handle].m_nLockCount )
+		return;
+
+	m_MDLDict[handle].m_nLockCount--;
+	DataCache_Unlock( &pModel->cache );
+}
+
+
+//-----------------------------------------------------------------------------
+// Loading. Only MDLCACHE_STUDIOHDR honors the async switch: with it set,
+// GetStudioHdr returns NULL for an evicted header and queues a refill, and
+// OnDataLoaded goes out once the header is back. The rest of the model
+// loader is synchronous.
+//-----------------------------------------------------------------------------
+void CMDLCache::FinishPendingLoads()
+{
+	DataCache_FinishPendingFills();
+
+	// Announce the headers that just came in
+	for ( MDLHandle_t i = m_MDLDict.First(); i != m_MDLDict.InvalidIndex(); i = m_MDLDict.Next( i ) )
+	{
+		if ( m_MDLDict[i].m_bStudioHdrPending )
+		{
+			GetStudioHdr( i );
+		}
+	}
+}
+
+bool CMDLCache::GetAsyncLoad( MDLCacheDataType_t type )
+{
+	return m_bAsyncLoad[type];
+}
+
+bool CMDLCache::SetAsyncLoad( MDLCacheDataType_t type, bool bAsync )
+{
+	bool bRetVal = m_bAsyncLoad[type];
+	m_bAsyncLoad[type] = bAsync;
+	return bRetVal;
+}
+
+bool CMDLCache::GetAsyncLoading()
+{
+	return m_bAsyncLoading;
+}
+
+void CMDLCache::SetAsyncLoading( bool bAsync )
+{
+	m_bAsyncLoading = bAsync;
+}
+
+void CMDLCache::BeginMapLoad()
+{
+}
+
+void CMDLCache::EndMapLoad()
+{
+}
+
+void CMDLCache::MarkAsLoaded( MDLHandle_t handle )
+{
+}
+
+void CMDLCache::InitPreloadData( bool rebuild )
+{
+}
+
+void CMDLCache::ShutdownPreloadData()
+{
+}
+
+bool CMDLCache::PreloadModel( MDLHandle_t handle )
+{
+	if ( !GetModel( handle ) )
+		return false;
+
+	TouchAllData( handle );
+	return true;
+}
+
+void CMDLCache::ReloadVCollide( MDLHandle_t handle )
+{
+	Flush( handle, MDLCACHE_FLUSH_VCOLLIDE | MDLCACHE_FLUSH_IGNORELOCK );
+	GetVCollide( handle );
+}
@@ -0,0 +1,707 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Console-driven microbenchmarks for shared low-level code. These
+//			run inside the engine so they can be used on dedicated servers.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "quakedef.h"
+#include "convar.h"
+#include "cmd.h"
+#include "utlsymbol.h"
+#include "mathlib.h"
+#include "studio.h"
+#include "studioskin.h"
+#include "tier0/fasttimer.h"
+#include "tier0/threadtools.h"
+#include "vstdlib/random.h"
+#include "server.h"
+#include "gl_model_private.h"
+#include "enginetrace.h"
+#include "engine/IEngineTrace.h"
+#include "gametrace.h"
+#include "cmodel.h"
+#include "cmodel_engine.h"
+#include "bspflags.h"
+#include "modelloader.h"
+#include "../game_shared/bone_setup.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//-----------------------------------------------------------------------------
+// Symbol tables: compares CUtlSymbolTable (rb-tree) and CUtlSymbolTableMT
+// (hashed) lookups, then runs concurrent lookups on the MT table.
+//-----------------------------------------------------------------------------
+
+#define BENCH_SYMBOL_COUNT	8192
+#define BENCH_LOOKUP_COUNT	1000000
+
+struct SymbolBenchThread_t
+{
+	CUtlSymbolTableMT	*m_pTable;
+	char				(*m_pNames)[32];
+	int					m_nSeed;
+	int					m_nMisses;
+};
+
+static unsigned SymbolBenchThreadFunc( void *pParam )
+{
+	SymbolBenchThread_t *pInfo = (SymbolBenchThread_t *)pParam;
+
+	int nMisses = 0;
+	unsigned int nIndex = pInfo->m_nSeed;
+	for ( int i = 0; i < BENCH_LOOKUP_COUNT; ++i )
+	{
+		nIndex = nIndex * 1103515245 + 12345;
+		if ( !pInfo->m_pTable->Find( pInfo->m_pNames[ ( nIndex >> 8 ) % BENCH_SYMBOL_COUNT ] ).IsValid() )
+		{
+			++nMisses;
+		}
+	}
+	pInfo->m_nMisses = nMisses;
+	return 0;
+}
+
+static void ReportLookupRate( const char *pName, int nLookups, const CFastTimer &timer )
+{
+	double flSeconds = timer.GetDuration().GetSeconds();
+	Con_Printf( "  %-32s %8.2f ms  %8.2f M lookups/sec\n", pName, flSeconds * 1000.0,
+		( flSeconds > 0.0 ) ? ( nLookups / flSeconds ) / 1000000.0 : 0.0 );
+}
+
+CON_COMMAND( bench_utlsymbol, "Compares CUtlSymbolTable and CUtlSymbolTableMT lookup rates. Usage: bench_utlsymbol [threads]" )
+{
+	int nThreads = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : ThreadGetProcessorCount();
+	nThreads = clamp( nThreads, 1, 32 );
+
+	// Key-like names with common prefixes, similar to what KeyValues sees
+	char (*pNames)[32] = new char[BENCH_SYMBOL_COUNT][32];
+	for ( int i = 0; i < BENCH_SYMBOL_COUNT; ++i )
+	{
+		Q_snprintf( pNames[i], sizeof( pNames[i] ), "$basetexture_%d_%x", i, RandomInt( 0, 0xffff ) );
+	}
+
+	CUtlSymbolTable rbTable( 0, 1024, true );
+	CUtlSymbolTableMT hashTable( 0, BENCH_SYMBOL_COUNT, true );
+
+	Con_Printf( "bench_utlsymbol: %d symbols, %d lookups per pass\n", BENCH_SYMBOL_COUNT, BENCH_LOOKUP_COUNT );
+
+	CFastTimer timer;
+	int i;
+
+	timer.Start();
+	for ( i = 0; i < BENCH_SYMBOL_COUNT; ++i )
+	{
+		rbTable.AddString( pNames[i] );
+	}
+	timer.End();
+	ReportLookupRate( "CUtlSymbolTable insert", BENCH_SYMBOL_COUNT, timer );
+
+	timer.Start();
+	for ( i = 0; i < BENCH_SYMBOL_COUNT; ++i )
+	{
+		hashTable.AddString( pNames[i] );
+	}
+	timer.End();
+	ReportLookupRate( "CUtlSymbolTableMT insert", BENCH_SYMBOL_COUNT, timer );
+
+	unsigned int nIndex = 1;
+	int nFound = 0;
+	timer.Start();
+	for ( i = 0; i < BENCH_LOOKUP_COUNT; ++i )
+	{
+		nIndex = nIndex * 1103515245 + 12345;
+		nFound += rbTable.Find( pNames[ ( nIndex >> 8 ) % BENCH_SYMBOL_COUNT ] ).IsValid();
+	}
+	timer.End();
+	ReportLookupRate( "CUtlSymbolTable find", BENCH_LOOKUP_COUNT, timer );
+
+	nIndex = 1;
+	timer.Start();
+	for ( i = 0; i < BENCH_LOOKUP_COUNT; ++i )
+	{
+		nIndex = nIndex * 1103515245 + 12345;
+		nFound += hashTable.Find( pNames[ ( nIndex >> 8 ) % BENCH_SYMBOL_COUNT ] ).IsValid();
+	}
+	timer.End();
+	ReportLookupRate( "CUtlSymbolTableMT find", BENCH_LOOKUP_COUNT, timer );
+
+	if ( nFound != 2 * BENCH_LOOKUP_COUNT )
+	{
+		Con_Printf( "  ERROR: %d lookups failed\n", 2 * BENCH_LOOKUP_COUNT - nFound );
+	}
+
+	// Concurrent lookups; only the MT table supports this
+	SymbolBenchThread_t threads[32];
+	ThreadHandle_t hThreads[32];
+	timer.Start();
+	for ( i = 0; i < nThreads; ++i )
+	{
+		threads[i].m_pTable = &hashTable;
+		threads[i].m_pNames = pNames;
+		threads[i].m_nSeed = i + 1;
+		threads[i].m_nMisses = 0;
+		hThreads[i] = CreateSimpleThread( SymbolBenchThreadFunc, &threads[i] );
+	}
+
+	int nMisses = 0;
+	for ( i = 0; i < nThreads; ++i )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+		nMisses += threads[i].m_nMisses;
+	}
+	timer.End();
+
+	char szLabel[64];
+	Q_snprintf( szLabel, sizeof( szLabel ), "CUtlSymbolTableMT find x%d threads", nThreads );
+	ReportLookupRate( szLabel, BENCH_LOOKUP_COUNT * nThreads, timer );
+
+	if ( nMisses )
+	{
+		Con_Printf( "  ERROR: %d concurrent lookups failed\n", nMisses );
+	}
+
+	delete[] pNames;
+}
+
+
+//-----------------------------------------------------------------------------
+// Software skinning: the scalar reference against the SSE batch kernel, with
+// every vertex on one, two or three bones and then a mix in short runs like
+// a real mesh. The SSE results are checked against the reference.
+//-----------------------------------------------------------------------------
+
+#define BENCH_SKIN_BONES	64
+
+static void SkinBenchPass( const char *pName, int nVerts, int nPasses, const mstudioboneweight_t * const *ppBoneWeights,
+	const matrix3x4_t *pPoseToWorld, const SkinBatch_t &src )
+{
+	SkinBatch_t dst, ref;
+	CFastTimer timer;
+	float flMaxError = 0.0f;
+	int i, j;
+
+	for ( i = 0; i < nVerts; i += SKIN_BATCH_SIZE )
+	{
+		int nBatchVerts = min( SKIN_BATCH_SIZE, nVerts - i );
+		Studio_SkinBatch( nBatchVerts, &ppBoneWeights[i], pPoseToWorld, src, ref, true );
+		Studio_SkinBatchSSE( nBatchVerts, &ppBoneWeights[i], pPoseToWorld, src, dst, true );
+		for ( j = 0; j < nBatchVerts; ++j )
+		{
+			flMaxError = max( flMaxError, (float)fabs( ref.m_PosX[j] - dst.m_PosX[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_PosY[j] - dst.m_PosY[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_PosZ[j] - dst.m_PosZ[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_NormX[j] - dst.m_NormX[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_NormY[j] - dst.m_NormY[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_NormZ[j] - dst.m_NormZ[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_TangentSX[j] - dst.m_TangentSX[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_TangentSY[j] - dst.m_TangentSY[j] ) );
+			flMaxError = max( flMaxError, (float)fabs( ref.m_TangentSZ[j] - dst.m_TangentSZ[j] ) );
+		}
+	}
+
+	timer.Start();
+	for ( int nPass = 0; nPass < nPasses; ++nPass )
+	{
+		for ( i = 0; i < nVerts; i += SKIN_BATCH_SIZE )
+		{
+			Studio_SkinBatch( min( SKIN_BATCH_SIZE, nVerts - i ), &ppBoneWeights[i], pPoseToWorld, src, dst, true );
+		}
+	}
+	timer.End();
+	double flScalar = timer.GetDuration().GetSeconds();
+
+	timer.Start();
+	for ( int nPass = 0; nPass < nPasses; ++nPass )
+	{
+		for ( i = 0; i < nVerts; i += SKIN_BATCH_SIZE )
+		{
+			Studio_SkinBatchSSE( min( SKIN_BATCH_SIZE, nVerts - i ), &ppBoneWeights[i], pPoseToWorld, src, dst, true );
+		}
+	}
+	timer.End();
+	double flSSE = timer.GetDuration().GetSeconds();
+
+	double flVerts = (double)nVerts * nPasses / 1000000.0;
+	Con_Printf( "  %-8s scalar %8.2f M verts/sec  sse %8.2f M verts/sec  %5.2fx  max error %g\n", pName,
+		( flScalar > 0.0 ) ? flVerts / flScalar : 0.0, ( flSSE > 0.0 ) ? flVerts / flSSE : 0.0,
+		( flSSE > 0.0 ) ? flScalar / flSSE : 0.0, flMaxError );
+}
+
+CON_COMMAND( bench_skinning, "Compares the scalar and SSE software skinning kernels. Usage: bench_skinning [verts] [passes]" )
+{
+	int nVerts = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : 16384;
+	int nPasses = ( Cmd_Argc() > 2 ) ? atoi( Cmd_Argv( 2 ) ) : 100;
+	nVerts = clamp( nVerts, SKIN_BATCH_SIZE, 1 << 20 );
+	nPasses = max( nPasses, 1 );
+
+	// The SSE kernel wants its bones 16 byte aligned
+	byte *pPoseMem = new byte[BENCH_SKIN_BONES * sizeof( matrix3x4_t ) + 15];
+	matrix3x4_t *pPoseToWorld = (matrix3x4_t *)( ( (size_t)pPoseMem + 15 ) & ~15 );
+	int i;
+	for ( i = 0; i < BENCH_SKIN_BONES; ++i )
+	{
+		QAngle angles( RandomFloat( -180, 180 ), RandomFloat( -180, 180 ), RandomFloat( -180, 180 ) );
+		Vector origin( RandomFloat( -64, 64 ), RandomFloat( -64, 64 ), RandomFloat( -64, 64 ) );
+		AngleMatrix( angles, origin, pPoseToWorld[i] );
+	}
+
+	// The kernels only ever see one batch of source data; the weights are
+	// what varies from vertex to vertex
+	SkinBatch_t src;
+	for ( i = 0; i < SKIN_BATCH_SIZE; ++i )
+	{
+		Vector normal = RandomAngularImpulse( -1, 1 );
+		VectorNormalize( normal );
+		src.m_PosX[i] = RandomFloat( -32, 32 );
+		src.m_PosY[i] = RandomFloat( -32, 32 );
+		src.m_PosZ[i] = RandomFloat( -32, 32 );
+		src.m_NormX[i] = normal.x;
+		src.m_NormY[i] = normal.y;
+		src.m_NormZ[i] = normal.z;
+		src.m_TangentSX[i] = normal.y;
+		src.m_TangentSY[i] = normal.z;
+		src.m_TangentSZ[i] = normal.x;
+		src.m_TangentSW[i] = ( i & 1 ) ? 1.0f : -1.0f;
+	}
+
+	mstudioboneweight_t *pWeights = new mstudioboneweight_t[nVerts];
+	const mstudioboneweight_t **ppBoneWeights = new const mstudioboneweight_t *[nVerts];
+
+	Con_Printf( "bench_skinning: %d verts, %d passes\n", nVerts, nPasses );
+
+	static const char *s_pPassNames[] = { "1 bone", "2 bones", "3 bones", "mixed" };
+	for ( int nPass = 0; nPass < 4; ++nPass )
+	{
+		int nBones = nPass + 1;
+		int nRun = 0;
+		for ( i = 0; i < nVerts; ++i )
+		{
+			if ( nPass == 3 && --nRun <= 0 )
+			{
+				nBones = RandomInt( 1, MAX_NUM_BONES_PER_VERT );
+				nRun = RandomInt( 1, 32 );
+			}
+
+			mstudioboneweight_t &weights = pWeights[i];
+			weights.numbones = nBones;
+
+			float flTotal = 0.0f;
+			for ( int b = 0; b < MAX_NUM_BONES_PER_VERT; ++b )
+			{
+				weights.bone[b] = RandomInt( 0, BENCH_SKIN_BONES - 1 );
+				weights.weight[b] = ( b < nBones ) ? RandomFloat( 0.1f, 1.0f ) : 0.0f;
+				flTotal += weights.weight[b];
+			}
+			for ( int b = 0; b < nBones; ++b )
+			{
+				weights.weight[b] /= flTotal;
+			}
+			ppBoneWeights[i] = &weights;
+		}
+
+		SkinBenchPass( s_pPassNames[nPass], nVerts, nPasses, ppBoneWeights, pPoseToWorld, src );
+	}
+
+	delete[] ppBoneWeights;
+	delete[] pWeights;
+	delete[] pPoseMem;
+}
+
+
+//-----------------------------------------------------------------------------
+// Trace batches: traces shotgun-like fans of rays and hulls through the
+// current map one at a time and as ITraceBatches, and checks the results match.
+//-----------------------------------------------------------------------------
+
+#define BENCH_TRACE_LENGTH	4096.0f
+
+static bool TracesMatch( const trace_t &a, const trace_t &b )
+{
+	return a.fraction == b.fraction && a.allsolid == b.allsolid && a.startsolid == b.startsolid &&
+		a.contents == b.contents && a.m_pEnt == b.m_pEnt && a.hitbox == b.hitbox &&
+		a.plane.normal == b.plane.normal && a.endpos == b.endpos;
+}
+
+CON_COMMAND( bench_tracebatch, "Compares TraceRay with ITraceBatch on the loaded map. Usage: bench_tracebatch [shots] [rays per shot] [passes]" )
+{
+	if ( !sv.active || !host_state.worldmodel )
+	{
+		Con_Printf( "bench_tracebatch: needs a running map\n" );
+		return;
+	}
+
+	int nShots = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : 256;
+	int nRaysPerShot = ( Cmd_Argc() > 2 ) ? atoi( Cmd_Argv( 2 ) ) : 12;
+	int nPasses = ( Cmd_Argc() > 3 ) ? atoi( Cmd_Argv( 3 ) ) : 10;
+	nShots = clamp( nShots, 1, 16384 );
+	nRaysPerShot = clamp( nRaysPerShot, 1, 128 );
+	nPasses = max( nPasses, 1 );
+
+	int nRays = nShots * nRaysPerShot;
+	Ray_t *pRays = new Ray_t[nRays];
+	trace_t *pTraces = new trace_t[nRays];
+
+	// Every fourth shot is a hull sweep, the rest are lines with some spread
+	const Vector &worldMins = host_state.worldmodel->mins;
+	const Vector &worldMaxs = host_state.worldmodel->maxs;
+	Vector hullExtents( 16, 16, 16 );
+	int i;
+	for ( i = 0; i < nShots; ++i )
+	{
+		Vector vecStart( RandomFloat( worldMins.x, worldMaxs.x ), RandomFloat( worldMins.y, worldMaxs.y ), RandomFloat( worldMins.z, worldMaxs.z ) );
+		Vector vecDir = RandomAngularImpulse( -1, 1 );
+		VectorNormalize( vecDir );
+		bool bHull = ( ( i & 3 ) == 3 );
+		for ( int j = 0; j < nRaysPerShot; ++j )
+		{
+			Vector vecSpread = vecDir + RandomAngularImpulse( -0.05f, 0.05f );
+			VectorNormalize( vecSpread );
+			Ray_t &ray = pRays[i * nRaysPerShot + j];
+			if ( bHull )
+			{
+				ray.Init( vecStart, vecStart + vecSpread * BENCH_TRACE_LENGTH, -hullExtents, hullExtents );
+			}
+			else
+			{
+				ray.Init( vecStart, vecStart + vecSpread * BENCH_TRACE_LENGTH );
+			}
+		}
+	}
+
+	Con_Printf( "bench_tracebatch: %d shots of %d rays, %d passes\n", nShots, nRaysPerShot, nPasses );
+
+	CFastTimer timer;
+	timer.Start();
+	int nPass;
+	for ( nPass = 0; nPass < nPasses; ++nPass )
+	{
+		for ( i = 0; i < nRays; ++i )
+		{
+			g_pEngineTraceServer->TraceRay( pRays[i], MASK_SHOT, NULL, &pTraces[i] );
+		}
+	}
+	timer.End();
+	double flSingleSeconds = timer.GetDuration().GetSeconds();
+
+	ITraceBatch *pBatch = g_pEngineTraceServer->CreateTraceBatch();
+	timer.Start();
+	for ( nPass = 0; nPass < nPasses; ++nPass )
+	{
+		for ( i = 0; i < nShots; ++i )
+		{
+			pBatch->Clear();
+			for ( int j = 0; j < nRaysPerShot; ++j )
+			{
+				pBatch->AddRay( pRays[i * nRaysPerShot + j] );
+			}
+			pBatch->Trace( MASK_SHOT, NULL );
+		}
+	}
+	timer.End();
+	double flBatchSeconds = timer.GetDuration().GetSeconds();
+
+	// Everything in one batch, and the comparison
+	pBatch->Clear();
+	for ( i = 0; i < nRays; ++i )
+	{
+		pBatch->AddRay( pRays[i] );
+	}
+	timer.Start();
+	for ( nPass = 0; nPass < nPasses; ++nPass )
+	{
+		pBatch->Trace( MASK_SHOT, NULL );
+	}
+	timer.End();
+	double flAllSeconds = timer.GetDuration().GetSeconds();
+
+	int nMismatches = 0;
+	for ( i = 0; i < nRays; ++i )
+	{
+		if ( !TracesMatch( pTraces[i], pBatch->GetTrace( i ) ) )
+		{
+			++nMismatches;
+		}
+	}
+	g_pEngineTraceServer->DestroyTraceBatch( pBatch );
+
+	double flTotalRays = (double)nRays * nPasses;
+	Con_Printf( "  %-24s %8.2f ms  %8.3f M rays/sec\n", "TraceRay", flSingleSeconds * 1000.0, flSingleSeconds > 0 ? flTotalRays / flSingleSeconds / 1000000.0 : 0.0 );
+	Con_Printf( "  %-24s %8.2f ms  %8.3f M rays/sec\n", "batch per shot", flBatchSeconds * 1000.0, flBatchSeconds > 0 ? flTotalRays / flBatchSeconds / 1000000.0 : 0.0 );
+	Con_Printf( "  %-24s %8.2f ms  %8.3f M rays/sec\n", "one batch", flAllSeconds * 1000.0, flAllSeconds > 0 ? flTotalRays / flAllSeconds / 1000000.0 : 0.0 );
+	Con_Printf( "  %d of %d traces differ from TraceRay\n", nMismatches, nRays );
+
+	delete[] pTraces;
+	delete[] pRays;
+}
+
+
+//-----------------------------------------------------------------------------
+// Hull traces: sweeps random rays and boxes through the world with the
+// recursive BSP walk and with the flat tree, and checks the results match.
+//-----------------------------------------------------------------------------
+
+static void BenchBoxTraces( const Ray_t *pRays, trace_t *pTraces, int nRays, int nPasses, bool bFlat )
+{
+	cm_flattree.SetValue( bFlat ? 1 : 0 );
+	for ( int nPass = 0; nPass < nPasses; ++nPass )
+	{
+		for ( int i = 0; i < nRays; ++i )
+		{
+			CM_BoxTrace( pRays[i], 0, MASK_SOLID, true, pTraces[i] );
+		}
+	}
+}
+
+CON_COMMAND( bench_hulltrace, "Compares the recursive and flat collision tree walks on the loaded map. Usage: bench_hulltrace [rays] [passes]" )
+{
+	if ( !host_state.worldmodel || !GetCollisionBSPData()->numnodes )
+	{
+		Con_Printf( "bench_hulltrace: needs a loaded map\n" );
+		return;
+	}
+
+	int nRays = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : 4096;
+	int nPasses = ( Cmd_Argc() > 2 ) ? atoi( Cmd_Argv( 2 ) ) : 10;
+	nRays = clamp( nRays, 1, 262144 );
+	nPasses = max( nPasses, 1 );
+
+	Ray_t *pRays = new Ray_t[nRays];
+	trace_t *pRecursive = new trace_t[nRays];
+	trace_t *pFlat = new trace_t[nRays];
+
+	// Half lines, half player sized hulls
+	const Vector &worldMins = host_state.worldmodel->mins;
+	const Vector &worldMaxs = host_state.worldmodel->maxs;
+	Vector hullMins( -16, -16, 0 );
+	Vector hullMaxs( 16, 16, 72 );
+	int i;
+	for ( i = 0; i < nRays; ++i )
+	{
+		Vector vecStart( RandomFloat( worldMins.x, worldMaxs.x ), RandomFloat( worldMins.y, worldMaxs.y ), RandomFloat( worldMins.z, worldMaxs.z ) );
+		Vector vecDir = RandomAngularImpulse( -1, 1 );
+		VectorNormalize( vecDir );
+		if ( i & 1 )
+		{
+			pRays[i].Init( vecStart, vecStart + vecDir * BENCH_TRACE_LENGTH, hullMins, hullMaxs );
+		}
+		else
+		{
+			pRays[i].Init( vecStart, vecStart + vecDir * BENCH_TRACE_LENGTH );
+		}
+	}
+
+	bool bWasFlat = cm_flattree.GetBool();
+
+	CFastTimer timer;
+	timer.Start();
+	BenchBoxTraces( pRays, pRecursive, nRays, nPasses, false );
+	timer.End();
+	double flRecursiveSeconds = timer.GetDuration().GetSeconds();
+
+	timer.Start();
+	BenchBoxTraces( pRays, pFlat, nRays, nPasses, true );
+	timer.End();
+	double flFlatSeconds = timer.GetDuration().GetSeconds();
+
+	cm_flattree.SetValue( bWasFlat ? 1 : 0 );
+
+	int nMismatches = 0;
+	for ( i = 0; i < nRays; ++i )
+	{
+		if ( !TracesMatch( pRecursive[i], pFlat[i] ) )
+		{
+			++nMismatches;
+		}
+	}
+
+	double flTotalRays = (double)nRays * nPasses;
+	Con_Printf( "bench_hulltrace: %d rays, %d passes\n", nRays, nPasses );
+	Con_Printf( "  %-24s %8.2f ms  %8.3f M traces/sec\n", "recursive", flRecursiveSeconds * 1000.0, flRecursiveSeconds > 0 ? flTotalRays / flRecursiveSeconds / 1000000.0 : 0.0 );
+	Con_Printf( "  %-24s %8.2f ms  %8.3f M traces/sec\n", "flat", flFlatSeconds * 1000.0, flFlatSeconds > 0 ? flTotalRays / flFlatSeconds / 1000000.0 : 0.0 );
+	Con_Printf( "  %d of %d traces differ\n", nMismatches, nRays );
+
+	delete[] pFlat;
+	delete[] pRecursive;
+	delete[] pRays;
+}
+
+
+//-----------------------------------------------------------------------------
+// Bone setup: CalcPose over every studio model the server has precached,
+// cold and through a CBonePoseCache, then the scalar and SSE quaternion
+// kernels on the rotations that came out.
+//-----------------------------------------------------------------------------
+
+static double BenchQuaternionKernel( bool bSIMD, bool bSlerp, const CUtlVector< Quaternion > &p, const CUtlVector< Quaternion > &q, CUtlVector< Quaternion > &qt, int nPasses )
+{
+	static const float t[4] = { 0.25f, 0.5f, 0.75f, 0.9f };
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int nPass = 0; nPass < nPasses; nPass++ )
+	{
+		for ( int i = 0; i < p.Count(); i += 4 )
+		{
+			if ( bSIMD )
+			{
+				if ( bSlerp )
+				{
+					QuaternionSlerpSIMD( &p[i], &q[i], t, &qt[i] );
+				}
+				else
+				{
+					QuaternionBlendSIMD( &p[i], &q[i], t, &qt[i] );
+				}
+				continue;
+			}
+
+			for ( int j = 0; j < 4; j++ )
+			{
+				if ( bSlerp )
+				{
+					QuaternionSlerp( p[i+j], q[i+j], t[j], qt[i+j] );
+				}
+				else
+				{
+					QuaternionBlend( p[i+j], q[i+j], t[j], qt[i+j] );
+				}
+			}
+		}
+	}
+	timer.End();
+	return timer.GetDuration().GetMillisecondsF();
+}
+
+CON_COMMAND( bench_bonesetup, "Times CalcPose over every precached studio model, cold and through the pose cache, and compares the scalar and SSE quaternion kernels. Usage: bench_bonesetup [steps]" )
+{
+	if ( !sv.active )
+	{
+		Con_Printf( "bench_bonesetup: needs a running map\n" );
+		return;
+	}
+
+	int nSteps = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : 16;
+	nSteps = max( nSteps, 1 );
+
+	float poseParameter[MAXSTUDIOPOSEPARAM];
+	int i;
+	for ( i = 0; i < MAXSTUDIOPOSEPARAM; i++ )
+	{
+		poseParameter[i] = 0.5f;
+	}
+
+	static Vector pos[MAXSTUDIOBONES];
+	static Quaternion q[MAXSTUDIOBONES];
+	CUtlVector< Quaternion > kernelP, kernelQ;
+
+	CFastTimer timer;
+	double flColdMS = 0, flCachedMS = 0;
+	int nModels = 0, nPoses = 0;
+
+	Con_Printf( "%-48s %5s %5s %10s %10s\n", "model", "bones", "seqs", "cold us", "cached us" );
+	for ( i = 1; ; i++ )
+	{
+		model_t *pModel = sv.GetModel( i );
+		if ( !pModel )
+			break;
+
+		if ( pModel->type != mod_studio )
+			continue;
+
+		studiohdr_t *pStudioHdr = (studiohdr_t *)modelloader->GetExtraData( pModel );
+		if ( !pStudioHdr || pStudioHdr->numseq <= 0 )
+			continue;
+
+		CBonePoseCache cache;
+		double flModelColdMS = 0, flModelCachedMS = 0;
+		for ( int nSeq = 0; nSeq < pStudioHdr->numseq; nSeq++ )
+		{
+			for ( int nStep = 0; nStep < nSteps; nStep++ )
+			{
+				float flCycle = (float)nStep / nSteps;
+
+				timer.Start();
+				CalcPose( pStudioHdr, NULL, pos, q, nSeq, flCycle, poseParameter, BONE_USED_BY_ANYTHING );
+				timer.End();
+				flModelColdMS += timer.GetDuration().GetMillisecondsF();
+
+				// The second call hits what the first stored
+				CalcPose( pStudioHdr, NULL, pos, q, nSeq, flCycle, poseParameter, BONE_USED_BY_ANYTHING, 1.0f, &cache );
+				timer.Start();
+				CalcPose( pStudioHdr, NULL, pos, q, nSeq, flCycle, poseParameter, BONE_USED_BY_ANYTHING, 1.0f, &cache );
+				timer.End();
+				flModelCachedMS += timer.GetDuration().GetMillisecondsF();
+
+				// Pair each pose with the one half a cycle later for the kernels
+				if ( nStep == 0 || nStep == nSteps / 2 )
+				{
+					CUtlVector< Quaternion > &dest = ( nStep == 0 ) ? kernelP : kernelQ;
+					for ( int iBone = 0; iBone < pStudioHdr->numbones; iBone++ )
+					{
+						dest.AddToTail( q[iBone] );
+					}
+				}
+			}
+
+			if ( nSteps == 1 )
+			{
+				kernelQ.AddMultipleToTail( pStudioHdr->numbones, &kernelP[kernelP.Count() - pStudioHdr->numbones] );
+			}
+		}
+
+		int nModelPoses = pStudioHdr->numseq * nSteps;
+		Con_Printf( "%-48s %5d %5d %10.2f %10.2f\n", pStudioHdr->name, pStudioHdr->numbones, pStudioHdr->numseq,
+			flModelColdMS * 1000.0 / nModelPoses, flModelCachedMS * 1000.0 / nModelPoses );
+
+		flColdMS += flModelColdMS;
+		flCachedMS += flModelCachedMS;
+		nPoses += nModelPoses;
+		nModels++;
+	}
+
+	if ( !nPoses )
+	{
+		Con_Printf( "No studio models are loaded\n" );
+		return;
+	}
+
+	Con_Printf( "%d models, %d poses: %.2f us per pose cold, %.2f us cached\n", nModels, nPoses,
+		flColdMS * 1000.0 / nPoses, flCachedMS * 1000.0 / nPoses );
+
+	// Pad the kernel inputs to whole groups of four
+	while ( kernelP.Count() & 3 )
+	{
+		kernelP.AddToTail( kernelP[0] );
+		kernelQ.AddToTail( kernelQ[0] );
+	}
+
+	CUtlVector< Quaternion > scalar, simd;
+	scalar.SetSize( kernelP.Count() );
+	simd.SetSize( kernelP.Count() );
+
+	int nPasses = max( 1, 4000000 / kernelP.Count() );
+	for ( int nKernel = 0; nKernel < 2; nKernel++ )
+	{
+		bool bSlerp = ( nKernel == 0 );
+		double flScalarMS = BenchQuaternionKernel( false, bSlerp, kernelP, kernelQ, scalar, nPasses );
+		double flSIMDMS = BenchQuaternionKernel( true, bSlerp, kernelP, kernelQ, simd, nPasses );
+
+		float flMaxError = 0;
+		for ( i = 0; i < scalar.Count(); i++ )
+		{
+			for ( int j = 0; j < 4; j++ )
+			{
+				flMaxError = max( flMaxError, fabs( scalar[i][j] - simd[i][j] ) );
+			}
+		}
+
+		double flQuats = (double)kernelP.Count() * nPasses;
+		Con_Printf( "%s: scalar %.1f Mquat/s, SSE %.1f Mquat/s (%.2fx), max error %g\n", bSlerp ? "slerp" : "blend",
+			flQuats / ( flScalarMS * 1000.0 ), flQuats / ( flSIMDMS * 1000.0 ), flScalarMS / flSIMDMS, flMaxError );
+	}
+}
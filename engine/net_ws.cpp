@@ -9,6 +9,7 @@
 #include "host.h"
 #include "convar.h"
 #include "vstdlib/icommandline.h"
+#include "sv_telemetry.h"
 
 #if defined( _WIN32 )
 
@@ -1530,6 +1531,11 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	struct sockaddr	addr;
 	int		net_socket;
 
+	if ( sock == NS_SERVER )
+	{
+		SV_TelemetryAddBytesSent( length );
+	}
+
 	if ( to.type == NA_LOOPBACK )
 	{
 		NET_SendLoopPacket (sock, length, data, to);
@@ -33,6 +33,7 @@
 #include "collisionutils.h"
 #include "debugoverlay.h"
 #include "tier0/vprof.h"
+#include "tier0/mem.h"
 
 
 //-----------------------------------------------------------------------------
@@ -291,7 +292,7 @@ private:
 									ShadowRenderInfo_t& info, int baseIndex );
 
 	// Does the actual work of computing shadow vertices
-	bool ComputeShadowVertices( ShadowDecal_t& decal, const VMatrix* pModelToWorld, ShadowVertexCache_t* pVertexCache );
+	bool ComputeShadowVertices( ShadowDecal_t& decal, const VMatrix* pModelToWorld, ShadowVertexCache_t* pVertexCache, bool bTemporary );
 
 	// Project vertices into shadow space
 	bool ProjectVerticesIntoShadowSpace( const VMatrix& modelToShadow, float maxDist,
@@ -300,8 +301,9 @@ private:
 	// Copies vertex info from the clipped vertices
 	void CopyClippedVertices( int count, ShadowVertex_t** ppSrcVert, ShadowVertex_t* pDstVert );
 
-	// Allocate, free vertices
-	ShadowVertex_t* AllocateVertices( ShadowVertexCache_t& cache, int count );
+	// Allocate, free vertices. Temporary vertices come from frame memory
+	// and only live until the end of the current RenderShadowList call.
+	ShadowVertex_t* AllocateVertices( ShadowVertexCache_t& cache, int count, bool bTemporary );
 	void FreeVertices( ShadowVertexCache_t& cache );
 
 	// Gets at cache entry...
@@ -557,8 +559,16 @@ ShadowVertex_t* CShadowMgr::GetCachedVerts( const ShadowVertexCache_t& cache )
 //-----------------------------------------------------------------------------
 // Allocates, cleans up vertex cache vertices
 //-----------------------------------------------------------------------------
-inline ShadowVertex_t* CShadowMgr::AllocateVertices( ShadowVertexCache_t& cache, int count )
+inline ShadowVertex_t* CShadowMgr::AllocateVertices( ShadowVertexCache_t& cache, int count, bool bTemporary )
 {
+	if (bTemporary)
+	{
+		cache.m_Count = count;
+		cache.m_pVerts = MemAllocFrameArray<ShadowVertex_t>( count );
+		cache.m_CachedVerts = m_LargeVertexList.InvalidIndex();
+		return cache.m_pVerts;
+	}
+
 	cache.m_pVerts = 0;
 	if (count <= SHADOW_VERTEX_SMALL_CACHE_COUNT)
 	{
@@ -607,12 +617,7 @@ inline void CShadowMgr::FreeVertices( ShadowVertexCache_t& cache )
 //-----------------------------------------------------------------------------
 void CShadowMgr::ClearTempCache( )
 {
-	// Clear out the vertices
-	for (int i = m_TempVertexCache.Count(); --i >= 0; ) 
-	{
-		FreeVertices( m_TempVertexCache[i] );
-	}
-
+	// The vertices themselves are frame memory, released by RenderShadowList
 	m_TempVertexCache.RemoveAll();
 }
 
@@ -1503,7 +1508,7 @@ inline void CShadowMgr::CopyClippedVertices( int count, ShadowVertex_t** ppSrcVe
 // Does the actual work of computing shadow vertices
 //-----------------------------------------------------------------------------
 bool CShadowMgr::ComputeShadowVertices( ShadowDecal_t& decal, 
-			const VMatrix* pModelToWorld, ShadowVertexCache_t* pVertexCache )
+			const VMatrix* pModelToWorld, ShadowVertexCache_t* pVertexCache, bool bTemporary )
 {
 	g_EngineStats.IncrementCountedStat( ENGINE_STATS_SHADOWS_CLIPPED, 1 );
 
@@ -1536,7 +1541,7 @@ bool CShadowMgr::ComputeShadowVertices( ShadowDecal_t& decal,
 	}
 	
 	// Allocate the vertices we're going to use for the decal
-	ShadowVertex_t* pDstVert = AllocateVertices( *pVertexCache, clipCount );
+	ShadowVertex_t* pDstVert = AllocateVertices( *pVertexCache, clipCount, bTemporary );
 	Assert( pDstVert );
 
 	// Copy the clipped vertices into the cache
@@ -1610,7 +1615,7 @@ inline bool CShadowMgr::GenerateNormalShadowRenderInfo( ShadowDecal_t& decal, Sh
 
 		// Compute the shadow vertices
 		// If no vertices were created, indicate this surface should be removed from the cache
-		if (!ComputeShadowVertices( decal, info.m_pModelToWorld, pVertexCache ))
+		if (!ComputeShadowVertices( decal, info.m_pModelToWorld, pVertexCache, !shouldCacheVerts ))
 			return false;
 	}
 
@@ -1850,6 +1855,7 @@ void CShadowMgr::RenderShadowList( ShadowDecalHandle_t decalHandle, const VMatri
 
 	// Blow away the temporary vertex cache (for normal surfaces)
 	ClearTempCache();
+	CMemFrameMark tempVertsMark;
 
 	// Set up rendering info structure
 	ShadowRenderInfo_t info;
@@ -37,7 +37,10 @@ int COM_IOReadBinary::open( const char *pFileName )
 
 	Q_strcat( namebuffer, pFileName );
 
-	if ( COM_OpenFile( namebuffer, hFile ) < 0 )
+	// The data cache may refill sounds from its worker thread, so leave
+	// com_filesize alone
+	*hFile = COM_FindFileHandle( namebuffer );
+	if ( !*hFile )
 	{
 		delete hFile;
 		hFile = 0;
@@ -0,0 +1,394 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Headless server benchmark.
+//
+//			sv_benchmark_record <file> records the usercmds the first real
+//			client sends until sv_benchmark_record_stop. sv_benchmark
+//			then spawns fake clients that replay them, each starting at a
+//			different point in the recording, and runs a fixed number of
+//			server ticks back to back. Fake clients are run as stress bots,
+//			so their snapshots are packed and written just like a real
+//			client's, they just never hit the wire.
+//
+//			On a dedicated server this runs unattended:
+//			srcds -game hl2 +map <map> +sv_benchmark 16 2000 moves.dat +quit
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "quakedef.h"
+#include "eiface.h"
+#include "server.h"
+#include "sv_main.h"
+#include "host.h"
+#include "filesystem.h"
+#include "filesystem_engine.h"
+#include "vengineserver_impl.h"
+#include "sv_benchmark.h"
+#include "sv_telemetry.h"
+#include "convar.h"
+#include "cmd.h"
+#include "bitbuf.h"
+#include "utlvector.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+extern ConVar sv_stressbots;
+extern ConVar sv_telemetry;
+void _Host_RunFrame_Server( bool finaltick );
+
+#define BENCHMARK_FILE_ID		(('M'<<24)+('B'<<16)+('V'<<8)+'S')
+#define BENCHMARK_FILE_VERSION	1
+#define BENCHMARK_WARMUP_TICKS	32
+
+// One clc_move worth of usercmds
+struct RecordedMove_t
+{
+	unsigned char	m_nBackup;
+	unsigned char	m_nCmds;
+	unsigned short	m_nBits;
+	int				m_nOffset;		// into s_MoveData
+};
+
+static CUtlVector< RecordedMove_t >	s_Moves;
+static CUtlVector< unsigned char >	s_MoveData;
+
+static client_t		*s_pRecordClient;
+static char			s_szRecordFile[MAX_OSPATH];
+
+static bool			s_bRunning;
+static int			s_nReplayTick;
+
+struct BenchmarkClient_t
+{
+	client_t	*m_pClient;
+	int			m_nMoveOffset;
+};
+
+static CUtlVector< BenchmarkClient_t >	s_Clients;
+
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+void SV_BenchmarkRecordMove( client_t *cl, bf_read *pBuf, int nStartBit, int numbackup, int numcmds )
+{
+	if ( !s_pRecordClient )
+		return;
+
+	// Latch onto the first real client that moves
+	if ( s_pRecordClient != cl )
+	{
+		if ( s_pRecordClient != (client_t *)-1 || cl->fakeclient )
+			return;
+
+		s_pRecordClient = cl;
+		Con_Printf( "sv_benchmark_record: recording %s\n", cl->name );
+	}
+
+	int nBits = pBuf->GetNumBitsRead() - nStartBit;
+	if ( nBits <= 0 || nBits > 0xffff )
+		return;
+
+	int iMove = s_Moves.AddToTail();
+	RecordedMove_t &move = s_Moves[iMove];
+	move.m_nBackup = numbackup;
+	move.m_nCmds = numcmds;
+	move.m_nBits = nBits;
+	move.m_nOffset = s_MoveData.Count();
+
+	s_MoveData.AddMultipleToTail( ( nBits + 7 ) >> 3 );
+
+	bf_read copy = *pBuf;
+	copy.Seek( nStartBit );
+	copy.ReadBits( s_MoveData.Base() + move.m_nOffset, nBits );
+}
+
+static bool SV_BenchmarkSaveMoves( const char *pFilename )
+{
+	FileHandle_t hFile = g_pFileSystem->Open( pFilename, "wb" );
+	if ( hFile == FILESYSTEM_INVALID_HANDLE )
+		return false;
+
+	int header[3] = { BENCHMARK_FILE_ID, BENCHMARK_FILE_VERSION, s_Moves.Count() };
+	g_pFileSystem->Write( header, sizeof( header ), hFile );
+	for ( int i = 0; i < s_Moves.Count(); i++ )
+	{
+		const RecordedMove_t &move = s_Moves[i];
+		unsigned char moveHeader[4] = { move.m_nBackup, move.m_nCmds, (unsigned char)( move.m_nBits & 0xff ), (unsigned char)( move.m_nBits >> 8 ) };
+		g_pFileSystem->Write( moveHeader, sizeof( moveHeader ), hFile );
+		g_pFileSystem->Write( s_MoveData.Base() + move.m_nOffset, ( move.m_nBits + 7 ) >> 3, hFile );
+	}
+	g_pFileSystem->Close( hFile );
+	return true;
+}
+
+static bool SV_BenchmarkLoadMoves( const char *pFilename )
+{
+	s_Moves.RemoveAll();
+	s_MoveData.RemoveAll();
+
+	FileHandle_t hFile = g_pFileSystem->Open( pFilename, "rb" );
+	if ( hFile == FILESYSTEM_INVALID_HANDLE )
+		return false;
+
+	int header[3];
+	bool bOk = ( g_pFileSystem->Read( header, sizeof( header ), hFile ) == sizeof( header ) &&
+		header[0] == BENCHMARK_FILE_ID && header[1] == BENCHMARK_FILE_VERSION );
+
+	for ( int i = 0; bOk && i < header[2]; i++ )
+	{
+		unsigned char moveHeader[4];
+		if ( g_pFileSystem->Read( moveHeader, sizeof( moveHeader ), hFile ) != sizeof( moveHeader ) )
+		{
+			bOk = false;
+			break;
+		}
+
+		int iMove = s_Moves.AddToTail();
+		RecordedMove_t &move = s_Moves[iMove];
+		move.m_nBackup = moveHeader[0];
+		move.m_nCmds = moveHeader[1];
+		move.m_nBits = moveHeader[2] | ( moveHeader[3] << 8 );
+		move.m_nOffset = s_MoveData.Count();
+
+		int nBytes = ( move.m_nBits + 7 ) >> 3;
+		s_MoveData.AddMultipleToTail( nBytes );
+		bOk = ( g_pFileSystem->Read( s_MoveData.Base() + move.m_nOffset, nBytes, hFile ) == nBytes );
+	}
+
+	g_pFileSystem->Close( hFile );
+	if ( !bOk )
+	{
+		s_Moves.RemoveAll();
+		s_MoveData.RemoveAll();
+	}
+	return bOk;
+}
+
+CON_COMMAND( sv_benchmark_record, "Record the usercmds of the first client that moves, for sv_benchmark. Usage: sv_benchmark_record <file>" )
+{
+	if ( Cmd_Argc() != 2 )
+	{
+		Con_Printf( "Usage: sv_benchmark_record <file>\n" );
+		return;
+	}
+
+	s_Moves.RemoveAll();
+	s_MoveData.RemoveAll();
+	Q_strncpy( s_szRecordFile, Cmd_Argv( 1 ), sizeof( s_szRecordFile ) );
+	s_pRecordClient = (client_t *)-1;
+	Con_Printf( "sv_benchmark_record: waiting for a client to move\n" );
+}
+
+CON_COMMAND( sv_benchmark_record_stop, "Stop recording usercmds and save them" )
+{
+	if ( !s_pRecordClient )
+	{
+		Con_Printf( "sv_benchmark_record_stop: not recording\n" );
+		return;
+	}
+
+	s_pRecordClient = NULL;
+	if ( SV_BenchmarkSaveMoves( s_szRecordFile ) )
+	{
+		Con_Printf( "sv_benchmark_record_stop: wrote %d moves to %s\n", s_Moves.Count(), s_szRecordFile );
+	}
+	else
+	{
+		Con_Printf( "sv_benchmark_record_stop: couldn't write %s\n", s_szRecordFile );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Replay
+//-----------------------------------------------------------------------------
+void SV_BenchmarkProcessUsercmds( void )
+{
+	if ( !s_bRunning || !s_Moves.Count() )
+		return;
+
+	g_ServerGlobalVariables.curtime = sv.gettime();
+	g_ServerGlobalVariables.frametime = TICK_RATE;
+
+	for ( int i = 0; i < s_Clients.Count(); i++ )
+	{
+		const RecordedMove_t &move = s_Moves[( s_nReplayTick + s_Clients[i].m_nMoveOffset ) % s_Moves.Count()];
+
+		bf_read buf( "SV_BenchmarkProcessUsercmds", s_MoveData.Base() + move.m_nOffset, ( move.m_nBits + 7 ) >> 3, move.m_nBits );
+		serverGameClients->ProcessUsercmds( s_Clients[i].m_pClient->edict, &buf, move.m_nCmds, move.m_nBackup + move.m_nCmds, 0, false, false );
+	}
+	s_nReplayTick++;
+}
+
+static bool SV_BenchmarkSpawnClients( int nClients )
+{
+	s_Clients.RemoveAll();
+	for ( int i = 0; i < nClients; i++ )
+	{
+		char szName[32];
+		Q_snprintf( szName, sizeof( szName ), "benchmark%02d", i );
+
+		edict_t *pEdict = g_pVEngineServer->CreateFakeClient( szName );
+		if ( !pEdict )
+		{
+			Con_Printf( "sv_benchmark: server is full after %d clients\n", i );
+			break;
+		}
+
+		char szRejectReason[128];
+		serverGameClients->ClientConnect( pEdict, szName, "loopback", szRejectReason );
+		serverGameClients->ClientPutInServer( pEdict, szName );
+		serverGameClients->ClientActive( pEdict );
+
+		int iClient = s_Clients.AddToTail();
+		s_Clients[iClient].m_pClient = &svs.clients[NUM_FOR_EDICT( pEdict ) - 1];
+
+		// Spread everybody out over the recording so they aren't in lockstep
+		s_Clients[iClient].m_nMoveOffset = ( s_Moves.Count() ) ? ( i * s_Moves.Count() ) / nClients : 0;
+	}
+	return ( s_Clients.Count() != 0 );
+}
+
+static void SV_BenchmarkRunTick( void )
+{
+	++host_tickcount;
+	g_ServerGlobalVariables.tickcount = sv.tickcount;
+	_Host_RunFrame_Server( true );
+}
+
+static int FloatCompare( const void *a, const void *b )
+{
+	float fa = *(const float *)a;
+	float fb = *(const float *)b;
+	return ( fa < fb ) ? -1 : ( fa > fb ) ? 1 : 0;
+}
+
+static float Percentile( const CUtlVector< float > &sorted, float flPercent )
+{
+	int i = (int)( flPercent * 0.01f * ( sorted.Count() - 1 ) + 0.5f );
+	return sorted[clamp( i, 0, sorted.Count() - 1 )];
+}
+
+CON_COMMAND( sv_benchmark, "Run server ticks back to back with fake clients replaying recorded usercmds. Usage: sv_benchmark <clients> <ticks> [usercmd file]" )
+{
+	if ( Cmd_Argc() < 3 )
+	{
+		Con_Printf( "Usage: sv_benchmark <clients> <ticks> [usercmd file]\n" );
+		return;
+	}
+
+	if ( !sv.active )
+	{
+		Con_Printf( "sv_benchmark: no map is running\n" );
+		return;
+	}
+
+	int nClients = atoi( Cmd_Argv( 1 ) );
+	int nTicks = atoi( Cmd_Argv( 2 ) );
+	if ( nClients <= 0 || nTicks <= 0 )
+		return;
+
+	if ( Cmd_Argc() > 3 )
+	{
+		if ( !SV_BenchmarkLoadMoves( Cmd_Argv( 3 ) ) )
+		{
+			Con_Printf( "sv_benchmark: couldn't load usercmds from %s\n", Cmd_Argv( 3 ) );
+			return;
+		}
+	}
+	else if ( !s_Moves.Count() )
+	{
+		Con_Printf( "sv_benchmark: no usercmds, the clients will stand still\n" );
+	}
+
+	if ( !SV_BenchmarkSpawnClients( nClients ) )
+		return;
+
+	int nOldTelemetry = sv_telemetry.GetInt();
+	int nOldStressBots = sv_stressbots.GetInt();
+	sv_telemetry.SetValue( 1 );
+	sv_stressbots.SetValue( 1 );
+
+	s_bRunning = true;
+	s_nReplayTick = 0;
+
+	// Let everybody spawn and settle before measuring
+	int i;
+	for ( i = 0; i < BENCHMARK_WARMUP_TICKS; i++ )
+	{
+		SV_BenchmarkRunTick();
+	}
+
+	CUtlVector< float > tickTimes;
+	tickTimes.EnsureCapacity( nTicks );
+	double flStageSum[TSTAGE_COUNT], flStageMax[TSTAGE_COUNT];
+	for ( i = 0; i < TSTAGE_COUNT; i++ )
+	{
+		flStageSum[i] = flStageMax[i] = 0;
+	}
+	double flBytesSent = 0;
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int tick = 0; tick < nTicks; tick++ )
+	{
+		SV_BenchmarkRunTick();
+
+		TelemetryTick_t sample;
+		if ( !SV_TelemetryGetLastTick( &sample ) )
+			continue;
+
+		tickTimes.AddToTail( sample.m_nTotal * g_ClockSpeedMillisecondsMultiplier );
+		for ( i = 0; i < TSTAGE_COUNT; i++ )
+		{
+			double flStage = sample.m_nStage[i] * g_ClockSpeedMillisecondsMultiplier;
+			flStageSum[i] += flStage;
+			flStageMax[i] = max( flStageMax[i], flStage );
+		}
+		flBytesSent += sample.m_nBytesSent;
+	}
+	timer.End();
+
+	s_bRunning = false;
+	sv_telemetry.SetValue( nOldTelemetry );
+	sv_stressbots.SetValue( nOldStressBots );
+
+	for ( i = 0; i < s_Clients.Count(); i++ )
+	{
+		SV_DropClient( s_Clients[i].m_pClient, false, "benchmark finished" );
+	}
+
+	int nSamples = tickTimes.Count();
+	if ( !nSamples )
+	{
+		Con_Printf( "sv_benchmark: no ticks were recorded\n" );
+		s_Clients.RemoveAll();
+		return;
+	}
+
+	qsort( tickTimes.Base(), nSamples, sizeof( float ), FloatCompare );
+	double flTotal = 0;
+	for ( i = 0; i < nSamples; i++ )
+	{
+		flTotal += tickTimes[i];
+	}
+
+	float flSeconds = timer.GetDuration().GetSeconds();
+	Con_Printf( "sv_benchmark: %d clients, %d ticks in %.2f s (%.1f ticks/s), %d recorded moves\n",
+		s_Clients.Count(), nTicks, flSeconds, nTicks / max( flSeconds, 0.001f ), s_Moves.Count() );
+	Con_Printf( "  tick ms:  avg %.3f  min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+		flTotal / nSamples, tickTimes[0], Percentile( tickTimes, 50 ), Percentile( tickTimes, 90 ), Percentile( tickTimes, 99 ), tickTimes[nSamples - 1] );
+	for ( i = 0; i < TSTAGE_COUNT; i++ )
+	{
+		Con_Printf( "  %-10s avg %.3f ms  max %.3f ms\n", SV_TelemetryStageName( (TelemetryStage_t)i ), flStageSum[i] / nSamples, flStageMax[i] );
+	}
+	Con_Printf( "  bytes/client/tick %.1f  (%.1f KB/s per client at the tick rate)\n",
+		flBytesSent / ( nSamples * s_Clients.Count() ), flBytesSent / ( nSamples * s_Clients.Count() ) / TICK_RATE / 1024.0f );
+
+	s_Clients.RemoveAll();
+}
@@ -0,0 +1,27 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Headless server benchmark. Fills the server with fake clients
+//			that replay recorded usercmds and runs a fixed number of ticks
+//			as fast as possible.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef SV_BENCHMARK_H
+#define SV_BENCHMARK_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+class bf_read;
+typedef struct client_s client_t;
+
+// Feeds the benchmark clients their next usercmds; called after the real
+// client packets have been read
+void SV_BenchmarkProcessUsercmds( void );
+
+// Called by SV_ParseMove with the usercmd bits a client just sent
+void SV_BenchmarkRecordMove( client_t *cl, bf_read *pBuf, int nStartBit, int numbackup, int numcmds );
+
+#endif // SV_BENCHMARK_H
@@ -51,6 +51,8 @@
 #include "gameeventmanager.h"
 #include "enginebugreporter.h"
 #include "vgui_intwrap2.h"
+#include "sv_telemetry.h"
+#include "sv_benchmark.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -2790,6 +2792,8 @@ void SV_ReadPackets (void)
 	{
 		MSG_GetReadBuf()->Reset();
 
+		SV_TelemetryAddBytesReceived( net_message.cursize );
+
 		if ( Filter_ShouldDiscard ( &net_from ) )
 		{
 			Filter_SendBan( &net_from );	// tell them we aren't listening...
@@ -2862,6 +2866,9 @@ void SV_ReadPackets (void)
 		//	Con_Printf ("%s:sequenced packet without connection\n"
 		// ,NET_AdrToString(net_from));
 	}
+
+	// Benchmark clients don't send packets, hand them their moves here
+	SV_BenchmarkProcessUsercmds();
 }
 
 /*
@@ -3458,7 +3465,9 @@ static void SV_SendClientDatagrams ( int clientCount, client_t** clients, CFrame
 	msg.SetDebugName( "SV_SendClientDatagrams->msg" );
 
 	// Compute the client packs
+	SV_TelemetryBeginStage( TSTAGE_PACKENTITIES );
 	SV_ComputeClientPacks( clientCount, clients, pSnapshot, pPack );
+	SV_TelemetryEndStage( TSTAGE_PACKENTITIES );
 
 	for (i = 0; i < clientCount; ++i)
 	{
@@ -3521,6 +3530,11 @@ static void SV_SendClientDatagrams ( int clientCount, client_t** clients, CFrame
 		{
 			Netchan_TransmitBits( &pClient->netchan, msg.GetNumBitsWritten(), buf );
 		}
+		else
+		{
+			// Stress bots stand in for real clients, count what they would have cost
+			SV_TelemetryAddBytesSent( msg.GetNumBytesWritten() );
+		}
 	}
 }
 
@@ -4717,22 +4731,33 @@ void SV_Frame( bool send_client_updates )
 
 	g_ServerGlobalVariables.frametime = TICK_RATE;
 
+	SV_TelemetryBeginTick();
+
 	// Run any commands from client and play client Think functions if it is time.
+	SV_TelemetryBeginStage( TSTAGE_READPACKETS );
 	SV_ReadPackets();
+	SV_TelemetryEndStage( TSTAGE_READPACKETS );
 
 	// Move other things around and think
+	SV_TelemetryBeginStage( TSTAGE_GAMEFRAME );
 	SV_Physics( SV_IsSimulating() );
+	SV_TelemetryEndStage( TSTAGE_GAMEFRAME );
 
 	// Send the results of movement and physics to the clients
 	if ( send_client_updates )
 	{
 		// This causes network messages to be sent
 		SV_GameRenderDebugOverlays();
+
+		SV_TelemetryBeginStage( TSTAGE_SENDCLIENTS );
 		SV_SendClientMessages();
+		SV_TelemetryEndStage( TSTAGE_SENDCLIENTS );
 	}
 
 	// Send a heartbeat to the master if needed
 	master->CheckHeartbeat ();
+
+	SV_TelemetryEndTick();
 }
 
 
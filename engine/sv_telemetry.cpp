@@ -0,0 +1,247 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Always on server tick telemetry. Each tick costs a handful of
+//			cycle counter reads and one ring slot; nothing is formatted until
+//			somebody asks for a dump.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "quakedef.h"
+#include "server.h"
+#include "host.h"
+#include "sv_log.h"
+#include "sv_telemetry.h"
+#include "convar.h"
+#include "cmd.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+ConVar sv_telemetry( "sv_telemetry", "1", 0, "Record per tick server timings for sv_telemetry_dump and spike reports." );
+static ConVar sv_telemetry_spike_ms( "sv_telemetry_spike_ms", "0", 0, "Dump the recent tick telemetry to the console and server log when a tick takes longer than this many ms. 0 = disabled." );
+static ConVar sv_telemetry_spike_seconds( "sv_telemetry_spike_seconds", "2", 0, "Seconds of tick telemetry dumped when a spike is detected." );
+
+#define TELEMETRY_RING_SIZE		4096	// about a minute of ticks, must be a power of two
+
+static const char *s_StageNames[TSTAGE_COUNT] =
+{
+	"readpkts",
+	"gameframe",
+	"pack",
+	"send",
+};
+
+static TelemetryTick_t	s_TickRing[TELEMETRY_RING_SIZE];
+static unsigned		s_nTicksRecorded;
+
+// The tick being recorded
+static bool			s_bInTick;
+static TelemetryTick_t	s_CurTick;
+static CCycleCount	s_TickStart;
+static CCycleCount	s_StageStart[TSTAGE_COUNT];
+
+static double		s_flLastSpikeDump = -1e9;
+
+
+void SV_TelemetryBeginTick( void )
+{
+	if ( !sv_telemetry.GetInt() )
+		return;
+
+	memset( &s_CurTick, 0, sizeof( s_CurTick ) );
+	s_CurTick.m_nTick = host_tickcount;
+	s_CurTick.m_flRealTime = realtime;
+	s_bInTick = true;
+	s_TickStart.Sample();
+}
+
+void SV_TelemetryBeginStage( TelemetryStage_t stage )
+{
+	if ( s_bInTick )
+	{
+		s_StageStart[stage].Sample();
+	}
+}
+
+void SV_TelemetryEndStage( TelemetryStage_t stage )
+{
+	if ( s_bInTick )
+	{
+		CCycleCount end;
+		end.Sample();
+		s_CurTick.m_nStage[stage] += end.m_Int64 - s_StageStart[stage].m_Int64;
+	}
+}
+
+void SV_TelemetryAddBytesSent( int nBytes )
+{
+	if ( s_bInTick )
+	{
+		s_CurTick.m_nBytesSent += nBytes;
+	}
+}
+
+void SV_TelemetryAddBytesReceived( int nBytes )
+{
+	if ( s_bInTick )
+	{
+		s_CurTick.m_nBytesReceived += nBytes;
+	}
+}
+
+bool SV_TelemetryGetLastTick( TelemetryTick_t *pTick )
+{
+	if ( !s_nTicksRecorded )
+		return false;
+
+	*pTick = s_TickRing[( s_nTicksRecorded - 1 ) & ( TELEMETRY_RING_SIZE - 1 )];
+	return true;
+}
+
+const char *SV_TelemetryStageName( TelemetryStage_t stage )
+{
+	return s_StageNames[stage];
+}
+
+static double CyclesToMS( int64 nCycles )
+{
+	return (double)nCycles * g_ClockSpeedMillisecondsMultiplier;
+}
+
+//-----------------------------------------------------------------------------
+// Prints every recorded tick from the last flSeconds, followed by the
+// average and worst case of each column
+//-----------------------------------------------------------------------------
+typedef void (*TelemetryPrintFunc_t)( const char *pFmt, ... );
+
+static void SV_TelemetryLogPrintf( const char *pFmt, ... )
+{
+	char	string[1024];
+	va_list	argptr;
+
+	va_start( argptr, pFmt );
+	Q_vsnprintf( string, sizeof( string ), pFmt, argptr );
+	va_end( argptr );
+
+	g_Log.Print( string );
+}
+
+static void SV_TelemetryDump( float flSeconds, TelemetryPrintFunc_t pfnPrint )
+{
+	unsigned nAvailable = min( s_nTicksRecorded, (unsigned)TELEMETRY_RING_SIZE );
+	if ( !nAvailable )
+	{
+		pfnPrint( "No server ticks recorded\n" );
+		return;
+	}
+
+	// Walk back from the newest tick to find the start of the window
+	double flNewest = s_TickRing[( s_nTicksRecorded - 1 ) & ( TELEMETRY_RING_SIZE - 1 )].m_flRealTime;
+	unsigned nTicks = 0;
+	while ( nTicks < nAvailable )
+	{
+		const TelemetryTick_t &sample = s_TickRing[( s_nTicksRecorded - 1 - nTicks ) & ( TELEMETRY_RING_SIZE - 1 )];
+		if ( flNewest - sample.m_flRealTime > flSeconds )
+			break;
+		nTicks++;
+	}
+
+	pfnPrint( "Server tick telemetry, last %d ticks (%.1f seconds)\n", nTicks, flSeconds );
+	pfnPrint( "    tick      time  total ms  %9s %9s %9s %9s  clients  bots  bytes out  bytes in\n",
+		s_StageNames[0], s_StageNames[1], s_StageNames[2], s_StageNames[3] );
+
+	double flSumTotal = 0, flMaxTotal = 0;
+	double flSumStage[TSTAGE_COUNT], flMaxStage[TSTAGE_COUNT];
+	int nSumSent = 0, nSumReceived = 0;
+	int i;
+	for ( i = 0; i < TSTAGE_COUNT; i++ )
+	{
+		flSumStage[i] = flMaxStage[i] = 0;
+	}
+
+	for ( unsigned n = s_nTicksRecorded - nTicks; n != s_nTicksRecorded; n++ )
+	{
+		const TelemetryTick_t &sample = s_TickRing[n & ( TELEMETRY_RING_SIZE - 1 )];
+
+		double flTotal = CyclesToMS( sample.m_nTotal );
+		double flStage[TSTAGE_COUNT];
+		for ( i = 0; i < TSTAGE_COUNT; i++ )
+		{
+			flStage[i] = CyclesToMS( sample.m_nStage[i] );
+			flSumStage[i] += flStage[i];
+			flMaxStage[i] = max( flMaxStage[i], flStage[i] );
+		}
+		flSumTotal += flTotal;
+		flMaxTotal = max( flMaxTotal, flTotal );
+		nSumSent += sample.m_nBytesSent;
+		nSumReceived += sample.m_nBytesReceived;
+
+		pfnPrint( "%8d %9.3f %9.3f  %9.3f %9.3f %9.3f %9.3f  %7d %5d %10d %9d\n",
+			sample.m_nTick, sample.m_flRealTime, flTotal,
+			flStage[0], flStage[1], flStage[2], flStage[3],
+			sample.m_nClients, sample.m_nBots, sample.m_nBytesSent, sample.m_nBytesReceived );
+	}
+
+	pfnPrint( "     avg           %9.3f  %9.3f %9.3f %9.3f %9.3f  %20s %10d %9d\n",
+		flSumTotal / nTicks, flSumStage[0] / nTicks, flSumStage[1] / nTicks, flSumStage[2] / nTicks, flSumStage[3] / nTicks,
+		"", nSumSent / (int)nTicks, nSumReceived / (int)nTicks );
+	pfnPrint( "     max           %9.3f  %9.3f %9.3f %9.3f %9.3f\n",
+		flMaxTotal, flMaxStage[0], flMaxStage[1], flMaxStage[2], flMaxStage[3] );
+}
+
+void SV_TelemetryEndTick( void )
+{
+	if ( !s_bInTick )
+		return;
+
+	s_bInTick = false;
+
+	CCycleCount end;
+	end.Sample();
+	s_CurTick.m_nTotal = end.m_Int64 - s_TickStart.m_Int64;
+
+	// Packing happens inside the send stage, keep the two apart
+	s_CurTick.m_nStage[TSTAGE_SENDCLIENTS] -= s_CurTick.m_nStage[TSTAGE_PACKENTITIES];
+
+	int i;
+	client_t *cl;
+	for ( i = 0, cl = svs.clients; i < svs.maxclients; i++, cl++ )
+	{
+		if ( !cl->active )
+			continue;
+
+		if ( cl->fakeclient )
+		{
+			s_CurTick.m_nBots++;
+		}
+		else
+		{
+			s_CurTick.m_nClients++;
+		}
+	}
+
+	s_TickRing[s_nTicksRecorded & ( TELEMETRY_RING_SIZE - 1 )] = s_CurTick;
+	s_nTicksRecorded++;
+
+	// Report spikes, but not so often that the reports overlap
+	float flSpikeMS = sv_telemetry_spike_ms.GetFloat();
+	float flSpikeSeconds = sv_telemetry_spike_seconds.GetFloat();
+	if ( flSpikeMS > 0 && CyclesToMS( s_CurTick.m_nTotal ) > flSpikeMS &&
+		realtime - s_flLastSpikeDump > flSpikeSeconds )
+	{
+		s_flLastSpikeDump = realtime;
+
+		TelemetryPrintFunc_t pfnPrint = ( g_Log.IsActive() ) ? SV_TelemetryLogPrintf : Con_Printf;
+		pfnPrint( "Server tick %d took %.2f ms (sv_telemetry_spike_ms %.2f)\n", s_CurTick.m_nTick, CyclesToMS( s_CurTick.m_nTotal ), flSpikeMS );
+		SV_TelemetryDump( flSpikeSeconds, pfnPrint );
+	}
+}
+
+CON_COMMAND( sv_telemetry_dump, "Print the recorded server tick timings. Usage: sv_telemetry_dump [seconds]" )
+{
+	float flSeconds = ( Cmd_Argc() > 1 ) ? atof( Cmd_Argv( 1 ) ) : 5.0f;
+	SV_TelemetryDump( flSeconds, Con_Printf );
+}
@@ -0,0 +1,54 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Always on server tick telemetry. Keeps the last minute or so of
+//			per tick stage timings, client counts and traffic in a fixed ring
+//			so a lag spike can be looked at after the fact.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef SV_TELEMETRY_H
+#define SV_TELEMETRY_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+enum TelemetryStage_t
+{
+	TSTAGE_READPACKETS = 0,		// net receive and client usercmds
+	TSTAGE_GAMEFRAME,			// game dll think and physics
+	TSTAGE_PACKENTITIES,
+	TSTAGE_SENDCLIENTS,			// writing and sending client datagrams, not counting packing
+
+	TSTAGE_COUNT
+};
+
+struct TelemetryTick_t
+{
+	int		m_nTick;
+	double	m_flRealTime;
+	int64	m_nTotal;						// cycles
+	int64	m_nStage[TSTAGE_COUNT];			// cycles
+	int		m_nBytesSent;
+	int		m_nBytesReceived;
+	short	m_nClients;
+	short	m_nBots;
+};
+
+// Brackets one server tick; calls outside of a tick are ignored
+void SV_TelemetryBeginTick( void );
+void SV_TelemetryEndTick( void );
+
+void SV_TelemetryBeginStage( TelemetryStage_t stage );
+void SV_TelemetryEndStage( TelemetryStage_t stage );
+
+void SV_TelemetryAddBytesSent( int nBytes );
+void SV_TelemetryAddBytesReceived( int nBytes );
+
+// The most recently finished tick; false if nothing has been recorded
+bool SV_TelemetryGetLastTick( TelemetryTick_t *pTick );
+const char *SV_TelemetryStageName( TelemetryStage_t stage );
+
+#endif // SV_TELEMETRY_H
@@ -28,6 +28,7 @@
 #include "filesystem_engine.h"
 #include "console.h"
 #include "host.h"
+#include "sv_benchmark.h"
 
 edict_t	*sv_player = NULL;
 
@@ -284,6 +285,8 @@ void SV_ParseMove(client_t *cl)
 	numbackup	= pBuf->ReadUBitLong( NUM_BACKUP_COMMAND_BITS );;
 	numcmds		= pBuf->ReadByte();
 
+	int nStartBit = pBuf->GetNumBitsRead();
+
 	totalcmds	= numbackup + numcmds;
 
 	// Decrement drop count by held back packet count
@@ -326,6 +329,8 @@ void SV_ParseMove(client_t *cl)
 		return;
 	}
 
+	SV_BenchmarkRecordMove( cl, pBuf, nStartBit, numbackup, numcmds );
+
 	unsigned int tag = pBuf->ReadUBitLong( 32 );
 	if ( tag != 0xffffffff )
 	{
@@ -19,6 +19,8 @@
 
 #include "convar.h"
 #include "cmd.h"
+#include "common.h"
+#include "vstdlib/strtools.h"
 
 #include "tier0/vprof.h"
 
@@ -154,6 +156,46 @@ DEFERRED_CON_COMMAND(vprof_generate_report_AI_only, "Generate a report to the co
 	g_VProfCurrentProfile.Resume();
 }
 
+static char g_szTraceFile[MAX_OSPATH];
+
+DEFERRED_CON_COMMAND(vprof_trace_start, "Start recording VProf scopes from every thread to a timeline")
+{
+	if ( g_VProfCurrentProfile.IsTracing() )
+	{
+		Msg( "VProf trace already running.\n" );
+		return;
+	}
+
+	Msg( "VProf trace started.\n" );
+	g_VProfCurrentProfile.StartTrace();
+}
+
+static void VProfTraceStop()
+{
+	if ( !g_VProfCurrentProfile.IsTracing() )
+	{
+		Msg( "VProf trace isn't running.\n" );
+		return;
+	}
+
+	g_VProfCurrentProfile.StopTrace();
+	if ( g_VProfCurrentProfile.WriteTrace( g_szTraceFile ) )
+	{
+		Msg( "VProf trace written to %s. Open it in chrome://tracing or Perfetto.\n", g_szTraceFile );
+	}
+	else
+	{
+		Warning( "Couldn't write VProf trace to %s\n", g_szTraceFile );
+	}
+}
+
+CON_COMMAND(vprof_trace_stop, "Stop the VProf timeline and save it as Chrome trace JSON. Usage: vprof_trace_stop [filename]")
+{
+	// Deferred so the trace ends on a frame boundary
+	Q_snprintf( g_szTraceFile, sizeof( g_szTraceFile ), "%s/%s", com_gamedir, ( Cmd_Argc() > 1 ) ? Cmd_Argv( 1 ) : "vprof_trace.json" );
+	g_pfnDeferredOp = VProfTraceStop;
+}
+
 #ifdef MOVE_BACK_TO_PANEL
 	DEFERRED_CON_COMMAND(vprof_expand_all, "Expand the whole vprof tree")
 	{
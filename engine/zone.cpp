@@ -28,10 +28,8 @@
 #include "sound.h" // just to get at MAX_SFX
 #include "vstdlib/strtools.h"
 #include "vstdlib/icommandline.h"
-
-
-void Cache_FreeLow (int new_low_hunk);
-void Cache_FreeHigh (int new_high_hunk);
+#include "datacache.h"
+#include "utlvector.h"
 
 ConVar mem_dbgfile( "mem_dbgfile",".\\mem.txt" );
 
@@ -203,8 +201,6 @@ void *Hunk_AllocName (int size, const char *name)
 	h = (hunk_t *)(hunk_base + hunk_low_used);
 	hunk_low_used += size;
 
-	Cache_FreeLow (hunk_low_used);
-
 	memset (h, 0, size);
 	
 	h->size = size;
@@ -308,7 +304,6 @@ void *Hunk_HighAllocName (int size, const char *name)
 	}
 
 	hunk_high_used += size;
-	Cache_FreeHigh (hunk_high_used);
 
 	h = (hunk_t *)(hunk_base + hunk_size - hunk_high_used);
 
@@ -354,249 +349,66 @@ void *Hunk_TempAlloc (int size)
 
 CACHE MEMORY
 
-===============================================================================
-*/
-
-#define CACHE_NAME_LEN 64
-typedef struct cache_system_s
-{
-	int						size;		// including this header
-	cache_user_t			*user;
-	char					name[CACHE_NAME_LEN];
-	struct cache_system_s	*prev, *next;
-	struct cache_system_s	*lru_prev, *lru_next;	// for LRU flushing	
-	int						locked;
-} cache_system_t;
-
-cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
-
-cache_system_t	cache_head;
-
-int	cache_critical_section;
-
-/*
-===========
-Cache_Move
-===========
-*/
-void Cache_Move ( cache_system_t *c)
-{
-	cache_system_t		*newmem;
-
-// we are clearing up space at the bottom, so only allocate it late
-	newmem = Cache_TryAlloc (c->size, true);
-	if (newmem)
-	{
-//		Con_Printf ("cache_move ok\n");
-
-		Q_memcpy ( newmem+1, c+1, c->size - sizeof(cache_system_t) );
-		newmem->user = c->user;
-		Q_memcpy (newmem->name, c->name, sizeof(newmem->name));
-		Cache_Free (c->user);
-		newmem->user->data = (void *)(newmem+1);
-	}
-	else
-	{
-//		Con_Printf ("cache_move failed\n");
+Cached data no longer lives between the hunk marks; these are thin wrappers
+around the data cache in datacache.cpp, which keeps each kind of resource
+in its own budgeted section.
 
-		Cache_Free (c->user);		// tough luck...
-	}
-}
-
-/*
-============
-Cache_FreeLow
-
-Throw things out until the hunk can be expanded to the given point
-============
+===============================================================================
 */
-void Cache_FreeLow (int new_low_hunk)
-{
-	cache_system_t	*c;
-	
-	while (1)
-	{
-		c = cache_head.next;
-		if (c == &cache_head)
-			return;		// nothing in cache at all
-		if ((byte *)c >= hunk_base + new_low_hunk)
-			return;		// there is space to grow the hunk
-		Cache_Move ( c );	// reclaim the space
-	}
-}
 
 /*
 ============
-Cache_FreeHigh
+Cache_Flush
 
-Throw things out until the hunk can be expanded to the given point
+Throw everything out, so new data will be demand cached
 ============
 */
-void Cache_FreeHigh (int new_high_hunk)
-{
-	cache_system_t	*c, *prev;
-	
-	prev = NULL;
-	while (1)
-	{
-		c = cache_head.prev;
-		if (c == &cache_head)
-			return;		// nothing in cache at all
-		if ( (byte *)c + c->size <= hunk_base + hunk_size - new_high_hunk)
-			return;		// there is space to grow the hunk
-		if (c == prev)
-			Cache_Free (c->user);	// didn't move out of the way
-		else
-		{
-			Cache_Move (c);	// try to move it
-			prev = c;
-		}
-	}
-}
-
-void Cache_UnlinkLRU (cache_system_t *cs)
+void Cache_Flush (void)
 {
-	if (!cs->lru_next || !cs->lru_prev)
-		Sys_Error ("Cache_UnlinkLRU: NULL link");
-
-	cs->lru_next->lru_prev = cs->lru_prev;
-	cs->lru_prev->lru_next = cs->lru_next;
-	
-	cs->lru_prev = cs->lru_next = NULL;
-
-	// consider it unneeded.
-	cs->locked = 0;
+	DataCache_Flush ();
 }
 
-void Cache_MakeLRU (cache_system_t *cs)
-{
-	if (cs->lru_next || cs->lru_prev)
-		Sys_Error ("Cache_MakeLRU: active link");
-
-	cache_head.lru_next->lru_prev = cs;
-	cs->lru_next = cache_head.lru_next;
-	cs->lru_prev = &cache_head;
-	cache_head.lru_next = cs;
-
-	// if it's wanted it must be important.
-	cs->locked = cache_critical_section;
-}
 
 /*
 ============
-Cache_TryAlloc
+Cache_GetEntries
 
-Looks for a free block of memory between the high and low hunk marks
-Size should already include the header and padding
+Collects the entries of one cache section for the memory reports
 ============
 */
-cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
+struct cacheprint_t
 {
-	cache_system_t	*cs, *newmem;
-	
-// is the cache completely empty?
-
-	if (!nobottom && cache_head.prev == &cache_head)
-	{
-		if (hunk_size - hunk_high_used - hunk_low_used < size)
-			Sys_Error ("Cache_TryAlloc: %i is greater then free hunk", size);
-
-		newmem = (cache_system_t *) (hunk_base + hunk_low_used);
-		memset (newmem, 0, sizeof(*newmem));
-		newmem->size = size;
-
-		cache_head.prev = cache_head.next = newmem;
-		newmem->prev = newmem->next = &cache_head;
-		
-		Cache_MakeLRU (newmem);
-		return newmem;
-	}
-	
-// search from the bottom up for space
-
-	newmem = (cache_system_t *) (hunk_base + hunk_low_used);
-	cs = cache_head.next;
-	
-	do
-	{
-		if (!nobottom || cs != cache_head.next)
-		{
-			if ( (byte *)cs - (byte *)newmem >= size)
-			{	// found space
-				memset (newmem, 0, sizeof(*newmem));
-				newmem->size = size;
-				
-				newmem->next = cs;
-				newmem->prev = cs->prev;
-				cs->prev->next = newmem;
-				cs->prev = newmem;
-				
-				Cache_MakeLRU (newmem);
-	
-				return newmem;
-			}
-		}
+	const char	*name;
+	int			size;
+	void		*data;
+};
 
-	// continue looking		
-		newmem = (cache_system_t *)((byte *)cs + cs->size);
-		cs = cs->next;
-
-	} while (cs != &cache_head);
-	
-// try to allocate one at the very end
-	if ( hunk_base + hunk_size - hunk_high_used - (byte *)newmem >= size)
-	{
-		memset (newmem, 0, sizeof(*newmem));
-		newmem->size = size;
-		
-		newmem->next = &cache_head;
-		newmem->prev = cache_head.prev;
-		cache_head.prev->next = newmem;
-		cache_head.prev = newmem;
-		
-		Cache_MakeLRU (newmem);
-
-		return newmem;
-	}
-	
-	return NULL;		// couldn't allocate
+static void Cache_AddEntry( const char *pName, int nSize, void *pData, void *pContext )
+{
+	CUtlVector<cacheprint_t> *pEntries = (CUtlVector<cacheprint_t> *)pContext;
+	int i = pEntries->AddToTail();
+	(*pEntries)[i].name = pName;
+	(*pEntries)[i].size = nSize;
+	(*pEntries)[i].data = pData;
 }
 
-/*
-============
-Cache_Flush
-
-Throw everything out, so newmem data will be demand cached
-============
-*/
-void Cache_Flush (void)
+static void Cache_GetEntries( DataCacheSection_t section, CUtlVector<cacheprint_t> &entries )
 {
-	while (cache_head.next != &cache_head)
-		Cache_Free ( cache_head.next->user );	// reclaim the space
+	DataCache_EnumerateSection( section, Cache_AddEntry, &entries );
 }
 
-
-
-
 /*
 ============
 CacheSystemCompare
 
-Compares the names of two cache_system_t structs.
+Compares the names of two cacheprint_t structs.
 Used with qsort()
 ============
 */
-
-//needed for OutputDebugString
-//#include <windows.h>
 static int CacheSystemCompare(const void* ppcs1,const void* ppcs2)
 {
-	cache_system_t* pcs1=*(cache_system_t**)ppcs1;
-	cache_system_t* pcs2=*(cache_system_t**)ppcs2;
-//	char buf[400];
-//	sprintf(buf,"Comparing \"%s\" and \"%s\"\n",pcs1->name,pcs2->name);
-//	OutputDebugString(buf);
-	
+	cacheprint_t* pcs1=(cacheprint_t*)ppcs1;
+	cacheprint_t* pcs2=(cacheprint_t*)ppcs2;
 
 	return _stricmp(pcs1->name,pcs2->name);
 }	
@@ -611,29 +423,28 @@ Cache_Print
 */
 void Cache_Print (void)
 {
-	cache_system_t	*cd;
-	cache_system_t *sortarray[512];
-	int i=0,j=0;
+	CUtlVector<cacheprint_t> entries;
+	int i;
 
 	FileHandle_t file = g_pFileSystem->Open(mem_dbgfile.GetString(), "a");
 	if (!file)
 		return;
 
-	
-	memset(sortarray,sizeof(cache_system_t*)*512,0);
-	
 	g_pFileSystem->FPrintf(file,"\nCACHE:\n");
 
-	for (cd = cache_head.next ; cd != &cache_head ; cd = cd->next)
+	for (i = 0; i < DC_NUM_SECTIONS; i++)
 	{
-		sortarray[i++]=cd;
+		Cache_GetEntries( (DataCacheSection_t)i, entries );
 	}
 
 	//Sort the array alphabetically
-	qsort(sortarray,i,sizeof(cache_system_t*),CacheSystemCompare);
+	if ( entries.Count() )
+	{
+		qsort(entries.Base(),entries.Count(),sizeof(cacheprint_t),CacheSystemCompare);
+	}
 	
-	for(j=0;j<i;j++)
-		g_pFileSystem->FPrintf(file, "%16.16s : %-16s\n", Q_pretifymem(sortarray[j]->size), sortarray[j]->name);
+	for(i=0;i<entries.Count();i++)
+		g_pFileSystem->FPrintf(file, "%16.16s : %-16s\n", Q_pretifymem(entries[i].size), entries[i].name);
 
 	g_pFileSystem->Close(file);
 }
@@ -711,17 +522,15 @@ Cache_Report
 */
 void Cache_Report (void)
 {
-	Con_DPrintf ("%4.1f megabyte data cache\n", (hunk_size - hunk_high_used - hunk_low_used) / (float)(1024*1024) );
-}
-
-/*
-============
-Cache_Compact
+	int nBudget = 0;
+	for ( int i = 0; i < DC_NUM_SECTIONS; i++ )
+	{
+		DataCacheStats_t stats;
+		DataCache_GetStats( (DataCacheSection_t)i, &stats );
+		nBudget += stats.m_nBudget;
+	}
 
-============
-*/
-void Cache_Compact (void)
-{
+	Con_DPrintf ("%4.1f megabyte data cache\n", nBudget / (float)(1024*1024) );
 }
 
 /*
@@ -734,8 +543,7 @@ static ConCommand flush( "flush", Cache_Flush, "Flush cache memory." );
 
 void Cache_Init (void)
 {
-	cache_head.next = cache_head.prev = &cache_head;
-	cache_head.lru_next = cache_head.lru_prev = &cache_head;
+	DataCache_Init ();
 }
 
 /*
@@ -747,30 +555,15 @@ Frees the memory and removes it from the LRU list
 */
 void Cache_Free (cache_user_t *c)
 {
-	cache_system_t	*cs;
-
 	if (!c->data)
 		Sys_Error ("Cache_Free: not allocated");
 
-	cs = ((cache_system_t *)c->data) - 1;
-
-	cs->prev->next = cs->next;
-	cs->next->prev = cs->prev;
-	cs->next = cs->prev = NULL;
-
-	c->data = NULL;
-
-	Cache_UnlinkLRU (cs);
+	DataCache_Free (c);
 }
 
 int Cache_TotalUsed(void)
 {
-	cache_system_t	*cd;
-	int Total=0;
-	for (cd = cache_head.next ; cd != &cache_head ; cd = cd->next)
-			Total+=cd->size;
-
-	return Total;
+	return DataCache_TotalUsed ();
 }
 	
 
@@ -783,18 +576,7 @@ Cache_Check
 */
 void *Cache_Check (cache_user_t *c)
 {
-	cache_system_t	*cs;
-
-	if (!c->data)
-		return NULL;
-
-	cs = ((cache_system_t *)c->data) - 1;
-
-// move to head of LRU
-	Cache_UnlinkLRU (cs);
-	Cache_MakeLRU (cs);
-	
-	return c->data;
+	return DataCache_Check (c);
 }
 
 
@@ -803,60 +585,21 @@ void *Cache_Check (cache_user_t *c)
 Cache_Alloc
 ==============
 */
-void *Cache_Alloc (cache_user_t *c, int size, const char *name)
+void *Cache_Alloc (cache_user_t *c, int size, const char *name, DataCacheSection_t section)
 {
-	cache_system_t	*cs;
-
-	if (c->data)
-		Sys_Error ("Cache_Alloc: already allocated");
-	
-	if (size <= 0)
-		Sys_Error ("Cache_Alloc: size %i", size);
-
-	size = (size + sizeof(cache_system_t) + 15) & ~15;
-
-// find memory for it	
-	while (1)
-	{
-		cs = Cache_TryAlloc (size, false);
-		if (cs)
-		{
-			Q_strncpy(cs->name, name, sizeof(cs->name));
-			c->data = (void *)(cs+1);
-			cs->user = c;
-			break;
-		}
-
-	// free the least recently used entry
-		// assume if it's a locked entry that we've run out.
-		if (cache_head.lru_prev == &cache_head || cache_head.lru_prev->locked)
-			Sys_Error ("Cache_Alloc: out of memory");
-		
-		Cache_Free ( cache_head.lru_prev->user );
-	}
-	
-	return Cache_Check (c);
+	return DataCache_Alloc (section, c, size, name);
 }
 
 
 void Cache_EnterCriticalSection( )
 {
-	cache_critical_section = 1;
+	DataCache_BeginLock ();
 }
 
 
 void Cache_ExitCriticalSection( void )
 {
-	cache_critical_section = 0;
-
-	cache_system_t	*cs = &cache_head;
-
-	// clear all existing locked entries
-	do
-	{
-		cs->locked = 0;
-		cs = cs->lru_next;
-	} while (cs != &cache_head && cs->locked);
+	DataCache_EndLock ();
 }
 
 //============================================================================
@@ -982,9 +725,8 @@ void MEM_Summary(void)
 	g_pFileSystem->FPrintf(file, "\tTotal memory available:    %s\n",Q_pretifymem(hunk_size,buf));
 	g_pFileSystem->FPrintf(file, "\tTotal used in low hunk:    %s\n",Q_pretifymem(hunk_low_used,buf));
 	g_pFileSystem->FPrintf(file, "\tTotal used in high hunk:   %s\n",Q_pretifymem(hunk_high_used,buf));
-	g_pFileSystem->FPrintf(file, "\tTotal cache space:         %s\n",Q_pretifymem(hunk_size - hunk_low_used - hunk_high_used,buf));
+	g_pFileSystem->FPrintf(file, "\tTotal hunk free:           %s\n",Q_pretifymem(hunk_size - hunk_low_used - hunk_high_used,buf));
 	g_pFileSystem->FPrintf(file, "\tTotal cache used:          %s\n",Q_pretifymem(CacheUsed,buf));
-	g_pFileSystem->FPrintf(file, "\tTotal memory available:    %s\n",Q_pretifymem(hunk_size - hunk_low_used - hunk_high_used-CacheUsed,buf));
 	g_pFileSystem->FPrintf(file, "------------------------------------\n\n");
 
 	g_pFileSystem->Close(file);
@@ -1061,65 +803,35 @@ void Memory_Init ( void )
 void Memory_Shutdown( void )
 {
 	// TODO: Clear out the hunk?
+	DataCache_Shutdown ();
 }
 
 void Cache_Print_Models_And_Totals (void)
 {
 	char buf[50];
-	cache_system_t	*cd;
-	cache_system_t *sortarray[512];
-	long i=0,j=0;
+	CUtlVector<cacheprint_t> entries;
+	long j=0;
 	long totalbytes=0;
 	FileHandle_t file = g_pFileSystem->Open(mem_dbgfile.GetString(), "a");
-	int subtot=0;
 
 	if (!file)
 		return;
 
-
-
-	memset(sortarray,sizeof(cache_system_t*)*512,0);
-
-	//pack names into the array.
-	for (cd = cache_head.next ; cd != &cache_head ; cd = cd->next)
+	Cache_GetEntries( DC_SECTION_MODEL, entries );
+	if ( entries.Count() )
 	{
-		if (strstr(cd->name,".mdl"))
-		{
-			sortarray[i++]=cd;
-		}
+		qsort(entries.Base(),entries.Count(),sizeof(cacheprint_t),CacheSystemCompare);
 	}
 
-	qsort(sortarray,i,sizeof(cache_system_t*),CacheSystemCompare);
-
-
-
-
 	g_pFileSystem->FPrintf(file,"\nCACHED MODELS:\n");
 
-	
 	//now process the sorted list.
-	for (j=0;j<i;j++)
+	for (j=0;j<entries.Count();j++)
 	{
-		int k;
-		studiohdr_t			*phdr=(studiohdr_t*)sortarray[j]->user->data;
-
-
-		// Use version-safe accessor for texture data
-		// This code calculates memory usage from texture dimensions - use 0 for v44+ as they don't store textures inline
-		int numTextures = StudioHdr_GetNumTextures(phdr);
-		subtot=0;
-		for (k = 0; k < numTextures; k++)
-		{
-			mstudiotexture_t* pTex = StudioHdr_GetTexture(phdr, k);
-			if (pTex)
-				subtot += pTex->width * pTex->height + 768; // (256*3 for the palette)
-		}
-
-		g_pFileSystem->FPrintf(file, "\t%16.16s : %s\n", Q_pretifymem(sortarray[j]->size,buf),sortarray[j]->name);
-		totalbytes+=sortarray[j]->size;
+		g_pFileSystem->FPrintf(file, "\t%16.16s : %s\n", Q_pretifymem(entries[j].size,buf),entries[j].name);
+		totalbytes+=entries[j].size;
 	}
 
-	
 	g_pFileSystem->FPrintf(file,"Total bytes in cache used by models:  %s\n",Q_pretifymem(totalbytes,buf));
 	g_pFileSystem->Close(file);
 }
@@ -1138,9 +850,8 @@ directories that they're in.
 void Cache_Print_Sounds_And_Totals (void)
 {
 	char buf[50];
-	cache_system_t	*cd;
-	cache_system_t *sortarray[MAX_SFX];
-	long i=0,j=0;
+	CUtlVector<cacheprint_t> entries;
+	long j=0;
 	long totalsndbytes=0;
 	FileHandle_t file = g_pFileSystem->Open(mem_dbgfile.GetString(), "a");
 	int subtot=0;
@@ -1148,37 +859,27 @@ void Cache_Print_Sounds_And_Totals (void)
 	if (!file)
 		return;
 
-	memset(sortarray,sizeof(cache_system_t*)*MAX_SFX,0);
-
-	//pack names into the array.
-	for (cd = cache_head.next ; cd != &cache_head ; cd = cd->next)
+	Cache_GetEntries( DC_SECTION_SOUND, entries );
+	if ( entries.Count() )
 	{
-		if (Q_stristr(cd->name,".wav"))
-		{
-			sortarray[i++]=cd;
-		}
+		qsort(entries.Base(),entries.Count(),sizeof(cacheprint_t),CacheSystemCompare);
 	}
 
-	qsort(sortarray,i,sizeof(cache_system_t*),CacheSystemCompare);
-
-
-	if (!file)
-		return;
 	g_pFileSystem->FPrintf(file,"\nCACHED SOUNDS:\n");
 
 	
 	//now process the sorted list.  (totals by directory)
-	for (j=0;j<i;j++)
+	for (j=0;j<entries.Count();j++)
 	{
 		
-		g_pFileSystem->FPrintf(file, "\t%16.16s : %s\n", Q_pretifymem(sortarray[j]->size,buf),sortarray[j]->name);
-		totalsndbytes+=sortarray[j]->size;
+		g_pFileSystem->FPrintf(file, "\t%16.16s : %s\n", Q_pretifymem(entries[j].size,buf),entries[j].name);
+		totalsndbytes+=entries[j].size;
 
 #ifdef _WIN32
-		if (j+1==i || ComparePath1(sortarray[j]->name,sortarray[j+1]->name)==0)
+		if (j+1==entries.Count() || ComparePath1((char *)entries[j].name,(char *)entries[j+1].name)==0)
 		{
 			char pathbuf[512];
-			_splitpath(sortarray[j]->name,NULL,pathbuf,NULL,NULL);
+			_splitpath(entries[j].name,NULL,pathbuf,NULL,NULL);
 			g_pFileSystem->FPrintf(file, "\tTotal Bytes used in \"%s\": %s\n",pathbuf,Q_pretifymem(totalsndbytes-subtot,buf));
 			subtot=totalsndbytes;
 		}
@@ -1198,9 +899,8 @@ int MEM_Summary_Console( void )
 	Msg("\tTotal memory available:    %s\n",Q_pretifymem(hunk_size));
 	Msg("\tTotal used in low hunk:    %s\n",Q_pretifymem(hunk_low_used));
 	Msg("\tTotal used in high hunk:   %s\n",Q_pretifymem(hunk_high_used));
-	Msg("\tTotal cache space:         %s\n",Q_pretifymem(hunk_size - hunk_low_used - hunk_high_used));
+	Msg("\tTotal hunk free:           %s\n",Q_pretifymem(hunk_size - hunk_low_used - hunk_high_used));
 	Msg("\tTotal cache used:          %s\n",Q_pretifymem(Cache_TotalUsed()));
-	Msg("\tTotal memory available:    %s\n",Q_pretifymem(hunk_size - hunk_low_used - hunk_high_used-Cache_TotalUsed()));
 
 	Msg("------------------------------------\n");
 
@@ -26,7 +26,7 @@ static char s_pScratchFileName[ MAX_PATH ];
 
 
 // Case-insensitive symbol table for path IDs.
-CUtlSymbolTable g_PathIDTable( 0, 32, true );
+CUtlSymbolTableMT g_PathIDTable( 0, 32, true );
 
 
 //-----------------------------------------------------------------------------
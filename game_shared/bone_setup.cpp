@@ -7,6 +7,8 @@
 #include "collisionutils.h"
 #include "vstdlib/random.h"
 #include "tier0/vprof.h"
+#include "tier0/threadtools.h"
+#include <xmmintrin.h>
 
 // Include shared model loader for v37 animation groups
 #include "engine/ISharedModelLoader.h"
@@ -22,6 +24,10 @@ void BuildBoneChain(
 	int	iBone,
 	matrix3x4_t *pBoneToWorld );
 
+// Bones may be set up on worker threads, the shared model loader is not
+// thread safe
+static CThreadFastMutex s_SharedModelLock;
+
 //-----------------------------------------------------------------------------
 // GetAnimDescriptions - Version-aware animation descriptor retrieval
 //
@@ -86,7 +92,11 @@ mstudioanimdesc_t *GetAnimDescriptions( const studiohdr_t *pStudioHdr, mstudiose
 			}
 		}
 
-		studioanimgrouphdr_t *pAnimGroupShared = (studioanimgrouphdr_t *)sharedmodelloader->LoadSharedModel( pSeqGroup->pszName() );
+		studioanimgrouphdr_t *pAnimGroupShared;
+		{
+			AUTO_LOCK_FM( s_SharedModelLock );
+			pAnimGroupShared = (studioanimgrouphdr_t *)sharedmodelloader->LoadSharedModel( pSeqGroup->pszName() );
+		}
 		if ( pAnimGroupShared == NULL )
 			return pStudioHdr->pAnimdesc( 0 );
 
@@ -626,7 +636,7 @@ static void CalcLocalHierarchyAnimation(
 	Quaternion localQ;
 
 	// make fake root transform
-	static matrix3x4_t rootXform( 1.0f, 0, 0, 0,   0, 1.0f, 0, 0,  0, 0, 1.0f, 0 );
+	matrix3x4_t rootXform( 1.0f, 0, 0, 0,   0, 1.0f, 0, 0,  0, 0, 1.0f, 0 );
 
 	float weight = 1.0f;
 
@@ -894,6 +904,186 @@ void QuaternionAccumulate( const Quaternion &p, float s, const Quaternion &q, Qu
 	qt[3] = p[3] + s * qt[3];
 }
 
+//-----------------------------------------------------------------------------
+// SSE quaternion kernels. Four quaternions are transposed so each register
+// holds one component of all four, q is flipped into p's hemisphere the same
+// way QuaternionAlign does it, and the blended result is transposed back.
+//-----------------------------------------------------------------------------
+#define QUATERNION_LOAD4( _q, _x, _y, _z, _w )	\
+	_x = _mm_loadu_ps( &_q[0].x );				\
+	_y = _mm_loadu_ps( &_q[1].x );				\
+	_z = _mm_loadu_ps( &_q[2].x );				\
+	_w = _mm_loadu_ps( &_q[3].x );				\
+	_MM_TRANSPOSE4_PS( _x, _y, _z, _w )
+
+#define QUATERNION_STORE4( _q, _x, _y, _z, _w )	\
+	_MM_TRANSPOSE4_PS( _x, _y, _z, _w );		\
+	_mm_storeu_ps( &_q[0].x, _x );				\
+	_mm_storeu_ps( &_q[1].x, _y );				\
+	_mm_storeu_ps( &_q[2].x, _z );				\
+	_mm_storeu_ps( &_q[3].x, _w )
+
+static inline __m128 QuaternionAlign4( __m128 px, __m128 py, __m128 pz, __m128 pw,
+	__m128 &qx, __m128 &qy, __m128 &qz, __m128 &qw )
+{
+	__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, qx ), _mm_mul_ps( py, qy ) ),
+		_mm_add_ps( _mm_mul_ps( pz, qz ), _mm_mul_ps( pw, qw ) ) );
+
+	// |p - q| > |p + q| exactly when p.q is negative
+	__m128 flip = _mm_and_ps( _mm_cmplt_ps( dot, _mm_setzero_ps() ), _mm_set1_ps( -0.0f ) );
+	qx = _mm_xor_ps( qx, flip );
+	qy = _mm_xor_ps( qy, flip );
+	qz = _mm_xor_ps( qz, flip );
+	qw = _mm_xor_ps( qw, flip );
+	return _mm_xor_ps( dot, flip );
+}
+
+// Eberly, "A Fast and Accurate Algorithm for Computing SLERP". The slerp
+// weights are evaluated as a polynomial in cos(omega), so there's no acos or
+// sin per bone. The error is under 2e-5 for aligned unit quaternions, at
+// worst when they're 90 degrees apart.
+#define SLERP_TERMS		8
+#define SLERP_ONE_PLUS_MU	1.85298109240830f
+
+// u[i] = 1 / (n * (2n + 1)), v[i] = n / (2n + 1) for n = i + 1, with the
+// last term corrected by (1 + mu)
+static const float s_SlerpU[SLERP_TERMS] =
+{
+	1.0f / 3.0f, 1.0f / 10.0f, 1.0f / 21.0f, 1.0f / 36.0f,
+	1.0f / 55.0f, 1.0f / 78.0f, 1.0f / 105.0f, SLERP_ONE_PLUS_MU / 136.0f
+};
+static const float s_SlerpV[SLERP_TERMS] =
+{
+	1.0f / 3.0f, 2.0f / 5.0f, 3.0f / 7.0f, 4.0f / 9.0f,
+	5.0f / 11.0f, 6.0f / 13.0f, 7.0f / 15.0f, SLERP_ONE_PLUS_MU * 8.0f / 17.0f
+};
+
+static inline __m128 SlerpWeight4( __m128 t, __m128 cosMinusOne )
+{
+	__m128 one = _mm_set1_ps( 1.0f );
+	__m128 tSqr = _mm_mul_ps( t, t );
+	__m128 c = one;
+	for ( int i = SLERP_TERMS - 1; i >= 0; i-- )
+	{
+		__m128 b = _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( s_SlerpU[i] ), tSqr ), _mm_set1_ps( s_SlerpV[i] ) ), cosMinusOne );
+		c = _mm_add_ps( one, _mm_mul_ps( b, c ) );
+	}
+	return _mm_mul_ps( t, c );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: qt[i] = QuaternionSlerp( p[i], q[i], t[i] ) for four quaternions
+//-----------------------------------------------------------------------------
+void QuaternionSlerpSIMD( const Quaternion p[4], const Quaternion q[4], const float t[4], Quaternion qt[4] )
+{
+	__m128 px, py, pz, pw, qx, qy, qz, qw;
+	QUATERNION_LOAD4( p, px, py, pz, pw );
+	QUATERNION_LOAD4( q, qx, qy, qz, qw );
+
+	__m128 cosMinusOne = _mm_sub_ps( QuaternionAlign4( px, py, pz, pw, qx, qy, qz, qw ), _mm_set1_ps( 1.0f ) );
+
+	// 0.0 returns p, 1.0 returns q
+	__m128 sclq = _mm_loadu_ps( t );
+	__m128 sclp = SlerpWeight4( _mm_sub_ps( _mm_set1_ps( 1.0f ), sclq ), cosMinusOne );
+	sclq = SlerpWeight4( sclq, cosMinusOne );
+
+	__m128 rx = _mm_add_ps( _mm_mul_ps( px, sclp ), _mm_mul_ps( qx, sclq ) );
+	__m128 ry = _mm_add_ps( _mm_mul_ps( py, sclp ), _mm_mul_ps( qy, sclq ) );
+	__m128 rz = _mm_add_ps( _mm_mul_ps( pz, sclp ), _mm_mul_ps( qz, sclq ) );
+	__m128 rw = _mm_add_ps( _mm_mul_ps( pw, sclp ), _mm_mul_ps( qw, sclq ) );
+	QUATERNION_STORE4( qt, rx, ry, rz, rw );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: qt[i] = QuaternionBlend( p[i], q[i], t[i] ) for four quaternions
+//-----------------------------------------------------------------------------
+void QuaternionBlendSIMD( const Quaternion p[4], const Quaternion q[4], const float t[4], Quaternion qt[4] )
+{
+	__m128 px, py, pz, pw, qx, qy, qz, qw;
+	QUATERNION_LOAD4( p, px, py, pz, pw );
+	QUATERNION_LOAD4( q, qx, qy, qz, qw );
+
+	QuaternionAlign4( px, py, pz, pw, qx, qy, qz, qw );
+
+	__m128 sclq = _mm_loadu_ps( t );
+	__m128 sclp = _mm_sub_ps( _mm_set1_ps( 1.0f ), sclq );
+
+	__m128 rx = _mm_add_ps( _mm_mul_ps( px, sclp ), _mm_mul_ps( qx, sclq ) );
+	__m128 ry = _mm_add_ps( _mm_mul_ps( py, sclp ), _mm_mul_ps( qy, sclq ) );
+	__m128 rz = _mm_add_ps( _mm_mul_ps( pz, sclp ), _mm_mul_ps( qz, sclq ) );
+	__m128 rw = _mm_add_ps( _mm_mul_ps( pw, sclp ), _mm_mul_ps( qw, sclq ) );
+
+	// Normalize with a refined reciprocal square root, leaving zero
+	// quaternions alone like QuaternionNormalize does
+	__m128 radius = _mm_add_ps( _mm_add_ps( _mm_mul_ps( rx, rx ), _mm_mul_ps( ry, ry ) ),
+		_mm_add_ps( _mm_mul_ps( rz, rz ), _mm_mul_ps( rw, rw ) ) );
+	__m128 nonzero = _mm_cmpgt_ps( radius, _mm_setzero_ps() );
+	__m128 iradius = _mm_rsqrt_ps( _mm_or_ps( radius, _mm_andnot_ps( nonzero, _mm_set1_ps( 1.0f ) ) ) );
+	iradius = _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 0.5f ), iradius ),
+		_mm_sub_ps( _mm_set1_ps( 3.0f ), _mm_mul_ps( _mm_mul_ps( radius, iradius ), iradius ) ) );
+	iradius = _mm_or_ps( _mm_and_ps( nonzero, iradius ), _mm_andnot_ps( nonzero, _mm_set1_ps( 1.0f ) ) );
+
+	rx = _mm_mul_ps( rx, iradius );
+	ry = _mm_mul_ps( ry, iradius );
+	rz = _mm_mul_ps( rz, iradius );
+	rw = _mm_mul_ps( rw, iradius );
+	QUATERNION_STORE4( qt, rx, ry, rz, rw );
+}
+
+//-----------------------------------------------------------------------------
+// Collects bones into groups of four for the SIMD kernels. Partial groups
+// are padded by repeating the first bone.
+//-----------------------------------------------------------------------------
+typedef void (*QuaternionKernel4_t)( const Quaternion p[4], const Quaternion q[4], const float t[4], Quaternion qt[4] );
+
+class CQuaternionBatch
+{
+public:
+	CQuaternionBatch( QuaternionKernel4_t pfnKernel, Quaternion *pOut ) : m_pfnKernel( pfnKernel ), m_pOut( pOut ), m_nCount( 0 ) {}
+
+	void Add( int iBone, const Quaternion &p, const Quaternion &q, float t )
+	{
+		m_iBone[m_nCount] = iBone;
+		m_p[m_nCount] = p;
+		m_q[m_nCount] = q;
+		m_t[m_nCount] = t;
+		if ( ++m_nCount == 4 )
+		{
+			Flush();
+		}
+	}
+
+	void Flush( void )
+	{
+		if ( !m_nCount )
+			return;
+
+		for ( int i = m_nCount; i < 4; i++ )
+		{
+			m_p[i] = m_p[0];
+			m_q[i] = m_q[0];
+			m_t[i] = m_t[0];
+		}
+
+		Quaternion qt[4];
+		m_pfnKernel( m_p, m_q, m_t, qt );
+		for ( int i = 0; i < m_nCount; i++ )
+		{
+			m_pOut[m_iBone[i]] = qt[i];
+		}
+		m_nCount = 0;
+	}
+
+private:
+	QuaternionKernel4_t	m_pfnKernel;
+	Quaternion	*m_pOut;
+	int			m_nCount;
+	int			m_iBone[4];
+	Quaternion	m_p[4];
+	Quaternion	m_q[4];
+	float		m_t[4];
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
 //			0 returns q1, pos1.  1 returns q2, pos2
@@ -958,6 +1148,10 @@ void SlerpBones(
 	}
 	else
 	{
+		// Each bone only reads its own q1, so results can be written as
+		// the groups complete
+		CQuaternionBatch batch( QuaternionSlerpSIMD, q1 );
+
 		for (i = 0; i < pStudioHdr->numbones; i++)
 		{
 			// skip unused bones - use version-aware flag accessor for v44+ support
@@ -975,20 +1169,21 @@ void SlerpBones(
 				if (StudioBone_GetFlags(pStudioHdr, i) & BONE_FIXED_ALIGNMENT)
 				{
 					QuaternionSlerpNoAlign( q2[i], q1[i], s1, q3 );
+					q1[i][0] = q3[0];
+					q1[i][1] = q3[1];
+					q1[i][2] = q3[2];
+					q1[i][3] = q3[3];
 				}
 				else
 				{
-					QuaternionSlerp( q2[i], q1[i], s1, q3 );
+					batch.Add( i, q2[i], q1[i], s1 );
 				}
-				q1[i][0] = q3[0];
-				q1[i][1] = q3[1];
-				q1[i][2] = q3[2];
-				q1[i][3] = q3[3];
 				pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
 				pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
 				pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
 			}
 		}
+		batch.Flush();
 	}
 }
 
@@ -1038,6 +1233,8 @@ void BlendBones(
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
+	CQuaternionBatch batch( QuaternionBlendSIMD, q1 );
+
 	for (i = 0; i < pStudioHdr->numbones; i++)
 	{
 		// skip unused bones - use version-aware flag accessor for v44+ support
@@ -1052,20 +1249,21 @@ void BlendBones(
 			if (StudioBone_GetFlags(pStudioHdr, i) & BONE_FIXED_ALIGNMENT)
 			{
 				QuaternionBlendNoAlign( q2[i], q1[i], s1, q3 );
+				q1[i][0] = q3[0];
+				q1[i][1] = q3[1];
+				q1[i][2] = q3[2];
+				q1[i][3] = q3[3];
 			}
 			else
 			{
-				QuaternionBlend( q2[i], q1[i], s1, q3 );
+				batch.Add( i, q2[i], q1[i], s1 );
 			}
-			q1[i][0] = q3[0];
-			q1[i][1] = q3[1];
-			q1[i][2] = q3[2];
-			q1[i][3] = q3[3];
 			pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
 			pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
 			pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
 		}
 	}
+	batch.Flush();
 }
 
 
@@ -1190,6 +1388,84 @@ void Studio_CalcBoneToBoneTransform( const studiohdr_t *pStudioHdr, int inputBon
 	ConcatTransforms( *pOutputPoseToBone, inputToPose, matrixOut );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: per entity cache of CalcPoseSingle results
+//-----------------------------------------------------------------------------
+CBonePoseCache::CBonePoseCache()
+{
+	m_nHits = 0;
+	m_nMisses = 0;
+	m_nUseCount = 0;
+	Invalidate();
+}
+
+void CBonePoseCache::Invalidate( void )
+{
+	for (int i = 0; i < BONE_POSE_CACHE_SIZE; i++)
+	{
+		memset( &m_Entries[i].key, 0, sizeof( m_Entries[i].key ) );
+		m_Entries[i].nLastUsed = 0;
+	}
+}
+
+bool CBonePoseCache::Lookup( const posecachekey_t &key, Vector pos[], Quaternion q[] )
+{
+	for (int i = 0; i < BONE_POSE_CACHE_SIZE; i++)
+	{
+		entry_t &entry = m_Entries[i];
+
+		// The key is memset before it's filled in, so padding compares equal
+		if (!entry.key.pStudioHdr || memcmp( &entry.key, &key, sizeof( key ) ))
+			continue;
+
+		for (int j = 0; j < entry.bones.Count(); j++)
+		{
+			int iBone = entry.bones[j];
+			pos[iBone] = entry.pos[j];
+			q[iBone] = entry.q[j];
+		}
+
+		entry.nLastUsed = ++m_nUseCount;
+		m_nHits++;
+		return true;
+	}
+
+	m_nMisses++;
+	return false;
+}
+
+void CBonePoseCache::Store( const posecachekey_t &key, const Vector pos[], const Quaternion q[] )
+{
+	entry_t *pEntry = &m_Entries[0];
+	for (int i = 1; i < BONE_POSE_CACHE_SIZE; i++)
+	{
+		if (m_Entries[i].nLastUsed < pEntry->nLastUsed)
+		{
+			pEntry = &m_Entries[i];
+		}
+	}
+
+	pEntry->key = key;
+	pEntry->nLastUsed = ++m_nUseCount;
+	pEntry->bones.RemoveAll();
+	pEntry->pos.RemoveAll();
+	pEntry->q.RemoveAll();
+
+	// Keep every bone in the setup mask, so a hit hands back the same pose
+	// a miss would have left in the caller's arrays
+	const studiohdr_t *pStudioHdr = key.pStudioHdr;
+	for (int i = 0; i < pStudioHdr->numbones; i++)
+	{
+		if (!(StudioBone_GetFlags(pStudioHdr, i) & key.boneMask))
+			continue;
+
+		pEntry->bones.AddToTail( i );
+		pEntry->pos.AddToTail( pos[i] );
+		pEntry->q.AddToTail( q[i] );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: calculate a pose for a single sequence
 // Version-aware: v37 uses value[0-5], v48 uses pos/quat directly
@@ -1244,16 +1520,15 @@ bool CalcPoseSingle(
 	int sequence, 
 	float cycle,
 	const float poseParameter[],
-	int boneMask
+	int boneMask,
+	CBonePoseCache *pPoseCache
 	)
 {
-	ASSERT_NO_REENTRY();
-	
 	mstudioseqdesc_t	*pseqdesc;
-	static Vector		pos2[MAXSTUDIOBONES];
-	static Quaternion	q2[MAXSTUDIOBONES];
-	static Vector		pos3[MAXSTUDIOBONES];
-	static Quaternion	q3[MAXSTUDIOBONES];
+	Vector				pos2[MAXSTUDIOBONES];
+	Quaternion			q2[MAXSTUDIOBONES];
+	Vector				pos3[MAXSTUDIOBONES];
+	Quaternion			q3[MAXSTUDIOBONES];
 
 	if (sequence >= pStudioHdr->numseq) 
 	{
@@ -1283,6 +1558,26 @@ bool CalcPoseSingle(
 		}
 	}
 
+	posecachekey_t key;
+	if (pPoseCache)
+	{
+		memset( &key, 0, sizeof( key ) );
+		key.pStudioHdr = pStudioHdr;
+		key.checksum = pStudioHdr->checksum;
+		key.sequence = sequence;
+		key.cycle = cycle;
+		key.boneMask = boneMask;
+		key.index[0] = i0;
+		key.index[1] = i1;
+		key.setting[0] = s0;
+		key.setting[1] = s1;
+
+		if (pPoseCache->Lookup( key, pos, q ))
+		{
+			return true;
+		}
+	}
+
 	// Direct access (same binary layout for v37 and v48)
 	int groupSize0 = pseqdesc->groupsize[0];
 	int groupSize1 = pseqdesc->groupsize[1];
@@ -1377,6 +1672,11 @@ bool CalcPoseSingle(
 		}
 	}
 
+	if (pPoseCache)
+	{
+		pPoseCache->Store( key, pos, q );
+	}
+
 	return true;
 }
 
@@ -1396,7 +1696,8 @@ void AddSequenceLayers(
 	float cycle,
 	const float poseParameter[],
 	int boneMask,
-	float flWeight
+	float flWeight,
+	CBonePoseCache *pPoseCache
 	)
 {
 	mstudioseqdesc_t	*pseqdesc = pStudioHdr->pSeqdesc( sequence );
@@ -1443,7 +1744,7 @@ void AddSequenceLayers(
 			layerCycle = (cycle - pLayer->start) / (pLayer->end - pLayer->start);
 		}
 
-		AccumulatePose( pStudioHdr, pIKContext, pos, q, pLayer->iSequence, layerCycle, poseParameter, boneMask, layerWeight );
+		AccumulatePose( pStudioHdr, pIKContext, pos, q, pLayer->iSequence, layerCycle, poseParameter, boneMask, layerWeight, pPoseCache );
 	}
 }
 
@@ -1461,7 +1762,8 @@ void CalcPose(
 	float cycle,
 	const float poseParameter[],
 	int boneMask,
-	float flWeight
+	float flWeight,
+	CBonePoseCache *pPoseCache
 	)
 {
 	mstudioseqdesc_t	*pseqdesc = pStudioHdr->pSeqdesc( sequence );
@@ -1475,7 +1777,7 @@ void CalcPose(
 		pIKContext->AddDependencies( sequence, cycle, poseParameter, flWeight );
 	}
 	
-	CalcPoseSingle( pStudioHdr, pos, q, sequence, cycle, poseParameter, boneMask );
+	CalcPoseSingle( pStudioHdr, pos, q, sequence, cycle, poseParameter, boneMask, pPoseCache );
 
 	// add any IK locks to prevent numautolayers from moving extremities
 	CIKContext seq_ik;
@@ -1486,7 +1788,7 @@ void CalcPose(
 		seq_ik.AddSequenceLocks( pseqdesc, pos, q );
 	}
 
-	AddSequenceLayers( 	pStudioHdr, pIKContext, pos, q, sequence, cycle, poseParameter, boneMask, flWeight );
+	AddSequenceLayers( 	pStudioHdr, pIKContext, pos, q, sequence, cycle, poseParameter, boneMask, flWeight, pPoseCache );
 
 	if (numIKLocks)
 	{
@@ -1508,7 +1810,8 @@ void AccumulatePose(
 	float cycle,
 	const float poseParameter[],
 	int boneMask,
-	float flWeight
+	float flWeight,
+	CBonePoseCache *pPoseCache
 	)
 {
 	Vector		pos2[MAXSTUDIOBONES];
@@ -1520,7 +1823,7 @@ void AccumulatePose(
 
 	mstudioseqdesc_t	*pseqdesc = pStudioHdr->pSeqdesc( sequence );
 
-	if (!CalcPoseSingle( pStudioHdr, pos2, q2, sequence, cycle, poseParameter, boneMask ))
+	if (!CalcPoseSingle( pStudioHdr, pos2, q2, sequence, cycle, poseParameter, boneMask, pPoseCache ))
 	{
 		return;
 	}
@@ -1541,7 +1844,7 @@ void AccumulatePose(
 
 	SlerpBones( pStudioHdr, q, pos, pseqdesc, q2, pos2, flWeight, boneMask );
 
-	AddSequenceLayers( 	pStudioHdr, pIKContext, pos, q, sequence, cycle, poseParameter, boneMask, flWeight );
+	AddSequenceLayers( 	pStudioHdr, pIKContext, pos, q, sequence, cycle, poseParameter, boneMask, flWeight, pPoseCache );
 
 	if (numIKLocks)
 	{
@@ -1687,13 +1990,14 @@ public:
 //   (1) R = Mfwd(P)         -- rotate P onto the x axis
 //   (2) Solve for S
 //   (3) Q = Minv(S)         -- rotate back again
-
-   static float Mfwd[3][3];
-   static float Minv[3][3];
+//
+// M lives on the stack rather than in statics, as bones can be set up on
+// several threads at once.
 
    static bool solve(float A, float B, float const P[], float const D[], float Q[]) {
+      float Mfwd[3][3], Minv[3][3];
       float R[3];
-      defineM(P,D);
+      defineM(P,D,Mfwd,Minv);
       rot(Minv,P,R);
       float d = findD(A,B,length(R));
       float e = findE(A,d);
@@ -1707,7 +2011,7 @@ public:
 //
 // Given that constraint, define the forward and inverse of M as follows:
 
-   static void defineM(float const P[], float const D[]) {
+   static void defineM(float const P[], float const D[], float Mfwd[3][3], float Minv[3][3]) {
       float *X = Minv[0], *Y = Minv[1], *Z = Minv[2];
 
 // Minv defines a coordinate system whose x axis contains P, so X = unit(P).
@@ -1760,9 +2064,6 @@ public:
    }
 };
 
-float ik::Mfwd[3][3];
-float ik::Minv[3][3];
-
 
 
 //-----------------------------------------------------------------------------
@@ -2399,7 +2700,7 @@ void CIKContext::AddDependencies(
 void CIKContext::AddAutoplayLocks( Vector pos[], Quaternion q[] )
 {
 	int i;
-	static matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+	matrix3x4_t boneToWorld[MAXSTUDIOBONES];
 
 	for (i = 0; i < m_pStudioHdr->numikautoplaylocks; i++)
 	{
@@ -2432,7 +2733,7 @@ void CIKContext::AddAutoplayLocks( Vector pos[], Quaternion q[] )
 void CIKContext::AddSequenceLocks( mstudioseqdesc_t *pSeqDesc, Vector pos[], Quaternion q[] )
 {
 	int i;
-	static matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+	matrix3x4_t boneToWorld[MAXSTUDIOBONES];
 
 	int numIKLocks = pSeqDesc->numiklocks;
 	for (i = 0; i < numIKLocks; i++)
@@ -2688,9 +2989,7 @@ void CIKContext::SolveAutoplayLocks(
 	Quaternion q[]
 	)
 {
-	ASSERT_NO_REENTRY();
-
-	static matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+	matrix3x4_t boneToWorld[MAXSTUDIOBONES];
 	int i;
 
 	for (i = 0; i < m_ikRule.Count(); i++)
@@ -2740,9 +3039,7 @@ void CIKContext::SolveSequenceLocks(
 	Quaternion q[]
 	)
 {
-	ASSERT_NO_REENTRY();
-
-	static matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+	matrix3x4_t boneToWorld[MAXSTUDIOBONES];
 	int i;
 
 	for (i = 0; i < m_ikRule.Count(); i++)
@@ -2793,8 +3090,6 @@ void CalcAutoplaySequences(
 	float time
 	)
 {
-	ASSERT_NO_REENTRY();
-	
 	int			i;
 
 	if ( pIKContext )
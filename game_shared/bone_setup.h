@@ -19,6 +19,7 @@
 
 class CBoneToWorld;
 class CIKContext;
+class CBonePoseCache;
 
 
 // This provides access to networked arrays, so if this code actually changes a value, 
@@ -57,6 +58,52 @@ void SlerpBones(
 	);
 
 
+//-----------------------------------------------------------------------------
+// Purpose: remembers the last few single sequence poses of one entity, so the
+//			animation isn't decompressed and blended again while its sequence,
+//			cycle, pose parameters and bone mask stay the same
+//-----------------------------------------------------------------------------
+#define BONE_POSE_CACHE_SIZE	4
+
+struct posecachekey_t
+{
+	const studiohdr_t	*pStudioHdr;
+	long				checksum;
+	int					sequence;
+	float				cycle;
+	int					boneMask;
+	int					index[2];	// local pose parameter settings
+	float				setting[2];
+};
+
+class CBonePoseCache
+{
+public:
+	CBonePoseCache();
+
+	// Copies the cached pose into pos and q, returns false on a miss
+	bool Lookup( const posecachekey_t &key, Vector pos[], Quaternion q[] );
+	void Store( const posecachekey_t &key, const Vector pos[], const Quaternion q[] );
+	void Invalidate( void );
+
+	int		m_nHits;
+	int		m_nMisses;
+
+private:
+	struct entry_t
+	{
+		posecachekey_t				key;
+		int							nLastUsed;
+		CUtlVector< unsigned char >	bones;		// the bones in the key's bone mask
+		CUtlVector< Vector >		pos;		// parallel to bones
+		CUtlVector< Quaternion >	q;
+	};
+
+	entry_t	m_Entries[BONE_POSE_CACHE_SIZE];
+	int		m_nUseCount;
+};
+
+
 void InitPose(
 	const studiohdr_t *pStudioHdr,
 	Vector pos[MAXSTUDIOBONES], 
@@ -72,7 +119,8 @@ void CalcPose(
 	float cycle,
 	const float poseParameter[],
 	int boneMask,
-	float flWeight = 1.0f
+	float flWeight = 1.0f,
+	CBonePoseCache *pPoseCache = NULL	//optional
 	);
 
 bool CalcPoseSingle(
@@ -82,7 +130,8 @@ bool CalcPoseSingle(
 	int sequence, 
 	float cycle,
 	const float poseParameter[],
-	int boneMask
+	int boneMask,
+	CBonePoseCache *pPoseCache = NULL	//optional
 	);
 
 void AccumulatePose(
@@ -94,7 +143,8 @@ void AccumulatePose(
 	float cycle,
 	const float poseParameter[],
 	int boneMask,
-	float flWeight = 1.0f
+	float flWeight = 1.0f,
+	CBonePoseCache *pPoseCache = NULL	//optional
 	);
 
 // takes a "controllers[]" array normalized to 0..1 and adds in the adjustments to pos[], and q[].
@@ -283,4 +333,8 @@ bool TraceToStudio( const Ray_t& ray, studiohdr_t *pStudioHdr, mstudiohitboxset_
 void QuaternionSM( float s, const Quaternion &p, const Quaternion &q, Quaternion &qt );
 void QuaternionMA( const Quaternion &p, float s, const Quaternion &q, Quaternion &qt );
 
+// SSE versions of QuaternionSlerp and QuaternionBlend, four at a time
+void QuaternionSlerpSIMD( const Quaternion p[4], const Quaternion q[4], const float t[4], Quaternion qt[4] );
+void QuaternionBlendSIMD( const Quaternion p[4], const Quaternion q[4], const float t[4], Quaternion qt[4] );
+
 #endif // BONE_SETUP_H
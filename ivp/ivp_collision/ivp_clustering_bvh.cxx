@@ -0,0 +1,378 @@
+// Copyright (C) Ipion Software GmbH 1999-2000. All rights reserved.
+
+#include <ivp_physics.hxx>
+
+#include <ivp_clustering_longrange.hxx>
+#include <ivp_clustering_bvh.hxx>
+
+#define IVP_OV_BVH_MIN_NODES 64
+
+
+IVP_OV_BVH_Manager::IVP_OV_BVH_Manager()
+{
+    this->nodes = NULL;
+    this->n_nodes_alloced = 0;
+    this->first_free_node = IVP_OV_BVH_NULL_NODE;
+    this->root = IVP_OV_BVH_NULL_NODE;
+}
+
+
+IVP_OV_BVH_Manager::~IVP_OV_BVH_Manager()
+{
+    P_FREE(this->nodes);
+}
+
+
+int IVP_OV_BVH_Manager::alloc_node()
+{
+    if ( this->first_free_node == IVP_OV_BVH_NULL_NODE ) {
+	// grow the node array and put the new nodes onto the free list
+	int old_size = this->n_nodes_alloced;
+	int new_size = old_size * 2;
+	if ( new_size < IVP_OV_BVH_MIN_NODES ) new_size = IVP_OV_BVH_MIN_NODES;
+
+	this->nodes = (IVP_OV_BVH_Node *)p_realloc( this->nodes, new_size * sizeof(IVP_OV_BVH_Node) );
+	this->n_nodes_alloced = new_size;
+
+	for (int i = new_size-1; i >= old_size; i--) {
+	    this->nodes[i].parent = this->first_free_node;
+	    this->nodes[i].height = -1;
+	    this->first_free_node = i;
+	}
+    }
+
+    int node = this->first_free_node;
+    IVP_OV_BVH_Node *n = &this->nodes[node];
+    this->first_free_node = n->parent;
+
+    n->parent = IVP_OV_BVH_NULL_NODE;
+    n->child[0] = IVP_OV_BVH_NULL_NODE;
+    n->child[1] = IVP_OV_BVH_NULL_NODE;
+    n->height = 0;
+    n->element = NULL;
+    return(node);
+}
+
+
+void IVP_OV_BVH_Manager::free_node(int node)
+{
+    IVP_ASSERT( node >= 0 && node < this->n_nodes_alloced );
+    this->nodes[node].parent = this->first_free_node;
+    this->nodes[node].height = -1;
+    this->first_free_node = node;
+}
+
+
+void IVP_OV_BVH_Manager::set_sphere_box(IVP_OV_BVH_Node *node, const IVP_U_Float_Point *center, IVP_DOUBLE radius)
+{
+    for (int k = 0; k < 3; k++) {
+	node->min[k] = (IVP_FLOAT)( center->k[k] - radius );
+	node->max[k] = (IVP_FLOAT)( center->k[k] + radius );
+    }
+}
+
+
+// half the surface of the box around a and b, the cost of a node when searching the best sibling
+static inline IVP_FLOAT ivp_bvh_combined_area(const IVP_OV_BVH_Node *a, const IVP_OV_BVH_Node *b)
+{
+    IVP_FLOAT d[3];
+    for (int k = 0; k < 3; k++) {
+	IVP_FLOAT lo = a->min[k] < b->min[k] ? a->min[k] : b->min[k];
+	IVP_FLOAT hi = a->max[k] > b->max[k] ? a->max[k] : b->max[k];
+	d[k] = hi - lo;
+    }
+    return( d[0] * d[1] + d[1] * d[2] + d[2] * d[0] );
+}
+
+
+static inline IVP_FLOAT ivp_bvh_area(const IVP_OV_BVH_Node *a)
+{
+    IVP_FLOAT dx = a->max[0] - a->min[0];
+    IVP_FLOAT dy = a->max[1] - a->min[1];
+    IVP_FLOAT dz = a->max[2] - a->min[2];
+    return( dx * dy + dy * dz + dz * dx );
+}
+
+
+static inline IVP_BOOL ivp_bvh_box_overlaps_box(const IVP_FLOAT *min0, const IVP_FLOAT *max0, const IVP_FLOAT *min1, const IVP_FLOAT *max1)
+{
+    if ( min0[0] > max1[0] || min1[0] > max0[0] ) return(IVP_FALSE);
+    if ( min0[1] > max1[1] || min1[1] > max0[1] ) return(IVP_FALSE);
+    if ( min0[2] > max1[2] || min1[2] > max0[2] ) return(IVP_FALSE);
+    return(IVP_TRUE);
+}
+
+
+void IVP_OV_BVH_Manager::refit_node(int node)
+{
+    IVP_OV_BVH_Node *n = &this->nodes[node];
+    const IVP_OV_BVH_Node *c0 = &this->nodes[n->child[0]];
+    const IVP_OV_BVH_Node *c1 = &this->nodes[n->child[1]];
+
+    for (int k = 0; k < 3; k++) {
+	n->min[k] = c0->min[k] < c1->min[k] ? c0->min[k] : c1->min[k];
+	n->max[k] = c0->max[k] > c1->max[k] ? c0->max[k] : c1->max[k];
+    }
+    n->height = 1 + ( c0->height > c1->height ? c0->height : c1->height );
+}
+
+
+// if one child of node is more than one level higher than the other, the higher child
+// takes the place of node, node becomes its child and gets the lower of its grandchildren;
+// returns the node now at the position of node
+int IVP_OV_BVH_Manager::balance(int a)
+{
+    IVP_OV_BVH_Node *na = &this->nodes[a];
+    if ( na->is_leaf() || na->height < 2 ) {
+	return(a);
+    }
+
+    int b = na->child[0];
+    int c = na->child[1];
+    int balance = this->nodes[c].height - this->nodes[b].height;
+
+    int up_side;		// child of a that moves up
+    if ( balance > 1 ) {
+	up_side = 1;
+    } else if ( balance < -1 ) {
+	up_side = 0;
+    } else {
+	return(a);
+    }
+
+    int up = na->child[up_side];
+    IVP_OV_BVH_Node *nup = &this->nodes[up];
+    int f = nup->child[0];
+    int g = nup->child[1];
+
+    // up takes the place of a
+    nup->parent = na->parent;
+    if ( nup->parent != IVP_OV_BVH_NULL_NODE ) {
+	IVP_OV_BVH_Node *np = &this->nodes[nup->parent];
+	if ( np->child[0] == a ) {
+	    np->child[0] = up;
+	} else {
+	    np->child[1] = up;
+	}
+    } else {
+	this->root = up;
+    }
+    na->parent = up;
+
+    // the higher grandchild stays with up, the lower one goes to a
+    int keep = f, give = g;
+    if ( this->nodes[g].height > this->nodes[f].height ) {
+	keep = g; give = f;
+    }
+    nup->child[0] = a;
+    nup->child[1] = keep;
+    na->child[up_side] = give;
+    this->nodes[give].parent = a;
+
+    refit_node(a);
+    refit_node(up);
+    return(up);
+}
+
+
+void IVP_OV_BVH_Manager::insert_leaf(int leaf)
+{
+    if ( this->root == IVP_OV_BVH_NULL_NODE ) {
+	this->root = leaf;
+	this->nodes[leaf].parent = IVP_OV_BVH_NULL_NODE;
+	return;
+    }
+
+    // find the best sibling: descend into the child whose box grows the least, stop when
+    // making a new parent here is cheaper than pushing the leaf further down
+    const IVP_OV_BVH_Node *nleaf = &this->nodes[leaf];
+    int index = this->root;
+    while ( !this->nodes[index].is_leaf() ) {
+	const IVP_OV_BVH_Node *n = &this->nodes[index];
+
+	IVP_FLOAT area = ivp_bvh_area(n);
+	IVP_FLOAT combined_area = ivp_bvh_combined_area(n, nleaf);
+
+	IVP_FLOAT cost = 2.0f * combined_area;				// new parent for node and leaf
+	IVP_FLOAT inheritance_cost = 2.0f * (combined_area - area);	// growth of all boxes above when descending
+
+	IVP_FLOAT child_cost[2];
+	for (int i = 0; i < 2; i++) {
+	    const IVP_OV_BVH_Node *child = &this->nodes[n->child[i]];
+	    child_cost[i] = ivp_bvh_combined_area(child, nleaf) + inheritance_cost;
+	    if ( !child->is_leaf() ) {
+		child_cost[i] -= ivp_bvh_area(child);
+	    }
+	}
+
+	if ( cost < child_cost[0] && cost < child_cost[1] ) break;
+
+	index = ( child_cost[0] < child_cost[1] ) ? n->child[0] : n->child[1];
+    }
+
+    int sibling = index;
+    int old_parent = this->nodes[sibling].parent;
+    int new_parent = alloc_node();		// may move the node array
+
+    IVP_OV_BVH_Node *np = &this->nodes[new_parent];
+    np->parent = old_parent;
+    np->child[0] = sibling;
+    np->child[1] = leaf;
+    this->nodes[sibling].parent = new_parent;
+    this->nodes[leaf].parent = new_parent;
+    refit_node(new_parent);
+
+    if ( old_parent != IVP_OV_BVH_NULL_NODE ) {
+	IVP_OV_BVH_Node *op = &this->nodes[old_parent];
+	if ( op->child[0] == sibling ) {
+	    op->child[0] = new_parent;
+	} else {
+	    op->child[1] = new_parent;
+	}
+    } else {
+	this->root = new_parent;
+    }
+
+    // walk back up, fixing the boxes and heights
+    index = old_parent;
+    while ( index != IVP_OV_BVH_NULL_NODE ) {
+	index = balance(index);
+	refit_node(index);
+	index = this->nodes[index].parent;
+    }
+}
+
+
+void IVP_OV_BVH_Manager::remove_leaf(int leaf)
+{
+    if ( leaf == this->root ) {
+	this->root = IVP_OV_BVH_NULL_NODE;
+	return;
+    }
+
+    int parent = this->nodes[leaf].parent;
+    int grand_parent = this->nodes[parent].parent;
+    int sibling = ( this->nodes[parent].child[0] == leaf ) ? this->nodes[parent].child[1] : this->nodes[parent].child[0];
+
+    // the sibling takes the place of the parent
+    this->nodes[sibling].parent = grand_parent;
+    free_node(parent);
+
+    if ( grand_parent == IVP_OV_BVH_NULL_NODE ) {
+	this->root = sibling;
+	return;
+    }
+
+    IVP_OV_BVH_Node *gp = &this->nodes[grand_parent];
+    if ( gp->child[0] == parent ) {
+	gp->child[0] = sibling;
+    } else {
+	gp->child[1] = sibling;
+    }
+
+    int index = grand_parent;
+    while ( index != IVP_OV_BVH_NULL_NODE ) {
+	index = balance(index);
+	refit_node(index);
+	index = this->nodes[index].parent;
+    }
+}
+
+
+IVP_DOUBLE IVP_OV_BVH_Manager::insert_ov_element(IVP_OV_Element *element,
+                         IVP_DOUBLE min_radius,
+                         IVP_DOUBLE /*max_radius*/,
+                         IVP_U_Vector<IVP_OV_Element> *colliding_balls)
+{
+    if ( element == NULL ) {
+        return(0);
+    }
+    IVP_ASSERT( element->bvh_leaf == IVP_OV_BVH_NULL_NODE );
+
+    // unlike the grid of the IVP_OV_Tree_Manager, boxes fit any sphere, so the smallest radius is used
+    IVP_DOUBLE used_radius = min_radius;
+    element->radius = (IVP_FLOAT)used_radius;
+
+    int leaf = alloc_node();
+    IVP_OV_BVH_Node *nleaf = &this->nodes[leaf];
+    set_sphere_box(nleaf, &element->center, used_radius);
+    nleaf->element = element;
+    element->bvh_leaf = leaf;
+
+    insert_leaf(leaf);
+
+    if ( colliding_balls ) {
+	// search for colliding objects and insert them into the supplied list
+	int stack[IVP_OV_BVH_MAX_DEPTH];
+	int n_stack = 0;
+	stack[n_stack++] = this->root;
+
+	const IVP_FLOAT *qmin = this->nodes[leaf].min;
+	const IVP_FLOAT *qmax = this->nodes[leaf].max;
+
+	while ( n_stack > 0 ) {
+	    const IVP_OV_BVH_Node *n = &this->nodes[stack[--n_stack]];
+	    if ( !ivp_bvh_box_overlaps_box(n->min, n->max, qmin, qmax) ) continue;
+
+	    if ( !n->is_leaf() ) {
+		IVP_ASSERT( n_stack + 2 <= IVP_OV_BVH_MAX_DEPTH );
+		stack[n_stack++] = n->child[0];
+		stack[n_stack++] = n->child[1];
+		continue;
+	    }
+
+	    IVP_OV_Element *el = n->element;
+	    if ( el == element ) continue;
+
+	    // check real distance of spheres
+	    IVP_DOUBLE qdist = el->center.quad_distance_to(&element->center);
+	    IVP_DOUBLE minimal_dist = element->radius + el->radius;
+	    if ( qdist > minimal_dist * minimal_dist) continue;
+	    colliding_balls->add(el);
+	}
+    }
+
+    return(used_radius);
+}
+
+
+void IVP_OV_BVH_Manager::remove_ov_element(IVP_OV_Element *element)
+{
+    int leaf = element->bvh_leaf;
+    if ( leaf == IVP_OV_BVH_NULL_NODE ) return;
+
+    IVP_ASSERT( this->nodes[leaf].element == element );
+    remove_leaf(leaf);
+    free_node(leaf);
+    element->bvh_leaf = IVP_OV_BVH_NULL_NODE;
+}
+
+
+void IVP_OV_BVH_Manager::collect_elements_in_box(const IVP_U_Float_Point *box_min, const IVP_U_Float_Point *box_max, IVP_U_Vector<IVP_OV_Element> *elements_out)
+{
+    if ( this->root == IVP_OV_BVH_NULL_NODE ) return;
+
+    int stack[IVP_OV_BVH_MAX_DEPTH];
+    int n_stack = 0;
+    stack[n_stack++] = this->root;
+
+    while ( n_stack > 0 ) {
+	const IVP_OV_BVH_Node *n = &this->nodes[stack[--n_stack]];
+	if ( !ivp_bvh_box_overlaps_box(n->min, n->max, box_min->k, box_max->k) ) continue;
+
+	if ( n->is_leaf() ) {
+	    elements_out->add(n->element);
+	    continue;
+	}
+	IVP_ASSERT( n_stack + 2 <= IVP_OV_BVH_MAX_DEPTH );
+	stack[n_stack++] = n->child[0];
+	stack[n_stack++] = n->child[1];
+    }
+}
+
+
+int IVP_OV_BVH_Manager::get_tree_height() const
+{
+    if ( this->root == IVP_OV_BVH_NULL_NODE ) return(0);
+    return( this->nodes[this->root].height );
+}
@@ -0,0 +1,68 @@
+// Copyright (C) Ipion Software GmbH 1999-2000. All rights reserved.
+
+#ifndef _IVP_CLUSTERING_BVH_INCLUDED
+#define _IVP_CLUSTERING_BVH_INCLUDED
+
+#ifndef _IVP_CLUSTERING_LONGRANGE_INCLUDED
+#	include <ivp_clustering_longrange.hxx>
+#endif
+
+#define IVP_OV_BVH_MAX_DEPTH 256	// size of the traversal stacks, the tree is kept balanced
+
+/********************************************************************************
+ *	Name:	    	IVP_OV_BVH_Node
+ *	Description:	Node of the IVP_OV_BVH_Manager, all nodes live in one array
+ *			and reference each other by index
+ ********************************************************************************/
+struct IVP_OV_BVH_Node {
+    IVP_FLOAT min[3];		// box around the spheres of all elements below
+    IVP_FLOAT max[3];
+    int parent;			// next free node while the node is unused
+    int child[2];		// IVP_OV_BVH_NULL_NODE for leaves
+    int height;			// 0 for leaves
+    IVP_OV_Element *element;	// leaves only
+
+    IVP_BOOL is_leaf() const { return (IVP_BOOL)(child[0] == IVP_OV_BVH_NULL_NODE); };
+};
+
+/********************************************************************************
+ *	Name:	    	IVP_OV_BVH_Manager
+ *	Description:	Alternative to the IVP_OV_Tree_Manager: a dynamic bounding box
+ *			tree with one leaf per element. Leaves are inserted next to the
+ *			sibling that grows the least and the tree is rebalanced by
+ *			rotations on the way up, so updates are O(log n) and need no
+ *			memory once the node array is large enough.
+ ********************************************************************************/
+class IVP_OV_BVH_Manager : public IVP_OV_Broadphase
+{
+    IVP_OV_BVH_Node *nodes;
+    int n_nodes_alloced;
+    int first_free_node;
+    int root;
+
+    int  alloc_node();
+    void free_node(int node);
+    void insert_leaf(int leaf);
+    void remove_leaf(int leaf);
+    int  balance(int node);
+    void refit_node(int node);	// box and height from the children
+
+    void set_sphere_box(IVP_OV_BVH_Node *node, const IVP_U_Float_Point *center, IVP_DOUBLE radius);
+
+public:
+    IVP_OV_BVH_Manager();
+    ~IVP_OV_BVH_Manager();
+
+    IVP_DOUBLE insert_ov_element(IVP_OV_Element *element,
+                            IVP_DOUBLE min_radius,
+                            IVP_DOUBLE max_radius,
+			    IVP_U_Vector<IVP_OV_Element> *colliding_balls); // pass NULL if you are not interested in collisions
+
+    void remove_ov_element(IVP_OV_Element *element);
+
+    void collect_elements_in_box(const IVP_U_Float_Point *box_min, const IVP_U_Float_Point *box_max, IVP_U_Vector<IVP_OV_Element> *elements_out);
+
+    int get_tree_height() const;
+};
+
+#endif
@@ -37,6 +37,7 @@ void ivp_indent_output()
 IVP_OV_Element::IVP_OV_Element(IVP_Real_Object *obj): collision_fvector(16)
 {
     this->node = NULL;
+    this->bvh_leaf = IVP_OV_BVH_NULL_NODE;
     this->center.set_to_zero();
     this->radius = -1.0f;
     this->real_object = obj;
@@ -51,7 +52,7 @@ IVP_OV_Element::~IVP_OV_Element(){
     }
     this->real_object->get_environment()->fire_object_is_removed_from_collision_detection(real_object);
     IVP_ASSERT( collision_fvector.len() == 0);
-    this->real_object->get_environment()->get_ov_tree_manager()->remove_ov_element(this);
+    this->real_object->get_environment()->get_ov_broadphase()->remove_ov_element(this);
 }
 
 void IVP_OV_Element::add_to_hull_manager(IVP_Hull_Manager *hm, IVP_DOUBLE hull_time){
@@ -805,6 +806,43 @@ void IVP_OV_Tree_Manager::remove_ov_element(IVP_OV_Element *element)
 }
 
 
+void IVP_OV_Tree_Manager::collect_box_elements(const IVP_OV_Node *node, const IVP_U_Float_Point *box_min, const IVP_U_Float_Point *box_max, IVP_U_Vector<IVP_OV_Element> *elements_out)
+{
+    // all spheres of a node lie inside its cube
+    IVP_U_Float_Point luf;
+    IVP_FLOAT cubesize;
+    get_luf_coordinates_ws(node, &luf, &cubesize);
+    for (int k = 0; k < 3; k++) {
+	if ( luf.k[k] > box_max->k[k] || luf.k[k] + cubesize < box_min->k[k] ) return;
+    }
+
+    {
+	for (int i=node->elements.len()-1;i>=0; i--) {
+	    IVP_OV_Element *el = node->elements.element_at(i);
+	    int k;
+	    for (k = 0; k < 3; k++) {
+		if ( el->center.k[k] - el->radius > box_max->k[k] ) break;
+		if ( el->center.k[k] + el->radius < box_min->k[k] ) break;
+	    }
+	    if ( k < 3 ) continue;
+	    elements_out->add(el);
+	}
+    }
+    {
+	for (int i=node->children.len()-1; i>=0; i--) {
+	    collect_box_elements(node->children.element_at(i), box_min, box_max, elements_out);
+	}
+    }
+}
+
+
+void IVP_OV_Tree_Manager::collect_elements_in_box(const IVP_U_Float_Point *box_min, const IVP_U_Float_Point *box_max, IVP_U_Vector<IVP_OV_Element> *elements_out)
+{
+    if ( !this->root ) return;
+    collect_box_elements(this->root, box_min, box_max, elements_out);
+}
+
+
 void IVP_OV_Tree_Manager::get_luf_coordinates_ws(const IVP_OV_Node *node, IVP_U_Float_Point *p, IVP_FLOAT *cubesize)
 {
     p->k[0]   = (IVP_FLOAT)( this->power2(node->data.rasterlevel) * node->data.x );
@@ -1,7 +1,12 @@
 // Copyright (C) Ipion Software GmbH 1999-2000. All rights reserved.
 
+#ifndef _IVP_CLUSTERING_LONGRANGE_INCLUDED
+#define _IVP_CLUSTERING_LONGRANGE_INCLUDED
+
 typedef int IVP_OV_TIME_STAMP;
 
+#define IVP_OV_BVH_NULL_NODE -1
+
 class IVP_OV_Node;
 
 
@@ -22,6 +27,7 @@ protected:
     virtual void hull_manager_is_going_to_be_deleted_event(IVP_Hull_Manager *mgr);
 public:
     IVP_OV_Node *node;
+    int bvh_leaf;			// set if in IVP_OV_BVH_Manager, else IVP_OV_BVH_NULL_NODE
     IVP_Hull_Manager *hull_manager;	// set if in hull manager
     IVP_U_Float_Point center;            // xyz // #+# check alignment
     IVP_FLOAT radius;
@@ -62,13 +68,37 @@ public:
 };
 
 
+/********************************************************************************
+ *	Name:	    	IVP_OV_Broadphase
+ *	Description:	Stores the spheres around the objects and finds the ones
+ *			overlapping, see IVP_BROADPHASE_TYPE for the implementations
+ ********************************************************************************/
+class IVP_OV_Broadphase
+{
+public:
+    // sets element->radius to a value between min_radius and max_radius and returns it,
+    // colliding_balls gets all elements whose spheres overlap (may include element itself)
+    virtual IVP_DOUBLE insert_ov_element(IVP_OV_Element *element,
+                            IVP_DOUBLE min_radius,
+                            IVP_DOUBLE max_radius,
+			    IVP_U_Vector<IVP_OV_Element> *colliding_balls) = 0; // pass NULL if you are not interested in collisions
+
+    virtual void remove_ov_element(IVP_OV_Element *element) = 0;
+
+    // all elements whose spheres may touch the box, used by queries
+    virtual void collect_elements_in_box(const IVP_U_Float_Point *box_min, const IVP_U_Float_Point *box_max, IVP_U_Vector<IVP_OV_Element> *elements_out) = 0;
+
+    virtual ~IVP_OV_Broadphase() { ; };
+};
+
+
 class IVP_ov_tree_hash;
 
 /********************************************************************************
  *	Name:	    	IVP_OV_Tree_Manager  	
  *	Description:	Tree-like datastructure, used to store spheres (around objects)
  ********************************************************************************/
-class IVP_OV_Tree_Manager
+class IVP_OV_Tree_Manager : public IVP_OV_Broadphase
 {
   friend class IVP_Ray_Solver;
   friend class IVP_Ray_Solver_Group;
@@ -97,6 +127,7 @@ class IVP_OV_Tree_Manager
     void         expand_tree(const IVP_OV_Node *new_node);
     void         collect_subbox_collision_partners(const IVP_OV_Element *center_element, const IVP_OV_Node *node);
     void         collect_collision_partners(const IVP_OV_Element *center_element, const IVP_OV_Node *masternode, const IVP_OV_Node *new_node);
+    void         collect_box_elements(const IVP_OV_Node *node, const IVP_U_Float_Point *box_min, const IVP_U_Float_Point *box_max, IVP_U_Vector<IVP_OV_Element> *elements_out);
 
     void get_luf_coordinates_ws   (const IVP_OV_Node *node, IVP_U_Float_Point *p, IVP_FLOAT *cubesize); // fills vars with left-upper-front corner's coordinates and cube's size
     void get_center_coordinates_ws(const IVP_OV_Node *node, IVP_U_Float_Point *p, IVP_FLOAT *cubesize); // fills vars with center's coordinates and cube's size
@@ -113,9 +144,8 @@ public:
 			    IVP_U_Vector<IVP_OV_Element> *colliding_balls); // pass NULL if you are not interested in collisions
 
     void remove_ov_element(IVP_OV_Element *element);
-};
-
-
-
 
+    void collect_elements_in_box(const IVP_U_Float_Point *box_min, const IVP_U_Float_Point *box_max, IVP_U_Vector<IVP_OV_Element> *elements_out);
+};
 
+#endif
@@ -674,7 +674,7 @@ void IVP_Mindist_Manager::recheck_ov_element(IVP_Real_Object *object){
 	return;
     }
 #endif
-    environment->ov_tree_manager->remove_ov_element( elem);
+    environment->ov_broadphase->remove_ov_element( elem);
 
     environment->get_statistic_manager()->range_world_exceeded++;
 
@@ -698,14 +698,16 @@ void IVP_Mindist_Manager::recheck_ov_element(IVP_Real_Object *object){
 		scanning_universe = IVP_FALSE;  // finished
 	    }
 	}
-	radius = environment->ov_tree_manager->insert_ov_element( elem, real_check_sphere, real_check_sphere, &colliding_elements);
+	radius = environment->ov_broadphase->insert_ov_element( elem, real_check_sphere, real_check_sphere, &colliding_elements);
+	environment->get_statistic_manager()->sum_ov_updates++;
+	environment->get_statistic_manager()->sum_ov_pairs += colliding_elements.len();
 	
 	IVP_DOUBLE real_hull_time =   radius - core->upper_limit_radius;
 	elem->add_to_hull_manager( hm, real_hull_time );	    // insert into event queue
 	
     } else {	// recursive call by IVP_Universe_Manager, use minimal radius
 	IVP_DOUBLE real_check_sphere = core->upper_limit_radius;
-	radius = environment->ov_tree_manager->insert_ov_element( elem, real_check_sphere, real_check_sphere, NULL);
+	radius = environment->ov_broadphase->insert_ov_element( elem, real_check_sphere, real_check_sphere, NULL);
 	IVP_DOUBLE real_hull_time =   P_DOUBLE_EPS;	// recheck as soon as possible because it's not checked now
 	elem->add_to_hull_manager( hm, real_hull_time );	    // insert into event queue
 	return;			// thats it, IVP_Universe_Manager can only add objects which do not have collision candidates except object
@@ -712,7 +712,25 @@ void IVP_Ray_Solver::check_ray_against_all_objects_in_sim(const IVP_Environment
     
     // get root node from long range cluster manager
     IVP_OV_Tree_Manager *ov_tree_man = environment->get_ov_tree_manager();
-    if(!ov_tree_man) return;
+    if(!ov_tree_man){
+	// other broadphases only answer box queries: use the box around the ray
+	IVP_U_Point ray_min, ray_max;
+	ray_min.set(&ray_start_point); ray_min.line_min(&ray_end_point);
+	ray_max.set(&ray_start_point); ray_max.line_max(&ray_end_point);
+	IVP_U_Float_Point box_min(&ray_min), box_max(&ray_max);
+	IVP_U_Vector<IVP_OV_Element> elements(64);
+	environment->get_ov_broadphase()->collect_elements_in_box(&box_min, &box_max, &elements);
+
+	for (int i = elements.len()-1; i>=0; --i){
+	    IVP_OV_Element *elem = elements.element_at(i);
+	    IVP_Core *core = elem->real_object->get_core();
+	    IVP_U_Float_Point object_center_os(core->get_position_PSI());
+	    if (check_ray_against_sphere(&object_center_os, core->upper_limit_radius)){
+		this->check_ray_against_object(elem->real_object);
+	    }
+	}
+	return;
+    }
     
     IVP_OV_Node *node = ov_tree_man->root;
     
@@ -726,7 +744,24 @@ void IVP_Ray_Solver_Group::check_ray_group_against_all_objects_in_sim(const IVP_
     
     // get root node from long range cluster manager
     IVP_OV_Tree_Manager *ov_tree_man = environment->get_ov_tree_manager();
-    if(!ov_tree_man) return;
+    if(!ov_tree_man){
+	// other broadphases only answer box queries: use the box around the group's sphere
+	IVP_U_Float_Point box_min, box_max;
+	box_min.set(center_ws.k[0] - radius, center_ws.k[1] - radius, center_ws.k[2] - radius);
+	box_max.set(center_ws.k[0] + radius, center_ws.k[1] + radius, center_ws.k[2] + radius);
+	IVP_U_Vector<IVP_OV_Element> elements(64);
+	environment->get_ov_broadphase()->collect_elements_in_box(&box_min, &box_max, &elements);
+
+	for (int i = elements.len()-1; i>=0; --i){
+	    IVP_OV_Element *elem = elements.element_at(i);
+	    IVP_Core *core = elem->real_object->get_core();
+	    IVP_U_Float_Point object_center_os(core->get_position_PSI());
+	    if (check_ray_group_against_sphere(&object_center_os, core->upper_limit_radius)){
+		this->check_ray_group_against_object(elem->real_object);
+	    }
+	}
+	return;
+    }
     
     IVP_OV_Node *node = ov_tree_man->root;
     
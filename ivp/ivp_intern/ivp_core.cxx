@@ -694,6 +694,8 @@ void IVP_Core::reset_freeze_check_values() {
     IVP_Time time = environment->get_current_time();
     this->time_of_calm_reference[0] = time.get_time();
     this->time_of_calm_reference[1] = time.get_time();
+    this->time_of_energy_calm_reference = time.get_time();
+    this->time_of_wake = time.get_time();
 }
 
 // init core for calc_next_PSI_matrix
@@ -909,6 +911,17 @@ IVP_Core_Merged::IVP_Core_Merged(IVP_Core *core0, IVP_Core *core1):
 
 // @@@ maybe not necessary each PSI !!!!
 IVP_Movement_Type IVP_Core::calc_movement_state(IVP_Time psi_time) {
+    IVP_Freeze_Manager *fm = environment->get_freeze_manager();
+    IVP_BOOL energy_calm = IVP_FALSE;
+
+    // check energy, catches objects jittering in place
+    if ( fm->sleep_energy > 0.0f ){
+	if ( get_energy_per_mass() > fm->get_sleep_energy( psi_time - time_of_wake ) ){
+	    this->time_of_energy_calm_reference = psi_time.get_time();
+	} else if ( psi_time - time_of_energy_calm_reference > fm->freeze_check_dtime ){
+	    energy_calm = IVP_TRUE;
+	}
+    }
 
     // check short time movements
     while(1){	// break if object has moved
@@ -928,6 +941,10 @@ IVP_Movement_Type IVP_Core::calc_movement_state(IVP_Time psi_time) {
     position_world_f_core_calm_reference[0].set( & pos_world_f_core_last_psi );
     this->time_of_calm_reference[0] = psi_time.get_time();
     
+    if ( energy_calm ){
+	fm->n_cores_calm_by_energy++;
+	return IVP_MT_CALM;
+    }
     
     while(1){	// break if object has moved
 	IVP_DOUBLE q_dist = pos_world_f_core_last_psi.quad_distance_to(&position_world_f_core_calm_reference[1]);
@@ -34,6 +34,7 @@
 #include <ivp_collision_filter.hxx>
 #include <ivp_compact_ledge.hxx>
 #include <ivp_clustering_longrange.hxx>
+#include <ivp_clustering_bvh.hxx>
 #include <ivp_cache_object.hxx>
 #include <ivp_cache_ledge_point.hxx>
 #include <ivp_range_manager.hxx>
@@ -71,6 +72,19 @@ IVP_Freeze_Manager::IVP_Freeze_Manager(){
 
 void IVP_Freeze_Manager::init_freeze_manager(){
     freeze_check_dtime = 0.3f;
+    sleep_energy = 0.0f;
+    island_sleep_energy = 0.0f;
+    wake_ramp_dtime = 0.0f;
+    wake_ramp_scale = 1.0f;
+    n_sim_units_frozen = 0;
+    n_sim_units_frozen_island = 0;
+    n_cores_calm_by_energy = 0;
+}
+
+IVP_FLOAT IVP_Freeze_Manager::get_sleep_energy(IVP_DOUBLE time_since_wake) const {
+    if ( time_since_wake >= wake_ramp_dtime ) return sleep_energy;
+    IVP_DOUBLE ramp = 1.0f - time_since_wake / wake_ramp_dtime;
+    return IVP_FLOAT( sleep_energy * (1.0f + (wake_ramp_scale - 1.0f) * ramp) );
 }
 
 IVP_Environment::IVP_Environment(IVP_Environment_Manager *manager,IVP_Application_Environment *appl_env,
@@ -135,7 +149,13 @@ IVP_Environment::IVP_Environment(IVP_Environment_Manager *manager,IVP_Applicatio
     sim_units_manager= new IVP_Sim_Units_Manager(this);
     time_manager     = new IVP_Time_Manager();
     mindist_manager  = new IVP_Mindist_Manager(this);
-    ov_tree_manager  = new IVP_OV_Tree_Manager();
+    if (appl_env->broadphase_type == IVP_BROADPHASE_BVH){
+	ov_tree_manager = NULL;
+	ov_broadphase    = new IVP_OV_BVH_Manager();
+    }else{
+	ov_tree_manager  = new IVP_OV_Tree_Manager();
+	ov_broadphase    = ov_tree_manager;
+    }
     this->better_statisticsmanager = new IVP_BetterStatisticsmanager();
 
     this->range_manager = appl_env->range_manager;
@@ -228,7 +248,8 @@ IVP_Environment::~IVP_Environment(){
     P_DELETE(time_manager);
     P_DELETE(sim_units_manager);
     P_DELETE(mindist_manager);
-    P_DELETE(ov_tree_manager);
+    P_DELETE(ov_broadphase);
+    ov_tree_manager = NULL;
     P_DELETE(this->better_statisticsmanager);
     
     IVP_IF( delete_debug_information == IVP_TRUE ) {
@@ -261,6 +261,7 @@ IVP_Simulation_Unit::IVP_Simulation_Unit() {
     sim_unit_movement_type = IVP_MT_NOT_SIM;
     sim_unit_just_slowed_down = IVP_FALSE;
     sim_unit_has_fast_objects = IVP_FALSE;
+    sim_unit_island_calm = IVP_FALSE;
 }
 
 void IVP_Simulation_Unit::rem_sim_unit_controller( IVP_Controller *rem_controller ) {
@@ -615,6 +616,7 @@ revive_all_cores:
 	}
     }
 
+    sim_unit_island_calm = IVP_FALSE;
     if(sim_unit_movement_type==IVP_MT_NOT_SIM) {
         env->get_sim_units_manager()->rem_sim_unit_from_manager(this);
 	sim_unit_movement_type=IVP_MT_MOVING;
@@ -672,6 +674,36 @@ IVP_BOOL IVP_Simulation_Unit::sim_unit_calc_movement_state(IVP_Environment *env)
 	core->movement_state=core->calc_movement_state(current_time);
         whole_sys=(IVP_Movement_Type)((int)whole_sys & (int)core->movement_state);
     }
+
+    IVP_Freeze_Manager *fm = env->get_freeze_manager();
+    if( whole_sys == IVP_MT_CALM ) {
+	fm->n_sim_units_frozen++;
+    } else if ( fm->island_sleep_energy > 0.0f ) {
+	// let the whole island sleep when its mass weighted energy is low and no core is moving fast
+	IVP_DOUBLE energy = 0.0f;
+	IVP_DOUBLE mass = 0.0f;
+	IVP_BOOL fast_core = IVP_FALSE;
+	for (int e = sim_unit_cores.len()-1; e>=0; e--) {
+	    IVP_Core *core = sim_unit_cores.element_at(e);
+	    IVP_DOUBLE core_energy = core->get_energy_on_test(&core->speed, &core->rot_speed);
+	    if ( core_energy * core->get_inv_mass() > IVP_ISLAND_MAX_CORE_ENERGY_FACTOR * fm->island_sleep_energy ) {
+		fast_core = IVP_TRUE;
+		break;
+	    }
+	    energy += core_energy;
+	    mass += core->get_mass();
+	}
+	if ( fast_core || energy > mass * fm->island_sleep_energy ) {
+	    sim_unit_island_calm = IVP_FALSE;
+	} else if ( !sim_unit_island_calm ) {
+	    sim_unit_island_calm = IVP_TRUE;
+	    time_of_island_calm_reference = current_time;
+	} else if ( current_time - time_of_island_calm_reference > fm->freeze_check_dtime ) {
+	    whole_sys = IVP_MT_CALM;
+	    fm->n_sim_units_frozen_island++;
+	}
+    }
+
     if( whole_sys == IVP_MT_CALM ) {
 	for (int n = sim_unit_cores.len()-1; n>=0; n--){
 	    IVP_Core *my_core = sim_unit_cores.element_at(n);
@@ -1,6 +1,7 @@
 // Copyright (C) Ipion Software GmbH 1999-2000. All rights reserved.
 
 #define IVP_SIM_SLOTS_NUM 100
+#define IVP_ISLAND_MAX_CORE_ENERGY_FACTOR 4.0f // island sleep: no core may have more than this times island_sleep_energy
 
 //#define IVP_DISABLE_FREEZING /* disable freezing of objects */
 
@@ -21,6 +22,8 @@ public:
     IVP_BOOL union_find_needed_for_sim_unit:2;
     IVP_BOOL sim_unit_has_fast_objects:2; //fast moving objects: some optimizations like: no energy controll ...
     IVP_BOOL sim_unit_just_slowed_down:2; //changing from fast moving to slowly moving
+    IVP_BOOL sim_unit_island_calm:2; //island energy is below island_sleep_energy since time_of_island_calm_reference
+    IVP_Time time_of_island_calm_reference;
     
     IVP_Simulation_Unit *prev_sim_unit;
     IVP_Simulation_Unit *next_sim_unit;
@@ -208,6 +208,8 @@ public:
     IVP_Time			time_of_calm_reference[2];
     IVP_U_Float_Quat		q_world_f_core_calm_reference[2];	// used to check the movement of an objec
     IVP_U_Float_Point		position_world_f_core_calm_reference[2];    
+    IVP_Time			time_of_energy_calm_reference;		// last time the energy was above the sleep energy
+    IVP_Time			time_of_wake;				// last reset_freeze_check_values
 
 #ifdef DEBUG_FRICTION_CONSISTENCY
     IVP_U_Vector<IVP_Friction_Info_For_Core> list_debug_hash;
@@ -330,6 +332,7 @@ public:
      *	section:	different simulation functions
      ********************************************************************************/
     IVP_Movement_Type calc_movement_state(IVP_Time psi_time);
+    IVP_DOUBLE get_energy_per_mass() { return get_energy_on_test(&speed, &rot_speed) * get_inv_mass(); };
 
     void create_collision_merged_core_with(IVP_Core *other_core);		// create a merged core
     void set_matrizes_and_speed(IVP_Core_Merged *template_core, IVP_U_Matrix *m_CORE_f_core_out); // for splitting
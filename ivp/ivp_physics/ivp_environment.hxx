@@ -17,6 +17,7 @@
 class IVP_BetterStatisticsmanager;
 class IVP_Sim_Units_Manager;
 class IVP_OV_Tree_Manager;
+class IVP_OV_Broadphase;
 class IVP_Collision_Filter;
 class IVP_Range_Manager;
 class IVP_Controller_Manager;
@@ -59,6 +60,15 @@ class IVP_Cluster_Manager;
 class IVP_Mindist_Manager;
 class IVP_Cache_Object_Manager;
 
+/********************************************************************************
+ *	Name:	     	IVP_BROADPHASE_TYPE
+ *	Description:	Which IVP_OV_Broadphase finds the objects close to each other
+ ********************************************************************************/
+enum IVP_BROADPHASE_TYPE {
+    IVP_BROADPHASE_OV_TREE,	// IVP_OV_Tree_Manager, octree like grid of cubes (default)
+    IVP_BROADPHASE_BVH		// IVP_OV_BVH_Manager, balanced tree of boxes, faster for many moving objects
+};
+
 /********************************************************************************
  *	Name:	     	IVP_ENV_STATE	
  *	Description:	State of the IVP_Environment	
@@ -105,6 +115,8 @@ public:
 
     int range_intra_exceeded;   // number of events: sphere for checking two objects recalculated
     int range_world_exceeded;	// number of events: sphere for checking object - world recalculated
+    int sum_ov_updates;		// number of objects reinserted into the broadphase (not cleared by clear_statistic)
+    int sum_ov_pairs;		// number of overlapping spheres found by those updates (not cleared by clear_statistic)
 
 	// friction
     int processed_fmindists;	// number of calls to recalc_friction_s_vals
@@ -116,10 +128,35 @@ public:
     IVP_Statistic_Manager();
 };
 
+/********************************************************************************
+ *	Name:	    	IVP_Freeze_Manager
+ *	Description:	Parameters to decide when objects go to sleep.
+ *			Besides the movement check a core is calm when its kinetic
+ *			energy per mass stays below sleep_energy for freeze_check_dtime,
+ *			so objects jittering in place fall asleep too. A whole sim unit
+ *			sleeps when its mass weighted energy stays below island_sleep_energy
+ *			and none of its cores is moving fast.
+ *			Right after waking up the core limit starts wake_ramp_scale times
+ *			higher and falls back to sleep_energy over wake_ramp_dtime, so a
+ *			small push passed on through a pile is damped out quickly.
+ *	Note:		energies are in [m*m/s*s], 0 disables the energy checks
+ ********************************************************************************/
 class IVP_Freeze_Manager {
 public:
     void init_freeze_manager();
     IVP_FLOAT freeze_check_dtime; // default 0.3 sec
+
+    IVP_FLOAT sleep_energy;		// default 0
+    IVP_FLOAT island_sleep_energy;	// default 0
+    IVP_FLOAT wake_ramp_dtime;		// default 0
+    IVP_FLOAT wake_ramp_scale;		// default 1
+
+    // statistics, never cleared
+    int n_sim_units_frozen;		// sim units frozen because all cores were calm
+    int n_sim_units_frozen_island;	// sim units frozen by the island energy check
+    int n_cores_calm_by_energy;		// calm cores that the movement check alone had kept awake
+
+    IVP_FLOAT get_sleep_energy(IVP_DOUBLE time_since_wake) const;
     IVP_Freeze_Manager();
 };
 
@@ -166,7 +203,8 @@ class IVP_Environment {		// the environment
     IVP_Sim_Units_Manager    *sim_units_manager;
     IVP_Cluster_Manager      *cluster_manager;
     IVP_Mindist_Manager      *mindist_manager;
-    IVP_OV_Tree_Manager      *ov_tree_manager;
+    IVP_OV_Tree_Manager      *ov_tree_manager;		// NULL if another broadphase is used
+    IVP_OV_Broadphase        *ov_broadphase;
     IVP_Collision_Filter     *collision_filter;
     IVP_Range_Manager	     *range_manager;
     IVP_Anomaly_Manager	     *anomaly_manager;
@@ -297,6 +335,7 @@ public:
 
     IVP_Cache_Object_Manager	 *get_cache_object_manager() const      { return cache_object_manager; };
     IVP_OV_Tree_Manager          *get_ov_tree_manager() const           { return ov_tree_manager; };
+    IVP_OV_Broadphase            *get_ov_broadphase() const             { return ov_broadphase; };
     IVP_Cluster_Manager          *get_cluster_manager() const           { return cluster_manager; };
     IVP_Debug_Manager		 *get_debug_manager() const             { return debug_information; };
     IVP_U_Memory		 *get_memory_manager() const	        { return short_term_mem; };
@@ -453,6 +492,7 @@ public:
 
     IVP_U_Active_Value_Manager *env_active_float_manager;	// a hash of active_values
     IVP_Range_Manager *range_manager;			// optional custom range_manager
+    IVP_BROADPHASE_TYPE broadphase_type;		// default IVP_BROADPHASE_OV_TREE
 
     
     IVP_Application_Environment();
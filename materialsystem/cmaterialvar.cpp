@@ -135,7 +135,7 @@ DEFINE_FIXEDSIZE_ALLOCATOR( CMaterialVar, 1024, true );
 DEFINE_FIXEDSIZE_ALLOCATOR( MaterialVarMatrix_t, 32, true );
 
 // Stores symbols for the material vars
-static CUtlSymbolTable s_MaterialVarSymbols;
+static CUtlSymbolTableMT s_MaterialVarSymbols( 0, 1024 );
 
 
 //-----------------------------------------------------------------------------
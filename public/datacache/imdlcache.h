@@ -61,7 +61,7 @@ enum MDLCacheDataType_t
 	MDLCACHE_DECODEDANIMBLOCK,
 };
 
-abstract_class IMDLCacheNotify
+class IMDLCacheNotify
 {
 public:
 	// Called right after the data is loaded
@@ -95,7 +95,7 @@ enum MDLCacheFlush_t
 //-----------------------------------------------------------------------------
 #define MDLCACHE_INTERFACE_VERSION "MDLCache004"
 
-abstract_class IMDLCache : public IBaseInterface
+class IMDLCache : public IBaseInterface
 {
 public:
 	// Used to install callbacks for when data is loaded + unloaded
@@ -115,11 +115,32 @@ public:
 };
 
 
+//-----------------------------------------------------------------------------
+// A set of rays traced with one mask and filter, e.g. the pellets of a shot.
+// Each ray gets the same trace as IEngineTrace::TraceRay would give it, but
+// rays that are close together share the search for entities along them.
+// The filter is asked about each entity once per group of rays, so it must
+// not depend on which ray is being traced.
+//-----------------------------------------------------------------------------
+class ITraceBatch
+{
+public:
+	// Returns the index of the ray's trace
+	virtual int		AddRay( const Ray_t &ray ) = 0;
+	virtual int		Count() const = 0;
+	virtual void	Clear() = 0;
+
+	// Traces all the rays added since the last Clear
+	virtual void	Trace( unsigned int fMask, ITraceFilter *pTraceFilter ) = 0;
+	virtual const trace_t &GetTrace( int nRay ) const = 0;
+};
+
+
 //-----------------------------------------------------------------------------
 // Interface the engine exposes to the game DLL
 //-----------------------------------------------------------------------------
-#define INTERFACEVERSION_ENGINETRACE_SERVER	"EngineTraceServer002"
-#define INTERFACEVERSION_ENGINETRACE_CLIENT	"EngineTraceClient002"
+#define INTERFACEVERSION_ENGINETRACE_SERVER	"EngineTraceServer003"
+#define INTERFACEVERSION_ENGINETRACE_CLIENT	"EngineTraceClient003"
 class IEngineTrace
 {
 public:
@@ -138,6 +159,10 @@ public:
 
 	// Same thing, but enumerate entitys within a box
 	virtual void	EnumerateEntities( const Vector &vecAbsMins, const Vector &vecAbsMaxs, IEntityEnumerator *pEnumerator ) = 0;
+
+	// Batches of rays traced together, see ITraceBatch
+	virtual ITraceBatch *CreateTraceBatch() = 0;
+	virtual void	DestroyTraceBatch( ITraceBatch *pBatch ) = 0;
 };
 
 
@@ -14,11 +14,14 @@
 #include <malloc.h>
 #include <memory.h>
 #include "tier0/dbg.h"
+#include "tier0/mem.h"
 #include <ctype.h>
 #include "tier0/memdbgon.h"
 
 #undef max
 #define max(x,y) (((x)>(y)) ? (x) : (y))
+#undef min
+#define min(x,y) (((x)<(y)) ? (x) : (y))
 
 MemoryPoolReportFunc_t CMemoryPool::g_ReportFunc = 0;
 
@@ -35,14 +38,18 @@ void CMemoryPool::SetErrorReportFunc( MemoryPoolReportFunc_t func )
 // Purpose: Constructor
 //-----------------------------------------------------------------------------
 
-CMemoryPool::CMemoryPool(int blockSize, int numElements, int growMode)
+CMemoryPool::CMemoryPool(int blockSize, int numElements, int growMode, const char *pszName)
 {
+	m_pszName = pszName;
 	m_BlockSize = blockSize < sizeof(void*) ? sizeof(void*) : blockSize;
 	m_BlocksPerBlob = numElements;
 	m_PeakAlloc = 0;
+	m_TotalAllocs = 0;
 	m_GrowMode = growMode;
 	Init();
 	AddNewBlob();
+
+	MemRegisterPool( this, GetStats );
 }
 
 //-----------------------------------------------------------------------------
@@ -52,6 +59,8 @@ CMemoryPool::CMemoryPool(int blockSize, int numElements, int growMode)
 //-----------------------------------------------------------------------------
 CMemoryPool::~CMemoryPool()
 {
+	MemUnregisterPool( this );
+
 	if (m_BlocksAllocated > 0)
 	{
 		ReportLeaks();
@@ -60,6 +69,28 @@ CMemoryPool::~CMemoryPool()
 }
 
 
+//-----------------------------------------------------------------------------
+// Stats for mem_dumpstats
+//-----------------------------------------------------------------------------
+void CMemoryPool::GetStats( const void *pPool, MemPoolStats_t *pStats )
+{
+	const CMemoryPool *pThis = (const CMemoryPool *)pPool;
+
+	pStats->m_pName = pThis->m_pszName;
+	pStats->m_nBlockSize = pThis->m_BlockSize;
+	pStats->m_nBlocksAllocated = pThis->m_BlocksAllocated;
+	pStats->m_nPeakAlloc = pThis->m_PeakAlloc;
+	pStats->m_nTotalAllocs = pThis->m_TotalAllocs;
+	pStats->m_bThreadSafe = false;
+
+	pStats->m_nCommittedBytes = 0;
+	for( CBlob *pCur = pThis->m_BlobHead.m_pNext; pCur != &pThis->m_BlobHead; pCur = pCur->m_pNext )
+	{
+		pStats->m_nCommittedBytes += pCur->m_NumBytes;
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Resets the pool
 //-----------------------------------------------------------------------------
@@ -229,6 +260,7 @@ void *CMemoryPool::Alloc( unsigned int amount )
 		}
 	}
 	m_BlocksAllocated++;
+	m_TotalAllocs++;
 	m_PeakAlloc = max(m_PeakAlloc, m_BlocksAllocated);
 
 	returnBlock = m_pHeadOfFreeList;
@@ -277,3 +309,363 @@ void CMemoryPool::Free( void *memBlock )
 
 
 
+
+
+//-----------------------------------------------------------------------------
+// CMemoryPoolMT
+//-----------------------------------------------------------------------------
+
+// Free blocks are linked into chains through their first pointer, and the
+// first block of each chain links the global list through its second one.
+#define CHAIN_NEXT_BLOCK( _pBlock )		( ((void**)(_pBlock))[0] )
+#define CHAIN_NEXT_CHAIN( _pBlock )		( ((void**)(_pBlock))[1] )
+
+// The global list head packs a pointer and a sequence number into 64 bits.
+// 64 bit user space pointers fit in the low 48 bits.
+static inline int64 PackChainHead( void *pChain, uint64 nSequence )
+{
+	if ( sizeof(void*) == 4 )
+		return (int64)( (uint64)(uintp)pChain | ( ( nSequence & 0xffffffff ) << 32 ) );
+
+	return (int64)( (uint64)(uintp)pChain | ( ( nSequence & 0xffff ) << 48 ) );
+}
+
+static inline void *UnpackChainPointer( int64 nHead )
+{
+	if ( sizeof(void*) == 4 )
+		return (void*)(uintp)( (uint64)nHead & 0xffffffff );
+
+	return (void*)(uintp)( (uint64)nHead & ( ( (uint64)1 << 48 ) - 1 ) );
+}
+
+static inline uint64 UnpackChainSequence( int64 nHead )
+{
+	return ( sizeof(void*) == 4 ) ? ( (uint64)nHead >> 32 ) : ( (uint64)nHead >> 48 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Constructor
+//-----------------------------------------------------------------------------
+CMemoryPoolMT::CMemoryPoolMT(int blockSize, int numElements, int growMode, const char *pszName)
+{
+	// Free blocks need room for both chain links
+	m_pszName = pszName;
+	m_BlockSize = max( blockSize, (int)( 2 * sizeof(void*) ) );
+	m_BlocksPerBlob = max( numElements, 1 );
+	m_GrowMode = growMode;
+
+	m_FreeChains = 0;
+	m_nGlobalFree = 0;
+	m_pBlobs = NULL;
+	m_nBlocksCarved = 0;
+	m_NumBlobs = 0;
+	m_PeakAlloc = 0;
+
+	for ( int i = 0; i < NUM_MAGAZINES; ++i )
+	{
+		m_Magazines[i].m_pHead = NULL;
+		m_Magazines[i].m_nCount = 0;
+		m_Magazines[i].m_nTotalAllocs = 0;
+	}
+
+	AddNewBlob();
+
+	MemRegisterPool( this, GetStats );
+}
+
+CMemoryPoolMT::~CMemoryPoolMT()
+{
+	MemUnregisterPool( this );
+	Clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Frees everything
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::Clear()
+{
+	CBlob *pNext;
+	for ( CBlob *pCur = m_pBlobs; pCur; pCur = pNext )
+	{
+		pNext = pCur->m_pNext;
+		free( pCur );
+	}
+
+	m_pBlobs = NULL;
+	m_NumBlobs = 0;
+	m_nBlocksCarved = 0;
+	m_FreeChains = 0;
+	m_nGlobalFree = 0;
+
+	for ( int i = 0; i < NUM_MAGAZINES; ++i )
+	{
+		m_Magazines[i].m_pHead = NULL;
+		m_Magazines[i].m_nCount = 0;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Global chain list
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::PushChain( void *pChain, int nCount )
+{
+	ThreadInterlockedExchangeAdd( &m_nGlobalFree, nCount );
+
+	// A compare-exchange that can't succeed is the portable atomic 64 bit read
+	int64 nHead = ThreadInterlockedCompareExchange64( &m_FreeChains, 0, 0 );
+	for (;;)
+	{
+		CHAIN_NEXT_CHAIN( pChain ) = UnpackChainPointer( nHead );
+		int64 nNewHead = PackChainHead( pChain, UnpackChainSequence( nHead ) + 1 );
+
+		int64 nPrevHead = ThreadInterlockedCompareExchange64( &m_FreeChains, nNewHead, nHead );
+		if ( nPrevHead == nHead )
+			return;
+
+		nHead = nPrevHead;
+	}
+}
+
+void *CMemoryPoolMT::PopChain()
+{
+	int64 nHead = ThreadInterlockedCompareExchange64( &m_FreeChains, 0, 0 );
+	for (;;)
+	{
+		void *pChain = UnpackChainPointer( nHead );
+		if ( !pChain )
+			return NULL;
+
+		// Another thread may pop and reuse pChain before our exchange. Reading
+		// it is still safe since blobs are never freed while the pool is in
+		// use, and the sequence number makes the exchange fail.
+		void *pNextChain = CHAIN_NEXT_CHAIN( pChain );
+		int64 nNewHead = PackChainHead( pNextChain, UnpackChainSequence( nHead ) + 1 );
+
+		int64 nPrevHead = ThreadInterlockedCompareExchange64( &m_FreeChains, nNewHead, nHead );
+		if ( nPrevHead == nHead )
+			return pChain;
+
+		nHead = nPrevHead;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Allocates a new blob and puts its blocks on the global list. Called with
+// m_GrowLock held (or from the constructor).
+//-----------------------------------------------------------------------------
+bool CMemoryPoolMT::AddNewBlob()
+{
+	int sizeMultiplier;
+	if ( m_GrowMode == CMemoryPool::GROW_SLOW )
+	{
+		sizeMultiplier = 1;
+	}
+	else
+	{
+		// Can only have one allocation when we're in GROW_NONE
+		if ( m_GrowMode == CMemoryPool::GROW_NONE && m_NumBlobs != 0 )
+			return false;
+
+		sizeMultiplier = m_NumBlobs + 1;
+	}
+
+	int nElements = m_BlocksPerBlob * sizeMultiplier;
+	int blobSize = m_BlockSize * nElements;
+	CBlob *pBlob = (CBlob*)malloc( sizeof(CBlob) + blobSize - 1 );
+	Assert( pBlob );
+	if ( !pBlob )
+		return false;
+
+	pBlob->m_NumBytes = blobSize;
+	pBlob->m_pNext = m_pBlobs;
+	m_pBlobs = pBlob;
+	m_NumBlobs++;
+
+	ThreadInterlockedExchangeAdd( &m_nBlocksCarved, nElements );
+
+	// Link the blocks into magazine sized chains
+	for ( int nFirst = 0; nFirst < nElements; nFirst += MAGAZINE_SIZE )
+	{
+		int nCount = min( (int)MAGAZINE_SIZE, nElements - nFirst );
+		char *pChain = pBlob->m_Data + nFirst * m_BlockSize;
+
+		for ( int i = 0; i < nCount - 1; ++i )
+		{
+			CHAIN_NEXT_BLOCK( pChain + i * m_BlockSize ) = pChain + ( i + 1 ) * m_BlockSize;
+		}
+		CHAIN_NEXT_BLOCK( pChain + ( nCount - 1 ) * m_BlockSize ) = NULL;
+
+		PushChain( pChain, nCount );
+	}
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Magazines
+//-----------------------------------------------------------------------------
+inline CMemoryPoolMT::Magazine_t &CMemoryPoolMT::GetMagazine()
+{
+	// Thread ids tend to be aligned, so mix the bits before picking one
+	uint64 nThreadId = ThreadGetCurrentId();
+	uint32 nHash = (uint32)nThreadId ^ (uint32)( nThreadId >> 32 );
+	nHash = ( nHash ^ ( nHash >> 16 ) ) * 0x45d9f3b;
+	nHash ^= nHash >> 16;
+	return m_Magazines[ nHash & ( NUM_MAGAZINES - 1 ) ];
+}
+
+//-----------------------------------------------------------------------------
+// Fills an empty magazine from the global list, growing the pool if needed.
+// Called with the magazine's lock held.
+//-----------------------------------------------------------------------------
+bool CMemoryPoolMT::Refill( Magazine_t &magazine )
+{
+	void *pChain = PopChain();
+	if ( !pChain )
+	{
+		AUTO_LOCK_FM( m_GrowLock );
+
+		// Someone else may have grown the pool while we waited
+		pChain = PopChain();
+		if ( !pChain )
+		{
+			if ( !AddNewBlob() )
+				return false;
+
+			pChain = PopChain();
+			if ( !pChain )
+				return false;
+		}
+	}
+
+	int nCount = 1;
+	for ( void *pBlock = CHAIN_NEXT_BLOCK( pChain ); pBlock; pBlock = CHAIN_NEXT_BLOCK( pBlock ) )
+	{
+		++nCount;
+	}
+	ThreadInterlockedExchangeAdd( &m_nGlobalFree, -nCount );
+
+	magazine.m_pHead = pChain;
+	magazine.m_nCount = nCount;
+
+	UpdatePeak();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Blocks only leave the shared pool on refills, so that's when usage can
+// reach a new peak.
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::UpdatePeak()
+{
+	long nInUse = m_nBlocksCarved - m_nGlobalFree;
+	for ( int i = 0; i < NUM_MAGAZINES; ++i )
+	{
+		nInUse -= m_Magazines[i].m_nCount;
+	}
+
+	long nPeak = m_PeakAlloc;
+	while ( nInUse > nPeak && !ThreadInterlockedAssignIf( &m_PeakAlloc, nInUse, nPeak ) )
+	{
+		nPeak = m_PeakAlloc;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Allocs a single block of memory from the pool.
+//-----------------------------------------------------------------------------
+void *CMemoryPoolMT::Alloc()
+{
+	return Alloc( m_BlockSize );
+}
+
+void *CMemoryPoolMT::Alloc( unsigned int amount )
+{
+	if ( amount > (unsigned int)m_BlockSize )
+		return NULL;
+
+	Magazine_t &magazine = GetMagazine();
+	AUTO_LOCK_FM( magazine.m_Lock );
+
+	if ( !magazine.m_pHead && !Refill( magazine ) )
+	{
+		// returning NULL is fine in GROW_NONE
+		Assert( m_GrowMode == CMemoryPool::GROW_NONE );
+		return NULL;
+	}
+
+	void *pBlock = magazine.m_pHead;
+	magazine.m_pHead = CHAIN_NEXT_BLOCK( pBlock );
+	--magazine.m_nCount;
+	++magazine.m_nTotalAllocs;
+
+	return pBlock;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees a block of memory
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::Free( void *memBlock )
+{
+	if ( !memBlock )
+		return;  // trying to delete NULL pointer, ignore
+
+#ifdef _DEBUG
+	// invalidate the memory
+	memset( memBlock, 0xDD, m_BlockSize );
+#endif
+
+	Magazine_t &magazine = GetMagazine();
+	AUTO_LOCK_FM( magazine.m_Lock );
+
+	CHAIN_NEXT_BLOCK( memBlock ) = magazine.m_pHead;
+	magazine.m_pHead = memBlock;
+
+	// Keep up to two chains' worth, hand any more back to the global list
+	if ( ++magazine.m_nCount >= 2 * MAGAZINE_SIZE )
+	{
+		void *pChain = magazine.m_pHead;
+		void *pLast = pChain;
+		for ( int i = 1; i < MAGAZINE_SIZE; ++i )
+		{
+			pLast = CHAIN_NEXT_BLOCK( pLast );
+		}
+
+		magazine.m_pHead = CHAIN_NEXT_BLOCK( pLast );
+		magazine.m_nCount -= MAGAZINE_SIZE;
+		CHAIN_NEXT_BLOCK( pLast ) = NULL;
+
+		PushChain( pChain, MAGAZINE_SIZE );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Stats for mem_dumpstats. Counts are read without locking.
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::GetStats( const void *pPool, MemPoolStats_t *pStats )
+{
+	const CMemoryPoolMT *pThis = (const CMemoryPoolMT *)pPool;
+
+	int nInUse = pThis->m_nBlocksCarved - pThis->m_nGlobalFree;
+	int64 nTotalAllocs = 0;
+	for ( int i = 0; i < NUM_MAGAZINES; ++i )
+	{
+		nInUse -= pThis->m_Magazines[i].m_nCount;
+		nTotalAllocs += pThis->m_Magazines[i].m_nTotalAllocs;
+	}
+
+	pStats->m_pName = pThis->m_pszName;
+	pStats->m_nBlockSize = pThis->m_BlockSize;
+	pStats->m_nBlocksAllocated = nInUse;
+	pStats->m_nPeakAlloc = max( (int)pThis->m_PeakAlloc, nInUse );
+	pStats->m_nTotalAllocs = nTotalAllocs;
+	pStats->m_nCommittedBytes = pThis->m_nBlocksCarved * pThis->m_BlockSize;
+	pStats->m_bThreadSafe = true;
+}
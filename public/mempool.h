@@ -25,6 +25,7 @@
 
 
 #include "utlmemory.h"
+#include "tier0/threadtools.h"
 
 
 //-----------------------------------------------------------------------------
@@ -45,7 +46,7 @@ public:
 		GROW_SLOW=2			// New blob size is numElements.
 	};
 
-				CMemoryPool(int blockSize, int numElements, int growMode = GROW_FAST);
+				CMemoryPool(int blockSize, int numElements, int growMode = GROW_FAST, const char *pszName = NULL);
 				~CMemoryPool();
 
 	void*		Alloc();	// Allocate the element size you specified in the constructor.
@@ -74,9 +75,12 @@ private:
 	void		AddNewBlob();
 	void		ReportLeaks();
 
+	static void GetStats( const void *pPool, struct MemPoolStats_t *pStats );
+
 
 private:
 
+	const char	*m_pszName;
 	int			m_BlockSize;
 	int			m_BlocksPerBlob;
 
@@ -87,12 +91,91 @@ private:
 	void			*m_pHeadOfFreeList;
 	int				m_BlocksAllocated;
 	int				m_PeakAlloc;
+	int				m_TotalAllocs;
 	unsigned short	m_NumBlobs;
 
 	static MemoryPoolReportFunc_t g_ReportFunc;
 };
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Thread safe version of CMemoryPool.
+//
+// Each thread works out of a magazine, a short free list picked by hashing
+// the thread id; magazines trade fixed size chains of blocks with a lock-free
+// global free list. Threads only contend when they hash to the same magazine.
+// Peak usage is tracked when magazines are refilled, so it can be off by a
+// few magazines' worth of blocks.
+//
+// Clear() and destruction are not thread safe.
+//-----------------------------------------------------------------------------
+class CMemoryPoolMT
+{
+public:
+				CMemoryPoolMT(int blockSize, int numElements, int growMode = CMemoryPool::GROW_FAST, const char *pszName = NULL);
+				~CMemoryPoolMT();
+
+	void*		Alloc();	// Allocate the element size you specified in the constructor.
+	void*		Alloc( unsigned int amount );
+	void		Free(void *pMem);
+
+	// Frees everything
+	void		Clear();
+
+private:
+	enum
+	{
+		MAGAZINE_SIZE = 32,		// Blocks in each chain on the global list
+		NUM_MAGAZINES = 16,		// Must be a power of two
+	};
+
+	class CBlob
+	{
+	public:
+		CBlob	*m_pNext;
+		int		m_NumBytes;		// Number of bytes in this blob.
+		char	m_Data[1];
+	};
+
+	struct Magazine_t
+	{
+		CThreadFastMutex	m_Lock;
+		void				*m_pHead;
+		int					m_nCount;
+		int64				m_nTotalAllocs;
+
+		// Keep magazines on separate cache lines
+		char				m_Pad[32];
+	};
+
+	Magazine_t	&GetMagazine();
+	bool		Refill( Magazine_t &magazine );
+	void		PushChain( void *pChain, int nCount );
+	void		*PopChain();
+	bool		AddNewBlob();
+	void		UpdatePeak();
+
+	static void GetStats( const void *pPool, struct MemPoolStats_t *pStats );
+
+	const char		*m_pszName;
+	int				m_BlockSize;
+	int				m_BlocksPerBlob;
+	int				m_GrowMode;
+
+	// Tagged head of the global chain list; the tag defeats ABA
+	TT_ALIGN8 int64 volatile m_FreeChains;
+	long volatile	m_nGlobalFree;
+
+	CThreadFastMutex m_GrowLock;
+	CBlob			*m_pBlobs;
+	long volatile	m_nBlocksCarved;
+	int				m_NumBlobs;
+	long volatile	m_PeakAlloc;
+
+	Magazine_t		m_Magazines[NUM_MAGAZINES];
+};
+
+
 //-----------------------------------------------------------------------------
 // Wrapper macro to make an allocator that returns particular typed allocations
 // and construction and destruction of objects.
@@ -148,7 +231,23 @@ void CClassMemoryPool<T>::Free(T *pMem)
       static   CMemoryPool   s_Allocator
     
 #define DEFINE_FIXEDSIZE_ALLOCATOR( _class, _initsize, _grow )					\
-   CMemoryPool   _class::s_Allocator(sizeof(_class), _initsize, _grow)
+   CMemoryPool   _class::s_Allocator(sizeof(_class), _initsize, _grow, #_class)
+
+
+//-----------------------------------------------------------------------------
+// Same as above, but the objects may be allocated and freed from any thread
+//-----------------------------------------------------------------------------
+#define DECLARE_FIXEDSIZE_ALLOCATOR_MT( _class )								\
+   public:																		\
+      inline void* operator new( size_t size ) { return s_Allocator.Alloc(size); }   \
+      inline void* operator new( size_t size, int nBlockUse, const char *pFileName, int nLine ) { return s_Allocator.Alloc(size); }   \
+      inline void  operator delete( void* p ) { s_Allocator.Free(p); }		\
+      inline void  operator delete( void* p, int nBlockUse, const char *pFileName, int nLine ) { s_Allocator.Free(p); }   \
+  private:																		\
+      static   CMemoryPoolMT   s_Allocator
+
+#define DEFINE_FIXEDSIZE_ALLOCATOR_MT( _class, _initsize, _grow )				\
+   CMemoryPoolMT   _class::s_Allocator(sizeof(_class), _initsize, _grow, #_class)
 
 
 //-----------------------------------------------------------------------------
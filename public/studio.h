@@ -1776,11 +1776,14 @@ struct studiomeshgroup_t
 };
 
 
+struct studioflexdata_t;
+
 // studio model data
 struct studiomeshdata_t
 {
 	int					m_NumGroup;
 	studiomeshgroup_t*	m_pMeshGroup;
+	studioflexdata_t*	m_pFlexData;	// built by the studio renderer the first time the mesh is flexed
 };
 
 struct studioloddata_t
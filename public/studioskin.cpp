@@ -0,0 +1,221 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Batched software skinning.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "studioskin.h"
+#include "studio.h"
+#include "mathlib.h"
+#include <xmmintrin.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//-----------------------------------------------------------------------------
+// Scalar reference
+//-----------------------------------------------------------------------------
+static const matrix3x4_t *ComputeSkinMatrix( const mstudioboneweight_t &boneweights, const matrix3x4_t *pPoseToWorld, matrix3x4_t &result )
+{
+	float flWeight0, flWeight1, flWeight2;
+
+	switch( boneweights.numbones )
+	{
+	default:
+	case 1:
+		return &pPoseToWorld[boneweights.bone[0]];
+
+	case 2:
+		{
+			const matrix3x4_t &boneMat0 = pPoseToWorld[boneweights.bone[0]];
+			const matrix3x4_t &boneMat1 = pPoseToWorld[boneweights.bone[1]];
+			flWeight0 = boneweights.weight[0];
+			flWeight1 = boneweights.weight[1];
+
+			for ( int i = 0; i < 3; ++i )
+			{
+				result[i][0] = boneMat0[i][0] * flWeight0 + boneMat1[i][0] * flWeight1;
+				result[i][1] = boneMat0[i][1] * flWeight0 + boneMat1[i][1] * flWeight1;
+				result[i][2] = boneMat0[i][2] * flWeight0 + boneMat1[i][2] * flWeight1;
+				result[i][3] = boneMat0[i][3] * flWeight0 + boneMat1[i][3] * flWeight1;
+			}
+		}
+		return &result;
+
+	case 3:
+		{
+			const matrix3x4_t &boneMat0 = pPoseToWorld[boneweights.bone[0]];
+			const matrix3x4_t &boneMat1 = pPoseToWorld[boneweights.bone[1]];
+			const matrix3x4_t &boneMat2 = pPoseToWorld[boneweights.bone[2]];
+			flWeight0 = boneweights.weight[0];
+			flWeight1 = boneweights.weight[1];
+			flWeight2 = boneweights.weight[2];
+
+			for ( int i = 0; i < 3; ++i )
+			{
+				result[i][0] = boneMat0[i][0] * flWeight0 + boneMat1[i][0] * flWeight1 + boneMat2[i][0] * flWeight2;
+				result[i][1] = boneMat0[i][1] * flWeight0 + boneMat1[i][1] * flWeight1 + boneMat2[i][1] * flWeight2;
+				result[i][2] = boneMat0[i][2] * flWeight0 + boneMat1[i][2] * flWeight1 + boneMat2[i][2] * flWeight2;
+				result[i][3] = boneMat0[i][3] * flWeight0 + boneMat1[i][3] * flWeight1 + boneMat2[i][3] * flWeight2;
+			}
+		}
+		return &result;
+	}
+}
+
+void Studio_SkinBatch( int nVerts, const mstudioboneweight_t * const *ppBoneWeights,
+	const matrix3x4_t *pPoseToWorld, const SkinBatch_t &src, SkinBatch_t &dst, bool bTangentS )
+{
+	Assert( nVerts <= SKIN_BATCH_SIZE );
+
+	matrix3x4_t temp;
+	for ( int i = 0; i < nVerts; ++i )
+	{
+		const matrix3x4_t &m = *ComputeSkinMatrix( *ppBoneWeights[i], pPoseToWorld, temp );
+
+		float x = src.m_PosX[i], y = src.m_PosY[i], z = src.m_PosZ[i];
+		dst.m_PosX[i] = x * m[0][0] + y * m[0][1] + z * m[0][2] + m[0][3];
+		dst.m_PosY[i] = x * m[1][0] + y * m[1][1] + z * m[1][2] + m[1][3];
+		dst.m_PosZ[i] = x * m[2][0] + y * m[2][1] + z * m[2][2] + m[2][3];
+
+		x = src.m_NormX[i]; y = src.m_NormY[i]; z = src.m_NormZ[i];
+		dst.m_NormX[i] = x * m[0][0] + y * m[0][1] + z * m[0][2];
+		dst.m_NormY[i] = x * m[1][0] + y * m[1][1] + z * m[1][2];
+		dst.m_NormZ[i] = x * m[2][0] + y * m[2][1] + z * m[2][2];
+
+		if ( bTangentS )
+		{
+			x = src.m_TangentSX[i]; y = src.m_TangentSY[i]; z = src.m_TangentSZ[i];
+			dst.m_TangentSX[i] = x * m[0][0] + y * m[0][1] + z * m[0][2];
+			dst.m_TangentSY[i] = x * m[1][0] + y * m[1][1] + z * m[1][2];
+			dst.m_TangentSZ[i] = x * m[2][0] + y * m[2][1] + z * m[2][2];
+			dst.m_TangentSW[i] = src.m_TangentSW[i];
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// SSE. The batch is walked four vertices at a time and each group is skinned
+// with as many bones as its heaviest vertex needs; lighter vertices get zero
+// weights for the extra bones. The blended matrices are transposed so every
+// register holds one matrix element for four vertices, which makes the
+// transform straight mul/adds across the position, normal and tangent streams.
+//-----------------------------------------------------------------------------
+#define SKIN_TRANSFORM_ROW( _x, _y, _z, _row )	\
+	_mm_add_ps( _mm_add_ps( _mm_mul_ps( _x, m[_row][0] ), _mm_mul_ps( _y, m[_row][1] ) ), _mm_mul_ps( _z, m[_row][2] ) )
+
+template< int nBones >
+static void SkinFourSSE( int i, int nValid, const mstudioboneweight_t * const *ppBoneWeights,
+	const matrix3x4_t *pPoseToWorld, const SkinBatch_t &src, SkinBatch_t &dst, bool bTangentS )
+{
+	const mstudioboneweight_t *pWeights[4];
+	int l;
+	for ( l = 0; l < 4; ++l )
+	{
+		pWeights[l] = ppBoneWeights[i + min( l, nValid - 1 )];
+	}
+
+	// Blend each vertex's bone matrices a row at a time
+	__m128 rows[4][3];
+	for ( l = 0; l < 4; ++l )
+	{
+		const mstudioboneweight_t &weights = *pWeights[l];
+		const matrix3x4_t &mat0 = pPoseToWorld[weights.bone[0]];
+		if ( nBones == 1 )
+		{
+			rows[l][0] = _mm_load_ps( mat0[0] );
+			rows[l][1] = _mm_load_ps( mat0[1] );
+			rows[l][2] = _mm_load_ps( mat0[2] );
+			continue;
+		}
+
+		__m128 w = _mm_set1_ps( ( weights.numbones > 1 ) ? weights.weight[0] : 1.0f );
+		rows[l][0] = _mm_mul_ps( _mm_load_ps( mat0[0] ), w );
+		rows[l][1] = _mm_mul_ps( _mm_load_ps( mat0[1] ), w );
+		rows[l][2] = _mm_mul_ps( _mm_load_ps( mat0[2] ), w );
+
+		for ( int b = 1; b < nBones; ++b )
+		{
+			// Vertices with fewer bones than the group reuse their first bone
+			// with no weight
+			bool bUsed = ( b < weights.numbones );
+			const matrix3x4_t &mat = pPoseToWorld[weights.bone[bUsed ? b : 0]];
+			w = _mm_set1_ps( bUsed ? weights.weight[b] : 0.0f );
+			rows[l][0] = _mm_add_ps( rows[l][0], _mm_mul_ps( _mm_load_ps( mat[0] ), w ) );
+			rows[l][1] = _mm_add_ps( rows[l][1], _mm_mul_ps( _mm_load_ps( mat[1] ), w ) );
+			rows[l][2] = _mm_add_ps( rows[l][2], _mm_mul_ps( _mm_load_ps( mat[2] ), w ) );
+		}
+	}
+
+	// Transpose so m[row][col] holds that element for all four vertices
+	__m128 m[3][4];
+	for ( int r = 0; r < 3; ++r )
+	{
+		m[r][0] = rows[0][r];
+		m[r][1] = rows[1][r];
+		m[r][2] = rows[2][r];
+		m[r][3] = rows[3][r];
+		_MM_TRANSPOSE4_PS( m[r][0], m[r][1], m[r][2], m[r][3] );
+	}
+
+	// The streams are padded to the batch size, so the lanes past the end of
+	// a partial group just skin whatever is there
+	__m128 x = _mm_load_ps( &src.m_PosX[i] );
+	__m128 y = _mm_load_ps( &src.m_PosY[i] );
+	__m128 z = _mm_load_ps( &src.m_PosZ[i] );
+	_mm_store_ps( &dst.m_PosX[i], _mm_add_ps( SKIN_TRANSFORM_ROW( x, y, z, 0 ), m[0][3] ) );
+	_mm_store_ps( &dst.m_PosY[i], _mm_add_ps( SKIN_TRANSFORM_ROW( x, y, z, 1 ), m[1][3] ) );
+	_mm_store_ps( &dst.m_PosZ[i], _mm_add_ps( SKIN_TRANSFORM_ROW( x, y, z, 2 ), m[2][3] ) );
+
+	x = _mm_load_ps( &src.m_NormX[i] );
+	y = _mm_load_ps( &src.m_NormY[i] );
+	z = _mm_load_ps( &src.m_NormZ[i] );
+	_mm_store_ps( &dst.m_NormX[i], SKIN_TRANSFORM_ROW( x, y, z, 0 ) );
+	_mm_store_ps( &dst.m_NormY[i], SKIN_TRANSFORM_ROW( x, y, z, 1 ) );
+	_mm_store_ps( &dst.m_NormZ[i], SKIN_TRANSFORM_ROW( x, y, z, 2 ) );
+
+	if ( bTangentS )
+	{
+		x = _mm_load_ps( &src.m_TangentSX[i] );
+		y = _mm_load_ps( &src.m_TangentSY[i] );
+		z = _mm_load_ps( &src.m_TangentSZ[i] );
+		_mm_store_ps( &dst.m_TangentSX[i], SKIN_TRANSFORM_ROW( x, y, z, 0 ) );
+		_mm_store_ps( &dst.m_TangentSY[i], SKIN_TRANSFORM_ROW( x, y, z, 1 ) );
+		_mm_store_ps( &dst.m_TangentSZ[i], SKIN_TRANSFORM_ROW( x, y, z, 2 ) );
+		_mm_store_ps( &dst.m_TangentSW[i], _mm_load_ps( &src.m_TangentSW[i] ) );
+	}
+}
+
+void Studio_SkinBatchSSE( int nVerts, const mstudioboneweight_t * const *ppBoneWeights,
+	const matrix3x4_t *pPoseToWorld, const SkinBatch_t &src, SkinBatch_t &dst, bool bTangentS )
+{
+	Assert( nVerts <= SKIN_BATCH_SIZE );
+	Assert( ( (size_t)pPoseToWorld & 15 ) == 0 );
+
+	for ( int i = 0; i < nVerts; i += 4 )
+	{
+		int nValid = min( 4, nVerts - i );
+
+		int nBones = 1;
+		for ( int l = 0; l < nValid; ++l )
+		{
+			nBones = max( nBones, (int)ppBoneWeights[i + l]->numbones );
+		}
+
+		switch ( nBones )
+		{
+		case 1:
+			SkinFourSSE< 1 >( i, nValid, ppBoneWeights, pPoseToWorld, src, dst, bTangentS );
+			break;
+		case 2:
+			SkinFourSSE< 2 >( i, nValid, ppBoneWeights, pPoseToWorld, src, dst, bTangentS );
+			break;
+		default:
+			SkinFourSSE< 3 >( i, nValid, ppBoneWeights, pPoseToWorld, src, dst, bTangentS );
+			break;
+		}
+	}
+}
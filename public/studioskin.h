@@ -0,0 +1,54 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Batched software skinning. Vertices are skinned in batches laid
+//			out as one stream per component, so the SSE kernel can blend and
+//			transform four vertices at once. The scalar kernel is the
+//			reference the SSE one is checked against.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef STUDIOSKIN_H
+#define STUDIOSKIN_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+struct mstudioboneweight_t;
+struct matrix3x4_t;
+
+#define SKIN_BATCH_SIZE		64
+
+//-----------------------------------------------------------------------------
+// One batch of vertices, structure of arrays
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+struct __declspec(align(16)) SkinBatch_t
+#elif _LINUX
+struct __attribute__((aligned(16))) SkinBatch_t
+#endif
+{
+	float	m_PosX[SKIN_BATCH_SIZE];
+	float	m_PosY[SKIN_BATCH_SIZE];
+	float	m_PosZ[SKIN_BATCH_SIZE];
+	float	m_NormX[SKIN_BATCH_SIZE];
+	float	m_NormY[SKIN_BATCH_SIZE];
+	float	m_NormZ[SKIN_BATCH_SIZE];
+	float	m_TangentSX[SKIN_BATCH_SIZE];
+	float	m_TangentSY[SKIN_BATCH_SIZE];
+	float	m_TangentSZ[SKIN_BATCH_SIZE];
+	float	m_TangentSW[SKIN_BATCH_SIZE];
+};
+
+//-----------------------------------------------------------------------------
+// Skins the first nVerts vertices of src into dst. ppBoneWeights[i] holds
+// the weights of vertex i. Tangents are only touched if bTangentS is set.
+// The SSE version needs pPoseToWorld to be 16 byte aligned.
+//-----------------------------------------------------------------------------
+void Studio_SkinBatch( int nVerts, const mstudioboneweight_t * const *ppBoneWeights,
+	const matrix3x4_t *pPoseToWorld, const SkinBatch_t &src, SkinBatch_t &dst, bool bTangentS );
+void Studio_SkinBatchSSE( int nVerts, const mstudioboneweight_t * const *ppBoneWeights,
+	const matrix3x4_t *pPoseToWorld, const SkinBatch_t &src, SkinBatch_t &dst, bool bTangentS );
+
+#endif // STUDIOSKIN_H
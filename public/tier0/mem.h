@@ -28,6 +28,88 @@
 MEM_INTERFACE void *MemAllocScratch( int nMemSize );
 MEM_INTERFACE void MemFreeScratch();
 
+
+//-----------------------------------------------------------------------------
+// Frame memory: a per-thread linear allocator for temporaries that don't
+// outlive the current frame. Allocations are 16-byte aligned and are never
+// freed individually; either roll back to a mark taken earlier on the same
+// thread, or let MemFrameReset release everything at the end of the frame.
+// Requests that don't fit fall back to the heap and are released the same
+// way; the arena grows at the next reset so steady-state usage stays in one
+// block.
+//
+// The engine resets the main thread's arena once per host frame. Other
+// threads should scope their use with marks (or call MemFrameReset).
+//-----------------------------------------------------------------------------
+struct MemFrameMark_t
+{
+	void	*m_pBlock;
+	int		m_nBlockUsed;
+	int		m_nTotalUsed;
+};
+
+struct MemFrameStats_t
+{
+	int		m_nCapacity;			// size of the arena's main block
+	int		m_nLastFramePeak;		// bytes in use at the high point of the last frame
+	int		m_nMaxFramePeak;		// worst frame so far
+	int		m_nLastFrameOverflow;	// bytes that went to the heap last frame
+	int		m_nOverflowFrames;		// frames that needed the heap
+	int		m_nFrames;
+};
+
+MEM_INTERFACE void *MemAllocFrame( int nMemSize );
+MEM_INTERFACE void MemGetFrameMark( MemFrameMark_t *pMark );
+MEM_INTERFACE void MemFreeToFrameMark( const MemFrameMark_t *pMark );
+
+// Releases all frame memory of the calling thread and records its peak usage
+MEM_INTERFACE void MemFrameReset();
+MEM_INTERFACE void MemGetFrameStats( MemFrameStats_t *pStats );
+
+// Releases the calling thread's arena; called by tier0 when a thread exits
+MEM_INTERFACE void MemFrameThreadDetach();
+
+// Rolls frame memory back to where it was when this object was constructed
+class CMemFrameMark
+{
+public:
+	CMemFrameMark()		{ MemGetFrameMark( &m_Mark ); }
+	~CMemFrameMark()	{ MemFreeToFrameMark( &m_Mark ); }
+
+private:
+	MemFrameMark_t m_Mark;
+};
+
+// Typed frame allocation
+template< class T >
+inline T *MemAllocFrameArray( int nCount )
+{
+	return (T *)MemAllocFrame( nCount * sizeof(T) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Memory pool statistics. Pools in every module register here so they can be
+// reported together (mem_dumpstats); a pool must unregister before its
+// module unloads.
+//-----------------------------------------------------------------------------
+struct MemPoolStats_t
+{
+	const char	*m_pName;
+	int			m_nBlockSize;
+	int			m_nBlocksAllocated;
+	int			m_nPeakAlloc;
+	int64		m_nTotalAllocs;
+	int			m_nCommittedBytes;
+	bool		m_bThreadSafe;
+};
+
+typedef void (*MemPoolStatsFunc_t)( const void *pPool, MemPoolStats_t *pStats );
+
+MEM_INTERFACE void MemRegisterPool( const void *pPool, MemPoolStatsFunc_t pfnGetStats );
+MEM_INTERFACE void MemUnregisterPool( const void *pPool );
+MEM_INTERFACE void MemDumpPoolStats();
+
 #ifdef _LINUX
 MEM_INTERFACE void ZeroMemory( void *mem, size_t length );
 #endif
@@ -0,0 +1,322 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Portable threading primitives. Interlocked operations, spin and
+//			OS mutexes, and simple thread creation.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef THREADTOOLS_H
+#define THREADTOOLS_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+
+#ifdef _LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// dll export stuff
+//-----------------------------------------------------------------------------
+#ifdef TIER0_DLL_EXPORT
+#define TT_INTERFACE	DLL_EXPORT
+#define TT_OVERLOAD		DLL_GLOBAL_EXPORT
+#define TT_CLASS		DLL_CLASS_EXPORT
+#else
+#define TT_INTERFACE	DLL_IMPORT
+#define TT_OVERLOAD		DLL_GLOBAL_IMPORT
+#define TT_CLASS		DLL_CLASS_IMPORT
+#endif
+
+#define TT_INFINITE		0xffffffff
+
+
+//-----------------------------------------------------------------------------
+// Interlocked operations. All of these act as full memory barriers.
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+
+extern "C"
+{
+	long __cdecl _InterlockedIncrement( volatile long* );
+	long __cdecl _InterlockedDecrement( volatile long* );
+	long __cdecl _InterlockedExchange( volatile long*, long );
+	long __cdecl _InterlockedExchangeAdd( volatile long*, long );
+	long __cdecl _InterlockedCompareExchange( volatile long*, long, long );
+	__int64 __cdecl _InterlockedCompareExchange64( volatile __int64*, __int64, __int64 );
+	void _ReadWriteBarrier();
+	void _mm_pause();
+	__declspec(dllimport) unsigned long __stdcall GetCurrentThreadId();
+}
+
+#pragma intrinsic( _InterlockedIncrement )
+#pragma intrinsic( _InterlockedDecrement )
+#pragma intrinsic( _InterlockedExchange )
+#pragma intrinsic( _InterlockedExchangeAdd )
+#pragma intrinsic( _InterlockedCompareExchange )
+#pragma intrinsic( _InterlockedCompareExchange64 )
+#pragma intrinsic( _ReadWriteBarrier )
+
+inline long ThreadInterlockedIncrement( long volatile *p )								{ return _InterlockedIncrement( p ); }
+inline long ThreadInterlockedDecrement( long volatile *p )								{ return _InterlockedDecrement( p ); }
+inline long ThreadInterlockedExchange( long volatile *p, long value )					{ return _InterlockedExchange( p, value ); }
+inline long ThreadInterlockedExchangeAdd( long volatile *p, long value )				{ return _InterlockedExchangeAdd( p, value ); }
+inline long ThreadInterlockedCompareExchange( long volatile *p, long value, long comperand ) { return _InterlockedCompareExchange( p, value, comperand ); }
+inline int64 ThreadInterlockedCompareExchange64( int64 volatile *p, int64 value, int64 comperand ) { return _InterlockedCompareExchange64( p, value, comperand ); }
+
+#if defined( _M_AMD64 )
+extern "C" void *_InterlockedCompareExchangePointer( void * volatile *, void *, void * );
+#pragma intrinsic( _InterlockedCompareExchangePointer )
+inline void *ThreadInterlockedCompareExchangePointer( void * volatile *p, void *value, void *comperand ) { return _InterlockedCompareExchangePointer( p, value, comperand ); }
+#else
+inline void *ThreadInterlockedCompareExchangePointer( void * volatile *p, void *value, void *comperand ) { return (void *)_InterlockedCompareExchange( (long volatile *)p, (long)value, (long)comperand ); }
+#endif
+
+// Same as MemoryBarrier() from winnt.h, which this header does not pull in:
+// a locked exchange fences the CPU and _ReadWriteBarrier fences the compiler
+inline void ThreadMemoryBarrier()				{ long barrier; _InterlockedExchange( &barrier, 0 ); _ReadWriteBarrier(); }
+inline void ThreadPause()						{ _mm_pause(); }
+inline unsigned long ThreadGetCurrentId()		{ return GetCurrentThreadId(); }
+
+#elif defined( _LINUX )
+
+inline long ThreadInterlockedIncrement( long volatile *p )								{ return __sync_add_and_fetch( p, 1 ); }
+inline long ThreadInterlockedDecrement( long volatile *p )								{ return __sync_sub_and_fetch( p, 1 ); }
+inline long ThreadInterlockedExchange( long volatile *p, long value )					{ return __sync_lock_test_and_set( p, value ); }
+inline long ThreadInterlockedExchangeAdd( long volatile *p, long value )				{ return __sync_fetch_and_add( p, value ); }
+inline long ThreadInterlockedCompareExchange( long volatile *p, long value, long comperand ) { return __sync_val_compare_and_swap( p, comperand, value ); }
+inline int64 ThreadInterlockedCompareExchange64( int64 volatile *p, int64 value, int64 comperand ) { return __sync_val_compare_and_swap( p, comperand, value ); }
+inline void *ThreadInterlockedCompareExchangePointer( void * volatile *p, void *value, void *comperand ) { return __sync_val_compare_and_swap( p, comperand, value ); }
+
+inline void ThreadMemoryBarrier()				{ __sync_synchronize(); }
+inline void ThreadPause()						{ __asm__ __volatile__( "pause" ); }
+inline unsigned long ThreadGetCurrentId()		{ return (unsigned long)pthread_self(); }
+
+#endif
+
+inline bool ThreadInterlockedAssignIf( long volatile *p, long value, long comperand )
+{
+	return ( ThreadInterlockedCompareExchange( p, value, comperand ) == comperand );
+}
+
+inline bool ThreadInterlockedAssignPointerIf( void * volatile *p, void *value, void *comperand )
+{
+	return ( ThreadInterlockedCompareExchangePointer( p, value, comperand ) == comperand );
+}
+
+// 64 bit interlocked operands should be declared with this; 32 bit compilers
+// only align int64 members to 4 bytes
+#ifdef _WIN32
+#define TT_ALIGN8	__declspec( align( 8 ) )
+#else
+#define TT_ALIGN8	__attribute__(( aligned( 8 ) ))
+#endif
+
+inline bool ThreadInterlockedAssignIf64( int64 volatile *p, int64 value, int64 comperand )
+{
+	return ( ThreadInterlockedCompareExchange64( p, value, comperand ) == comperand );
+}
+
+
+//-----------------------------------------------------------------------------
+// Static thread local storage. Only use this in modules that are loaded when
+// the process starts (tier0, launchers); DLLs loaded later on older versions
+// of Windows don't get their __declspec(thread) data set up.
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+#define TT_THREAD_LOCAL		__declspec( thread )
+#else
+#define TT_THREAD_LOCAL		__thread
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Thread creation
+//-----------------------------------------------------------------------------
+typedef void *ThreadHandle_t;
+typedef unsigned (*ThreadFunc_t)( void *pParam );
+
+TT_INTERFACE ThreadHandle_t CreateSimpleThread( ThreadFunc_t pfnThread, void *pParam, unsigned stackSize = 0 );
+TT_INTERFACE bool ReleaseThreadHandle( ThreadHandle_t hThread );
+
+// Waits for the thread to exit. The handle must still be released afterwards.
+TT_INTERFACE bool ThreadJoin( ThreadHandle_t hThread, unsigned timeout = TT_INFINITE );
+
+TT_INTERFACE void ThreadSleep( unsigned nMilliseconds = 0 );
+
+// Number of hardware threads, used to size worker pools
+TT_INTERFACE int ThreadGetProcessorCount();
+
+
+//-----------------------------------------------------------------------------
+// CThreadFastMutex: a recursive spin lock. Use for very short critical
+// sections where entering the kernel would cost more than the work.
+//-----------------------------------------------------------------------------
+class CThreadFastMutex
+{
+public:
+	CThreadFastMutex() : m_ownerID( 0 ), m_depth( 0 ) {}
+
+	bool TryLock()
+	{
+		long threadId = (long)ThreadGetCurrentId();
+		if ( m_ownerID == threadId )
+		{
+			++m_depth;
+			return true;
+		}
+
+		if ( ThreadInterlockedAssignIf( &m_ownerID, threadId, 0 ) )
+		{
+			m_depth = 1;
+			return true;
+		}
+		return false;
+	}
+
+	void Lock()
+	{
+		if ( TryLock() )
+			return;
+
+		long threadId = (long)ThreadGetCurrentId();
+		int nSpins = 0;
+		for ( ;; )
+		{
+			// Spin on a plain read so we don't hammer the bus with locked ops
+			if ( m_ownerID == 0 && ThreadInterlockedAssignIf( &m_ownerID, threadId, 0 ) )
+				break;
+
+			if ( ++nSpins < 1000 )
+			{
+				ThreadPause();
+			}
+			else
+			{
+				ThreadSleep( 0 );
+				nSpins = 0;
+			}
+		}
+		m_depth = 1;
+	}
+
+	void Unlock()
+	{
+		AssertOwnedByCurrentThread();
+		if ( --m_depth == 0 )
+		{
+			ThreadInterlockedExchange( &m_ownerID, 0 );
+		}
+	}
+
+	bool AssertOwnedByCurrentThread()
+	{
+		Assert( m_ownerID == (long)ThreadGetCurrentId() );
+		return ( m_ownerID == (long)ThreadGetCurrentId() );
+	}
+
+private:
+	volatile long	m_ownerID;
+	int				m_depth;
+};
+
+
+//-----------------------------------------------------------------------------
+// CThreadMutex: a recursive OS mutex. Waiters block in the kernel instead
+// of spinning, so use this when the lock may be held for a while.
+//-----------------------------------------------------------------------------
+class TT_CLASS CThreadMutex
+{
+public:
+	CThreadMutex();
+	~CThreadMutex();
+
+	void Lock();
+	void Unlock();
+	bool TryLock();
+
+private:
+	// Disallow copying
+	CThreadMutex( const CThreadMutex & );
+	CThreadMutex &operator=( const CThreadMutex & );
+
+#ifdef _WIN32
+	// Large enough to hold a CRITICAL_SECTION without pulling in windows.h
+#if defined( _M_AMD64 )
+	unsigned char m_CriticalSection[40];
+#else
+	unsigned char m_CriticalSection[24];
+#endif
+#elif defined( _LINUX )
+	pthread_mutex_t m_Mutex;
+#endif
+};
+
+
+//-----------------------------------------------------------------------------
+// CThreadEvent: a waitable flag. Auto-reset events release one waiter and
+// clear themselves; manual-reset events stay set until Reset().
+//-----------------------------------------------------------------------------
+class TT_CLASS CThreadEvent
+{
+public:
+	CThreadEvent( bool bManualReset = false );
+	~CThreadEvent();
+
+	void Set();
+	void Reset();
+
+	// Returns false if the timeout expired before the event was set
+	bool Wait( unsigned timeout = TT_INFINITE );
+
+private:
+	// Disallow copying
+	CThreadEvent( const CThreadEvent & );
+	CThreadEvent &operator=( const CThreadEvent & );
+
+#ifdef _WIN32
+	void			*m_hEvent;
+#elif defined( _LINUX )
+	pthread_mutex_t	m_Mutex;
+	pthread_cond_t	m_Condition;
+	bool			m_bManualReset;
+	bool			m_bSignaled;
+#endif
+};
+
+
+//-----------------------------------------------------------------------------
+// Scoped locking helper
+//-----------------------------------------------------------------------------
+template< class MUTEX_TYPE >
+class CAutoLockT
+{
+public:
+	CAutoLockT( MUTEX_TYPE &lock ) : m_lock( lock )	{ m_lock.Lock(); }
+	~CAutoLockT()									{ m_lock.Unlock(); }
+
+private:
+	MUTEX_TYPE &m_lock;
+
+	CAutoLockT<MUTEX_TYPE> &operator=( const CAutoLockT<MUTEX_TYPE> & );
+};
+
+typedef CAutoLockT<CThreadMutex>		CAutoLock;
+typedef CAutoLockT<CThreadFastMutex>	CAutoFastLock;
+
+#define AUTO_LOCK_CAT2( a, b )		a##b
+#define AUTO_LOCK_CAT( a, b )		AUTO_LOCK_CAT2( a, b )
+
+#define AUTO_LOCK_( type, mutex )	CAutoLockT< type > AUTO_LOCK_CAT( _autolock_, __LINE__ )( mutex )
+#define AUTO_LOCK( mutex )			AUTO_LOCK_( CThreadMutex, mutex )
+#define AUTO_LOCK_FM( mutex )		AUTO_LOCK_( CThreadFastMutex, mutex )
+
+
+#endif // THREADTOOLS_H
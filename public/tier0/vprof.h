@@ -10,6 +10,7 @@
 
 #include "tier0/dbg.h"
 #include "tier0/fasttimer.h"
+#include "tier0/threadtools.h"
 
 
 #define VPROF_ENABLED
@@ -212,6 +213,18 @@ enum VProfReportType_t
 	VPRT_LIST_BY_PEAK_OVER_AVERAGE,
 };
 
+class CVProfThread;
+
+// Operations the main thread hands to the thread trees
+enum VProfThreadOp_t
+{
+	VPT_MARK_FRAME	= 0x01,
+	VPT_RESET		= 0x02,
+	VPT_RESET_PEAKS	= 0x04,
+};
+
+#define VPROF_TRACE_BUFFER_SIZE	65536		// events kept per thread, must be a power of two
+
 class DBG_CLASS CVProfile 
 {
 public:
@@ -260,13 +273,53 @@ public:
 	int BudgetGroupNameToBudgetGroupID( const char *pBudgetGroupName );
 	void RegisterNumBudgetGroupsChangedCallBack( void (*pCallBack)(void) );
 
+	//
+	// Threads. Scopes entered off the main thread are profiled into a tree
+	// owned by that thread, so entering and leaving a scope never takes a
+	// lock. Threads made by CreateSimpleThread register their tree when they
+	// start; any other thread is skipped until it calls RegisterThread or
+	// SetThreadName. A thread tree moves on to a new frame the next time its
+	// thread is outside of all its scopes, so its previous frame can lag the
+	// main tree by a frame. Budget group IDs are shared by all the trees.
+	//
+	bool InMainThread() const;
+	void RegisterThread();
+	void SetThreadName( const char *pszName );	// names the calling thread in reports and traces
+
+	int GetNumThreads();						// not counting the main thread
+	CVProfNode *GetThreadRoot( int iThread );
+	const char *GetThreadName( int iThread );
+
+	//
+	// Timeline tracing. While a trace is running every scope on every thread
+	// is also logged with its start time, along with a marker for each
+	// frame. WriteTrace saves the last VPROF_TRACE_BUFFER_SIZE events of each
+	// thread as Chrome trace event JSON, for chrome://tracing or Perfetto.
+	//
+	void StartTrace();
+	void StopTrace();
+	bool IsTracing() const;
+	bool WriteTrace( const char *pszFilename );
+
 private:
 	void SumTimes( const char *pszStartNode, int budgetGroupID );
-	void SumTimes( CVProfNode *pNode, int budgetGroupID );
-	void DumpNodes( CVProfNode *pNode, int indent );
+	void SumTimes( CVProfNode *pNode, CVProfNode *pRoot, int budgetGroupID );
+	void DumpNodes( CVProfNode *pNode, CVProfNode *pRoot, int indent );
 	int FindBudgetGroupName( const char *pBudgetGroupName );
 	int AddBudgetGroupName( const char *pBudgetGroupName );
 
+	CVProfThread *GetThread();
+	CVProfThread *GetThreadByIndex( int iThread );
+	void EnterThreadScope( const char *pszName, int detailLevel, const char *pBudgetGroupName );
+	void ExitThreadScope();
+	void PostToThreads( int flags );
+	void MarkThreadFrames();
+	void TraceEnter( const char *pszName );
+	void TraceExit( int budgetGroupID );
+	void TraceEnter( CVProfThread *pThread, const char *pszName );
+	void TraceExit( CVProfThread *pThread, int budgetGroupID );
+	void TraceFrame();
+
 	int 		m_enabled;
 	bool		m_fAtRoot; // tracked for efficiency of the "not profiling" case
 	CVProfNode *m_pCurNode;
@@ -274,10 +327,20 @@ private:
 	int			m_nFrames;
 	int			m_ProfileDetailLevel;
 	int			m_pausedEnabledDepth;
-	char		**m_pBudgetGroupNames;
+	char		**m_pBudgetGroupNames;	// outgrown arrays are chained behind the last slot
 	int			m_nBudgetGroupNamesAllocated;
 	int			m_nBudgetGroupNames;
 	void		(*m_pNumBudgetGroupsChangedCallBack)(void);
+	bool		m_bBudgetGroupsChanged;		// by another thread, callback is still due
+	CThreadFastMutex m_BudgetGroupLock;
+
+	unsigned long	m_MainThreadID;
+	CVProfThread * volatile m_pThreads;
+	long volatile	m_nThreadsInScope;	// threads other than main below their root
+
+	int			m_bTracing;
+	long		m_nTraceGeneration;
+	int64		m_TraceStart;
 };
 
 //-------------------------------------
@@ -536,14 +599,34 @@ inline void CVProfile::Stop()
 
 //-------------------------------------
 
+inline bool CVProfile::InMainThread() const
+{
+	return ( ThreadGetCurrentId() == m_MainThreadID );
+}
+
+//-------------------------------------
+
+inline bool CVProfile::IsTracing() const
+{
+	return ( m_bTracing != 0 );
+}
+
+//-------------------------------------
+
 inline void CVProfile::EnterScope( const char *pszName, int detailLevel, const char *pBudgetGroupName, bool bAssertAccounted )
 {
-	if ( m_enabled != 0 || !m_fAtRoot ) // if became disabled, need to unwind back to root before stopping
+	// Nothing is being profiled anywhere, so skip the thread lookup
+	if ( m_enabled == 0 && m_fAtRoot && m_nThreadsInScope == 0 )
+		return;
+
+	if ( !InMainThread() )
 	{
-		// Only account for vprof stuff on the primary thread.
-		//if( !Plat_IsPrimaryThread() )
-		//	return;
+		EnterThreadScope( pszName, detailLevel, pBudgetGroupName );
+		return;
+	}
 
+	if ( m_enabled != 0 || !m_fAtRoot ) // if became disabled, need to unwind back to root before stopping
+	{
 		if ( pszName != m_pCurNode->GetName() ) 
 		{
 			m_pCurNode = m_pCurNode->GetSubNode( pszName, detailLevel, pBudgetGroupName );
@@ -557,6 +640,11 @@ inline void CVProfile::EnterScope( const char *pszName, int detailLevel, const c
 #endif
 		m_pCurNode->EnterScope();
 		m_fAtRoot = false;
+
+		if ( m_bTracing )
+		{
+			TraceEnter( pszName );
+		}
 	}
 }
 
@@ -564,11 +652,21 @@ inline void CVProfile::EnterScope( const char *pszName, int detailLevel, const c
 
 inline void CVProfile::ExitScope()
 {
+	if ( m_enabled == 0 && m_fAtRoot && m_nThreadsInScope == 0 )
+		return;
+
+	if ( !InMainThread() )
+	{
+		ExitThreadScope();
+		return;
+	}
+
 	if ( !m_fAtRoot || m_enabled != 0 )
 	{
-		// Only account for vprof stuff on the primary thread.
-		//if( !Plat_IsPrimaryThread() )
-		//	return;
+		if ( m_bTracing )
+		{
+			TraceExit( m_pCurNode->GetBudgetGroupID() );
+		}
 
 		// ExitScope will indicate whether we should back up to our parent (we may
 		// be profiling a recursive function)
@@ -605,6 +703,7 @@ inline void CVProfile::Reset()
 {
 	m_Root.Reset(); 
 	m_nFrames = 0;
+	PostToThreads( VPT_RESET );
 }
 
 //-------------------------------------
@@ -612,6 +711,7 @@ inline void CVProfile::Reset()
 inline void CVProfile::ResetPeaks()
 {
 	m_Root.ResetPeak(); 
+	PostToThreads( VPT_RESET_PEAKS );
 }
 
 //-------------------------------------
@@ -624,6 +724,7 @@ inline void CVProfile::MarkFrame()
 		m_Root.ExitScope();
 		m_Root.MarkFrame(); 
 		m_Root.EnterScope();
+		MarkThreadFrames();
 	}
 }
 
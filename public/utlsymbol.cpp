@@ -13,6 +13,7 @@
 
 #pragma warning (disable:4514)
 
+#include <ctype.h>
 #include "utlsymbol.h"
 #include "tier0/memdbgon.h"
 
@@ -213,3 +214,233 @@ void CUtlSymbolTable::RemoveAll()
 	m_Strings.RemoveAll();
 }
 
+
+
+//-----------------------------------------------------------------------------
+// Thread-safe symbol table
+//-----------------------------------------------------------------------------
+
+CUtlSymbolTableMT::CUtlSymbolTableMT( int growSize, int initSize, bool caseInsensitive ) :
+	m_bInsensitive( caseInsensitive )
+{
+	// Aim for short chains at the expected size; the table can't rehash
+	// without blocking readers.
+	int nBuckets = 64;
+	while ( nBuckets < initSize * 2 && nBuckets < 65536 )
+	{
+		nBuckets <<= 1;
+	}
+
+	m_nBucketMask = nBuckets - 1;
+	m_pBuckets = (UtlSymId_t*)malloc( nBuckets * sizeof(UtlSymId_t) );
+	memset( (void*)m_pBuckets, 0xFF, nBuckets * sizeof(UtlSymId_t) );
+
+	memset( (void*)m_pPages, 0, sizeof(m_pPages) );
+	m_nSymbols = 0;
+
+	for ( int i = 0; i < SHARD_COUNT; ++i )
+	{
+		m_Shards[i].m_pStrings = NULL;
+	}
+}
+
+CUtlSymbolTableMT::~CUtlSymbolTableMT()
+{
+	RemoveAll();
+	free( (void*)m_pBuckets );
+}
+
+
+//-----------------------------------------------------------------------------
+// FNV-1a, folding case for insensitive tables so "Foo" and "foo" share a bucket
+//-----------------------------------------------------------------------------
+
+unsigned int CUtlSymbolTableMT::HashString( char const* pString ) const
+{
+	unsigned int nHash = 2166136261u;
+	if ( m_bInsensitive )
+	{
+		for ( unsigned char const* p = (unsigned char const*)pString; *p; ++p )
+		{
+			nHash = ( nHash ^ tolower( *p ) ) * 16777619u;
+		}
+	}
+	else
+	{
+		for ( unsigned char const* p = (unsigned char const*)pString; *p; ++p )
+		{
+			nHash = ( nHash ^ *p ) * 16777619u;
+		}
+	}
+	return nHash;
+}
+
+inline CUtlSymbolTableMT::Symbol_t* CUtlSymbolTableMT::GetSymbol( UtlSymId_t id ) const
+{
+	return &m_pPages[ id >> SYMBOL_PAGE_SHIFT ][ id & ( SYMBOL_PAGE_SIZE - 1 ) ];
+}
+
+
+//-----------------------------------------------------------------------------
+// Walks a bucket chain. Safe against concurrent inserts because a symbol is
+// fully written before it's linked in at the head of its chain.
+//-----------------------------------------------------------------------------
+
+UtlSymId_t CUtlSymbolTableMT::FindInBucket( int nBucket, unsigned int nHash, char const* pString ) const
+{
+	UtlSymId_t id = m_pBuckets[nBucket];
+	while ( id != UTL_INVAL_SYMBOL )
+	{
+		Symbol_t const* pSymbol = GetSymbol( id );
+		if ( pSymbol->m_nHash == nHash )
+		{
+			int nCmp = m_bInsensitive ? Q_stricmp( pSymbol->m_pString, pString ) : strcmp( pSymbol->m_pString, pString );
+			if ( nCmp == 0 )
+				return id;
+		}
+		id = pSymbol->m_nNext;
+	}
+	return UTL_INVAL_SYMBOL;
+}
+
+CUtlSymbol CUtlSymbolTableMT::Find( char const* pString ) const
+{
+	if (!pString)
+		return CUtlSymbol();
+
+	unsigned int nHash = HashString( pString );
+	return CUtlSymbol( FindInBucket( nHash & m_nBucketMask, nHash, pString ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Returns storage for a symbol id, allocating its page if need be. Pages can
+// be claimed by any shard, so they're installed with a compare-exchange.
+//-----------------------------------------------------------------------------
+
+CUtlSymbolTableMT::Symbol_t* CUtlSymbolTableMT::AllocSymbol( UtlSymId_t id )
+{
+	Symbol_t* volatile* ppPage = &m_pPages[ id >> SYMBOL_PAGE_SHIFT ];
+	if ( !*ppPage )
+	{
+		Symbol_t* pNewPage = (Symbol_t*)malloc( SYMBOL_PAGE_SIZE * sizeof(Symbol_t) );
+		if ( !ThreadInterlockedAssignPointerIf( (void * volatile *)ppPage, pNewPage, NULL ) )
+		{
+			free( pNewPage );
+		}
+	}
+	return GetSymbol( id );
+}
+
+char const* CUtlSymbolTableMT::CopyString( Shard_t &shard, char const* pString )
+{
+	int len = strlen(pString) + 1;
+
+	StringBlock_t* pBlock = shard.m_pStrings;
+	if ( !pBlock || pBlock->m_nUsed + len > pBlock->m_nSize )
+	{
+		int nSize = max( (int)STRING_BLOCK_SIZE, len );
+		pBlock = (StringBlock_t*)malloc( sizeof(StringBlock_t) + nSize );
+		pBlock->m_nUsed = 0;
+		pBlock->m_nSize = nSize;
+		pBlock->m_pNext = shard.m_pStrings;
+		shard.m_pStrings = pBlock;
+	}
+
+	char* pDest = (char*)( pBlock + 1 ) + pBlock->m_nUsed;
+	memcpy( pDest, pString, len * sizeof(char) );
+	pBlock->m_nUsed += len;
+	return pDest;
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds and/or creates a symbol based on the string
+//-----------------------------------------------------------------------------
+
+CUtlSymbol CUtlSymbolTableMT::AddString( char const* pString )
+{
+	if (!pString) 
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	unsigned int nHash = HashString( pString );
+	int nBucket = nHash & m_nBucketMask;
+
+	// Most calls are for strings that already exist; don't lock for those
+	UtlSymId_t id = FindInBucket( nBucket, nHash, pString );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	Shard_t &shard = m_Shards[ nBucket & ( SHARD_COUNT - 1 ) ];
+	AUTO_LOCK_FM( shard.m_Lock );
+
+	// Someone else may have inserted it while we waited for the lock
+	id = FindInBucket( nBucket, nHash, pString );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	long nIndex;
+	do
+	{
+		nIndex = m_nSymbols;
+		if ( nIndex >= MAX_SYMBOLS )
+		{
+			Assert( !"CUtlSymbolTableMT: out of symbols" );
+			return CUtlSymbol( UTL_INVAL_SYMBOL );
+		}
+	} while ( !ThreadInterlockedAssignIf( &m_nSymbols, nIndex + 1, nIndex ) );
+
+	id = (UtlSymId_t)nIndex;
+	Symbol_t* pSymbol = AllocSymbol( id );
+	pSymbol->m_pString = CopyString( shard, pString );
+	pSymbol->m_nHash = nHash;
+	pSymbol->m_nNext = m_pBuckets[nBucket];
+
+	// Publish only once the symbol is complete
+	ThreadMemoryBarrier();
+	m_pBuckets[nBucket] = id;
+
+	return CUtlSymbol( id );
+}
+
+
+//-----------------------------------------------------------------------------
+// Look up the string associated with a particular symbol
+//-----------------------------------------------------------------------------
+
+char const* CUtlSymbolTableMT::String( CUtlSymbol id ) const
+{
+	if (!id.IsValid()) 
+		return "";
+
+	Assert( (UtlSymId_t)id < m_nSymbols );
+	return GetSymbol( id )->m_pString;
+}
+
+
+//-----------------------------------------------------------------------------
+// Remove all symbols in the table.
+//-----------------------------------------------------------------------------
+
+void CUtlSymbolTableMT::RemoveAll()
+{
+	memset( (void*)m_pBuckets, 0xFF, ( m_nBucketMask + 1 ) * sizeof(UtlSymId_t) );
+
+	for ( int i = 0; i < SYMBOL_PAGE_COUNT; ++i )
+	{
+		free( m_pPages[i] );
+		m_pPages[i] = NULL;
+	}
+	m_nSymbols = 0;
+
+	for ( int i = 0; i < SHARD_COUNT; ++i )
+	{
+		StringBlock_t* pNext;
+		for ( StringBlock_t* pBlock = m_Shards[i].m_pStrings; pBlock; pBlock = pNext )
+		{
+			pNext = pBlock->m_pNext;
+			free( pBlock );
+		}
+		m_Shards[i].m_pStrings = NULL;
+	}
+}
@@ -16,6 +16,7 @@
 
 #include "utlrbtree.h"
 #include "utlvector.h"
+#include "tier0/threadtools.h"
 
 //-----------------------------------------------------------------------------
 // forward declarations
@@ -120,4 +121,93 @@ protected:
 };
 
 
+//-----------------------------------------------------------------------------
+// CUtlSymbolTableMT:
+// description:
+//    A thread-safe version of CUtlSymbolTable with the same interface and
+//    symbol handles. Symbols live in a fixed-size hash table with chained
+//    buckets; Find() and String() never take a lock, and AddString() only
+//    locks the one shard that owns the string's bucket. Symbols and their
+//    string data never move once published, so handles and returned string
+//    pointers stay valid until RemoveAll().
+//
+//    RemoveAll() is not thread-safe; no other thread may be using the table.
+//-----------------------------------------------------------------------------
+
+class CUtlSymbolTableMT
+{
+public:
+	// growSize is unused and only here to match CUtlSymbolTable. The bucket
+	// count is derived from initSize and never changes.
+	CUtlSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false );
+	~CUtlSymbolTableMT();
+
+	// Finds and/or creates a symbol based on the string
+	CUtlSymbol AddString( char const* pString );
+
+	// Finds the symbol for pString
+	CUtlSymbol Find( char const* pString ) const;
+
+	// Look up the string associated with a particular symbol
+	char const* String( CUtlSymbol id ) const;
+
+	// Number of symbols in the table
+	int GetNumStrings() const { return m_nSymbols; }
+
+	// Remove all symbols in the table.
+	void  RemoveAll();
+
+private:
+	enum
+	{
+		SYMBOL_PAGE_SHIFT = 8,
+		SYMBOL_PAGE_SIZE = ( 1 << SYMBOL_PAGE_SHIFT ),
+		SYMBOL_PAGE_COUNT = ( 65536 >> SYMBOL_PAGE_SHIFT ),
+		MAX_SYMBOLS = UTL_INVAL_SYMBOL,
+
+		SHARD_COUNT = 16,
+		STRING_BLOCK_SIZE = 4096,
+	};
+
+	struct Symbol_t
+	{
+		char const*		m_pString;
+		unsigned int	m_nHash;
+		UtlSymId_t		m_nNext;		// next symbol in the same bucket
+	};
+
+	struct StringBlock_t
+	{
+		StringBlock_t*	m_pNext;
+		int				m_nUsed;
+		int				m_nSize;
+	};
+
+	// Inserts into buckets owned by a shard are serialized by its lock,
+	// and each shard carves strings out of its own blocks.
+	struct Shard_t
+	{
+		CThreadFastMutex	m_Lock;
+		StringBlock_t*		m_pStrings;
+	};
+
+	unsigned int HashString( char const* pString ) const;
+	UtlSymId_t FindInBucket( int nBucket, unsigned int nHash, char const* pString ) const;
+	Symbol_t* GetSymbol( UtlSymId_t id ) const;
+	Symbol_t* AllocSymbol( UtlSymId_t id );
+	char const* CopyString( Shard_t &shard, char const* pString );
+
+	// Heads of the bucket chains
+	UtlSymId_t volatile*	m_pBuckets;
+	int						m_nBucketMask;
+
+	// Symbols are stored in pages that are never reallocated
+	Symbol_t* volatile		m_pPages[SYMBOL_PAGE_COUNT];
+	long volatile			m_nSymbols;
+
+	Shard_t					m_Shards[SHARD_COUNT];
+	bool					m_bInsensitive;
+};
+
+
 #endif // UTLSYMBOL_H
@@ -107,13 +107,21 @@ enum PhysInterfaceId_t
 class ISave;
 class IRestore;
 
-#define VPHYSICS_INTERFACE_VERSION	"VPhysics029"
+// Broadphase used to find the object pairs that need collision checks
+enum physbroadphase_t
+{
+	PHYSICS_BROADPHASE_OVTREE = 0,	// octree of cubes (default)
+	PHYSICS_BROADPHASE_BVH,			// dynamic bounding box tree, cheaper updates for many moving objects
+};
+
+#define VPHYSICS_INTERFACE_VERSION	"VPhysics033"
 class IPhysics
 {
 public:
 	virtual	IPhysicsEnvironment		*CreateEnvironment( void ) = 0;
 	virtual void DestroyEnvironment( IPhysicsEnvironment * ) = 0;
 	virtual IPhysicsEnvironment		*GetActiveEnvironmentByIndex( int index ) = 0;
+	virtual	IPhysicsEnvironment		*CreateEnvironmentEx( physbroadphase_t broadphase ) = 0;
 };
 
 
@@ -429,6 +437,42 @@ public:
 	virtual int ShouldSolvePenetration( IPhysicsObject *pObj0, IPhysicsObject *pObj1, void *pGameData0, void *pGameData1, float dt ) = 0;
 };
 
+// Energy based sleeping. Speeds count rotation too: an object is as slow as
+// a sliding object with the same kinetic energy per mass. 0 disables a check.
+struct physsleepparams_t
+{
+	float	sleepSpeed;			// in/s, objects slower than this for a moment go to sleep even if they jitter in place
+	float	islandSleepSpeed;	// in/s, touching objects whose mass weighted speed is lower sleep together
+	float	wakeRampTime;		// seconds after waking during which the sleep speed is raised
+	float	wakeRampScale;		// sleep speed multiplier right after waking, falls to 1 over wakeRampTime
+};
+
+struct physsleepstats_t
+{
+	// now
+	int		objects;			// moveable objects
+	int		awake;				// being simulated
+	int		settling;			// awake, but no longer moving enough to pass the movement check
+
+	// since the last reset
+	float	awakeSeconds;		// simulated seconds summed over the awake objects
+	float	settlingSeconds;	// part of awakeSeconds spent settling
+	float	asleepSeconds;		// simulated seconds summed over the sleeping and static objects
+	float	simulateMS;			// time spent in Simulate
+	int		sleeps;				// objects that went to sleep
+	int		wakes;				// objects that woke up
+	int		islandsSlept;		// groups of touching objects that went to sleep together
+	int		islandsSleptByEnergy;	// part of islandsSlept that only the island speed let sleep
+	int		objectsCalmByEnergy;	// times the sleep speed let an object sleep that was still moving
+};
+
+// Running totals since the environment was created
+struct physbroadphasestats_t
+{
+	int		updates;			// objects moved in the broadphase
+	int		pairs;				// overlapping pairs reported by those moves
+};
+
 class IPhysicsEnvironment
 {
 public:
@@ -535,6 +579,11 @@ public:
 	// get the number of ticks simulated in the last call to simulate
 	virtual int GetTimestepsSimulatedLast() = 0;
 
+	virtual void GetBroadphaseStats( physbroadphasestats_t &stats ) = 0;
+
+	virtual void SetSleepParams( const physsleepparams_t &params ) = 0;
+	virtual void GetSleepStats( physsleepstats_t &stats, bool bReset ) = 0;
+
 	// UNDONE: Expose spatial callback oriented controllers (you could implement AI-based or more complex fluid with this)
 	//			Physics trigger / phantom object
 	// UNDONE: Expose performance scalability options
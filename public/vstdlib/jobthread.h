@@ -0,0 +1,38 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Process wide pool of worker threads for splitting a loop of
+//			independent items across the cores. The calling thread works on
+//			the items too and ParallelProcess returns once they are all done.
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef JOBTHREAD_H
+#define JOBTHREAD_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "vstdlib/vstdlib.h"
+
+// Called once per item, from the caller or from any worker
+typedef void (*ParallelItemFunc_t)( void *pContext, int nItem );
+
+class IThreadPool
+{
+public:
+	// Threads that can run items at once, counting the caller. Sized from
+	// the processor count, or from -threads on the command line.
+	virtual int		NumThreads() const = 0;
+
+	// Runs pfnItem for items 0..nItems-1 and waits for them all. Items are
+	// handed out in order but finish in any order. nMaxThreads limits the
+	// threads used (0 = all). A call made while the pool is already busy,
+	// including one made from inside an item, runs its items serially.
+	virtual void	ParallelProcess( ParallelItemFunc_t pfnItem, void *pContext, int nItems, int nMaxThreads = 0 ) = 0;
+};
+
+VSTDLIB_INTERFACE IThreadPool *ThreadPool();
+
+#endif // JOBTHREAD_H
@@ -64,6 +64,7 @@ CStudioRender::CStudioRender()
 	m_nForcedMaterialType = OVERRIDE_NORMAL;
 	m_ColorMod[0] = m_ColorMod[1] = m_ColorMod[2] = 1.0f;
 	m_AlphaMod = 1.0f;
+	m_nFrameCount = 0;
 
 	// Cache-align our important matrices
 	g_pMemAlloc->PushAllocDbgInfo( __FILE__, __LINE__ );
@@ -206,6 +207,7 @@ void CStudioRender::BeginFrame( void )
 	m_bSupportsVertexAndPixelShaders = m_pMaterialSystemHardwareConfig->SupportsVertexAndPixelShaders();
 	m_bSupportsOverbright = m_pMaterialSystemHardwareConfig->SupportsOverbright();
 
+	++m_nFrameCount;
 
 }
 
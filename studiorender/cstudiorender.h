@@ -487,6 +487,7 @@ private:
 
 	// Helper methods related to flexing vertices
 	void R_StudioFlexVerts( mstudiomesh_t *pmesh );
+	studioflexdata_t *R_StudioBuildFlexData( mstudiomesh_t *pmesh );
 
 	// Avoid some warnings...
 	CStudioRender( CStudioRender const& );
@@ -567,6 +568,9 @@ private:
 	// Flex data
 	CCachedRenderData	m_VertexCache;
 
+	// Flex results are only reused within a frame
+	int m_nFrameCount;
+
 	friend class CGlintTextureRegenerator;
 
 	// Cached variables:
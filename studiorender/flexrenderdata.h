@@ -43,6 +43,45 @@ struct CachedVertex_t
 	}
 };
 
+//-----------------------------------------------------------------------------
+// Per mesh flex data, built the first time a mesh is flexed. The active set
+// is every vertex any of the mesh's flexes move, so deltas can be summed
+// into dense arrays instead of going through the vertex cache per delta.
+// The last few results are kept for the frame, keyed by the flex weights,
+// so a face drawn from several views is only flexed once.
+//-----------------------------------------------------------------------------
+
+#define FLEX_RESULT_CACHE_SIZE	4
+
+struct FlexResult_t
+{
+	int								m_nFrame;
+	int								m_nLastUsed;
+	CUtlVector< float >				m_Weights;		// one per mesh flex
+	CUtlVector< unsigned short >	m_Slots;		// active slots that were moved
+	CUtlVector< CachedVertex_t >	m_Verts;		// flexed vertices, parallel to m_Slots
+
+	FlexResult_t() : m_nFrame(-1), m_nLastUsed(0) {}
+};
+
+struct studioflexdata_t
+{
+	CUtlVector< unsigned short >	m_ActiveVerts;		// active slot -> mesh vertex
+	CUtlVector< int >				m_FlexFirstSlot;	// per flex, first entry in m_VertSlots
+	CUtlVector< unsigned short >	m_VertSlots;		// per vertanim, its active slot
+
+	// Scratch, four floats per active slot
+	CUtlVector< float >				m_PositionDelta;
+	CUtlVector< float >				m_NormalDelta;
+	CUtlVector< unsigned char >		m_Moved;
+
+	CUtlVector< float >				m_Weights;			// this draw's weights, one per flex
+	FlexResult_t					m_Results[FLEX_RESULT_CACHE_SIZE];
+	int								m_nUseCount;
+
+	studioflexdata_t() : m_nUseCount(0) {}
+};
+
 class CCachedRenderData
 {
 public:
@@ -768,6 +768,10 @@ bool CStudioRender::R_StudioCreateStaticMeshes(const char *pModelName, studiohdr
 	
 	Assert( !*ppStudioMeshes );
 	*ppStudioMeshes = new studiomeshdata_t[numStudioMeshes];
+	for ( int nMesh = 0; nMesh < numStudioMeshes; ++nMesh )
+	{
+		(*ppStudioMeshes)[nMesh].m_pFlexData = NULL;
+	}
 
 	int					i, j, k;
 
@@ -889,6 +893,12 @@ void CStudioRender::R_StudioDestroyStaticMeshes( int numStudioMeshes, studiomesh
 			delete[] pMesh->m_pMeshGroup;
 			pMesh->m_pMeshGroup = 0;
 		}
+
+		if (pMesh->m_pFlexData)
+		{
+			delete pMesh->m_pFlexData;
+			pMesh->m_pFlexData = 0;
+		}
 	}
 
 	if (*ppStudioMeshes)
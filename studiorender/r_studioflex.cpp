@@ -23,6 +23,7 @@
 #include "cstudiorender.h"
 #include "pixelwriter.h"
 #include "vtf/vtf.h"
+#include <xmmintrin.h>
 
 #define GLINT_SUPERSAMPLE_COUNT 2
 #define GLINT_SUPERSAMPLE_COUNT_SQ (GLINT_SUPERSAMPLE_COUNT*GLINT_SUPERSAMPLE_COUNT)
@@ -239,9 +240,16 @@ void CStudioRender::R_StudioFlexVerts( mstudiomesh_t *pmesh )
 	
 	m_VertexCache.SetupComputation( pmesh, m_pStudioHdr, true );
 
-	// apply flex weights
-	int i, j, n;
+	studiomeshdata_t *pMeshData = &m_pStudioMeshes[StudioMesh_GetMeshId(m_pStudioHdr, pmesh)];
+	if (!pMeshData->m_pFlexData)
+	{
+		pMeshData->m_pFlexData = R_StudioBuildFlexData( pmesh );
+	}
+	studioflexdata_t *pFlexData = pMeshData->m_pFlexData;
 
+	// compute flex weights
+	int i, j;
+	bool bAnyActive = false;
 	for (i = 0; i < pmesh->numflexes; i++)
 	{
 		float w = m_FlexWeights[pflex[i].flexdesc];
@@ -249,7 +257,7 @@ void CStudioRender::R_StudioFlexVerts( mstudiomesh_t *pmesh )
 		if (w <= pflex[i].target0 || w >= pflex[i].target3)
 		{
 			// value outside of range
-			continue;
+			w = 0.0f;
 		}
 		else if (w < pflex[i].target1)
 		{
@@ -268,45 +276,170 @@ void CStudioRender::R_StudioFlexVerts( mstudiomesh_t *pmesh )
 		}
 
 		if (w > -0.001 && w < 0.001)
+			w = 0.0f;
+
+		pFlexData->m_Weights[i] = w;
+		bAnyActive = bAnyActive || (w != 0.0f);
+	}
+
+	if (!bAnyActive)
+		return;
+
+	// Already flexed with these weights this frame?
+	FlexResult_t *pResult = NULL;
+	int nWeightBytes = pmesh->numflexes * sizeof(float);
+	for (i = 0; i < FLEX_RESULT_CACHE_SIZE; i++)
+	{
+		FlexResult_t &result = pFlexData->m_Results[i];
+		if (result.m_nFrame == m_nFrameCount && !memcmp( result.m_Weights.Base(), pFlexData->m_Weights.Base(), nWeightBytes ))
+		{
+			pResult = &result;
+			break;
+		}
+	}
+
+	if (pResult)
+	{
+		pResult->m_nLastUsed = ++pFlexData->m_nUseCount;
+		for (j = 0; j < pResult->m_Slots.Count(); j++)
+		{
+			int n = pFlexData->m_ActiveVerts[pResult->m_Slots[j]];
+			const CachedVertex_t &cached = pResult->m_Verts[j];
+			CachedVertex_t* pFlexedVertex = m_VertexCache.CreateFlexVertex(n);
+			VectorCopy( cached.m_Position, pFlexedVertex->m_Position );
+			VectorCopy( cached.m_Normal, pFlexedVertex->m_Normal );
+			Vector4DCopy( cached.m_TangentS, pFlexedVertex->m_TangentS );
+		}
+		return;
+	}
+
+	// Sum the deltas of every active flex per active vertex
+	int nActive = pFlexData->m_ActiveVerts.Count();
+	float *pPositionDelta = pFlexData->m_PositionDelta.Base();
+	float *pNormalDelta = pFlexData->m_NormalDelta.Base();
+	unsigned char *pMoved = pFlexData->m_Moved.Base();
+	memset( pPositionDelta, 0, nActive * 4 * sizeof(float) );
+	memset( pNormalDelta, 0, nActive * 4 * sizeof(float) );
+	memset( pMoved, 0, nActive );
+
+	for (i = 0; i < pmesh->numflexes; i++)
+	{
+		float w = pFlexData->m_Weights[i];
+		if (w == 0.0f)
 			continue;
 
 		mstudiovertanim_t *pvanim = pflex[i].pVertanim( 0 );
+		const unsigned short *pSlot = &pFlexData->m_VertSlots[pFlexData->m_FlexFirstSlot[i]];
+		__m128 vw = _mm_set1_ps( w );
 
 		for (j = 0; j < pflex[i].numverts; j++)
 		{
-			n = pvanim[j].index;
-			mstudiovertex_t &vert = pVertices[n];
+			int slot = pSlot[j];
+
+			// delta and ndelta are back to back, so both loads stay inside
+			// the vertanim: (dx dy dz ndx) and (dz ndx ndy ndz)
+			__m128 delta = _mm_loadu_ps( &pvanim[j].delta.x );
+			__m128 ndelta = _mm_loadu_ps( &pvanim[j].delta.z );
+			ndelta = _mm_shuffle_ps( ndelta, ndelta, _MM_SHUFFLE( 0, 3, 2, 1 ) );
+
+			float *pPos = &pPositionDelta[slot * 4];
+			float *pNorm = &pNormalDelta[slot * 4];
+			_mm_storeu_ps( pPos, _mm_add_ps( _mm_loadu_ps( pPos ), _mm_mul_ps( delta, vw ) ) );
+			_mm_storeu_ps( pNorm, _mm_add_ps( _mm_loadu_ps( pNorm ), _mm_mul_ps( ndelta, vw ) ) );
+			pMoved[slot] = 1;
+		}
+	}
 
-			// only flex the indicies that are (still) part of this mesh
-			// if (n < (int)pmesh->numvertices)
-			if (1) // need LOD info here
-			{
-				CachedVertex_t* pFlexedVertex;
-				if (!m_VertexCache.IsVertexFlexed(n))
-				{
-					// Add a new flexed vert to the flexed vertex list
-					pFlexedVertex = m_VertexCache.CreateFlexVertex(n);
+	// Write the moved vertices to the vertex cache, and remember them in
+	// the least recently used result
+	pResult = &pFlexData->m_Results[0];
+	for (i = 1; i < FLEX_RESULT_CACHE_SIZE; i++)
+	{
+		if (pFlexData->m_Results[i].m_nLastUsed < pResult->m_nLastUsed)
+		{
+			pResult = &pFlexData->m_Results[i];
+		}
+	}
+	pResult->m_nFrame = m_nFrameCount;
+	pResult->m_nLastUsed = ++pFlexData->m_nUseCount;
+	pResult->m_Weights.CopyArray( pFlexData->m_Weights.Base(), pmesh->numflexes );
+	pResult->m_Slots.RemoveAll();
+	pResult->m_Verts.RemoveAll();
 
-					VectorCopy( vert.m_vecPosition, pFlexedVertex->m_Position );
-					VectorCopy( vert.m_vecNormal, pFlexedVertex->m_Normal );
-					Vector4DCopy( pstudiotangentS[n], pFlexedVertex->m_TangentS );
-					Assert( pFlexedVertex->m_TangentS.w == -1.0f || pFlexedVertex->m_TangentS.w == 1.0f );
-				}
-				else
-				{
-					pFlexedVertex = m_VertexCache.GetFlexVertex(n);
-				}
+	for (j = 0; j < nActive; j++)
+	{
+		if (!pMoved[j])
+			continue;
+
+		int n = pFlexData->m_ActiveVerts[j];
+		mstudiovertex_t &vert = pVertices[n];
+
+		const Vector &vecPositionDelta = *(const Vector *)&pPositionDelta[j * 4];
+		const Vector &vecNormalDelta = *(const Vector *)&pNormalDelta[j * 4];
+
+		CachedVertex_t* pFlexedVertex = m_VertexCache.CreateFlexVertex(n);
+		VectorAdd( vert.m_vecPosition, vecPositionDelta, pFlexedVertex->m_Position );
+		VectorAdd( vert.m_vecNormal, vecNormalDelta, pFlexedVertex->m_Normal );
+		if (pstudiotangentS)
+		{
+			Vector4DCopy( pstudiotangentS[n], pFlexedVertex->m_TangentS );
+		}
+		else
+		{
+			pFlexedVertex->m_TangentS.Init( 0.0f, 0.0f, 0.0f, 1.0f );
+		}
+		pFlexedVertex->m_TangentS.AsVector3D() += vecNormalDelta;
+		Assert( pFlexedVertex->m_TangentS.w == -1.0f || pFlexedVertex->m_TangentS.w == 1.0f );
+
+		pResult->m_Slots.AddToTail( j );
+		pResult->m_Verts.AddToTail( *pFlexedVertex );
+	}
+}
 
-				Vector nDeltaScale;
-				VectorMultiply( pvanim[j].ndelta, w, nDeltaScale );
 
-				VectorMA( pFlexedVertex->m_Position, w, pvanim[j].delta, pFlexedVertex->m_Position );
-				pFlexedVertex->m_Normal += nDeltaScale;
-				pFlexedVertex->m_TangentS.AsVector3D() += nDeltaScale;
-				Assert( pFlexedVertex->m_TangentS.w == -1.0f || pFlexedVertex->m_TangentS.w == 1.0f );
+//-----------------------------------------------------------------------------
+// Gathers the vertices the mesh's flexes move and gives each a dense slot
+//-----------------------------------------------------------------------------
+studioflexdata_t *CStudioRender::R_StudioBuildFlexData( mstudiomesh_t *pmesh )
+{
+	studioflexdata_t *pFlexData = new studioflexdata_t;
+
+	CUtlVector< unsigned short > vertToSlot;
+	vertToSlot.SetSize( StudioMesh_GetNumVertices( m_pStudioHdr, pmesh ) );
+	memset( vertToSlot.Base(), 0xff, vertToSlot.Count() * sizeof(unsigned short) );
+
+	mstudioflex_t *pflex = pmesh->pFlex( 0 );
+	pFlexData->m_FlexFirstSlot.SetSize( pmesh->numflexes );
+	pFlexData->m_Weights.SetSize( pmesh->numflexes );
+	for (int i = 0; i < pmesh->numflexes; i++)
+	{
+		pFlexData->m_FlexFirstSlot[i] = pFlexData->m_VertSlots.Count();
+
+		mstudiovertanim_t *pvanim = pflex[i].pVertanim( 0 );
+		for (int j = 0; j < pflex[i].numverts; j++)
+		{
+			int n = pvanim[j].index;
+			if (n >= vertToSlot.Count())
+			{
+				int nOldCount = vertToSlot.Count();
+				vertToSlot.SetSize( n + 1 );
+				memset( &vertToSlot[nOldCount], 0xff, (n + 1 - nOldCount) * sizeof(unsigned short) );
 			}
+
+			if (vertToSlot[n] == 0xffff)
+			{
+				vertToSlot[n] = pFlexData->m_ActiveVerts.AddToTail( n );
+			}
+			pFlexData->m_VertSlots.AddToTail( vertToSlot[n] );
 		}
 	}
+
+	int nActive = pFlexData->m_ActiveVerts.Count();
+	pFlexData->m_PositionDelta.SetSize( nActive * 4 );
+	pFlexData->m_NormalDelta.SetSize( nActive * 4 );
+	pFlexData->m_Moved.SetSize( nActive );
+
+	return pFlexData;
 }
 
 
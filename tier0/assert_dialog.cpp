@@ -6,6 +6,7 @@
 
 #include "tier0/platform.h"
 #include "tier0/dbg.h"
+#include "tier0/mem.h"
 
 #if defined( _WIN32 )
 #include <windows.h>
@@ -77,6 +78,11 @@ static CDialogInitInfo g_Info;
 // -------------------------------------------------------------------------------- //
 
 #if defined( _WIN32 )
+#if !defined( _DEBUG )
+// memstd.cpp
+void SmallBlockHeap_ThreadDetach();
+#endif
+
 BOOL WINAPI DllMain(
   HINSTANCE hinstDLL,  // handle to the DLL module
   DWORD fdwReason,     // reason for calling function
@@ -84,6 +90,16 @@ BOOL WINAPI DllMain(
 )
 {
 	g_hTier0Instance = hinstDLL;
+
+	if ( fdwReason == DLL_THREAD_DETACH )
+	{
+		MemFrameThreadDetach();
+
+#if !defined( _DEBUG )
+		// Give the exiting thread's cached small blocks back to the heap
+		SmallBlockHeap_ThreadDetach();
+#endif
+	}
 	return true;
 }
 #endif
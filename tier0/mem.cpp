@@ -7,7 +7,10 @@
 
 #include "tier0/mem.h"
 #include <malloc.h>
+#include <string.h>
+#include <stdio.h>
 #include "tier0/dbg.h"
+#include "tier0/threadtools.h"
 
 
 enum 
@@ -76,6 +79,312 @@ void MemFreeScratch()
 }
 
 
+//-----------------------------------------------------------------------------
+// Frame memory
+//-----------------------------------------------------------------------------
+enum
+{
+	FRAME_ARENA_INITIAL_SIZE = 256 * 1024,
+	FRAME_ARENA_MAX_SIZE = 16 * 1024 * 1024,
+	FRAME_OVERFLOW_BLOCK_SIZE = 64 * 1024,
+};
+
+// Blocks are chained newest first; the oldest one is the arena's main block
+// and everything after it is heap overflow.
+struct FrameBlock_t
+{
+	FrameBlock_t	*m_pPrev;
+	int				m_nSize;
+	int				m_nUsed;
+
+	// Blocks are allocated with 16 bytes of slack so the data can be aligned
+	unsigned char	*Data()		{ return (unsigned char *)( ( (uintp)( this + 1 ) + 15 ) & ~15 ); }
+};
+
+struct FrameArena_t
+{
+	FrameBlock_t	*m_pBlock;
+	int				m_nCapacity;
+	int				m_nTotalUsed;
+	int				m_nFramePeak;
+	int				m_nFrameOverflow;
+	MemFrameStats_t	m_Stats;
+};
+
+static TT_THREAD_LOCAL FrameArena_t *s_pFrameArena;
+
+#ifdef _LINUX
+static pthread_key_t s_FrameArenaKey;
+static pthread_once_t s_FrameArenaKeyOnce = PTHREAD_ONCE_INIT;
+
+static void FrameArenaThreadExit( void * )
+{
+	MemFrameThreadDetach();
+}
+
+static void CreateFrameArenaKey()
+{
+	pthread_key_create( &s_FrameArenaKey, FrameArenaThreadExit );
+}
+#endif
+
+static FrameBlock_t *AllocFrameBlock( int nSize, FrameBlock_t *pPrev )
+{
+	FrameBlock_t *pBlock = (FrameBlock_t *)malloc( sizeof(FrameBlock_t) + 16 + nSize );
+	if ( !pBlock )
+		return NULL;
+
+	pBlock->m_pPrev = pPrev;
+	pBlock->m_nSize = nSize;
+	pBlock->m_nUsed = 0;
+	return pBlock;
+}
+
+static FrameArena_t *GetFrameArena()
+{
+	FrameArena_t *pArena = s_pFrameArena;
+	if ( !pArena )
+	{
+		pArena = (FrameArena_t *)calloc( 1, sizeof(FrameArena_t) );
+		pArena->m_nCapacity = FRAME_ARENA_INITIAL_SIZE;
+		pArena->m_pBlock = AllocFrameBlock( pArena->m_nCapacity, NULL );
+		s_pFrameArena = pArena;
+
+#ifdef _LINUX
+		pthread_once( &s_FrameArenaKeyOnce, CreateFrameArenaKey );
+		pthread_setspecific( s_FrameArenaKey, pArena );
+#endif
+	}
+	return pArena;
+}
+
+// Frees overflow blocks until pStop is the current block
+static void ReleaseFrameBlocks( FrameArena_t *pArena, FrameBlock_t *pStop )
+{
+	while ( pArena->m_pBlock != pStop && pArena->m_pBlock->m_pPrev )
+	{
+		FrameBlock_t *pPrev = pArena->m_pBlock->m_pPrev;
+		free( pArena->m_pBlock );
+		pArena->m_pBlock = pPrev;
+	}
+}
+
+void *MemAllocFrame( int nMemSize )
+{
+	FrameArena_t *pArena = GetFrameArena();
+	nMemSize = ( nMemSize + 15 ) & ~15;
+
+	FrameBlock_t *pBlock = pArena->m_pBlock;
+	if ( !pBlock || pBlock->m_nUsed + nMemSize > pBlock->m_nSize )
+	{
+		// Overflow goes to the heap until the next reset
+		int nBlockSize = ( nMemSize > FRAME_OVERFLOW_BLOCK_SIZE ) ? nMemSize : FRAME_OVERFLOW_BLOCK_SIZE;
+		pBlock = AllocFrameBlock( nBlockSize, pArena->m_pBlock );
+		if ( !pBlock )
+			return NULL;
+
+		pArena->m_pBlock = pBlock;
+		pArena->m_nFrameOverflow += nMemSize;
+	}
+
+	void *pMem = pBlock->Data() + pBlock->m_nUsed;
+	pBlock->m_nUsed += nMemSize;
+
+	pArena->m_nTotalUsed += nMemSize;
+	if ( pArena->m_nTotalUsed > pArena->m_nFramePeak )
+	{
+		pArena->m_nFramePeak = pArena->m_nTotalUsed;
+	}
+	return pMem;
+}
+
+void MemGetFrameMark( MemFrameMark_t *pMark )
+{
+	FrameArena_t *pArena = GetFrameArena();
+	pMark->m_pBlock = pArena->m_pBlock;
+	pMark->m_nBlockUsed = pArena->m_pBlock ? pArena->m_pBlock->m_nUsed : 0;
+	pMark->m_nTotalUsed = pArena->m_nTotalUsed;
+}
+
+void MemFreeToFrameMark( const MemFrameMark_t *pMark )
+{
+	FrameArena_t *pArena = GetFrameArena();
+	Assert( pArena->m_nTotalUsed >= pMark->m_nTotalUsed );
+
+	ReleaseFrameBlocks( pArena, (FrameBlock_t *)pMark->m_pBlock );
+
+	// If this fails, the mark was taken before the last MemFrameReset
+	Assert( pArena->m_pBlock == pMark->m_pBlock );
+	if ( pArena->m_pBlock == pMark->m_pBlock && pArena->m_pBlock )
+	{
+		pArena->m_pBlock->m_nUsed = pMark->m_nBlockUsed;
+		pArena->m_nTotalUsed = pMark->m_nTotalUsed;
+	}
+}
+
+void MemFrameReset()
+{
+	FrameArena_t *pArena = GetFrameArena();
+
+	MemFrameStats_t &stats = pArena->m_Stats;
+	++stats.m_nFrames;
+	stats.m_nLastFramePeak = pArena->m_nFramePeak;
+	stats.m_nLastFrameOverflow = pArena->m_nFrameOverflow;
+	if ( pArena->m_nFramePeak > stats.m_nMaxFramePeak )
+	{
+		stats.m_nMaxFramePeak = pArena->m_nFramePeak;
+	}
+
+	ReleaseFrameBlocks( pArena, NULL );
+
+	// Grow the main block so the next frame like this one fits
+	if ( pArena->m_nFrameOverflow )
+	{
+		++stats.m_nOverflowFrames;
+	}
+
+	if ( pArena->m_nFrameOverflow && pArena->m_nCapacity < FRAME_ARENA_MAX_SIZE )
+	{
+		int nCapacity = pArena->m_nCapacity;
+		while ( nCapacity < pArena->m_nFramePeak && nCapacity < FRAME_ARENA_MAX_SIZE )
+		{
+			nCapacity *= 2;
+		}
+
+		FrameBlock_t *pBlock = AllocFrameBlock( nCapacity, NULL );
+		if ( pBlock )
+		{
+			free( pArena->m_pBlock );
+			pArena->m_pBlock = pBlock;
+			pArena->m_nCapacity = nCapacity;
+		}
+	}
+
+	if ( pArena->m_pBlock )
+	{
+		pArena->m_pBlock->m_nUsed = 0;
+	}
+	pArena->m_nTotalUsed = 0;
+	pArena->m_nFramePeak = 0;
+	pArena->m_nFrameOverflow = 0;
+}
+
+void MemGetFrameStats( MemFrameStats_t *pStats )
+{
+	FrameArena_t *pArena = GetFrameArena();
+	*pStats = pArena->m_Stats;
+	pStats->m_nCapacity = pArena->m_nCapacity;
+}
+
+void MemFrameThreadDetach()
+{
+	FrameArena_t *pArena = s_pFrameArena;
+	if ( !pArena )
+		return;
+
+	ReleaseFrameBlocks( pArena, NULL );
+	free( pArena->m_pBlock );
+	free( pArena );
+	s_pFrameArena = NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Memory pool registry
+//-----------------------------------------------------------------------------
+struct RegisteredPool_t
+{
+	const void			*m_pPool;
+	MemPoolStatsFunc_t	m_pfnGetStats;
+};
+
+// Pools register from static constructors, so this has to work before any
+// constructor here runs; everything is zero-initialized plain data, which
+// is why the guard is a bare spin lock rather than a CThreadFastMutex.
+static long volatile s_nPoolRegistryLock;
+static RegisteredPool_t *s_pRegisteredPools;
+static int s_nRegisteredPools;
+static int s_nMaxRegisteredPools;
+
+class CPoolRegistryAutoLock
+{
+public:
+	CPoolRegistryAutoLock()
+	{
+		while ( !ThreadInterlockedAssignIf( &s_nPoolRegistryLock, 1, 0 ) )
+		{
+			ThreadPause();
+		}
+	}
+
+	~CPoolRegistryAutoLock()
+	{
+		ThreadInterlockedExchange( &s_nPoolRegistryLock, 0 );
+	}
+};
+
+void MemRegisterPool( const void *pPool, MemPoolStatsFunc_t pfnGetStats )
+{
+	CPoolRegistryAutoLock lock;
+
+	if ( s_nRegisteredPools == s_nMaxRegisteredPools )
+	{
+		int nNewMax = s_nMaxRegisteredPools ? s_nMaxRegisteredPools * 2 : 64;
+		RegisteredPool_t *pNewPools = (RegisteredPool_t *)realloc( s_pRegisteredPools, nNewMax * sizeof(RegisteredPool_t) );
+		if ( !pNewPools )
+			return;
+
+		s_pRegisteredPools = pNewPools;
+		s_nMaxRegisteredPools = nNewMax;
+	}
+
+	s_pRegisteredPools[s_nRegisteredPools].m_pPool = pPool;
+	s_pRegisteredPools[s_nRegisteredPools].m_pfnGetStats = pfnGetStats;
+	++s_nRegisteredPools;
+}
+
+void MemUnregisterPool( const void *pPool )
+{
+	CPoolRegistryAutoLock lock;
+
+	for ( int i = 0; i < s_nRegisteredPools; ++i )
+	{
+		if ( s_pRegisteredPools[i].m_pPool == pPool )
+		{
+			s_pRegisteredPools[i] = s_pRegisteredPools[--s_nRegisteredPools];
+			return;
+		}
+	}
+}
+
+void MemDumpPoolStats()
+{
+	CPoolRegistryAutoLock lock;
+
+	Msg( "Memory pools (* = thread safe)\n" );
+	Msg( "  %-32s %6s %8s %8s %14s %12s\n", "Name", "Size", "In use", "Peak", "Total allocs", "Committed(k)" );
+
+	int nTotalCommitted = 0;
+	for ( int i = 0; i < s_nRegisteredPools; ++i )
+	{
+		MemPoolStats_t stats;
+		memset( &stats, 0, sizeof(stats) );
+		s_pRegisteredPools[i].m_pfnGetStats( s_pRegisteredPools[i].m_pPool, &stats );
+
+		char szName[33];
+		_snprintf( szName, sizeof(szName), "%s%s", stats.m_bThreadSafe ? "*" : "", stats.m_pName ? stats.m_pName : "<unnamed>" );
+		szName[sizeof(szName) - 1] = 0;
+
+		Msg( "  %-32s %6d %8d %8d %14.0f %12d\n", szName, stats.m_nBlockSize, stats.m_nBlocksAllocated,
+			stats.m_nPeakAlloc, (double)stats.m_nTotalAllocs, stats.m_nCommittedBytes / 1024 );
+
+		nTotalCommitted += stats.m_nCommittedBytes;
+	}
+
+	Msg( "  %d pools, %dk committed\n", s_nRegisteredPools, nTotalCommitted / 1024 );
+}
+
+
 #ifdef _LINUX
 void ZeroMemory( void *mem, size_t length )
 {
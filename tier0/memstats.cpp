@@ -1,102 +1,176 @@
-//========= Copyright  1996-2001, Valve LLC, All rights reserved. ============
+//========= Copyright � 1996-2001, Valve LLC, All rights reserved. ============
 //
 // Purpose: Maintains memory statistics
 //
 // $NoKeywords: $
 //=============================================================================
 
-#include <malloc.h>
-#include "tier0/Dbg.h"
-#include "tier0/mem.h"
-#include <map>
+#include <string.h>
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "memstats.h"
 
 
 //-----------------------------------------------------------------------------
-// At any given point in time, we want to keep track of 
+// Per size class counters. The small block heap serializes updates to a
+// class through that class's lock, so nothing here needs to be atomic.
+// There's deliberately no constructor: the heap can register itself before
+// static constructors have run, and static storage starts out zeroed.
 //-----------------------------------------------------------------------------
 class CMemStats
 {
 public:
-	CMemStats();
+	enum
+	{
+		MAX_SIZE_CLASSES = 32
+	};
+
+	void InitSizeClasses( const int *pBlockSizes, int nClassCount, int nPageSize );
+	void RegisterActivity( int nClass, int nAllocs, int nFrees, int nRequestedBytes );
+	void RegisterPage( int nClass );
 
-	void RegisterAllocation( int nSize, const char *pFileName, float flTime );
-	void RegisterDeallocation( int nSize, const char *pFileName, float flTime );
-	
-//	void SpewStats( );
+	void DumpSizeClasses();
 
 private:
-	struct MemInfo_t
+	struct SizeClassInfo_t
 	{
-		// Size in bytes
-		int m_nCurrentSize;
-		int m_nPeakSize;
-		int m_nTotalSize;
-		int m_nOverheadSize;
-
-		// Count in terms of # of allocations
-		int m_nCurrentCount;
-		int m_nPeakCount;
-		int m_nTotalCount;
-
-		// Time spent allocating + deallocating
-		float m_flTime;
-	};
+		int		m_nBlockSize;
 
-	// NOTE: Deliberately using STL here because the UTL stuff
-	// is a client of this library; want to avoid circular dependency
+		// Blocks handed out + returned
+		int64	m_nTotalAllocs;
+		int64	m_nTotalFrees;
+		int		m_nPeakCount;
 
-	// Maps file name to info
-	typedef std::map< const char *, MemInfo_t > StatMap_t;
-	typedef StatMap_t::iterator StatMapIter_t;
-	typedef StatMap_t::value_type StatMapEntry_t;
+		// Bytes actually asked for, to measure internal fragmentation
+		int64	m_nRequestedBytes;
 
-private:
-	// Finds the file in our map
-	StatMapIter_t FindOrCreateEntry( const char *pFileName );
+		// Pages carved up for this class
+		int		m_nPages;
 
-private:
-	StatMap_t m_StatMap;
-	MemInfo_t m_GlobalInfo;
+		// Snapshot at the last dump, for rates
+		int64	m_nLastAllocs;
+	};
+
+	SizeClassInfo_t m_SizeClasses[MAX_SIZE_CLASSES];
+	int		m_nClassCount;
+	int		m_nPageSize;
+	double	m_flLastDumpTime;
 };
-				   
+
 
 //-----------------------------------------------------------------------------
-// Constructor
+// Registers the heap layout
 //-----------------------------------------------------------------------------
-CMemStats::CMemStats()
+void CMemStats::InitSizeClasses( const int *pBlockSizes, int nClassCount, int nPageSize )
 {
+	Assert( nClassCount <= MAX_SIZE_CLASSES );
+	m_nClassCount = ( nClassCount < MAX_SIZE_CLASSES ) ? nClassCount : MAX_SIZE_CLASSES;
+	m_nPageSize = nPageSize;
+
+	for ( int i = 0; i < m_nClassCount; ++i )
+	{
+		m_SizeClasses[i].m_nBlockSize = pBlockSizes[i];
+	}
 }
 
 
 //-----------------------------------------------------------------------------
-// Finds the file in our map
+// Registers allocations + deallocations
 //-----------------------------------------------------------------------------
-CMemStats::StatMapIter_t CMemStats::FindOrCreateEntry( const char *pFileName )
+void CMemStats::RegisterActivity( int nClass, int nAllocs, int nFrees, int nRequestedBytes )
 {
-	StatMapIter_t iter = m_StatMap.find( pFileName );
-	if (iter == m_StatMap.end() )
+	if ( nClass >= m_nClassCount )
+		return;
+
+	SizeClassInfo_t &info = m_SizeClasses[nClass];
+	info.m_nTotalAllocs += nAllocs;
+	info.m_nTotalFrees += nFrees;
+	info.m_nRequestedBytes += nRequestedBytes;
+
+	int nCurrent = (int)( info.m_nTotalAllocs - info.m_nTotalFrees );
+	if ( nCurrent > info.m_nPeakCount )
 	{
-		MemInfo_t newInfo;
-		memset( &newInfo, 0, sizeof(MemInfo_t) );
-		iter = m_StatMap.insert( StatMapEntry_t( pFileName, newInfo ) );
+		info.m_nPeakCount = nCurrent;
+	}
+}
+
+void CMemStats::RegisterPage( int nClass )
+{
+	if ( nClass < m_nClassCount )
+	{
+		++m_SizeClasses[nClass].m_nPages;
 	}
-	return iter;
 }
 
 
 //-----------------------------------------------------------------------------
-// Registers allocations + deallocations
+// Stat output
 //-----------------------------------------------------------------------------
-void RegisterAllocation( int nSize, const char *pFileName, float flTime )
+void CMemStats::DumpSizeClasses()
 {
-	StatMapIter_t iter = FindOrCreateEntry( pFileName );
-	MemInfo_t &info = iter->second;
-	++info.m_nCurrentCount;
-	++info.m_nTotalCount;
-	if (info.m_nCurrentCount > info.m_n
+	if ( !m_nClassCount )
+	{
+		Msg( "Small block heap is disabled (run with -smallblockheap)\n" );
+		return;
+	}
+
+	double flTime = Plat_FloatTime();
+	double flElapsed = flTime - m_flLastDumpTime;
+	m_flLastDumpTime = flTime;
+
+	Msg( "Small block heap (%d byte pages)\n", m_nPageSize );
+	Msg( "  Size    In use     Peak  Committed(k)  Used%%  Slack%%    Allocs/s      Total Allocs\n" );
+
+	int64 nTotalCommitted = 0;
+	int64 nTotalInUse = 0;
+	for ( int i = 0; i < m_nClassCount; ++i )
+	{
+		SizeClassInfo_t &info = m_SizeClasses[i];
+
+		int nInUse = (int)( info.m_nTotalAllocs - info.m_nTotalFrees );
+		int64 nCommitted = (int64)info.m_nPages * m_nPageSize;
+		int64 nInUseBytes = (int64)nInUse * info.m_nBlockSize;
+
+		// Used% is how much of the committed pages is handed out (external
+		// fragmentation); Slack% is the rounding waste inside handed out blocks.
+		float flUsed = nCommitted ? 100.0f * (float)nInUseBytes / (float)nCommitted : 0.0f;
+		float flSlack = info.m_nTotalAllocs ? 100.0f * ( 1.0f - (float)info.m_nRequestedBytes / ( (float)info.m_nTotalAllocs * info.m_nBlockSize ) ) : 0.0f;
+		float flRate = ( flElapsed > 0.0 ) ? (float)( ( info.m_nTotalAllocs - info.m_nLastAllocs ) / flElapsed ) : 0.0f;
+		info.m_nLastAllocs = info.m_nTotalAllocs;
+
+		Msg( "  %4d  %8d %8d  %12d  %5.1f  %6.1f  %10.0f  %16.0f\n",
+			info.m_nBlockSize, nInUse, info.m_nPeakCount, (int)( nCommitted / 1024 ),
+			flUsed, flSlack, flRate, (double)info.m_nTotalAllocs );
+
+		nTotalCommitted += nCommitted;
+		nTotalInUse += nInUseBytes;
+	}
+
+	Msg( "  Total: %dk in use of %dk committed\n", (int)( nTotalInUse / 1024 ), (int)( nTotalCommitted / 1024 ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Singleton...
+//-----------------------------------------------------------------------------
+static CMemStats s_MemStats;
+
+void MemStats_InitSizeClasses( const int *pBlockSizes, int nClassCount, int nPageSize )
+{
+	s_MemStats.InitSizeClasses( pBlockSizes, nClassCount, nPageSize );
 }
 
-void RegisterDeallocation( int nSize, const char *pFileName, float flTime )
+void MemStats_RegisterSizeClassActivity( int nClass, int nAllocs, int nFrees, int nRequestedBytes )
 {
+	s_MemStats.RegisterActivity( nClass, nAllocs, nFrees, nRequestedBytes );
 }
 
+void MemStats_RegisterSizeClassPage( int nClass )
+{
+	s_MemStats.RegisterPage( nClass );
+}
+
+void MemStats_DumpSizeClasses()
+{
+	s_MemStats.DumpSizeClasses();
+}
@@ -0,0 +1,33 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Memory statistics shared by the tier0 allocators
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef TIER0_MEMSTATS_H
+#define TIER0_MEMSTATS_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+
+
+//-----------------------------------------------------------------------------
+// Size class statistics for the small block heap. The heap folds per-thread
+// counters in whenever a thread cache trades blocks with the shared pool, so
+// they can lag the true values by one thread cache worth of blocks.
+//-----------------------------------------------------------------------------
+void MemStats_InitSizeClasses( const int *pBlockSizes, int nClassCount, int nPageSize );
+
+// Called with the size class lock held
+void MemStats_RegisterSizeClassActivity( int nClass, int nAllocs, int nFrees, int nRequestedBytes );
+void MemStats_RegisterSizeClassPage( int nClass );
+
+// Spews a table of all size classes
+void MemStats_DumpSizeClasses();
+
+
+#endif // TIER0_MEMSTATS_H
@@ -7,9 +7,356 @@
 
 #if !defined( _DEBUG ) || defined( _LINUX )
 
+#ifdef _WIN32
+#define WIN_32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined( _LINUX )
+#include <sys/mman.h>
+#endif
+
 #include <malloc.h>
+#include <string.h>
 #include "tier0/dbg.h"
 #include "tier0/memalloc.h"
+#include "tier0/threadtools.h"
+#include "memstats.h"
+
+
+//-----------------------------------------------------------------------------
+// Small block heap. Allocations up to MAX_SMALL_BLOCK bytes are rounded up to
+// a size class and served from pages that each hold blocks of one class. Each
+// thread keeps a short free list per class, so the common case touches no
+// shared state; threads trade blocks with the shared per class lists in
+// batches. All pages come from one reserved address range, which is how Free
+// tells our blocks apart from CRT blocks.
+//
+// This is off by default; run with -smallblockheap to enable it.
+//-----------------------------------------------------------------------------
+class CSmallBlockHeap
+{
+public:
+	enum
+	{
+		MAX_SMALL_BLOCK = 256,
+		NUM_SIZE_CLASSES = 12,
+		PAGE_SIZE = 64 * 1024,
+		NUM_PAGES = 1024,		// 64MB of address space
+
+		// Bytes a thread pulls from / returns to the shared lists at once,
+		// and how many it may hold on to per class before returning some
+		BATCH_BYTES = 4096,
+		MAX_CACHED_BATCHES = 2,
+	};
+
+	bool Init();
+	bool IsActive() const			{ return m_pBase != NULL; }
+
+	bool IsOwner( const void *pMem ) const
+	{
+		return ( m_pBase && (const char *)pMem >= m_pBase && (const char *)pMem < m_pBase + NUM_PAGES * PAGE_SIZE );
+	}
+
+	void *Alloc( size_t nSize );
+	void Free( void *pMem );
+	size_t GetSize( const void *pMem ) const;
+
+	// Returns everything the calling thread has cached to the shared lists
+	void ThreadDetach();
+
+private:
+	struct ThreadCache_t
+	{
+		void	*m_pFree[NUM_SIZE_CLASSES];
+		int		m_nFree[NUM_SIZE_CLASSES];
+
+		// Activity not yet folded into the stats
+		int		m_nAllocs[NUM_SIZE_CLASSES];
+		int		m_nFrees[NUM_SIZE_CLASSES];
+		int		m_nRequestedBytes[NUM_SIZE_CLASSES];
+	};
+
+	struct SizeClass_t
+	{
+		CThreadFastMutex	m_Lock;
+		void				*m_pFree;
+		char				*m_pNextFresh;	// uncarved space in the newest page
+		char				*m_pFreshEnd;
+		int					m_nBlockSize;
+		int					m_nBatchCount;
+	};
+
+	int SizeToClass( size_t nSize ) const	{ return s_SizeToClass[ ( nSize + 15 ) >> 4 ]; }
+	int PageClass( const void *pMem ) const	{ return m_PageClass[ ( (const char *)pMem - m_pBase ) / PAGE_SIZE ]; }
+
+	ThreadCache_t *GetThreadCache();
+	bool Refill( ThreadCache_t *pCache, int nClass );
+	void Flush( ThreadCache_t *pCache, int nClass, int nCount );
+	bool AddPage( int nClass );
+
+	static const int s_BlockSizes[NUM_SIZE_CLASSES];
+	static const unsigned char s_SizeToClass[ MAX_SMALL_BLOCK / 16 + 1 ];
+
+	char				*m_pBase;
+	long volatile		m_nPagesUsed;
+	unsigned char		m_PageClass[NUM_PAGES];
+	SizeClass_t			m_Classes[NUM_SIZE_CLASSES];
+
+	static TT_THREAD_LOCAL ThreadCache_t *s_pThreadCache;
+};
+
+const int CSmallBlockHeap::s_BlockSizes[NUM_SIZE_CLASSES] =
+{
+	16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256
+};
+
+// Indexed by ( size + 15 ) / 16
+const unsigned char CSmallBlockHeap::s_SizeToClass[ MAX_SMALL_BLOCK / 16 + 1 ] =
+{
+	0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11
+};
+
+TT_THREAD_LOCAL CSmallBlockHeap::ThreadCache_t *CSmallBlockHeap::s_pThreadCache;
+
+#ifdef _LINUX
+// Flushes a thread's cache when it exits
+static pthread_key_t s_SmallBlockThreadKey;
+static void SmallBlockHeapThreadExit( void * );
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Reserves the address range. Pages are committed as size classes need them.
+//-----------------------------------------------------------------------------
+bool CSmallBlockHeap::Init()
+{
+#ifdef _WIN32
+	m_pBase = (char *)VirtualAlloc( NULL, NUM_PAGES * PAGE_SIZE, MEM_RESERVE, PAGE_NOACCESS );
+#elif defined( _LINUX )
+	// Linux only backs the pages when they're touched
+	m_pBase = (char *)mmap( NULL, NUM_PAGES * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+	if ( m_pBase == (char *)MAP_FAILED )
+	{
+		m_pBase = NULL;
+	}
+#endif
+
+	if ( !m_pBase )
+		return false;
+
+	m_nPagesUsed = 0;
+	for ( int i = 0; i < NUM_SIZE_CLASSES; ++i )
+	{
+		m_Classes[i].m_pFree = NULL;
+		m_Classes[i].m_pNextFresh = m_Classes[i].m_pFreshEnd = NULL;
+		m_Classes[i].m_nBlockSize = s_BlockSizes[i];
+		m_Classes[i].m_nBatchCount = BATCH_BYTES / s_BlockSizes[i];
+	}
+
+#ifdef _LINUX
+	pthread_key_create( &s_SmallBlockThreadKey, SmallBlockHeapThreadExit );
+#endif
+
+	MemStats_InitSizeClasses( s_BlockSizes, NUM_SIZE_CLASSES, PAGE_SIZE );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Commits a new page for a size class. Called with the class lock held.
+//-----------------------------------------------------------------------------
+bool CSmallBlockHeap::AddPage( int nClass )
+{
+	long nPage = ThreadInterlockedIncrement( &m_nPagesUsed ) - 1;
+	if ( nPage >= NUM_PAGES )
+	{
+		// Out of address space; callers fall back to the CRT
+		m_nPagesUsed = NUM_PAGES;
+		return false;
+	}
+
+	char *pPage = m_pBase + nPage * PAGE_SIZE;
+#ifdef _WIN32
+	if ( !VirtualAlloc( pPage, PAGE_SIZE, MEM_COMMIT, PAGE_READWRITE ) )
+		return false;
+#endif
+
+	m_PageClass[nPage] = (unsigned char)nClass;
+
+	SizeClass_t &sizeClass = m_Classes[nClass];
+	sizeClass.m_pNextFresh = pPage;
+	sizeClass.m_pFreshEnd = pPage + ( PAGE_SIZE / sizeClass.m_nBlockSize ) * sizeClass.m_nBlockSize;
+
+	MemStats_RegisterSizeClassPage( nClass );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Thread caches
+//-----------------------------------------------------------------------------
+CSmallBlockHeap::ThreadCache_t *CSmallBlockHeap::GetThreadCache()
+{
+	ThreadCache_t *pCache = s_pThreadCache;
+	if ( !pCache )
+	{
+		pCache = (ThreadCache_t *)calloc( 1, sizeof(ThreadCache_t) );
+		s_pThreadCache = pCache;
+#ifdef _LINUX
+		pthread_setspecific( s_SmallBlockThreadKey, pCache );
+#endif
+	}
+	return pCache;
+}
+
+//-----------------------------------------------------------------------------
+// Pulls a batch of blocks from the shared list into the thread cache
+//-----------------------------------------------------------------------------
+bool CSmallBlockHeap::Refill( ThreadCache_t *pCache, int nClass )
+{
+	SizeClass_t &sizeClass = m_Classes[nClass];
+	AUTO_LOCK_FM( sizeClass.m_Lock );
+
+	MemStats_RegisterSizeClassActivity( nClass, pCache->m_nAllocs[nClass], pCache->m_nFrees[nClass], pCache->m_nRequestedBytes[nClass] );
+	pCache->m_nAllocs[nClass] = pCache->m_nFrees[nClass] = pCache->m_nRequestedBytes[nClass] = 0;
+
+	int nCount = 0;
+	while ( nCount < sizeClass.m_nBatchCount )
+	{
+		void *pBlock = sizeClass.m_pFree;
+		if ( pBlock )
+		{
+			sizeClass.m_pFree = *(void **)pBlock;
+		}
+		else
+		{
+			if ( sizeClass.m_pNextFresh == sizeClass.m_pFreshEnd && !AddPage( nClass ) )
+				break;
+
+			pBlock = sizeClass.m_pNextFresh;
+			sizeClass.m_pNextFresh += sizeClass.m_nBlockSize;
+		}
+
+		*(void **)pBlock = pCache->m_pFree[nClass];
+		pCache->m_pFree[nClass] = pBlock;
+		++nCount;
+	}
+
+	pCache->m_nFree[nClass] += nCount;
+	return ( nCount != 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Returns blocks from the thread cache to the shared list
+//-----------------------------------------------------------------------------
+void CSmallBlockHeap::Flush( ThreadCache_t *pCache, int nClass, int nCount )
+{
+	SizeClass_t &sizeClass = m_Classes[nClass];
+	AUTO_LOCK_FM( sizeClass.m_Lock );
+
+	MemStats_RegisterSizeClassActivity( nClass, pCache->m_nAllocs[nClass], pCache->m_nFrees[nClass], pCache->m_nRequestedBytes[nClass] );
+	pCache->m_nAllocs[nClass] = pCache->m_nFrees[nClass] = pCache->m_nRequestedBytes[nClass] = 0;
+
+	for ( int i = 0; i < nCount && pCache->m_pFree[nClass]; ++i )
+	{
+		void *pBlock = pCache->m_pFree[nClass];
+		pCache->m_pFree[nClass] = *(void **)pBlock;
+		--pCache->m_nFree[nClass];
+
+		*(void **)pBlock = sizeClass.m_pFree;
+		sizeClass.m_pFree = pBlock;
+	}
+}
+
+void CSmallBlockHeap::ThreadDetach()
+{
+	ThreadCache_t *pCache = s_pThreadCache;
+	if ( !pCache )
+		return;
+
+	for ( int i = 0; i < NUM_SIZE_CLASSES; ++i )
+	{
+		Flush( pCache, i, pCache->m_nFree[i] );
+	}
+
+	s_pThreadCache = NULL;
+	free( pCache );
+}
+
+
+//-----------------------------------------------------------------------------
+// Allocation
+//-----------------------------------------------------------------------------
+void *CSmallBlockHeap::Alloc( size_t nSize )
+{
+	int nClass = SizeToClass( nSize );
+	ThreadCache_t *pCache = GetThreadCache();
+	if ( !pCache )
+		return NULL;
+
+	void *pBlock = pCache->m_pFree[nClass];
+	if ( !pBlock )
+	{
+		if ( !Refill( pCache, nClass ) )
+			return NULL;
+		pBlock = pCache->m_pFree[nClass];
+	}
+
+	pCache->m_pFree[nClass] = *(void **)pBlock;
+	--pCache->m_nFree[nClass];
+	++pCache->m_nAllocs[nClass];
+	pCache->m_nRequestedBytes[nClass] += nSize;
+	return pBlock;
+}
+
+void CSmallBlockHeap::Free( void *pMem )
+{
+	int nClass = PageClass( pMem );
+	ThreadCache_t *pCache = GetThreadCache();
+	if ( !pCache )
+	{
+		// Can't cache it; hand it straight back to the shared list
+		SizeClass_t &sizeClass = m_Classes[nClass];
+		AUTO_LOCK_FM( sizeClass.m_Lock );
+		*(void **)pMem = sizeClass.m_pFree;
+		sizeClass.m_pFree = pMem;
+		MemStats_RegisterSizeClassActivity( nClass, 0, 1, 0 );
+		return;
+	}
+
+	*(void **)pMem = pCache->m_pFree[nClass];
+	pCache->m_pFree[nClass] = pMem;
+	++pCache->m_nFree[nClass];
+	++pCache->m_nFrees[nClass];
+
+	int nBatch = m_Classes[nClass].m_nBatchCount;
+	if ( pCache->m_nFree[nClass] > nBatch * MAX_CACHED_BATCHES )
+	{
+		Flush( pCache, nClass, nBatch );
+	}
+}
+
+size_t CSmallBlockHeap::GetSize( const void *pMem ) const
+{
+	return m_Classes[ PageClass( pMem ) ].m_nBlockSize;
+}
+
+static CSmallBlockHeap s_SmallBlockHeap;
+
+#ifdef _LINUX
+static void SmallBlockHeapThreadExit( void * )
+{
+	s_SmallBlockHeap.ThreadDetach();
+}
+#endif
+
+// Called by tier0's DllMain when a thread exits
+void SmallBlockHeap_ThreadDetach()
+{
+	if ( s_SmallBlockHeap.IsActive() )
+	{
+		s_SmallBlockHeap.ThreadDetach();
+	}
+}
 
 
 //-----------------------------------------------------------------------------
@@ -50,9 +397,25 @@ public:
 			int nLine, const char * szModule, const char * pMsg );
 	virtual int heapchk();
 
-	virtual void DumpStats() {}
+	virtual void DumpStats();
 
 private:
+	// The small block heap is switched on by the first allocation, since this
+	// object is used before static constructors and the command line are set up
+	bool UseSmallBlockHeap()
+	{
+		if ( !m_bSmallBlockHeapChecked )
+		{
+			InitSmallBlockHeap();
+		}
+		return m_bSmallBlockHeap;
+	}
+
+	void InitSmallBlockHeap();
+
+	// No constructor; static storage starts out zeroed
+	bool volatile m_bSmallBlockHeapChecked;
+	bool m_bSmallBlockHeap;
 };
 
 
@@ -68,26 +431,81 @@ IMemAlloc *g_pActualAlloc = &s_StdMemAlloc;
 #endif
 
 
+//-----------------------------------------------------------------------------
+// Small block heap setup
+//-----------------------------------------------------------------------------
+void CStdMemAlloc::InitSmallBlockHeap()
+{
+	static CThreadFastMutex s_InitLock;
+	AUTO_LOCK_FM( s_InitLock );
+
+	if ( m_bSmallBlockHeapChecked )
+		return;
+
+	m_bSmallBlockHeap = ( strstr( Plat_GetCommandLine(), "-smallblockheap" ) != NULL ) && s_SmallBlockHeap.Init();
+	ThreadMemoryBarrier();
+	m_bSmallBlockHeapChecked = true;
+}
+
+
 //-----------------------------------------------------------------------------
 // Release versions
 //-----------------------------------------------------------------------------
 void *CStdMemAlloc::Alloc( size_t nSize )
 {
+	if ( nSize <= CSmallBlockHeap::MAX_SMALL_BLOCK && UseSmallBlockHeap() )
+	{
+		// Falls through to the CRT if the heap is exhausted
+		void *pMem = s_SmallBlockHeap.Alloc( nSize );
+		if ( pMem )
+			return pMem;
+	}
+
 	return malloc( nSize );
 }
 
 void *CStdMemAlloc::Realloc( void *pMem, size_t nSize )
 {
-	return realloc( pMem, nSize );
+	if ( !pMem )
+		return Alloc( nSize );
+
+	if ( !s_SmallBlockHeap.IsOwner( pMem ) )
+		return realloc( pMem, nSize );
+
+	size_t nOldSize = s_SmallBlockHeap.GetSize( pMem );
+	if ( nSize <= nOldSize && nSize != 0 )
+		return pMem;
+
+	void *pNewMem = NULL;
+	if ( nSize )
+	{
+		pNewMem = Alloc( nSize );
+		if ( !pNewMem )
+			return NULL;
+
+		memcpy( pNewMem, pMem, ( nSize < nOldSize ) ? nSize : nOldSize );
+	}
+	s_SmallBlockHeap.Free( pMem );
+	return pNewMem;
 }
 
 void CStdMemAlloc::Free( void *pMem )
 {
+	if ( s_SmallBlockHeap.IsOwner( pMem ) )
+	{
+		s_SmallBlockHeap.Free( pMem );
+		return;
+	}
+
 	free( pMem );
 }
 
 void *CStdMemAlloc::Expand( void *pMem, size_t nSize )
 {
+	// Small blocks can only "expand" within their size class
+	if ( s_SmallBlockHeap.IsOwner( pMem ) )
+		return ( nSize <= s_SmallBlockHeap.GetSize( pMem ) ) ? pMem : NULL;
+
 #ifdef _WIN32
 	return _expand( pMem, nSize );
 #elif _LINUX
@@ -101,26 +519,22 @@ void *CStdMemAlloc::Expand( void *pMem, size_t nSize )
 //-----------------------------------------------------------------------------
 void *CStdMemAlloc::Alloc( size_t nSize, const char *pFileName, int nLine )
 {
-	return malloc( nSize );
+	return Alloc( nSize );
 }
 
 void *CStdMemAlloc::Realloc( void *pMem, size_t nSize, const char *pFileName, int nLine )
 {
-	return realloc( pMem, nSize );
+	return Realloc( pMem, nSize );
 }
 
 void  CStdMemAlloc::Free( void *pMem, const char *pFileName, int nLine )
 {
-	free( pMem );
+	Free( pMem );
 }
 
 void *CStdMemAlloc::Expand( void *pMem, size_t nSize, const char *pFileName, int nLine )
 {
-#ifdef _WIN32
-	return _expand( pMem, nSize );
-#elif _LINUX
-	return realloc( pMem, nSize );
-#endif
+	return Expand( pMem, nSize );
 }
 
 
@@ -129,6 +543,9 @@ void *CStdMemAlloc::Expand( void *pMem, size_t nSize, const char *pFileName, int
 //-----------------------------------------------------------------------------
 size_t CStdMemAlloc::GetSize( void *pMem )
 {
+	if ( s_SmallBlockHeap.IsOwner( pMem ) )
+		return s_SmallBlockHeap.GetSize( pMem );
+
 #ifdef _WIN32
 	return _msize( pMem );
 #elif _LINUX
@@ -208,4 +625,13 @@ int CStdMemAlloc::heapchk()
 }
 
 
+//-----------------------------------------------------------------------------
+// Stat output
+//-----------------------------------------------------------------------------
+void CStdMemAlloc::DumpStats()
+{
+	MemStats_DumpSizeClasses();
+}
+
+
 #endif // !_DEBUG || _LINUX
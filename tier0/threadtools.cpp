@@ -0,0 +1,353 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Portable threading primitives
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifdef _WIN32
+#define WIN_32_LEAN_AND_MEAN
+#define _WIN32_WINNT 0x0400	// for TryEnterCriticalSection
+#include <windows.h>
+#elif defined( _LINUX )
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier0/vprof.h"
+
+
+//-----------------------------------------------------------------------------
+// Thread creation
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+
+struct ThreadProcInfo_t
+{
+	ThreadFunc_t	pfnThread;
+	void			*pParam;
+};
+
+static DWORD WINAPI ThreadProcConvert( LPVOID pParam )
+{
+	ThreadProcInfo_t info = *((ThreadProcInfo_t *)pParam);
+	delete (ThreadProcInfo_t *)pParam;
+	g_VProfCurrentProfile.RegisterThread();
+	return (*info.pfnThread)( info.pParam );
+}
+
+ThreadHandle_t CreateSimpleThread( ThreadFunc_t pfnThread, void *pParam, unsigned stackSize )
+{
+	ThreadProcInfo_t *pInfo = new ThreadProcInfo_t;
+	pInfo->pfnThread = pfnThread;
+	pInfo->pParam = pParam;
+
+	DWORD threadID;
+	HANDLE hThread = CreateThread( NULL, stackSize, ThreadProcConvert, pInfo, 0, &threadID );
+	if ( !hThread )
+	{
+		delete pInfo;
+	}
+	return (ThreadHandle_t)hThread;
+}
+
+bool ReleaseThreadHandle( ThreadHandle_t hThread )
+{
+	return ( CloseHandle( (HANDLE)hThread ) != 0 );
+}
+
+bool ThreadJoin( ThreadHandle_t hThread, unsigned timeout )
+{
+	return ( WaitForSingleObject( (HANDLE)hThread, timeout ) == WAIT_OBJECT_0 );
+}
+
+void ThreadSleep( unsigned nMilliseconds )
+{
+	Sleep( nMilliseconds );
+}
+
+int ThreadGetProcessorCount()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return ( info.dwNumberOfProcessors > 0 ) ? info.dwNumberOfProcessors : 1;
+}
+
+#elif defined( _LINUX )
+
+struct ThreadProcInfo_t
+{
+	ThreadFunc_t	pfnThread;
+	void			*pParam;
+	pthread_t		thread;
+};
+
+static void *ThreadProcConvert( void *pParam )
+{
+	ThreadProcInfo_t *pInfo = (ThreadProcInfo_t *)pParam;
+	g_VProfCurrentProfile.RegisterThread();
+	return (void *)(intp)(*pInfo->pfnThread)( pInfo->pParam );
+}
+
+// On POSIX the handle owns the pthread_t and the trampoline data, so it
+// stays valid until ReleaseThreadHandle.
+ThreadHandle_t CreateSimpleThread( ThreadFunc_t pfnThread, void *pParam, unsigned stackSize )
+{
+	ThreadProcInfo_t *pInfo = new ThreadProcInfo_t;
+	pInfo->pfnThread = pfnThread;
+	pInfo->pParam = pParam;
+
+	pthread_attr_t attr;
+	pthread_attr_init( &attr );
+	if ( stackSize )
+	{
+		pthread_attr_setstacksize( &attr, stackSize );
+	}
+
+	int ret = pthread_create( &pInfo->thread, &attr, ThreadProcConvert, pInfo );
+	pthread_attr_destroy( &attr );
+	if ( ret != 0 )
+	{
+		delete pInfo;
+		return NULL;
+	}
+	return (ThreadHandle_t)pInfo;
+}
+
+bool ReleaseThreadHandle( ThreadHandle_t hThread )
+{
+	ThreadProcInfo_t *pInfo = (ThreadProcInfo_t *)hThread;
+	if ( !pInfo )
+		return false;
+
+	// Joined threads have already been reaped; otherwise let the thread
+	// clean up after itself when it exits.
+	if ( pInfo->pfnThread )
+	{
+		pthread_detach( pInfo->thread );
+	}
+	delete pInfo;
+	return true;
+}
+
+bool ThreadJoin( ThreadHandle_t hThread, unsigned timeout )
+{
+	ThreadProcInfo_t *pInfo = (ThreadProcInfo_t *)hThread;
+	if ( !pInfo || !pInfo->pfnThread )
+		return false;
+
+	// pthreads has no portable timed join; the timeout is only honored as
+	// "don't wait at all".
+	if ( timeout == 0 )
+		return false;
+
+	if ( pthread_join( pInfo->thread, NULL ) != 0 )
+		return false;
+
+	pInfo->pfnThread = NULL;
+	return true;
+}
+
+void ThreadSleep( unsigned nMilliseconds )
+{
+	if ( nMilliseconds == 0 )
+	{
+		sched_yield();
+		return;
+	}
+
+	struct timespec ts;
+	ts.tv_sec = nMilliseconds / 1000;
+	ts.tv_nsec = ( nMilliseconds % 1000 ) * 1000000;
+	while ( nanosleep( &ts, &ts ) == -1 && errno == EINTR )
+		;
+}
+
+int ThreadGetProcessorCount()
+{
+	long nCount = sysconf( _SC_NPROCESSORS_ONLN );
+	return ( nCount > 0 ) ? (int)nCount : 1;
+}
+
+#endif
+
+
+//-----------------------------------------------------------------------------
+// CThreadMutex
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+
+CThreadMutex::CThreadMutex()
+{
+	Assert( sizeof( m_CriticalSection ) == sizeof( CRITICAL_SECTION ) );
+	InitializeCriticalSection( (CRITICAL_SECTION *)&m_CriticalSection );
+}
+
+CThreadMutex::~CThreadMutex()
+{
+	DeleteCriticalSection( (CRITICAL_SECTION *)&m_CriticalSection );
+}
+
+void CThreadMutex::Lock()
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)&m_CriticalSection );
+}
+
+void CThreadMutex::Unlock()
+{
+	LeaveCriticalSection( (CRITICAL_SECTION *)&m_CriticalSection );
+}
+
+bool CThreadMutex::TryLock()
+{
+	return ( TryEnterCriticalSection( (CRITICAL_SECTION *)&m_CriticalSection ) != FALSE );
+}
+
+#elif defined( _LINUX )
+
+CThreadMutex::CThreadMutex()
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init( &attr );
+	pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( &m_Mutex, &attr );
+	pthread_mutexattr_destroy( &attr );
+}
+
+CThreadMutex::~CThreadMutex()
+{
+	pthread_mutex_destroy( &m_Mutex );
+}
+
+void CThreadMutex::Lock()
+{
+	pthread_mutex_lock( &m_Mutex );
+}
+
+void CThreadMutex::Unlock()
+{
+	pthread_mutex_unlock( &m_Mutex );
+}
+
+bool CThreadMutex::TryLock()
+{
+	return ( pthread_mutex_trylock( &m_Mutex ) == 0 );
+}
+
+#endif
+
+
+//-----------------------------------------------------------------------------
+// CThreadEvent
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+
+CThreadEvent::CThreadEvent( bool bManualReset )
+{
+	m_hEvent = CreateEvent( NULL, bManualReset, FALSE, NULL );
+}
+
+CThreadEvent::~CThreadEvent()
+{
+	CloseHandle( (HANDLE)m_hEvent );
+}
+
+void CThreadEvent::Set()
+{
+	SetEvent( (HANDLE)m_hEvent );
+}
+
+void CThreadEvent::Reset()
+{
+	ResetEvent( (HANDLE)m_hEvent );
+}
+
+bool CThreadEvent::Wait( unsigned timeout )
+{
+	return ( WaitForSingleObject( (HANDLE)m_hEvent, timeout ) == WAIT_OBJECT_0 );
+}
+
+#elif defined( _LINUX )
+
+CThreadEvent::CThreadEvent( bool bManualReset )
+{
+	pthread_mutex_init( &m_Mutex, NULL );
+	pthread_cond_init( &m_Condition, NULL );
+	m_bManualReset = bManualReset;
+	m_bSignaled = false;
+}
+
+CThreadEvent::~CThreadEvent()
+{
+	pthread_cond_destroy( &m_Condition );
+	pthread_mutex_destroy( &m_Mutex );
+}
+
+void CThreadEvent::Set()
+{
+	pthread_mutex_lock( &m_Mutex );
+	m_bSignaled = true;
+	if ( m_bManualReset )
+	{
+		pthread_cond_broadcast( &m_Condition );
+	}
+	else
+	{
+		pthread_cond_signal( &m_Condition );
+	}
+	pthread_mutex_unlock( &m_Mutex );
+}
+
+void CThreadEvent::Reset()
+{
+	pthread_mutex_lock( &m_Mutex );
+	m_bSignaled = false;
+	pthread_mutex_unlock( &m_Mutex );
+}
+
+bool CThreadEvent::Wait( unsigned timeout )
+{
+	pthread_mutex_lock( &m_Mutex );
+
+	if ( !m_bSignaled && timeout != 0 )
+	{
+		if ( timeout == TT_INFINITE )
+		{
+			while ( !m_bSignaled )
+			{
+				pthread_cond_wait( &m_Condition, &m_Mutex );
+			}
+		}
+		else
+		{
+			struct timespec ts;
+			clock_gettime( CLOCK_REALTIME, &ts );
+			ts.tv_sec += timeout / 1000;
+			ts.tv_nsec += ( timeout % 1000 ) * 1000000;
+			if ( ts.tv_nsec >= 1000000000 )
+			{
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+
+			while ( !m_bSignaled )
+			{
+				if ( pthread_cond_timedwait( &m_Condition, &m_Mutex, &ts ) == ETIMEDOUT )
+					break;
+			}
+		}
+	}
+
+	bool bSignaled = m_bSignaled;
+	if ( bSignaled && !m_bManualReset )
+	{
+		m_bSignaled = false;
+	}
+
+	pthread_mutex_unlock( &m_Mutex );
+	return bSignaled;
+}
+
+#endif
@@ -19,6 +19,7 @@
 #include <algorithm>
 #pragma warning(pop)
 
+#include <stdio.h>
 #include "tier0/vprof.h"
 
 // NOTE: Explicitly and intentionally using STL in here to not generate any
@@ -171,11 +172,14 @@ void CMemoryRegion::Access( void **ppRegion, unsigned *pBytes )
 //-----------------------------------------------------------------------------
 
 static CMemoryRegion g_NodeMemRegion( 0x400000, 0x10000 );
+static CThreadFastMutex g_NodeMemRegionLock;
 
 //-------------------------------------
 
 void *CVProfNode::operator new( size_t bytes )
 {
+	// Thread trees add nodes too
+	AUTO_LOCK_FM( g_NodeMemRegionLock );
 	return g_NodeMemRegion.Alloc( bytes );
 }
 
@@ -221,9 +225,11 @@ CVProfNode *CVProfNode::GetSubNode( const char *pszName, int detailLevel, const
 		child = child->m_pSibling;
 	}
 
-	// We didn't find it, so add it
+	// We didn't find it, so add it. Reports can walk the tree from another
+	// thread, so the node has to be complete before it's linked in.
 	CVProfNode * node = new CVProfNode( pszName, detailLevel, this, pBudgetGroupName );
 	node->m_pSibling = m_pChild;
+	ThreadMemoryBarrier();
 	m_pChild = node;
 	return node;
 }
@@ -333,6 +339,493 @@ void CVProfNode::ResetPeak()
 	}
 }
 
+//-----------------------------------------------------------------------------
+//
+// Per thread profiling state. The owning thread is the only one that moves
+// through its tree. The main thread posts it frame marks and resets, which
+// the thread applies itself on the way into and out of its top level scope,
+// so a thread that is idle picks them up the next time it runs.
+//
+
+#define VPROF_MAX_TRACE_DEPTH	64
+
+struct VProfTraceEvent_t
+{
+	const char	*m_pszName;			// NULL for frame markers
+	int64		m_Start;
+	int64		m_End;
+	int			m_nData;			// budget group, or frame number for markers
+};
+
+struct VProfTraceScope_t
+{
+	const char	*m_pszName;
+	int64		m_Start;
+};
+
+class CVProfThread
+{
+public:
+	CVProfThread( bool bMainThread );
+	~CVProfThread();
+
+	void ApplyPending();
+
+	CVProfNode			m_Root;
+	CVProfNode			*m_pCurNode;
+	int					m_nDepth;
+	long volatile		m_nPending;			// VProfThreadOp_t flags
+
+	unsigned long		m_ThreadID;
+	bool				m_bMainThread;
+	char				m_szName[32];
+	CVProfThread		*m_pNext;
+
+	VProfTraceEvent_t	*m_pTraceEvents;
+	unsigned			m_nTraceEvents;		// written since the trace started, may have wrapped
+	long				m_nTraceGeneration;
+	VProfTraceScope_t	m_TraceStack[VPROF_MAX_TRACE_DEPTH];
+	int					m_nTraceDepth;
+};
+
+static TT_THREAD_LOCAL CVProfThread *g_pVProfThread;
+
+//-------------------------------------
+
+CVProfThread::CVProfThread( bool bMainThread )
+ :	m_Root( "Root", 0, NULL, VPROF_BUDGETGROUP_OTHER_UNACCOUNTED ),
+	m_pCurNode( &m_Root ),
+	m_nDepth( 0 ),
+	m_nPending( 0 ),
+	m_ThreadID( ThreadGetCurrentId() ),
+	m_bMainThread( bMainThread ),
+	m_pNext( NULL ),
+	m_pTraceEvents( NULL ),
+	m_nTraceEvents( 0 ),
+	m_nTraceGeneration( 0 ),
+	m_nTraceDepth( 0 )
+{
+	if ( bMainThread )
+	{
+		strcpy( m_szName, "Main thread" );
+	}
+	else
+	{
+		sprintf( m_szName, "Thread %lu", m_ThreadID );
+	}
+}
+
+//-------------------------------------
+
+CVProfThread::~CVProfThread()
+{
+	free( m_pTraceEvents );
+}
+
+//-------------------------------------
+
+void CVProfThread::ApplyPending()
+{
+	if ( !m_nPending )
+		return;
+
+	long flags = ThreadInterlockedExchange( &m_nPending, 0 );
+
+	// Frames missed while the thread was busy collapse into one
+	if ( flags & VPT_MARK_FRAME )
+	{
+		m_Root.MarkFrame();
+	}
+	if ( flags & VPT_RESET )
+	{
+		m_Root.Reset();
+	}
+	if ( flags & VPT_RESET_PEAKS )
+	{
+		m_Root.ResetPeak();
+	}
+}
+
+//-------------------------------------
+
+void CVProfile::RegisterThread()
+{
+	if ( g_pVProfThread )
+		return;
+
+	CVProfThread *pThread = new CVProfThread( InMainThread() );
+
+	// Threads are never unlinked, so a plain push is safe
+	do
+	{
+		pThread->m_pNext = m_pThreads;
+	} while ( !ThreadInterlockedAssignPointerIf( (void * volatile *)&m_pThreads, pThread, pThread->m_pNext ) );
+
+	g_pVProfThread = pThread;
+}
+
+//-------------------------------------
+
+CVProfThread *CVProfile::GetThread()
+{
+	RegisterThread();
+	return g_pVProfThread;
+}
+
+//-------------------------------------
+
+CVProfThread *CVProfile::GetThreadByIndex( int iThread )
+{
+	for ( CVProfThread *pThread = m_pThreads; pThread; pThread = pThread->m_pNext )
+	{
+		if ( pThread->m_bMainThread )
+			continue;
+
+		if ( iThread-- == 0 )
+			return pThread;
+	}
+	return NULL;
+}
+
+//-------------------------------------
+
+void CVProfile::EnterThreadScope( const char *pszName, int detailLevel, const char *pBudgetGroupName )
+{
+	// Threads that were never registered are not profiled
+	CVProfThread *pThread = g_pVProfThread;
+	if ( !pThread )
+		return;
+
+	if ( pThread->m_nDepth == 0 )
+	{
+		// Threads only start profiling at the top of their call stack
+		if ( m_enabled == 0 )
+			return;
+
+		ThreadInterlockedIncrement( &m_nThreadsInScope );
+		pThread->ApplyPending();
+		pThread->m_Root.EnterScope();
+	}
+
+	pThread->m_nDepth++;
+	if ( pszName != pThread->m_pCurNode->GetName() ) 
+	{
+		pThread->m_pCurNode = pThread->m_pCurNode->GetSubNode( pszName, detailLevel, pBudgetGroupName );
+	}
+	pThread->m_pCurNode->EnterScope();
+
+	if ( m_bTracing )
+	{
+		TraceEnter( pThread, pszName );
+	}
+}
+
+//-------------------------------------
+
+void CVProfile::ExitThreadScope()
+{
+	CVProfThread *pThread = g_pVProfThread;
+	if ( !pThread || pThread->m_nDepth == 0 )
+		return;
+
+	if ( m_bTracing )
+	{
+		TraceExit( pThread, pThread->m_pCurNode->GetBudgetGroupID() );
+	}
+
+	if ( pThread->m_pCurNode->ExitScope() )
+	{
+		pThread->m_pCurNode = pThread->m_pCurNode->GetParent();
+	}
+
+	if ( --pThread->m_nDepth == 0 )
+	{
+		pThread->m_Root.ExitScope();
+		pThread->ApplyPending();
+		ThreadInterlockedDecrement( &m_nThreadsInScope );
+	}
+}
+
+//-------------------------------------
+
+void CVProfile::PostToThreads( int flags )
+{
+	for ( CVProfThread *pThread = m_pThreads; pThread; pThread = pThread->m_pNext )
+	{
+		if ( pThread->m_bMainThread )
+			continue;
+
+		long pending;
+		do
+		{
+			pending = pThread->m_nPending;
+		} while ( !ThreadInterlockedAssignIf( &pThread->m_nPending, pending | flags, pending ) );
+	}
+}
+
+//-------------------------------------
+
+void CVProfile::MarkThreadFrames()
+{
+	PostToThreads( VPT_MARK_FRAME );
+
+	if ( m_bBudgetGroupsChanged )
+	{
+		m_bBudgetGroupsChanged = false;
+		if ( m_pNumBudgetGroupsChangedCallBack )
+		{
+			(*m_pNumBudgetGroupsChangedCallBack)();
+		}
+	}
+
+	if ( m_bTracing )
+	{
+		TraceFrame();
+	}
+}
+
+//-------------------------------------
+
+void CVProfile::SetThreadName( const char *pszName )
+{
+	CVProfThread *pThread = GetThread();
+	strncpy( pThread->m_szName, pszName, sizeof( pThread->m_szName ) - 1 );
+	pThread->m_szName[sizeof( pThread->m_szName ) - 1] = 0;
+}
+
+//-------------------------------------
+
+int CVProfile::GetNumThreads()
+{
+	int nThreads = 0;
+	for ( CVProfThread *pThread = m_pThreads; pThread; pThread = pThread->m_pNext )
+	{
+		if ( !pThread->m_bMainThread )
+		{
+			nThreads++;
+		}
+	}
+	return nThreads;
+}
+
+//-------------------------------------
+
+CVProfNode *CVProfile::GetThreadRoot( int iThread )
+{
+	CVProfThread *pThread = GetThreadByIndex( iThread );
+	return ( pThread ) ? &pThread->m_Root : NULL;
+}
+
+//-------------------------------------
+
+const char *CVProfile::GetThreadName( int iThread )
+{
+	CVProfThread *pThread = GetThreadByIndex( iThread );
+	return ( pThread ) ? pThread->m_szName : NULL;
+}
+
+//-----------------------------------------------------------------------------
+//
+// Timeline tracing
+//
+
+void CVProfile::StartTrace()
+{
+	if ( m_bTracing )
+		return;
+
+	CCycleCount start;
+	start.Sample();
+	m_TraceStart = start.m_Int64;
+
+	// Threads notice the new generation and drop their old events themselves
+	ThreadInterlockedIncrement( &m_nTraceGeneration );
+	m_bTracing = true;
+	Start();
+}
+
+//-------------------------------------
+
+void CVProfile::StopTrace()
+{
+	if ( !m_bTracing )
+		return;
+
+	m_bTracing = false;
+	Stop();
+}
+
+//-------------------------------------
+
+static VProfTraceEvent_t *NextTraceEvent( CVProfThread *pThread, long generation )
+{
+	if ( pThread->m_nTraceGeneration != generation )
+	{
+		if ( !pThread->m_pTraceEvents )
+		{
+			pThread->m_pTraceEvents = (VProfTraceEvent_t *)malloc( VPROF_TRACE_BUFFER_SIZE * sizeof( VProfTraceEvent_t ) );
+		}
+		pThread->m_nTraceEvents = 0;
+		pThread->m_nTraceDepth = 0;
+		pThread->m_nTraceGeneration = generation;
+	}
+
+	if ( !pThread->m_pTraceEvents )
+		return NULL;
+
+	return &pThread->m_pTraceEvents[pThread->m_nTraceEvents & ( VPROF_TRACE_BUFFER_SIZE - 1 )];
+}
+
+//-------------------------------------
+
+void CVProfile::TraceEnter( const char *pszName )
+{
+	TraceEnter( GetThread(), pszName );
+}
+
+//-------------------------------------
+
+void CVProfile::TraceExit( int budgetGroupID )
+{
+	TraceExit( GetThread(), budgetGroupID );
+}
+
+//-------------------------------------
+
+void CVProfile::TraceEnter( CVProfThread *pThread, const char *pszName )
+{
+	if ( pThread->m_nTraceGeneration != m_nTraceGeneration )
+	{
+		// Starts the thread's events for this trace
+		NextTraceEvent( pThread, m_nTraceGeneration );
+	}
+
+	// Scopes deeper than the stack are still counted so exits pair up
+	int depth = pThread->m_nTraceDepth++;
+	if ( depth < VPROF_MAX_TRACE_DEPTH )
+	{
+		CCycleCount now;
+		now.Sample();
+		pThread->m_TraceStack[depth].m_pszName = pszName;
+		pThread->m_TraceStack[depth].m_Start = now.m_Int64;
+	}
+}
+
+//-------------------------------------
+
+void CVProfile::TraceExit( CVProfThread *pThread, int budgetGroupID )
+{
+	// Scopes entered before the trace started have nothing on the stack
+	if ( pThread->m_nTraceGeneration != m_nTraceGeneration || pThread->m_nTraceDepth == 0 )
+		return;
+
+	int depth = --pThread->m_nTraceDepth;
+	if ( depth >= VPROF_MAX_TRACE_DEPTH )
+		return;
+
+	VProfTraceEvent_t *pEvent = NextTraceEvent( pThread, m_nTraceGeneration );
+	if ( !pEvent )
+		return;
+
+	CCycleCount now;
+	now.Sample();
+	pEvent->m_pszName = pThread->m_TraceStack[depth].m_pszName;
+	pEvent->m_Start = pThread->m_TraceStack[depth].m_Start;
+	pEvent->m_End = now.m_Int64;
+	pEvent->m_nData = budgetGroupID;
+	pThread->m_nTraceEvents++;
+}
+
+//-------------------------------------
+
+void CVProfile::TraceFrame()
+{
+	CVProfThread *pThread = GetThread();
+	VProfTraceEvent_t *pEvent = NextTraceEvent( pThread, m_nTraceGeneration );
+	if ( !pEvent )
+		return;
+
+	CCycleCount now;
+	now.Sample();
+	pEvent->m_pszName = NULL;
+	pEvent->m_Start = pEvent->m_End = now.m_Int64;
+	pEvent->m_nData = m_nFrames;
+	pThread->m_nTraceEvents++;
+}
+
+//-------------------------------------
+
+static void WriteTraceString( FILE *fp, const char *pszString )
+{
+	fputc( '"', fp );
+	for ( const char *p = pszString; *p; p++ )
+	{
+		if ( *p == '"' || *p == '\\' )
+		{
+			fputc( '\\', fp );
+		}
+		if ( (unsigned char)*p >= ' ' )
+		{
+			fputc( *p, fp );
+		}
+	}
+	fputc( '"', fp );
+}
+
+//-------------------------------------
+// Writes Chrome trace event JSON. Scopes become complete ("X") events with
+// their budget group as the category; frames become global instant events.
+// Meant to be called after StopTrace; a thread that is still writing its
+// last event can leave that one event garbled.
+//-------------------------------------
+
+bool CVProfile::WriteTrace( const char *pszFilename )
+{
+	FILE *fp = fopen( pszFilename, "wt" );
+	if ( !fp )
+		return false;
+
+	fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+	const char *pszSeparator = "";
+	for ( CVProfThread *pThread = m_pThreads; pThread; pThread = pThread->m_pNext )
+	{
+		if ( pThread->m_nTraceGeneration != m_nTraceGeneration || !pThread->m_pTraceEvents )
+			continue;
+
+		fprintf( fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":", pszSeparator, pThread->m_ThreadID );
+		WriteTraceString( fp, pThread->m_szName );
+		fprintf( fp, "}}" );
+		pszSeparator = ",\n";
+
+		unsigned nEvents = pThread->m_nTraceEvents;
+		unsigned first = ( nEvents > VPROF_TRACE_BUFFER_SIZE ) ? nEvents - VPROF_TRACE_BUFFER_SIZE : 0;
+		for ( unsigned i = first; i < nEvents; i++ )
+		{
+			const VProfTraceEvent_t &event = pThread->m_pTraceEvents[i & ( VPROF_TRACE_BUFFER_SIZE - 1 )];
+			double start = (double)( event.m_Start - m_TraceStart ) * g_ClockSpeedMicrosecondsMultiplier;
+
+			if ( !event.m_pszName )
+			{
+				fprintf( fp, ",\n{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"args\":{\"frame\":%d}}",
+					pThread->m_ThreadID, start, event.m_nData );
+				continue;
+			}
+
+			fprintf( fp, ",\n{\"name\":" );
+			WriteTraceString( fp, event.m_pszName );
+			fprintf( fp, ",\"cat\":" );
+			WriteTraceString( fp, ( event.m_nData >= 0 && event.m_nData < m_nBudgetGroupNames ) ? GetBudgetGroupName( event.m_nData ) : "" );
+			fprintf( fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+				pThread->m_ThreadID, start, (double)( event.m_End - event.m_Start ) * g_ClockSpeedMicrosecondsMultiplier );
+		}
+	}
+
+	fprintf( fp, "\n]}\n" );
+	fclose( fp );
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 
 struct TimeSums_t
@@ -390,12 +883,12 @@ vector<TimeSums_t> 			g_TimeSums;
 
 //-------------------------------------
 
-void CVProfile::SumTimes( CVProfNode *pNode, int budgetGroupID )
+void CVProfile::SumTimes( CVProfNode *pNode, CVProfNode *pRoot, int budgetGroupID )
 {
 	if ( !pNode )
 		return; // this generally only happens on a failed FindNode()
 
-	if ( GetRoot() != pNode )
+	if ( pRoot != pNode )
 	{
 		if ( budgetGroupID == -1 || pNode->GetBudgetGroupID() == budgetGroupID )
 		{
@@ -424,13 +917,13 @@ void CVProfile::SumTimes( CVProfNode *pNode, int budgetGroupID )
 			
 		if( pNode->GetSibling() )
 		{
-			SumTimes( pNode->GetSibling(), budgetGroupID );
+			SumTimes( pNode->GetSibling(), pRoot, budgetGroupID );
 		}
 	}
 	
 	if( pNode->GetChild() )
 	{
-		SumTimes( pNode->GetChild(), budgetGroupID );
+		SumTimes( pNode->GetChild(), pRoot, budgetGroupID );
 	}
 		
 }
@@ -471,19 +964,30 @@ void CVProfile::SumTimes( const char *pszStartNode, int budgetGroupID )
 			// This only works for nodes that show up only once in tree
 			pStartNode = FindNode( GetRoot(), pszStartNode );
 		}
-		SumTimes( pStartNode, budgetGroupID );
+		SumTimes( pStartNode, GetRoot(), budgetGroupID );
 	}
 
+	// Thread trees go into the same sums, so scopes run on several threads
+	// are merged
+	for ( int i = 0; i < GetNumThreads(); i++ )
+	{
+		CVProfNode *pThreadRoot = GetThreadRoot( i );
+		if ( pThreadRoot->GetChild() )
+		{
+			bool bFromRoot = ( pszStartNode == NULL || strcmp( pszStartNode, GetRoot()->GetName() ) == 0 );
+			SumTimes( ( bFromRoot ) ? pThreadRoot : FindNode( pThreadRoot->GetChild(), pszStartNode ), pThreadRoot, budgetGroupID );
+		}
+	}
 }
 
 //-------------------------------------
 
-void CVProfile::DumpNodes( CVProfNode *pNode, int indent )
+void CVProfile::DumpNodes( CVProfNode *pNode, CVProfNode *pRoot, int indent )
 {
 	if ( !pNode )
 		return; // this generally only happens on a failed FindNode()
 
-	bool fIsRoot = ( pNode == GetRoot() );
+	bool fIsRoot = ( pNode == pRoot );
 
 	if ( !fIsRoot )
 	{
@@ -503,12 +1007,12 @@ void CVProfile::DumpNodes( CVProfNode *pNode, int indent )
 
 	if( pNode->GetChild() )
 	{
-		DumpNodes( pNode->GetChild(), indent + 1 );
+		DumpNodes( pNode->GetChild(), pRoot, indent + 1 );
 	}
 	
 	if( !fIsRoot && pNode->GetSibling() )
 	{
-		DumpNodes( pNode->GetSibling(), indent );
+		DumpNodes( pNode->GetSibling(), pRoot, indent );
 	}
 }
 
@@ -562,6 +1066,11 @@ void CVProfile::OutputReport( VProfReportType_t type, const char *pszStartNode,
 			
 			double timeAccountedFor = 100.0 - ( m_Root.GetTotalTimeLessChildren() / m_Root.GetTotalTime() );
 			Msg( "%.0f pct of time accounted for\n", min( 100.0, timeAccountedFor ) );
+			for ( int i = 0; i < GetNumThreads(); i++ )
+			{
+				CVProfNode *pThreadRoot = GetThreadRoot( i );
+				Msg( "%s busy %.2f ms per frame, peak %.2f ms\n", GetThreadName( i ), pThreadRoot->GetTotalTime() / NumFramesSampled(), pThreadRoot->GetPeakTime() );
+			}
 			Msg( "\n" );
 		}
 
@@ -576,8 +1085,20 @@ void CVProfile::OutputReport( VProfReportType_t type, const char *pszStartNode,
 		if ( type == VPRT_HIERARCHY || type == VPRT_FULL )
 		{
 			Msg( "-- Hierarchical Call Graph --\n");
-			DumpNodes( (pszStartNode == NULL ) ? GetRoot() : FindNode( GetRoot(), pszStartNode ), 0 );
+			DumpNodes( (pszStartNode == NULL ) ? GetRoot() : FindNode( GetRoot(), pszStartNode ), GetRoot(), 0 );
 			Msg( "\n" );
+
+			for ( int i = 0; i < GetNumThreads(); i++ )
+			{
+				CVProfNode *pThreadRoot = GetThreadRoot( i );
+				if ( !pThreadRoot->GetChild() )
+					continue;
+
+				bool bFromRoot = ( strcmp( pszStartNode, GetRoot()->GetName() ) == 0 );
+				Msg( "-- Hierarchical Call Graph, %s --\n", GetThreadName( i ) );
+				DumpNodes( ( bFromRoot ) ? pThreadRoot : FindNode( pThreadRoot->GetChild(), pszStartNode ), pThreadRoot, 0 );
+				Msg( "\n" );
+			}
 		}
 		
 		if ( type == VPRT_LIST_BY_TIME || type == VPRT_FULL )
@@ -631,12 +1152,24 @@ CVProfile::CVProfile()
  	m_nFrames( 0 ),
  	m_enabled( 0 ),
  	m_pausedEnabledDepth( 0 ),
-	m_fAtRoot( true )
+	m_fAtRoot( true ),
+	m_bBudgetGroupsChanged( false ),
+	m_MainThreadID( ThreadGetCurrentId() ),
+	m_pThreads( NULL ),
+	m_nThreadsInScope( 0 ),
+	m_bTracing( false ),
+	m_nTraceGeneration( 0 ),
+	m_TraceStart( 0 )
 {
-	// Go ahead and allocate 32 slots for budget group names
-	m_pBudgetGroupNames = ( char ** )malloc( sizeof( char * ) * 32 );
-	m_nBudgetGroupNames = 0;
-	m_nBudgetGroupNamesAllocated = 32;
+	// Go ahead and allocate 32 slots for budget group names. The root node
+	// may have already registered its group on the way in.
+	if ( !m_pBudgetGroupNames )
+	{
+		m_pBudgetGroupNames = ( char ** )malloc( sizeof( char * ) * ( 32 + 1 ) );
+		m_pBudgetGroupNames[32] = NULL;
+		m_nBudgetGroupNames = 0;
+		m_nBudgetGroupNamesAllocated = 32;
+	}
 		
 	BudgetGroupNameToBudgetGroupID( VPROF_BUDGETGROUP_OTHER_UNACCOUNTED );
 	BudgetGroupNameToBudgetGroupID( VPROF_BUDGETGROUP_WORLD_RENDERING );
@@ -665,6 +1198,13 @@ CVProfile::CVProfile()
 
 CVProfile::~CVProfile()
 {
+	while ( m_pThreads )
+	{
+		CVProfThread *pNext = m_pThreads->m_pNext;
+		delete m_pThreads;
+		m_pThreads = pNext;
+	}
+
 #ifdef _WIN32
 	CVProfNode::FreeAll();
 #endif
@@ -673,12 +1213,23 @@ CVProfile::~CVProfile()
 	{
 		free( m_pBudgetGroupNames[i] );
 	}
-	free( m_pBudgetGroupNames );
+
+	// Free the outgrown name arrays along with the current one
+	char **pNames = m_pBudgetGroupNames;
+	int nAllocated = m_nBudgetGroupNamesAllocated;
+	while ( pNames )
+	{
+		char **pPrev = ( char ** )pNames[nAllocated];
+		free( pNames );
+		pNames = pPrev;
+		nAllocated /= 2;
+	}
 }
 
 const char *CVProfile::GetBudgetGroupName( int budgetGroupID )
 {
 //	COMPILE_TIME_ASSERT( sizeof( g_pBudgetGroupNames ) / sizeof( g_pBudgetGroupNames[0] ) == VPROF_NUM_BUDGETGROUPS );
+	// No lock, the array is never freed under a reader (see AddBudgetGroupName)
 	Assert( budgetGroupID >= 0 && budgetGroupID < m_nBudgetGroupNames );
 	return m_pBudgetGroupNames[budgetGroupID];
 }
@@ -730,25 +1281,56 @@ int CVProfile::AddBudgetGroupName( const char *pBudgetGroupName )
 	strcpy( pNewString, pBudgetGroupName );
 	if( m_nBudgetGroupNames + 1 > m_nBudgetGroupNamesAllocated )
 	{
-		m_nBudgetGroupNamesAllocated *= 2;
-		m_pBudgetGroupNames = ( char ** )realloc( m_pBudgetGroupNames, sizeof( char * ) * m_nBudgetGroupNamesAllocated );
+		// GetBudgetGroupName reads the array without the lock, so a grown
+		// array is copied rather than realloced. The old one is chained
+		// behind the last slot of the new one and freed with the profile.
+		int nAllocated = ( m_nBudgetGroupNamesAllocated ) ? m_nBudgetGroupNamesAllocated * 2 : 32;
+		char **pNewNames = ( char ** )malloc( sizeof( char * ) * ( nAllocated + 1 ) );
+		if ( m_nBudgetGroupNames )
+		{
+			memcpy( pNewNames, m_pBudgetGroupNames, sizeof( char * ) * m_nBudgetGroupNames );
+		}
+		pNewNames[nAllocated] = ( char * )m_pBudgetGroupNames;
+
+		ThreadMemoryBarrier();
+		m_pBudgetGroupNames = pNewNames;
+		m_nBudgetGroupNamesAllocated = nAllocated;
 	}
 
 	m_pBudgetGroupNames[m_nBudgetGroupNames] = pNewString;
+
+	// Readers check the ID against the count, so the name goes in first
+	ThreadMemoryBarrier();
 	m_nBudgetGroupNames++;
-	if( m_pNumBudgetGroupsChangedCallBack )
-	{
-		(*m_pNumBudgetGroupsChangedCallBack)();
-	}
 	return m_nBudgetGroupNames - 1;
 }
 
 int CVProfile::BudgetGroupNameToBudgetGroupID( const char *pBudgetGroupName )
 {
-	int budgetGroupID = FindBudgetGroupName( pBudgetGroupName );
-	if( budgetGroupID == -1 )
+	int budgetGroupID;
+	bool bAdded = false;
+	{
+		// Thread trees share the IDs, so they're handed out under a lock
+		AUTO_LOCK_FM( m_BudgetGroupLock );
+		budgetGroupID = FindBudgetGroupName( pBudgetGroupName );
+		if( budgetGroupID == -1 )
+		{
+			budgetGroupID = AddBudgetGroupName( pBudgetGroupName );
+			bAdded = true;
+		}
+	}
+
+	if( bAdded )
 	{
-		budgetGroupID = AddBudgetGroupName( pBudgetGroupName );
+		// The callback feeds UI, so groups added by other threads wait for the next frame
+		if( !InMainThread() )
+		{
+			m_bBudgetGroupsChanged = true;
+		}
+		else if( m_pNumBudgetGroupsChangedCallBack )
+		{
+			(*m_pNumBudgetGroupsChangedCallBack)();
+		}
 	}
 	return budgetGroupID;
 }
@@ -33,14 +33,19 @@ BOOL WINAPI DllMain( HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved )
 #include "interface.h"
 #include "vphysics_interface.h"
 
-extern IPhysicsEnvironment *CreatePhysicsEnvironment( void );
+extern IPhysicsEnvironment *CreatePhysicsEnvironment( physbroadphase_t broadphase );
 
 class CPhysicsInterface : public IPhysics
 {
 public:
 	virtual	IPhysicsEnvironment *CreateEnvironment( void )
 	{
-		IPhysicsEnvironment *pEnvironment = CreatePhysicsEnvironment();
+		return CreateEnvironmentEx( PHYSICS_BROADPHASE_OVTREE );
+	}
+
+	virtual	IPhysicsEnvironment *CreateEnvironmentEx( physbroadphase_t broadphase )
+	{
+		IPhysicsEnvironment *pEnvironment = CreatePhysicsEnvironment( broadphase );
 		m_envList.AddToTail( pEnvironment );
 		return pEnvironment;
 	}
@@ -177,6 +177,8 @@ public:
 	CSleepObjects( void ) : IVP_Listener_Object() 
 	{
 		m_pCallback = NULL;
+		m_nSleeps = 0;
+		m_nWakes = 0;
 	}
 
 	void SetHandler( IPhysicsObjectEvent *pListener )
@@ -259,6 +261,7 @@ public:
 		int sleepState = pObject->GetSleepState();
 		
 		pObject->NotifyWake();
+		m_nWakes++;
 
 		// asleep, but already in active list
 		if ( sleepState == OBJ_STARTSLEEP )
@@ -287,12 +290,29 @@ public:
 			return;
 
 		pObject->NotifySleep();
+		m_nSleeps++;
 		if ( m_pCallback )
 		{
 			m_pCallback->ObjectSleep( pObject );
 		}
 	}
 
+	// Adds a frame of deltaTime to the awake and settling times
+	void AccumulateSleepStats( physsleepstats_t &stats, float deltaTime )
+	{
+		int settling = 0;
+		for ( int i = 0; i < m_activeObjects.Count(); i++ )
+		{
+			IVP_Core *pCore = m_activeObjects[i]->GetObject()->get_core();
+			if ( pCore->movement_state != IVP_MT_MOVING )
+			{
+				settling++;
+			}
+		}
+		stats.awakeSeconds += m_activeObjects.Count() * deltaTime;
+		stats.settlingSeconds += settling * deltaTime;
+	}
+
 	//-----------------------------------------------------------------------------
 	// Purpose: This walks the objects in the environment and generates friction events
 	//			for any scraping that is occurring.
@@ -399,6 +419,9 @@ public:
 		}
 	}
 
+	int								m_nSleeps;
+	int								m_nWakes;
+
 private:
 	CUtlVector<CPhysicsObject *>	m_activeObjects;
 	float							m_lastScrapeTime;
@@ -1000,7 +1023,7 @@ public:
 };
 
 
-CPhysicsEnvironment::CPhysicsEnvironment( void )
+CPhysicsEnvironment::CPhysicsEnvironment( physbroadphase_t broadphase )
 // assume that these lists will have at least one object
 {
 	// set this to true to force the 
@@ -1016,6 +1039,7 @@ CPhysicsEnvironment::CPhysicsEnvironment( void )
     appl_env.collision_filter = m_pCollisionSolver;
 	appl_env.material_manager = physprops->GetIVPManager();
 	appl_env.anomaly_manager = m_pCollisionSolver;
+	appl_env.broadphase_type = ( broadphase == PHYSICS_BROADPHASE_BVH ) ? IVP_BROADPHASE_BVH : IVP_BROADPHASE_OV_TREE;
 
 	BEGIN_IVP_ALLOCATION();
     m_pPhysEnv = env_manager->create_environment( &appl_env, "JAY", 0xBEEF );
@@ -1055,6 +1079,8 @@ CPhysicsEnvironment::CPhysicsEnvironment( void )
 	m_pPhysEnv->client_data = (void *)this;
 	m_simPSIs = 0;
 	m_invPSIscale = 0;
+	memset( &m_sleepStats, 0, sizeof(m_sleepStats) );
+	memset( m_sleepStatsBase, 0, sizeof(m_sleepStatsBase) );
 
 	BEGIN_IVP_ALLOCATION();
 
@@ -1231,6 +1257,8 @@ void CPhysicsEnvironment::Simulate( float deltaTime )
 	}
 	m_simPSIcurrent = m_simPSIs;
 
+	CFastTimer timer;
+	timer.Start();
 	m_inSimulation = true;
 	// don't simulate less than .1 ms
 	if ( deltaTime > 0.0001 )
@@ -1240,6 +1268,11 @@ void CPhysicsEnvironment::Simulate( float deltaTime )
 //		m_pPhysEnv->simulate_variable_time_step( deltaTime );
 	}
 	m_inSimulation = false;
+	timer.End();
+
+	m_sleepStats.simulateMS += timer.GetDuration().GetMillisecondsF();
+	m_pSleepEvents->AccumulateSleepStats( m_sleepStats, deltaTime );
+	m_sleepStats.asleepSeconds += ( m_objects.Count() - m_pSleepEvents->GetActiveObjectCount() ) * deltaTime;
 
 	// If the queue is disabled, it's only used during simulation.
 	// Flush it as soon as possible (which is now)
@@ -1286,6 +1319,66 @@ int CPhysicsEnvironment::GetTimestepsSimulatedLast()
 	return m_simPSIs;
 }
 
+void CPhysicsEnvironment::SetSleepParams( const physsleepparams_t &params )
+{
+	IVP_Freeze_Manager *pFreeze = m_pPhysEnv->get_freeze_manager();
+	float sleepSpeed = ConvertDistanceToIVP( params.sleepSpeed );
+	float islandSleepSpeed = ConvertDistanceToIVP( params.islandSleepSpeed );
+	pFreeze->sleep_energy = 0.5f * sleepSpeed * sleepSpeed;
+	pFreeze->island_sleep_energy = 0.5f * islandSleepSpeed * islandSleepSpeed;
+	pFreeze->wake_ramp_dtime = max( params.wakeRampTime, 0.0f );
+	pFreeze->wake_ramp_scale = max( params.wakeRampScale, 1.0f );
+}
+
+void CPhysicsEnvironment::GetSleepStats( physsleepstats_t &stats, bool bReset )
+{
+	IVP_Freeze_Manager *pFreeze = m_pPhysEnv->get_freeze_manager();
+
+	stats = m_sleepStats;
+	stats.objects = 0;
+	stats.awake = 0;
+	stats.settling = 0;
+	for ( int i = m_objects.Count()-1; i >= 0; --i )
+	{
+		IVP_Real_Object *pObject = static_cast<CPhysicsObject *>(m_objects[i])->GetObject();
+		IVP_Movement_Type movement = pObject->get_movement_state();
+		if ( movement == IVP_MT_STATIC )
+			continue;
+
+		stats.objects++;
+		if ( IVP_MTIS_SIMULATED( movement ) )
+		{
+			stats.awake++;
+			if ( pObject->get_core()->movement_state != IVP_MT_MOVING )
+			{
+				stats.settling++;
+			}
+		}
+	}
+	stats.sleeps = m_pSleepEvents->m_nSleeps;
+	stats.wakes = m_pSleepEvents->m_nWakes;
+	stats.islandsSlept = pFreeze->n_sim_units_frozen + pFreeze->n_sim_units_frozen_island - m_sleepStatsBase[0];
+	stats.islandsSleptByEnergy = pFreeze->n_sim_units_frozen_island - m_sleepStatsBase[1];
+	stats.objectsCalmByEnergy = pFreeze->n_cores_calm_by_energy - m_sleepStatsBase[2];
+
+	if ( bReset )
+	{
+		memset( &m_sleepStats, 0, sizeof(m_sleepStats) );
+		m_pSleepEvents->m_nSleeps = 0;
+		m_pSleepEvents->m_nWakes = 0;
+		m_sleepStatsBase[0] = pFreeze->n_sim_units_frozen + pFreeze->n_sim_units_frozen_island;
+		m_sleepStatsBase[1] = pFreeze->n_sim_units_frozen_island;
+		m_sleepStatsBase[2] = pFreeze->n_cores_calm_by_energy;
+	}
+}
+
+void CPhysicsEnvironment::GetBroadphaseStats( physbroadphasestats_t &stats )
+{
+	IVP_Statistic_Manager *pStats = m_pPhysEnv->get_statistic_manager();
+	stats.updates = pStats->sum_ov_updates;
+	stats.pairs = pStats->sum_ov_pairs;
+}
+
 // true if currently running the simulator (i.e. in a callback during physenv->Simulate())
 bool CPhysicsEnvironment::IsInSimulation( void ) const
 {
@@ -1553,8 +1646,8 @@ IPhysicsObject *CPhysicsEnvironment::CreateSphereObject( float radius, int mater
 }
 
 
-IPhysicsEnvironment *CreatePhysicsEnvironment( void )
+IPhysicsEnvironment *CreatePhysicsEnvironment( physbroadphase_t broadphase )
 {
-	return new CPhysicsEnvironment;
+	return new CPhysicsEnvironment( broadphase );
 }
 
@@ -29,7 +29,7 @@ class CDeleteQueue;
 class CPhysicsEnvironment : public IPhysicsEnvironment
 {
 public:
-	CPhysicsEnvironment( void );
+	CPhysicsEnvironment( physbroadphase_t broadphase );
 	~CPhysicsEnvironment( void );
 	void			SetGravity( const Vector& gravityVector );
 	IPhysicsObject	*CreatePolyObject( const CPhysCollide *pCollisionModel, int materialIndex, const Vector& position, const QAngle& angles, objectparams_t *pParams );
@@ -58,6 +58,9 @@ public:
 	float			GetSimulationTime( void );
 	int				GetTimestepsSimulatedLast();
 	bool			IsInSimulation( void ) const;
+	virtual void	GetBroadphaseStats( physbroadphasestats_t &stats );
+	virtual void	SetSleepParams( const physsleepparams_t &params );
+	virtual void	GetSleepStats( physsleepstats_t &stats, bool bReset );
 
 	virtual void DestroyObject( IPhysicsObject * );
 	virtual void DestroySpring( IPhysicsSpring * );
@@ -131,6 +134,8 @@ private:
 	int								m_simPSIs;		// number of PSIs this call to simulate
 	int								m_simPSIcurrent;
 	float							m_invPSIscale;  // inverse of simPSIs
+	physsleepstats_t				m_sleepStats;
+	int								m_sleepStatsBase[3];	// freeze manager counters at the last reset
 };
 
 extern IPhysicsEnvironment *CreatePhysicsEnvironment( void );
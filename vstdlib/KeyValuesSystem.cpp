@@ -41,8 +41,9 @@ public:
 	const char *GetStringForSymbol(HKeySymbol symbol);
 
 private:
-	CMemoryPool *m_pMemPool;
-	CUtlSymbolTable m_SymbolTable;
+	CMemoryPoolMT * volatile m_pMemPool;
+	CThreadFastMutex m_MemPoolLock;
+	CUtlSymbolTableMT m_SymbolTable;
 
 	int m_iMaxKeyValuesSize;
 };
@@ -95,7 +96,13 @@ void *CKeyValuesSystem::AllocKeyValuesMemory(int size)
 	// allocate, if we don't have one yet
 	if (!m_pMemPool)
 	{
-		m_pMemPool = new CMemoryPool(m_iMaxKeyValuesSize, 1024);
+		AUTO_LOCK_FM( m_MemPoolLock );
+		if (!m_pMemPool)
+		{
+			CMemoryPoolMT *pMemPool = new CMemoryPoolMT(m_iMaxKeyValuesSize, 1024, CMemoryPool::GROW_FAST, "KeyValues");
+			ThreadMemoryBarrier();
+			m_pMemPool = pMemPool;
+		}
 	}
 
 	return m_pMemPool->Alloc(size);
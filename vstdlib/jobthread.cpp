@@ -0,0 +1,241 @@
+//========= Copyright � 1996-2003, Valve LLC, All rights reserved. ============
+//
+// Purpose: Worker thread pool
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "vstdlib/jobthread.h"
+#include "vstdlib/icommandline.h"
+#include "tier0/threadtools.h"
+#include "tier0/dbg.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+#define MAX_POOL_THREADS	16
+
+//-----------------------------------------------------------------------------
+// The workers sleep on their own start events. A job is published by filling
+// in the job fields and setting the start events of the workers it needs;
+// items are claimed with an interlocked counter, and the last worker to
+// finish sets the done event the caller is waiting on. Workers are started
+// the first time a job needs them.
+//-----------------------------------------------------------------------------
+class CThreadPool : public IThreadPool
+{
+public:
+	CThreadPool();
+	~CThreadPool();
+
+	virtual int		NumThreads() const;
+	virtual void	ParallelProcess( ParallelItemFunc_t pfnItem, void *pContext, int nItems, int nMaxThreads );
+
+private:
+	void			StartWorkers();
+	void			RunItems();
+	static unsigned	WorkerThread( void *pParam );
+
+	struct Worker_t
+	{
+		CThreadPool		*m_pPool;
+		ThreadHandle_t	m_hThread;
+		CThreadEvent	m_Start;
+	};
+
+	int					m_nWorkers;
+	bool				m_bStarted;
+	bool				m_bExit;
+	Worker_t			m_Workers[MAX_POOL_THREADS];
+	CThreadFastMutex	m_StartLock;
+
+	// Set while a job is out, so overlapping calls fall back to running serially
+	volatile long		m_nBusy;
+
+	// The current job
+	ParallelItemFunc_t	m_pfnItem;
+	void				*m_pContext;
+	int					m_nItems;
+	volatile long		m_nNextItem;
+	volatile long		m_nWorkersRunning;
+	CThreadEvent		m_Done;
+};
+
+static CThreadPool s_ThreadPool;
+
+IThreadPool *ThreadPool()
+{
+	return &s_ThreadPool;
+}
+
+CThreadPool::CThreadPool() : m_Done( false )
+{
+	m_nWorkers = -1;
+	m_bStarted = false;
+	m_bExit = false;
+	m_nBusy = 0;
+	m_pfnItem = NULL;
+	m_pContext = NULL;
+	m_nItems = 0;
+	m_nNextItem = 0;
+	m_nWorkersRunning = 0;
+
+	for ( int i = 0; i < MAX_POOL_THREADS; i++ )
+	{
+		m_Workers[i].m_pPool = this;
+		m_Workers[i].m_hThread = NULL;
+	}
+}
+
+CThreadPool::~CThreadPool()
+{
+	if ( !m_bStarted )
+		return;
+
+	m_bExit = true;
+	int i;
+	for ( i = 0; i < m_nWorkers; i++ )
+	{
+		m_Workers[i].m_Start.Set();
+	}
+	for ( i = 0; i < m_nWorkers; i++ )
+	{
+		if ( m_Workers[i].m_hThread )
+		{
+			ThreadJoin( m_Workers[i].m_hThread );
+			ReleaseThreadHandle( m_Workers[i].m_hThread );
+		}
+	}
+}
+
+int CThreadPool::NumThreads() const
+{
+	if ( m_nWorkers < 0 )
+	{
+		// The command line isn't up yet when the statics are constructed
+		CThreadPool *pThis = const_cast<CThreadPool *>( this );
+		int nThreads = CommandLine()->ParmValue( "-threads", ThreadGetProcessorCount() );
+		pThis->m_nWorkers = min( max( nThreads - 1, 0 ), MAX_POOL_THREADS );
+	}
+	return m_nWorkers + 1;
+}
+
+void CThreadPool::StartWorkers()
+{
+	AUTO_LOCK_FM( m_StartLock );
+	if ( m_bStarted )
+		return;
+
+	for ( int i = 0; i < m_nWorkers; i++ )
+	{
+		m_Workers[i].m_hThread = CreateSimpleThread( WorkerThread, &m_Workers[i] );
+		if ( !m_Workers[i].m_hThread )
+		{
+			Warning( "ThreadPool: couldn't start worker %d, running with %d threads\n", i, i + 1 );
+			m_nWorkers = i;
+			break;
+		}
+	}
+	m_bStarted = true;
+}
+
+void CThreadPool::RunItems()
+{
+	for ( ;; )
+	{
+		int nItem = ThreadInterlockedIncrement( &m_nNextItem ) - 1;
+		if ( nItem >= m_nItems )
+			break;
+
+		m_pfnItem( m_pContext, nItem );
+	}
+}
+
+unsigned CThreadPool::WorkerThread( void *pParam )
+{
+	Worker_t *pWorker = (Worker_t *)pParam;
+	CThreadPool *pPool = pWorker->m_pPool;
+
+	for ( ;; )
+	{
+		pWorker->m_Start.Wait();
+		if ( pPool->m_bExit )
+			break;
+
+		pPool->RunItems();
+
+		if ( ThreadInterlockedDecrement( &pPool->m_nWorkersRunning ) == 0 )
+		{
+			pPool->m_Done.Set();
+		}
+	}
+	return 0;
+}
+
+void CThreadPool::ParallelProcess( ParallelItemFunc_t pfnItem, void *pContext, int nItems, int nMaxThreads )
+{
+	if ( nItems <= 0 )
+		return;
+
+	int nThreads = NumThreads();
+	if ( nMaxThreads > 0 && nMaxThreads < nThreads )
+	{
+		nThreads = nMaxThreads;
+	}
+	if ( nThreads > nItems )
+	{
+		nThreads = nItems;
+	}
+
+	bool bParallel = ( nThreads > 1 && ThreadInterlockedAssignIf( &m_nBusy, 1, 0 ) );
+	if ( bParallel )
+	{
+		if ( !m_bStarted )
+		{
+			StartWorkers();
+		}
+
+		// Fewer workers than asked for if some failed to start
+		if ( nThreads > m_nWorkers + 1 )
+		{
+			nThreads = m_nWorkers + 1;
+		}
+		if ( nThreads <= 1 )
+		{
+			ThreadInterlockedExchange( &m_nBusy, 0 );
+			bParallel = false;
+		}
+	}
+
+	if ( !bParallel )
+	{
+		for ( int i = 0; i < nItems; i++ )
+		{
+			pfnItem( pContext, i );
+		}
+		return;
+	}
+
+	m_pfnItem = pfnItem;
+	m_pContext = pContext;
+	m_nItems = nItems;
+	m_nNextItem = 0;
+	m_nWorkersRunning = nThreads - 1;
+
+	ThreadMemoryBarrier();
+	for ( int i = 0; i < nThreads - 1; i++ )
+	{
+		m_Workers[i].m_Start.Set();
+	}
+
+	RunItems();
+
+	// Wait for the workers to check in rather than for the items, so none of
+	// them can still be looking at the job once we return
+	m_Done.Wait();
+
+	m_pfnItem = NULL;
+	m_pContext = NULL;
+	ThreadInterlockedExchange( &m_nBusy, 0 );
+}